@@ -36,15 +36,22 @@ static void setAtomicInt(int * atom, const int value)
         *atom = value;
     }
 }
-int forwardModel(const SingleGroup * input, SingleGroup * output, SingleGroup * trapPixelMap, CTEParamsFast * ctePars)
+static Bool trapCoeffsMatchImage(const TrapColumnCoeffs * trapCoeffs, const SingleGroup * image)
 {
-    extern int status;
+    return trapCoeffs->nColumns == (unsigned)image->sci.data.nx && trapCoeffs->nRows == (unsigned)image->sci.data.ny;
+}
 
-   if (!input || !output || !trapPixelMap || !ctePars)
-       return (status = ALLOCATION_PROBLEM);
+/* The trap source for the readout kernels below is either a materialised trap pixel map,
+ * or (when trapPixelMap is NULL) per-column coefficients from which each trap column is
+ * evaluated into a thread local buffer. Both yield identical trap values.
+ */
+static int forwardModelCore(const SingleGroup * input, SingleGroup * output, SingleGroup * trapPixelMap,
+        const TrapColumnCoeffs * trapCoeffs, CTEParamsFast * ctePars)
+{
+    extern int status;
 
    //WARNING - assumes column major storage order
-   if ((trapPixelMap->sci.data.storageOrder != COLUMNMAJOR) ||
+   if ((trapPixelMap && trapPixelMap->sci.data.storageOrder != COLUMNMAJOR) ||
            (input->sci.data.storageOrder != COLUMNMAJOR))
        return (status = ALLOCATION_PROBLEM);
    output->sci.data.storageOrder = COLUMNMAJOR;
@@ -56,8 +63,9 @@ int forwardModel(const SingleGroup * input, SingleGroup * output, SingleGroup *
 
    Bool allocationFail = False;
    Bool runtimeFail = False;
+   int runtimeStatus = HSTCAL_OK; //this call's own failure, the global status may be set by concurrent callers
 #ifdef _OPENMP
-   #pragma omp parallel shared(input, output, ctePars, cteRprof, cteCprof, trapPixelMap, allocationFail, runtimeFail, status)
+   #pragma omp parallel shared(input, output, ctePars, cteRprof, cteCprof, trapPixelMap, trapCoeffs, allocationFail, runtimeFail, runtimeStatus, status)
 #endif
    {
        int localStatus = HSTCAL_OK; //Note: used to set extern int status atomically, note global status takes last set value
@@ -70,6 +78,15 @@ int forwardModel(const SingleGroup * input, SingleGroup * output, SingleGroup *
        if (!model)
            setAtomicFlag(&allocationFail);
 
+       float * trapColumn = NULL;
+       if (!trapPixelMap && !allocationFail)
+       {
+           trapColumn = malloc(sizeof(*trapColumn)*nRows);
+           addPtr(&localPtrReg, trapColumn, &free);
+           if (!trapColumn)
+               setAtomicFlag(&allocationFail);
+       }
+
        float * traps = NULL;
 
        //Allocate all local memory before anyone proceeds
@@ -91,11 +108,18 @@ int forwardModel(const SingleGroup * input, SingleGroup * output, SingleGroup *
                    model[i] = PixColumnMajor(input->sci.data,i,j);
                }
 
-               traps = &(PixColumnMajor(trapPixelMap->sci.data, 0, j));
+               if (trapPixelMap)
+                   traps = &(PixColumnMajor(trapPixelMap->sci.data, 0, j));
+               else
+               {
+                   evaluateTrapColumn(trapColumn, trapCoeffs, j);
+                   traps = trapColumn;
+               }
 
                if ((localStatus = simulateColumnReadout(model, traps, ctePars, cteRprof, cteCprof, nRows, ctePars->n_par)))
                {
                    setAtomicFlag(&runtimeFail);
+                   setAtomicInt(&runtimeStatus, localStatus);
                    setAtomicInt(&status, localStatus);
                }
                // Update source array
@@ -116,19 +140,264 @@ int forwardModel(const SingleGroup * input, SingleGroup * output, SingleGroup *
    if (runtimeFail)
    {
        trlerror("Runtime fail in inverseCTEBlur()");
-       return status;
+       return runtimeStatus;
    }
-   return (status);
+   return HSTCAL_OK;
 }
-int inverseCTEBlur(const SingleGroup * input, SingleGroup * output, SingleGroup * trapPixelMap, CTEParamsFast * ctePars)
+
+int forwardModel(const SingleGroup * input, SingleGroup * output, SingleGroup * trapPixelMap, CTEParamsFast * ctePars)
 {
     extern int status;
 
     if (!input || !output || !trapPixelMap || !ctePars)
         return (status = ALLOCATION_PROBLEM);
 
+    return forwardModelCore(input, output, trapPixelMap, NULL, ctePars);
+}
+
+int forwardModelWithTrapCoeffs(const SingleGroup * input, SingleGroup * output, const TrapColumnCoeffs * trapCoeffs, CTEParamsFast * ctePars)
+{
+    extern int status;
+
+    if (!input || !output || !trapCoeffs || !ctePars || !trapCoeffsMatchImage(trapCoeffs, input))
+        return (status = ALLOCATION_PROBLEM);
+
+    return forwardModelCore(input, output, NULL, trapCoeffs, ctePars);
+}
+
+/*
+   Batch forward modelling of CTE trails for simulation studies, i.e. many images (or
+   column stacks) run through the same CTE model with differing scale_frac.
+
+   The caller loads the CTE model once (initCTEParamsFast(), allocateCTEParamsFast(),
+   loadPCTETAB()) and describes each simulation with a CTEForwardModelCase. The SCLBYCOL
+   trap coefficients are evaluated once per distinct geometry and shared by all cases with
+   that geometry. All columns of all cases are then simulated as a single parallel work
+   list. Each output is identical to that of forwardModel() for the same case.
+*/
+
+double cteScaleFracFromDate(const CTEParamsFast * ctePars, const double mjd)
+{
+    return (mjd - ctePars->cte_date0) / (ctePars->cte_date1 - ctePars->cte_date0);
+}
+
+static int checkForwardModelCase(const CTEForwardModelCase * simCase)
+{
+    if (!simCase->input || !simCase->output ||
+            !simCase->input->sci.data.data || !simCase->output->sci.data.data)
+        return ALLOCATION_PROBLEM;
+
     //WARNING - assumes column major storage order
-    if ((trapPixelMap->sci.data.storageOrder != COLUMNMAJOR) ||
+    if (simCase->input->sci.data.storageOrder != COLUMNMAJOR)
+        return ALLOCATION_PROBLEM;
+
+    if (simCase->input->sci.data.nx != simCase->output->sci.data.nx ||
+            simCase->input->sci.data.ny != simCase->output->sci.data.ny)
+        return SIZE_MISMATCH;
+
+    return HSTCAL_OK;
+}
+
+//Returns the case owning global column 'column', i.e. firstColumn[k] <= column < firstColumn[k+1]
+static unsigned findCaseForColumn(const size_t * firstColumn, const unsigned nCases, const size_t column)
+{
+    unsigned lo = 0;
+    unsigned hi = nCases;
+    while (hi - lo > 1)
+    {
+        const unsigned mid = lo + (hi - lo)/2;
+        if (firstColumn[mid] <= column)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int forwardModelBatch(CTEForwardModelCase * cases, const unsigned nCases, const CTEParamsFast * ctePars)
+{
+    extern int status;
+
+    if (!cases || !ctePars || !ctePars->rprof || !ctePars->cprof)
+        return (status = ALLOCATION_PROBLEM);
+    if (!nCases)
+        return HSTCAL_OK;
+
+    PtrRegister ptrReg;
+    initPtrRegister(&ptrReg);
+    //The tables' own arrays are registered separately as &trapTables[0] == trapTables,
+    //which ptrReg would otherwise drop as already registered (and so leak)
+    PtrRegister tableReg;
+    initPtrRegister(&tableReg);
+
+    //Distinct geometries, tableOwner[t] is the first case with geometry t
+    TrapColumnCoeffs * trapTables = malloc(nCases*sizeof(*trapTables));
+    addPtr(&ptrReg, trapTables, &free);
+    unsigned * tableOwner = malloc(nCases*sizeof(*tableOwner));
+    addPtr(&ptrReg, tableOwner, &free);
+    //Per case view of its geometry's table, differing only in cteScale
+    TrapColumnCoeffs * caseCoeffs = malloc(nCases*sizeof(*caseCoeffs));
+    addPtr(&ptrReg, caseCoeffs, &free);
+    //Global column work list, case k owns columns [firstColumn[k], firstColumn[k+1])
+    size_t * firstColumn = malloc((nCases+1)*sizeof(*firstColumn));
+    addPtr(&ptrReg, firstColumn, &free);
+    if (!trapTables || !tableOwner || !caseCoeffs || !firstColumn)
+    {
+        freeOnExit(&tableReg);
+        freeOnExit(&ptrReg);
+        trlerror("Out of memory in forwardModelBatch()");
+        return (status = OUT_OF_MEMORY);
+    }
+
+    unsigned nTables = 0;
+    unsigned maxRows = 0;
+    unsigned nFailedCases = 0;
+    firstColumn[0] = 0;
+    {unsigned k;
+    for (k = 0; k < nCases; ++k)
+    {
+        CTEForwardModelCase * simCase = &cases[k];
+        firstColumn[k+1] = firstColumn[k];
+        initTrapColumnCoeffs(&caseCoeffs[k]);
+        if ((simCase->status = checkForwardModelCase(simCase)))
+        {
+            ++nFailedCases;
+            continue;
+        }
+
+        const unsigned nRows = simCase->input->sci.data.ny;
+        const unsigned nColumns = simCase->input->sci.data.nx;
+
+        unsigned t;
+        for (t = 0; t < nTables; ++t)
+        {
+            if (trapTables[t].nColumns == nColumns && trapTables[t].nRows == nRows &&
+                    cases[tableOwner[t]].razColumnOffset == simCase->razColumnOffset)
+                break;
+        }
+        if (t == nTables)
+        {
+            CTEParamsFast pars = *ctePars; //shallow copy, only razColumnOffset differs
+            pars.razColumnOffset = simCase->razColumnOffset;
+            initTrapColumnCoeffs(&trapTables[t]);
+            addPtr(&tableReg, &trapTables[t], &freeTrapColumnCoeffs);
+            //allocTrapColumnCoeffs() doesn't set the global status, so report its code directly
+            int err = allocTrapColumnCoeffs(&trapTables[t], nColumns, nRows);
+            if (!err)
+                err = populateTrapColumnCoeffs(&trapTables[t], &pars);
+            if (err)
+            {
+                freeOnExit(&tableReg);
+                freeOnExit(&ptrReg);
+                trlerror("Failed to populate trap coefficients in forwardModelBatch()");
+                return (status = err);
+            }
+            tableOwner[t] = k;
+            ++nTables;
+        }
+
+        caseCoeffs[k] = trapTables[t];
+        caseCoeffs[k].cteScale = simCase->scale_frac;
+        simCase->output->sci.data.storageOrder = COLUMNMAJOR;
+        firstColumn[k+1] += nColumns;
+        if (nRows > maxRows)
+            maxRows = nRows;
+    }}
+
+    const size_t nTotalColumns = firstColumn[nCases];
+    const FloatTwoDArray * cteRprof  = &ctePars->rprof->data;
+    const FloatTwoDArray * cteCprof = &ctePars->cprof->data;
+
+    Bool allocationFail = False;
+    Bool runtimeFail = False;
+    int runtimeStatus = HSTCAL_OK; //this call's own failure, the global status may be set by concurrent callers
+#ifdef _OPENMP
+    #pragma omp parallel shared(cases, caseCoeffs, firstColumn, ctePars, cteRprof, cteCprof, allocationFail, runtimeFail, runtimeStatus, status)
+#endif
+    {
+        int localStatus = HSTCAL_OK;
+        //Thread local pointer register
+        PtrRegister localPtrReg;
+        initPtrRegister(&localPtrReg);
+
+        double * model = malloc(sizeof(*model)*maxRows);
+        addPtr(&localPtrReg, model, &free);
+        float * traps = malloc(sizeof(*traps)*maxRows);
+        addPtr(&localPtrReg, traps, &free);
+        if (maxRows && (!model || !traps))
+            setAtomicFlag(&allocationFail);
+
+        //Allocate all local memory before anyone proceeds
+#ifdef _OPENMP
+        #pragma omp barrier
+#endif
+        if (!allocationFail)
+        {
+            {size_t column;
+#ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
+#endif
+            for (column = 0; column < nTotalColumns; ++column)
+            {
+                const unsigned k = findCaseForColumn(firstColumn, nCases, column);
+                const unsigned j = column - firstColumn[k];
+                const SingleGroup * input = cases[k].input;
+                SingleGroup * output = cases[k].output;
+                const unsigned nRows = input->sci.data.ny;
+
+                // Can't use memcpy as diff types
+                {unsigned i;
+                for (i = 0; i < nRows; ++i)
+                    model[i] = PixColumnMajor(input->sci.data,i,j);
+                }
+
+                evaluateTrapColumn(traps, &caseCoeffs[k], j);
+
+                if ((localStatus = simulateColumnReadout(model, traps, ctePars, cteRprof, cteCprof, nRows, ctePars->n_par)))
+                {
+                    setAtomicFlag(&runtimeFail);
+                    setAtomicInt(&cases[k].status, localStatus);
+                    setAtomicInt(&runtimeStatus, localStatus);
+                    setAtomicInt(&status, localStatus);
+                }
+
+                // Can't use memcpy as arrays of diff types
+                {unsigned i;
+                for (i = 0; i < nRows; ++i)
+                    PixColumnMajor(output->sci.data, i, j) = model[i];
+                }
+            }} //end loop over columns
+        }
+        freeOnExit(&localPtrReg);
+    }// close scope for #pragma omp parallel
+
+    freeOnExit(&tableReg);
+    freeOnExit(&ptrReg);
+
+    if (allocationFail)
+    {
+        trlerror("Out of memory in forwardModelBatch()");
+        return (status = OUT_OF_MEMORY);
+    }
+    if (runtimeFail)
+    {
+        trlerror("Runtime fail in forwardModelBatch()");
+        return runtimeStatus;
+    }
+    if (nFailedCases)
+    {
+        trlwarn("forwardModelBatch(): %u of %u cases rejected, see CTEForwardModelCase::status", nFailedCases, nCases);
+    }
+    return HSTCAL_OK;
+}
+
+static int inverseCTEBlurCore(const SingleGroup * input, SingleGroup * output, SingleGroup * trapPixelMap,
+        const TrapColumnCoeffs * trapCoeffs, CTEParamsFast * ctePars)
+{
+    extern int status;
+
+    //WARNING - assumes column major storage order
+    if ((trapPixelMap && trapPixelMap->sci.data.storageOrder != COLUMNMAJOR) ||
             (input->sci.data.storageOrder != COLUMNMAJOR))
         return (status = ALLOCATION_PROBLEM);
     output->sci.data.storageOrder = COLUMNMAJOR;
@@ -141,8 +410,9 @@ int inverseCTEBlur(const SingleGroup * input, SingleGroup * output, SingleGroup
 
     Bool allocationFail = False;
     Bool runtimeFail = False;
+    int runtimeStatus = HSTCAL_OK; //this call's own failure, the global status may be set by concurrent callers
 #ifdef _OPENMP
-    #pragma omp parallel shared(input, output, ctePars, cteRprof, cteCprof, trapPixelMap, allocationFail, runtimeFail, status)
+    #pragma omp parallel shared(input, output, ctePars, cteRprof, cteCprof, trapPixelMap, trapCoeffs, allocationFail, runtimeFail, runtimeStatus, status)
 #endif
     {
         int localStatus = HSTCAL_OK; //Note: used to set extern int status atomically, note global status takes last set value
@@ -169,6 +439,15 @@ int inverseCTEBlur(const SingleGroup * input, SingleGroup * output, SingleGroup
         if (!observed)
             setAtomicFlag(&allocationFail);
 
+        float * trapColumn = NULL;
+        if (!trapPixelMap && !allocationFail)
+        {
+            trapColumn = malloc(sizeof(*trapColumn)*nRows);
+            addPtr(&localPtrReg, trapColumn, &free);
+            if (!trapColumn)
+                setAtomicFlag(&allocationFail);
+        }
+
         float * traps = NULL;
 
         //Allocate all local memory before anyone proceeds
@@ -190,7 +469,14 @@ int inverseCTEBlur(const SingleGroup * input, SingleGroup * output, SingleGroup
                     observed[i] = PixColumnMajor(input->sci.data,i,j);
                 }
 
-                traps = &(PixColumnMajor(trapPixelMap->sci.data, 0, j));
+                //NOTE: correctCROverSubtraction() rescales traps in place, this is local to the column either way
+                if (trapPixelMap)
+                    traps = &(PixColumnMajor(trapPixelMap->sci.data, 0, j));
+                else
+                {
+                    evaluateTrapColumn(trapColumn, trapCoeffs, j);
+                    traps = trapColumn;
+                }
                 unsigned NREDO = 0;
                 Bool REDO;
                 do
@@ -208,6 +494,7 @@ int inverseCTEBlur(const SingleGroup * input, SingleGroup * output, SingleGroup
                         if ((localStatus = simulateColumnReadout(model, traps, ctePars, cteRprof, cteCprof, nRows, ctePars->n_par)))
                         {
                             setAtomicFlag(&runtimeFail);
+                            setAtomicInt(&runtimeStatus, localStatus);
                             setAtomicInt(&status, localStatus);
                             localOK = False;
                             break;
@@ -238,6 +525,7 @@ int inverseCTEBlur(const SingleGroup * input, SingleGroup * output, SingleGroup
                     if ((localStatus = simulateColumnReadout(model, traps, ctePars, cteRprof, cteCprof, nRows, ctePars->n_par)))
                     {
                         setAtomicFlag(&runtimeFail);
+                        setAtomicInt(&runtimeStatus, localStatus);
                         setAtomicInt(&status, localStatus);
                         localOK = False;
                         break;
@@ -271,9 +559,29 @@ int inverseCTEBlur(const SingleGroup * input, SingleGroup * output, SingleGroup
     if (runtimeFail)
     {
         trlerror("Runtime fail in inverseCTEBlur()");
-        return status;
+        return runtimeStatus;
     }
-    return (status);
+    return HSTCAL_OK;
+}
+
+int inverseCTEBlur(const SingleGroup * input, SingleGroup * output, SingleGroup * trapPixelMap, CTEParamsFast * ctePars)
+{
+    extern int status;
+
+    if (!input || !output || !trapPixelMap || !ctePars)
+        return (status = ALLOCATION_PROBLEM);
+
+    return inverseCTEBlurCore(input, output, trapPixelMap, NULL, ctePars);
+}
+
+int inverseCTEBlurWithTrapCoeffs(const SingleGroup * input, SingleGroup * output, const TrapColumnCoeffs * trapCoeffs, CTEParamsFast * ctePars)
+{
+    extern int status;
+
+    if (!input || !output || !trapCoeffs || !ctePars || !trapCoeffsMatchImage(trapCoeffs, input))
+        return (status = ALLOCATION_PROBLEM);
+
+    return inverseCTEBlurCore(input, output, NULL, trapCoeffs, ctePars);
 }
 
 int simulatePixelReadout_v1_1(double * const pixelColumn, const float * const traps, const CTEParamsFast * const ctePars,
@@ -560,8 +868,6 @@ int populateTrapPixelMap(SingleGroup * trapPixelMap, CTEParamsFast * ctePars)
 
     clock_t begin = clock();
 
-    extern int status;
-
     const unsigned nRows = trapPixelMap->sci.data.ny;
     const unsigned nColumns = trapPixelMap->sci.data.nx;
     const double cteScale = ctePars->scale_frac;
@@ -615,7 +921,178 @@ int populateTrapPixelMap(SingleGroup * trapPixelMap, CTEParamsFast * ctePars)
         trlmessage("(pctecorr) Time taken to populate pixel trap map image: %.2f(s) with %i threads",timeSpent/ctePars->maxThreads, ctePars->maxThreads);
     }
 
-    return(status);
+    return HSTCAL_OK;
+}
+
+int populateTrapColumnCoeffs(TrapColumnCoeffs * trapCoeffs, CTEParamsFast * ctePars)
+{
+    /*
+        Compact equivalent of populateTrapPixelMap(). trapCoeffs must already be allocated
+        to the image dimensions, see allocTrapColumnCoeffs().
+    */
+
+    //For performance this does not NULL check passed in ptrs
+
+    const unsigned nRows = trapCoeffs->nRows;
+    const unsigned nColumns = trapCoeffs->nColumns;
+    trapCoeffs->cteScale = ctePars->scale_frac;
+
+    //The row dependent terms are common to all columns
+    {unsigned j;
+    for (j = 0; j < nRows; ++j)
+    {
+        double ro = j / 512.0; //ro can be zero, it's an index
+        if (ro > 2.999)
+            ro = 2.999; // only 4 quads, 0 to 3
+        else if (ro < 0)
+            ro = 0;
+        const int io = (int) floor(ro); //force truncation towards 0 for pos numbers
+        trapCoeffs->rowNode[j] = io;
+        trapCoeffs->rowFrac[j] = ro - io;
+        trapCoeffs->rowScale[j] = (j+1) / 2048.0;
+    }}
+
+    {unsigned i;
+    for (i = 0; i < nColumns; ++i)
+        trapCoeffs->hasScale[i] = False;
+    }
+
+    {unsigned i;
+    for (i = 0; i < ctePars->nScaleTableColumns; ++i)
+    {
+        unsigned column = ctePars->iz_data[i] - ctePars->razColumnOffset; //which column to scale
+        if (column >= nColumns)
+            continue;
+        double * nodes = trapCoeffs->scale + 4*column;
+        nodes[0] = ctePars->scale512[i];
+        nodes[1] = ctePars->scale1024[i];
+        nodes[2] = ctePars->scale1536[i];
+        nodes[3] = ctePars->scale2048[i];
+        trapCoeffs->hasScale[column] = True;
+    }}
+
+    return HSTCAL_OK;
+}
+
+void evaluateTrapColumn(float * const traps, const TrapColumnCoeffs * const trapCoeffs, const unsigned column)
+{
+    //For performance this does not NULL check passed in ptrs
+
+    //NOTE: the arithmetic is kept identical to populateTrapPixelMap() so that both trap sources agree bit for bit.
+    const unsigned nRows = trapCoeffs->nRows;
+    if (!trapCoeffs->hasScale[column])
+    {
+        memset(traps, 0, nRows*sizeof(*traps));
+        return;
+    }
+
+    const double * nodes = trapCoeffs->scale + 4*column;
+    const double cteScale = trapCoeffs->cteScale;
+    {unsigned j;
+    for (j = 0; j < nRows; ++j)
+    {
+        const int io = trapCoeffs->rowNode[j];
+        const double cte_i = nodes[io] + (nodes[io+1] - nodes[io]) * trapCoeffs->rowFrac[j];
+        traps[j] = cte_i * trapCoeffs->rowScale[j] * cteScale;
+    }}
+}
+
+static inline double clampDelta(const double value, const double limit)
+{
+    if (value > limit)
+        return limit;
+    else if (value < -limit)
+        return -limit;
+    return value;
+}
+
+static inline double dadjFromDeltas(const double dval0, const double dval9, const double dmod1, const double dmod2,
+        const double readNoiseAmp)
+{
+    const double readNoiseAmpFraction = 0.33;
+    const double dval0u = clampDelta(dval0, 1);
+    const double dval9u = clampDelta(dval9, readNoiseAmp*readNoiseAmpFraction);
+    const double dmod1u = clampDelta(dmod1, readNoiseAmp*readNoiseAmpFraction);
+    const double dmod2u = clampDelta(dmod2, readNoiseAmp*readNoiseAmpFraction);
+
+    /*
+       IF IT'S WITHIN 2 SIGMA OF THE READNOISE, THEN
+       TEND TO TREAT AS READNOISE; IF IT'S FARTHER OFF
+       THAN THAT, THEN DOWNWEIGHT THE INFLUENCE
+       */
+    const double readNoiseAmp2 = readNoiseAmp*readNoiseAmp;
+    const double w0 =     dval0 * dval0 / (dval0 * dval0 + 4.0 * readNoiseAmp2);
+    const double w9 =     dval9 * dval9 / (dval9 * dval9 + 18.0 * readNoiseAmp2);
+    const double w1 = 4 * readNoiseAmp2 / (dmod1 * dmod1 + 4.0 * readNoiseAmp2);
+    const double w2 = 4 * readNoiseAmp2 / (dmod2 * dmod2 + 4.0 * readNoiseAmp2);
+
+    /*(note that with the last two, if a pixel
+      is too discordant with its upper or lower
+      that neighbor has less of an ability to
+      pull it)*/
+
+    return  dval0u * w0 * 0.25f + /* desire to keep the original pixel value */
+            dval9u * w9 * 0.25f + /* desire to keep the original sum over 3x3*/
+            dmod1u * w1 * 0.25f + /* desire to get closer to the pixel below*/
+            dmod2u * w2 * 0.25f; /* desire to get closer to the pixel above*/
+}
+
+static void find_dadjColumn(float * const dadj, const unsigned i, const unsigned nRows, const float * obsloc[3],
+        const float * rszloc[3], const double readNoiseAmp)
+{
+    /*
+       Column form of find_dadjFast(), producing identical values. The end rows are left to
+       find_dadjFast() so that the loops over the interior are branch free and vectorize.
+    */
+
+    //For performance this does not NULL check passed in ptrs
+
+    dadj[0] = find_dadjFast(i, 0, nRows, obsloc, rszloc, readNoiseAmp);
+    if (nRows < 2)
+        return;
+    dadj[nRows-1] = find_dadjFast(i, nRows-1, nRows, obsloc, rszloc, readNoiseAmp);
+
+    const float * obs = obsloc[i];
+    const float * rsz = rszloc[i];
+    if (i == 1)
+    {
+        const float * obsPrev = obsloc[0];
+        const float * rszPrev = rszloc[0];
+        const float * obsNext = obsloc[2];
+        const float * rszNext = rszloc[2];
+        {unsigned j;
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (j = 1; j < nRows-1; ++j)
+        {
+            const double mval = (double)rsz[j];
+            //NOTE: keep the order of the summation, it's part of the result
+            double dval9 = (double)obs[j-1]     - (double)rsz[j-1] +
+                           (double)obs[j]       - (double)rsz[j]   +
+                           (double)obs[j+1]     - (double)rsz[j+1] +
+                           (double)obsPrev[j-1] - (double)rszPrev[j-1] +
+                           (double)obsPrev[j]   - (double)rszPrev[j]   +
+                           (double)obsPrev[j+1] - (double)rszPrev[j+1] +
+                           (double)obsNext[j-1] - (double)rszNext[j-1] +
+                           (double)obsNext[j]   - (double)rszNext[j]  +
+                           (double)obsNext[j+1] - (double)rszNext[j+1];
+            dval9 = dval9 / 9.0;
+            dadj[j] = dadjFromDeltas((double)obs[j] - mval, dval9, (double)rsz[j-1] - mval, (double)rsz[j+1] - mval, readNoiseAmp);
+        }}
+    }
+    else
+    {
+        {unsigned j;
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for (j = 1; j < nRows-1; ++j)
+        {
+            const double mval = (double)rsz[j];
+            dadj[j] = dadjFromDeltas((double)obs[j] - mval, 0.0, (double)rsz[j-1] - mval, (double)rsz[j+1] - mval, readNoiseAmp);
+        }}
+    }
 }
 
 int cteSmoothImage(const SingleGroup * input, SingleGroup * output, CTEParamsFast * ctePars, double ampReadNoise)
@@ -633,6 +1110,12 @@ int cteSmoothImage(const SingleGroup * input, SingleGroup * output, CTEParamsFas
        This is strategy #1 in a two-pronged strategy to mitigate the readnoise
        amplification.  Strategy #2 will be to not iterate when the deblurring
        is less than the readnoise.
+
+       Each iteration reads the previous model and writes the next, so the model is held
+       twice (ping-pong) and the adjustment & readnoise images are never materialised. The
+       adjustments of a column are computed into its slot in the next model, then applied
+       in place. Iteration stops after 100 iterations or once the rms of the removed
+       readnoise reaches ampReadNoise.
 */
 
     extern int status;
@@ -644,13 +1127,9 @@ int cteSmoothImage(const SingleGroup * input, SingleGroup * output, CTEParamsFas
         return (status = ALLOCATION_PROBLEM);
     output->sci.data.storageOrder = COLUMNMAJOR;
 
-    extern int status;
-
     const unsigned nRows = input->sci.data.ny;
     const unsigned nColumns = input->sci.data.nx;
-
-    double rmsGlobal=0;
-    double nrmsGlobal=0;
+    const unsigned maxIterations = 100;
 
     clock_t begin = clock();
 
@@ -659,7 +1138,7 @@ int cteSmoothImage(const SingleGroup * input, SingleGroup * output, CTEParamsFas
     //Is the readnoise diff per amp? Current method assumes not.
     if (ampReadNoise < 0.1){
         trlmessage("rnsig < 0.1, No read-noise mitigation needed");
-        return(status);
+        return HSTCAL_OK;
     }
 
     /*GO THROUGH THE ENTIRE IMAGE AND ADJUST PIXELS TO MAKE THEM
@@ -669,35 +1148,28 @@ int cteSmoothImage(const SingleGroup * input, SingleGroup * output, CTEParamsFas
       DOWN THE LINE.
       */
 
-    //To remove the below code adjust in place i.e. using only output:
-    //Don't use pointers to output for obs_loc & rsz_loc
-    //Copy columns and then just shift these copies (boundary case might be annoying)
-    //Use schedule(static) and pre (inner for loop) copy boundary columns to avoid race conditions
-    SingleGroup adjustment;
-    initSingleGroup(&adjustment);
-    allocSingleGroup(&adjustment, nColumns, nRows, False);
-
-    SingleGroup readNoise;
-    initSingleGroup(&readNoise);
-    allocSingleGroup(&readNoise, nColumns, nRows, False);
-
-#ifdef _OPENMP
-    #pragma omp parallel shared(input, output, ampReadNoise, rmsGlobal, nrmsGlobal, readNoise)
-#endif
+    const size_t nPixels = (size_t)nRows*nColumns;
+    float * pingPong = malloc(nPixels*sizeof(*pingPong));
+    if (!pingPong)
     {
-    const float * obs_loc[3];
-    const float * rsz_loc[3];
+        trlerror("Out of memory in cteSmoothImage()");
+        return (status = OUT_OF_MEMORY);
+    }
+    float * current = output->sci.data.data;
+    float * next = pingPong;
+    const float * observed = input->sci.data.data;
 
-    double rmsLocal;
-    double nrmsLocal;
+    unsigned nIterations = 0;
     {unsigned iter;
-    for (iter = 0; iter < 100; ++iter)
+    for (iter = 0; iter < maxIterations; ++iter)
     {
-        rmsLocal = 0;
-        nrmsLocal = 0;
+        double rms = 0;
+        double nrms = 0;
+        ++nIterations;
+
         {unsigned i;
 #ifdef _OPENMP
-        #pragma omp for schedule(static)
+        #pragma omp parallel for schedule(static) reduction(+:rms,nrms)
 #endif
         for (i = 0; i < nColumns; ++i)
         {
@@ -710,100 +1182,59 @@ int cteSmoothImage(const SingleGroup * input, SingleGroup * output, CTEParamsFas
                 imid = nColumns-2;
 
             /*LOCATE THE MIDDLE AND NEIGHBORING PIXELS FOR ANALYSIS*/
-            obs_loc[0] = input->sci.data.data + (imid-1)*nRows;
+            const float * obs_loc[3];
+            const float * rsz_loc[3];
+            obs_loc[0] = observed + (size_t)(imid-1)*nRows;
             obs_loc[1] = obs_loc[0] + nRows;
             obs_loc[2] = obs_loc[1] + nRows;
 
-            rsz_loc[0] = output->sci.data.data + (imid-1)*nRows;
+            rsz_loc[0] = current + (size_t)(imid-1)*nRows;
             rsz_loc[1] = rsz_loc[0] + nRows;
             rsz_loc[2] = rsz_loc[1] + nRows;
 
-            {unsigned j;
-            for (j = 0; j < nRows; ++j)
-                PixColumnMajor(adjustment.sci.data, j, i) = find_dadjFast(1+i-imid, j, nRows, obs_loc, rsz_loc, ampReadNoise);
-            }
-        }} /*end the parallel for*/ //implicit omp barrier
+            //The adjustments only read the observed image and the current model
+            const float * obsColumn = observed + (size_t)i*nRows;
+            const float * currentColumn = current + (size_t)i*nRows;
+            float * nextColumn = next + (size_t)i*nRows;
+            find_dadjColumn(nextColumn, 1+i-imid, nRows, obs_loc, rsz_loc, ampReadNoise);
 
-        //NOW GO OVER ALL THE nColumns AND nRows AGAIN TO SCALE THE PIXELS
-        {unsigned i;
-#ifdef _OPENMP
-        #pragma omp for schedule(static)
-#endif
-        for (i = 0; i < nColumns; ++i)
-        {
+            //NOW SCALE THE PIXELS AND ACCUMULATE THE READNOISE REMOVED
             {unsigned j;
-            for(j = 0; j < nRows; ++j)
-            {
-                PixColumnMajor(output->sci.data,j,i) += (PixColumnMajor(adjustment.sci.data,j, i)*0.75);
-                PixColumnMajor(readNoise.sci.data,j,i) = (PixColumnMajor(input->sci.data,j,i) - PixColumnMajor(output->sci.data,j,i));
-            }}
-        }}//implicit omp barrier
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            rmsGlobal=0;
-            nrmsGlobal=0;
-        }
-
-        {unsigned j;
-#ifdef _OPENMP
-        #pragma omp for schedule(static)
-#endif
-        for (j = 0; j < nColumns; ++j)
-        {
-            {unsigned i;
-            for (i = 0; i < nRows; ++i)
+            for (j = 0; j < nRows; ++j)
             {
-                if ( (fabs(PixColumnMajor(input->sci.data, i, j)) > 0.1 ||
-                     fabs(PixColumnMajor(output->sci.data, i, j)) > 0.1))
+                nextColumn[j] = currentColumn[j] + (nextColumn[j]*0.75);
+                if ( (fabs(obsColumn[j]) > 0.1 ||
+                     fabs(nextColumn[j]) > 0.1))
                 {
-                    double tmp = PixColumnMajor(readNoise.sci.data, i, j);
-                    rmsLocal  +=  tmp*tmp;
-                    ++nrmsLocal;
+                    const float readNoise = obsColumn[j] - nextColumn[j];
+                    double tmp = readNoise;
+                    rms  +=  tmp*tmp;
+                    ++nrms;
                 }
             }}
-        }}//implicit omp barrier
+        }} /*end the parallel for*/
 
-#ifdef _OPENMP
-        #pragma omp critical (aggregate)
-#endif
-        {
-            rmsGlobal  += rmsLocal;
-            nrmsGlobal += nrmsLocal;
-        }
-#ifdef _OPENMP
-        #pragma omp barrier
-#endif
-
-#ifdef _OPENMP
-        #pragma omp single
-#endif
-        {
-            rmsGlobal = sqrt(rmsGlobal/nrmsGlobal);
-        } //implicit barrier
+        float * swap = current;
+        current = next;
+        next = swap;
 
-        // if it is true that one breaks then it is true for all
+        const double rmsGlobal = sqrt(rms/nrms);
         /*epsilon type comparison*/
         if ((ampReadNoise - rmsGlobal) < 0.00001)
             break; // this exits loop over iter
-
-#ifdef _OPENMP
-        #pragma omp barrier
-#endif
     }} // end loop over iter
-    } // close parallel block
-    freeSingleGroup(&adjustment);
-    freeSingleGroup(&readNoise);
+
+    if (current != output->sci.data.data)
+        memcpy(output->sci.data.data, current, nPixels*sizeof(*current));
+    free(pingPong);
 
     if (ctePars->verbose)
     {
         double timeSpent = ((double)(clock() - begin))/CLOCKS_PER_SEC;
-        trlmessage("(pctecorr) Time taken to smooth image: %.2f(s) with %i threads", timeSpent/ctePars->maxThreads, ctePars->maxThreads);
+        trlmessage("(pctecorr) Time taken to smooth image: %.2f(s) with %i threads, %u iterations", timeSpent/ctePars->maxThreads, ctePars->maxThreads, nIterations);
     }
 
-    return (status);
+    return HSTCAL_OK;
 }
 
 double find_dadjFast(const unsigned i, const unsigned j, const unsigned nRows, const float * obsloc[3], const float * rszloc[3], const double readNoiseAmp)
@@ -827,12 +1258,6 @@ double find_dadjFast(const unsigned i, const unsigned j, const unsigned nRows, c
 
     const double mval = (double)*(rszloc[i] + j);
     const double dval0  = (double)*(obsloc[i] + j) - mval;
-    double dval0u = dval0;
-
-    if (dval0u > 1)
-        dval0u = 1;
-    else if (dval0u < -1)
-        dval0u = -1;
 
     /*COMPARE THE SURROUNDING PIXELS*/
     double dval9 = 0.0;
@@ -850,46 +1275,9 @@ double find_dadjFast(const unsigned i, const unsigned j, const unsigned nRows, c
 
         dval9 = dval9 / 9.0;
     }
-    const double readNoiseAmpFraction = 0.33;
-    double dval9u = dval9;
-    if (dval9u > readNoiseAmp*readNoiseAmpFraction)
-        dval9u = readNoiseAmp*readNoiseAmpFraction;
-    else if (dval9u < readNoiseAmp*-readNoiseAmpFraction)
-        dval9u = readNoiseAmp*-readNoiseAmpFraction;
 
     const double dmod1 = j > 0 ? (double)*(rszloc[i] + j-1) - mval : 0;
     const double dmod2 = j < nRows-1 ? (double)*(rszloc[i] + j+1) - mval : 0;
 
-    double dmod1u = dmod1;
-    if (dmod1u > readNoiseAmp*readNoiseAmpFraction)
-        dmod1u = readNoiseAmp*readNoiseAmpFraction;
-    else if (dmod1u < readNoiseAmp*-readNoiseAmpFraction)
-        dmod1u = readNoiseAmp*-readNoiseAmpFraction;
-
-    double dmod2u = dmod2;
-    if (dmod2u > readNoiseAmp*readNoiseAmpFraction)
-        dmod2u = readNoiseAmp*readNoiseAmpFraction;
-    else if (dmod2u < readNoiseAmp*-readNoiseAmpFraction)
-        dmod2u = readNoiseAmp*-readNoiseAmpFraction;
-
-    /*
-       IF IT'S WITHIN 2 SIGMA OF THE READNOISE, THEN
-       TEND TO TREAT AS READNOISE; IF IT'S FARTHER OFF
-       THAN THAT, THEN DOWNWEIGHT THE INFLUENCE
-       */
-    const double readNoiseAmp2 = readNoiseAmp*readNoiseAmp;
-    const double w0 =     dval0 * dval0 / (dval0 * dval0 + 4.0 * readNoiseAmp2);
-    const double w9 =     dval9 * dval9 / (dval9 * dval9 + 18.0 * readNoiseAmp2);
-    const double w1 = 4 * readNoiseAmp2 / (dmod1 * dmod1 + 4.0 * readNoiseAmp2);
-    const double w2 = 4 * readNoiseAmp2 / (dmod2 * dmod2 + 4.0 * readNoiseAmp2);
-
-    /*(note that with the last two, if a pixel
-      is too discordant with its upper or lower
-      that neighbor has less of an ability to
-      pull it)*/
-
-    return  dval0u * w0 * 0.25f + /* desire to keep the original pixel value */
-            dval9u * w9 * 0.25f + /* desire to keep the original sum over 3x3*/
-            dmod1u * w1 * 0.25f + /* desire to get closer to the pixel below*/
-            dmod2u * w2 * 0.25f; /* desire to get closer to the pixel above*/
+    return dadjFromDeltas(dval0, dval9, dmod1, dmod2, readNoiseAmp);
 }
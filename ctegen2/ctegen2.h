@@ -78,11 +78,45 @@ typedef struct {
 
     // Serial CTE FITS extension information only
     char ccdamp[2];	/* ID of specific amp for the serial CTE correction */
+
+    Bool useTrapPixelMap; // materialise the full trap pixel map rather than evaluating it per column (see TrapColumnCoeffs)
 } CTEParamsFast;
 
+/* Compact stand-in for the trap pixel map image populated by populateTrapPixelMap().
+ * The trap density at row j of a column is the column's SCLBYCOL value interpolated
+ * between the 512, 1024, 1536 & 2048 nodes, times (j+1)/2048, times scale_frac. Only
+ * the per-column nodes and the per-row interpolation terms are stored, the readout
+ * kernels evaluate each trap column on the fly via evaluateTrapColumn().
+ */
+typedef struct {
+    unsigned nColumns;
+    unsigned nRows;
+    double cteScale; // scale_frac
+    double * scale; // 4 nodes per column, ordered scale512, scale1024, scale1536, scale2048
+    Bool * hasScale; // whether any SCLBYCOL row maps to this column
+    int * rowNode; // interpolation node index per row, 0 to 2
+    double * rowFrac; // interpolation fraction per row
+    double * rowScale; // (j+1)/2048 per row
+} TrapColumnCoeffs;
+
+/* One simulation for forwardModelBatch(). Cases sharing dimensions and razColumnOffset
+ * share a single set of trap coefficients, differing only in scale_frac.
+ */
+typedef struct {
+    const SingleGroup * input; // column major, as for forwardModel()
+    SingleGroup * output; // caller allocated, same dimensions as input
+    double scale_frac; // CTE scaling for this case, see cteScaleFracFromDate()
+    unsigned razColumnOffset; // column offset of input within the RAZ frame (SCLBYCOL alignment)
+    int status; // per case result, set by forwardModelBatch()
+} CTEForwardModelCase;
+
 int inverseCTEBlurWithRowMajorIput(const SingleGroup * rsz, SingleGroup * rsc, const SingleGroup * trapPixelMap, CTEParamsFast * cte);
 int inverseCTEBlur(const SingleGroup * rsz, SingleGroup * rsc, SingleGroup * trapPixelMap, CTEParamsFast * cte);
 int forwardModel(const SingleGroup * input, SingleGroup * output, SingleGroup * trapPixelMap, CTEParamsFast * ctePars);
+int inverseCTEBlurWithTrapCoeffs(const SingleGroup * rsz, SingleGroup * rsc, const TrapColumnCoeffs * trapCoeffs, CTEParamsFast * cte);
+int forwardModelWithTrapCoeffs(const SingleGroup * input, SingleGroup * output, const TrapColumnCoeffs * trapCoeffs, CTEParamsFast * ctePars);
+int forwardModelBatch(CTEForwardModelCase * cases, const unsigned nCases, const CTEParamsFast * ctePars);
+double cteScaleFracFromDate(const CTEParamsFast * ctePars, const double mjd);
 
 int simulatePixelReadout_v1_1(double * const pixelColumn, const float * const traps, const CTEParamsFast * const cte,
         const FloatTwoDArray * const rprof, const FloatTwoDArray * const cprof, const unsigned nRows);
@@ -97,6 +131,8 @@ Bool correctCROverSubtraction(float * const traps, const double * const pix_mode
         const unsigned nRows, const double threshHold);
 
 int populateTrapPixelMap(SingleGroup * input, CTEParamsFast * params);
+int populateTrapColumnCoeffs(TrapColumnCoeffs * trapCoeffs, CTEParamsFast * params);
+void evaluateTrapColumn(float * const traps, const TrapColumnCoeffs * const trapCoeffs, const unsigned column);
 int cteSmoothImage(const SingleGroup * input, SingleGroup * output, CTEParamsFast * ctePars, double readNoiseAmp);
 double find_dadjFast(const unsigned i ,const unsigned j, const unsigned nRows, const float * obsloc[3], const float * rszloc[3], const double readNoiseAmp);
 
@@ -104,6 +140,9 @@ double find_dadjFast(const unsigned i ,const unsigned j, const unsigned nRows, c
 void initCTEParamsFast(CTEParamsFast * pars, const unsigned _nTraps, const unsigned _nRows, const unsigned _nColumns, const unsigned _nScaleTableColumns, const unsigned maxThreads);
 int allocateCTEParamsFast(CTEParamsFast * pars);
 void freeCTEParamsFast(CTEParamsFast * pars);
+void initTrapColumnCoeffs(TrapColumnCoeffs * trapCoeffs);
+int allocTrapColumnCoeffs(TrapColumnCoeffs * trapCoeffs, const unsigned nColumns, const unsigned nRows);
+void freeTrapColumnCoeffs(TrapColumnCoeffs * trapCoeffs);
 
 int populateImageFileWithCTEKeywordValues(SingleGroup *group, CTEParamsFast *pars, char * corrType);
 int getCTEParsFromImageHeader(SingleGroup * input, CTEParamsFast * params);
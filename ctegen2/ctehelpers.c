@@ -74,6 +74,8 @@ void initCTEParamsFast(CTEParamsFast * pars, const unsigned _nTraps,
 
     *pars->cte_name='\0';
     *pars->cte_ver='\0';
+
+    pars->useTrapPixelMap = False;
 }
 
 int allocateCTEParamsFast(CTEParamsFast * pars)
@@ -168,6 +170,82 @@ void freeCTEParamsFast(CTEParamsFast * pars)
     delete((void*)&pars->cprof);
 }
 
+void initTrapColumnCoeffs(TrapColumnCoeffs * trapCoeffs)
+{
+    trapCoeffs->nColumns = 0;
+    trapCoeffs->nRows = 0;
+    trapCoeffs->cteScale = 0;
+    trapCoeffs->scale = NULL;
+    trapCoeffs->hasScale = NULL;
+    trapCoeffs->rowNode = NULL;
+    trapCoeffs->rowFrac = NULL;
+    trapCoeffs->rowScale = NULL;
+}
+
+int allocTrapColumnCoeffs(TrapColumnCoeffs * trapCoeffs, const unsigned nColumns, const unsigned nRows)
+{
+    PtrRegister ptrReg;
+    initPtrRegister(&ptrReg);
+
+    void * tmp = NULL;
+    tmp = newAndZero((void*)&trapCoeffs->scale, 4*nColumns, sizeof(*trapCoeffs->scale));
+    addPtr(&ptrReg, tmp, &free);
+    if (!tmp)
+    {
+        freeOnExit(&ptrReg);
+        trlerror ("Out of memory.\n");
+        return OUT_OF_MEMORY;
+    }
+    tmp = newAndZero((void*)&trapCoeffs->hasScale, nColumns, sizeof(*trapCoeffs->hasScale));
+    addPtr(&ptrReg, tmp, &free);
+    if (!tmp)
+    {
+        freeOnExit(&ptrReg);
+        trlerror ("Out of memory.\n");
+        return OUT_OF_MEMORY;
+    }
+    tmp = newAndZero((void*)&trapCoeffs->rowNode, nRows, sizeof(*trapCoeffs->rowNode));
+    addPtr(&ptrReg, tmp, &free);
+    if (!tmp)
+    {
+        freeOnExit(&ptrReg);
+        trlerror ("Out of memory.\n");
+        return OUT_OF_MEMORY;
+    }
+    tmp = newAndZero((void*)&trapCoeffs->rowFrac, nRows, sizeof(*trapCoeffs->rowFrac));
+    addPtr(&ptrReg, tmp, &free);
+    if (!tmp)
+    {
+        freeOnExit(&ptrReg);
+        trlerror ("Out of memory.\n");
+        return OUT_OF_MEMORY;
+    }
+    tmp = newAndZero((void*)&trapCoeffs->rowScale, nRows, sizeof(*trapCoeffs->rowScale));
+    addPtr(&ptrReg, tmp, &free);
+    if (!tmp)
+    {
+        freeOnExit(&ptrReg);
+        trlerror ("Out of memory.\n");
+        return OUT_OF_MEMORY;
+    }
+
+    trapCoeffs->nColumns = nColumns;
+    trapCoeffs->nRows = nRows;
+    freeReg(&ptrReg);
+    return 0;
+}
+
+void freeTrapColumnCoeffs(TrapColumnCoeffs * trapCoeffs)
+{
+    delete((void*)&trapCoeffs->scale);
+    delete((void*)&trapCoeffs->hasScale);
+    delete((void*)&trapCoeffs->rowNode);
+    delete((void*)&trapCoeffs->rowFrac);
+    delete((void*)&trapCoeffs->rowScale);
+    trapCoeffs->nColumns = 0;
+    trapCoeffs->nRows = 0;
+}
+
 /************ HELPER SUBROUTINES ****************************/
 /*
 MLS 2015: read in the CTE parameters from the PCTETAB file
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "trlbuf.h"
+#include "acs.h"
+#include "acsinfo.h"
+#include "pcte_gen3_funcs.h"
+
+# ifdef _OPENMP
+#  include <omp.h>
+# endif
+
+/* Correcting the amps as concurrent tasks (ACSCTE --parallelAmps, runAmpCTEJobs())
+   must give the same images as correcting them one after the other with
+   doPCTEGen3(), as doCte does by default, and the same trailer messages in the
+   same amp order.
+*/
+
+#define N_TRAPS 8
+#define CTE_LEN 30
+#define N_SCALE_COLUMNS 96
+#define AMP_NX 20
+#define CHIP_NX (2 * AMP_NX)
+#define CHIP_NY 36
+#define N_CHIPS 2
+#define N_JOBS (2 * N_CHIPS)
+
+/* Chip 2 (amps C and D) then chip 1 (amps A and B), as in a WFC exposure */
+static char * chipAmps[N_CHIPS] = {"CD", "AB"};
+
+static int setup_cte_pars(CTEParamsFast *pars, int n_par) {
+    int w, i;
+
+    initCTEParamsFast(pars, N_TRAPS, 0, 0, N_SCALE_COLUMNS, 1);
+    if (allocateCTEParamsFast(pars)) {
+        return OUT_OF_MEMORY;
+    }
+    pars->cte_traps = N_TRAPS;
+    pars->cte_len = CTE_LEN;
+    pars->n_par = n_par;
+    pars->n_forward = 3;
+    pars->thresh = -10.;
+    pars->fix_rocr = 1;
+    pars->scale_frac = 0.7;
+
+    for (w = 0; w < N_TRAPS; w++) {
+        pars->wcol_data[w] = w + 1;
+        pars->qlevq_data[w] = 5. * (w + 1) * (w + 1);
+        pars->dpdew_data[w] = 1.;
+    }
+    /* Columns of both chips in the RAZ frame, CD then AB */
+    for (i = 0; i < N_SCALE_COLUMNS; i++) {
+        pars->iz_data[i] = (i < N_SCALE_COLUMNS / 2) ? i : ACS_WFC_N_COLUMNS_PER_CHIP_EXCL_OVERSCAN + i - N_SCALE_COLUMNS / 2;
+        pars->scale512[i] = 20. + (i % 7);
+        pars->scale1024[i] = 40. + (i % 5);
+        pars->scale1536[i] = 60. + (i % 3);
+        pars->scale2048[i] = 80. + (i % 11);
+    }
+
+    pars->rprof = malloc(sizeof(*pars->rprof));
+    pars->cprof = malloc(sizeof(*pars->cprof));
+    if (!pars->rprof || !pars->cprof) {
+        return OUT_OF_MEMORY;
+    }
+    initFloatHdrData(pars->rprof);
+    initFloatHdrData(pars->cprof);
+    if (allocFloatHdrData(pars->rprof, CTE_LEN, N_TRAPS, True) ||
+        allocFloatHdrData(pars->cprof, CTE_LEN, N_TRAPS, True)) {
+        return OUT_OF_MEMORY;
+    }
+    for (w = 0; w < N_TRAPS; w++) {
+        float total = 0.;
+        for (i = 0; i < CTE_LEN; i++) {
+            float decay = expf(-(i + 1) / (2.f + w));
+            total += decay;
+            pars->rprof->data.data[w*CTE_LEN + i] = decay;
+            pars->cprof->data.data[w*CTE_LEN + i] = total;
+        }
+        for (i = 0; i < CTE_LEN; i++) {
+            pars->rprof->data.data[w*CTE_LEN + i] /= total;
+            pars->cprof->data.data[w*CTE_LEN + i] = 1.f - pars->cprof->data.data[w*CTE_LEN + i] / total;
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static void setup_acs(ACSInfo *acs) {
+    void ACSInit (ACSInfo *);
+    int chip, amp;
+
+    for (chip = 0; chip < N_CHIPS; chip++) {
+        ACSInit(&acs[chip]);
+        acs[chip].detector = WFC_CCD_DETECTOR;
+        acs[chip].chip = 2 - chip;
+        acs[chip].ampx = AMP_NX;
+        acs[chip].ampy = 0;
+        acs[chip].trimx[0] = acs[chip].trimx[1] = 0;
+        acs[chip].trimy[0] = acs[chip].trimy[1] = 0;
+        acs[chip].nThreads = 1;
+        for (amp = 0; amp < NAMPS; amp++) {
+            acs[chip].readnoise[amp] = 4.f + 0.5f * amp;
+        }
+    }
+}
+
+static int setup_chips(SingleGroup *x) {
+    int chip, i, j;
+
+    srand(2718);
+    for (chip = 0; chip < N_CHIPS; chip++) {
+        initSingleGroup(&x[chip]);
+        if (allocSingleGroup(&x[chip], CHIP_NX, CHIP_NY, True)) {
+            return OUT_OF_MEMORY;
+        }
+        for (j = 0; j < CHIP_NY; j++) {
+            for (i = 0; i < CHIP_NX; i++) {
+                float value = 100.f + 20.f * rand() / (float)RAND_MAX;
+                if (rand() % 13 == 0) {
+                    value += 4000.f * rand() / (float)RAND_MAX;
+                }
+                Pix(x[chip].sci.data, i, j) = value;
+                Pix(x[chip].err.data, i, j) = sqrtf(value);
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static void setup_jobs(AmpCTEJob *jobs, const CTEParamsFast *serialPars, const CTEParamsFast *parallelPars) {
+    int chip, nthAmp, k = 0;
+
+    for (chip = 0; chip < N_CHIPS; chip++) {
+        for (nthAmp = 0; nthAmp < 2; nthAmp++, k++) {
+            jobs[k].imset = chip;
+            jobs[k].nthAmp = nthAmp;
+            strcpy(jobs[k].ccdamp, chipAmps[chip]);
+            jobs[k].amploc = strchr(AMPSORDER, chipAmps[chip][nthAmp]);
+            jobs[k].ampID = jobs[k].amploc - AMPSORDER;
+            jobs[k].doSerial = True;
+            jobs[k].serialPars = *serialPars;
+            jobs[k].parallelPars = *parallelPars;
+        }
+    }
+}
+
+static int compare_chips(const SingleGroup *expected, const SingleGroup *got) {
+    int chip, i, j;
+
+    for (chip = 0; chip < N_CHIPS; chip++) {
+        for (j = 0; j < CHIP_NY; j++) {
+            for (i = 0; i < CHIP_NX; i++) {
+                float es = Pix(expected[chip].sci.data, i, j), gs = Pix(got[chip].sci.data, i, j);
+                float ee = Pix(expected[chip].err.data, i, j), ge = Pix(got[chip].err.data, i, j);
+                if (memcmp(&es, &gs, sizeof(es)) != 0 || memcmp(&ee, &ge, sizeof(ee)) != 0) {
+                    printf("ERROR: imset %d differs at row %d column %d: expected %.9g +- %.9g "
+                           "got %.9g +- %.9g\n", chip + 1, j, i, es, ee, gs, ge);
+                    return ERROR_RETURN;
+                }
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int parallel_amps_test_case(void) {
+    ACSInfo acs[N_CHIPS];
+    SingleGroup viaAmps[N_CHIPS], viaJobs[N_CHIPS];
+    CTEParamsFast serialPars, parallelPars;
+    AmpCTEJob jobs[N_JOBS];
+    char *expectedMessages = NULL;
+    size_t start;
+    int k, chip, test_status = HSTCAL_OK;
+
+    printf("==== runAmpCTEJobs vs doPCTEGen3 amp by amp ====\n");
+
+    setup_acs(acs);
+    for (chip = 0; chip < N_CHIPS; chip++) {
+        initSingleGroup(&viaAmps[chip]);
+        initSingleGroup(&viaJobs[chip]);
+    }
+    initCTEParamsFast(&serialPars, N_TRAPS, 0, 0, N_SCALE_COLUMNS, 1);
+    initCTEParamsFast(&parallelPars, N_TRAPS, 0, 0, N_SCALE_COLUMNS, 1);
+    if (setup_cte_pars(&serialPars, 1) || setup_cte_pars(&parallelPars, 3) ||
+        setup_chips(viaAmps) || setup_chips(viaJobs)) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    /* Amp by amp, as doCte does without --parallelAmps. The threads of each amp
+       match those runAmpCTEJobs() gives it below, so the summed counts reported in
+       the trailer agree too. */
+#ifdef _OPENMP
+    omp_set_num_threads(1);
+#endif
+    setup_jobs(jobs, &serialPars, &parallelPars);
+    start = strlen(trlbuf.buffer);
+    for (k = 0; k < N_JOBS && !test_status; k++) {
+        AmpCTEJob *job = &jobs[k];
+        char corrType[20];
+        strcpy(corrType, "serial");
+        if ((test_status = doPCTEGen3(&acs[job->imset], &job->serialPars, &viaAmps[job->imset], False, corrType,
+                                      job->ccdamp, job->nthAmp, job->amploc, job->ampID))) {
+            break;
+        }
+        strcpy(corrType, "parallel");
+        test_status = doPCTEGen3(&acs[job->imset], &job->parallelPars, &viaAmps[job->imset], False, corrType,
+                                 job->ccdamp, job->nthAmp, job->amploc, job->ampID);
+    }
+    if (test_status) {
+        printf("ERROR: doPCTEGen3 failed with status %d\n", test_status);
+        goto cleanup;
+    }
+    if (!(expectedMessages = strdup(trlbuf.buffer + start))) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    /* All amps as concurrent tasks */
+    setup_jobs(jobs, &serialPars, &parallelPars);
+    start = strlen(trlbuf.buffer);
+    if ((test_status = runAmpCTEJobs(acs, viaJobs, jobs, N_JOBS, False, N_JOBS))) {
+        printf("ERROR: runAmpCTEJobs failed with status %d\n", test_status);
+        goto cleanup;
+    }
+
+    if ((test_status = compare_chips(viaAmps, viaJobs))) {
+        goto cleanup;
+    }
+    if (strcmp(expectedMessages, trlbuf.buffer + start) != 0) {
+        printf("ERROR: trailer messages differ\n  Expected:\n%s\n  Got:\n%s\n",
+               expectedMessages, trlbuf.buffer + start);
+        test_status = ERROR_RETURN;
+    }
+
+cleanup:
+    free(expectedMessages);
+    for (chip = 0; chip < N_CHIPS; chip++) {
+        freeSingleGroup(&viaAmps[chip]);
+        freeSingleGroup(&viaJobs[chip]);
+    }
+    freeCTEParamsFast(&serialPars);
+    freeCTEParamsFast(&parallelPars);
+
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+
+    if (InitTrlBuf()) {
+        return OUT_OF_MEMORY;
+    }
+    SetTrlQuietMode(YES);
+
+    test_status += parallel_amps_test_case();
+
+    CloseTrlBuf(&trlbuf);
+    return test_status;
+}
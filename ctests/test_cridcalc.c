@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "wf3.h"
+#include "wf3info.h"
+#include "wf3dq.h"
+
+/* Fitting the clean IR ramps in batches (fitCleanRamps) must give the same output
+   image and input DQ as fitting every ramp with fitsamps/linfit, for ramps with
+   cosmic rays, earlier DATAREJECT flags, saturation, zero-variance samples and
+   overflowing fits, counts and countrates, with and without rejection of the first
+   samples.
+*/
+
+#define NX 53
+#define NY 7
+#define NGROUPS 12
+#define T0 2.9f
+#define DT 25.f
+
+int fitRamps (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *, int);
+
+enum RampKind {CLEAN, CR_HIT, SATURATED, ZERO_ERR, SATURATED_ZEROTH, OVERFLOW, N_KINDS};
+
+/* Sample s of a pixel (0 the zeroth read) is in group NGROUPS-1-s */
+static int setup_stack(MultiNicmosGroup *input, unsigned seed, int countrate) {
+    int g, i, j, s;
+
+    if (allocMultiNicmosGroup(input, NGROUPS)) {
+        return OUT_OF_MEMORY;
+    }
+    for (g = 0; g < NGROUPS; g++) {
+        if (allocSingleNicmosGroup(&input->group[g], NX, NY)) {
+            return OUT_OF_MEMORY;
+        }
+    }
+
+    srand(seed);
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            /* Mostly clean ramps, as in real data */
+            const int r = rand() % 20;
+            const enum RampKind kind = (r < 20 - N_KINDS + 1) ? CLEAN : (enum RampKind)(r - (20 - N_KINDS));
+            const float rate = (rand() % 4 == 0) ? 0.05f : 10.f * rand() / (float)RAND_MAX;
+            const int at = 1 + rand() % (NGROUPS - 1);
+            float jump = 0.f;
+
+            for (s = 0; s < NGROUPS; s++) {
+                SingleNicmosGroup *group = &input->group[NGROUPS-1-s];
+                const float t = T0 + s * DT;
+                float counts = rate * t + 4.f * (2.f * rand() / (float)RAND_MAX - 1.f);
+                short dq = 0;
+
+                if (kind == CR_HIT && s == at) {
+                    jump = 300.f + 1000.f * rand() / (float)RAND_MAX;
+                }
+                counts += jump;
+                if ((kind == SATURATED && s >= at) || (kind == SATURATED_ZEROTH && s <= 1)) {
+                    dq |= SATPIXEL;
+                }
+                if (kind == OVERFLOW) {
+                    counts = (s + 1) * 3e37f;
+                }
+                if (rand() % 50 == 0) {
+                    dq |= ZEROSIG;
+                }
+                /* Flagged by an earlier run, also among the rejected first samples */
+                if (rand() % 60 == 0) {
+                    dq |= DATAREJECT;
+                }
+
+                Pix(group->sci.data, i, j) = countrate ? counts / t : counts;
+                Pix(group->err.data, i, j) = (kind == ZERO_ERR && s == at) ? 0.f :
+                        sqrtf(fabsf(counts) + 400.f) / (countrate ? t : 1.f);
+                DQSetPix(group->dq.data, i, j, dq);
+                Pix(group->intg.data, i, j) = t;
+                Pix(group->smpl.data, i, j) = 1;
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static void setup_wf3(WF3Info *wf3, int samp_rej, int countrate) {
+    void WF3Init (WF3Info *);
+    int g;
+
+    WF3Init(wf3);
+    wf3->ngroups = NGROUPS;
+    wf3->samp_rej = samp_rej;
+    wf3->zsigcorr = PERFORM;
+    wf3->flatcorr = OMIT;
+    wf3->mean_gain = 2.5f;
+    wf3->crthresh = 4.f;
+    wf3->sampzero = T0;
+    wf3->trimx[0] = 2;
+    wf3->trimx[1] = 1;
+    wf3->trimy[0] = 1;
+    wf3->trimy[1] = 0;
+    for (g = 0; g < NGROUPS; g++) {
+        wf3->bunit[g] = countrate ? COUNTRATE : COUNTS;
+    }
+}
+
+static int same_float(float e, float g) {
+    return memcmp(&e, &g, sizeof(e)) == 0;
+}
+
+static int compare_fits(const MultiNicmosGroup *expInput, const SingleNicmosGroup *expected,
+        const MultiNicmosGroup *gotInput, const SingleNicmosGroup *got) {
+    int g, i, j;
+
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            if (!same_float(Pix(expected->sci.data, i, j), Pix(got->sci.data, i, j)) ||
+                !same_float(Pix(expected->err.data, i, j), Pix(got->err.data, i, j)) ||
+                !same_float(Pix(expected->intg.data, i, j), Pix(got->intg.data, i, j)) ||
+                Pix(expected->smpl.data, i, j) != Pix(got->smpl.data, i, j) ||
+                DQPix(expected->dq.data, i, j) != DQPix(got->dq.data, i, j)) {
+                printf("ERROR: output differs at row %d column %d: expected %.9g +- %.9g "
+                       "(dq %d, %d samples, %g s) got %.9g +- %.9g (dq %d, %d samples, %g s)\n",
+                       j, i, Pix(expected->sci.data, i, j), Pix(expected->err.data, i, j),
+                       DQPix(expected->dq.data, i, j), Pix(expected->smpl.data, i, j),
+                       Pix(expected->intg.data, i, j), Pix(got->sci.data, i, j),
+                       Pix(got->err.data, i, j), DQPix(got->dq.data, i, j),
+                       Pix(got->smpl.data, i, j), Pix(got->intg.data, i, j));
+                return ERROR_RETURN;
+            }
+            for (g = 0; g < NGROUPS; g++) {
+                if (DQPix(expInput->group[g].dq.data, i, j) != DQPix(gotInput->group[g].dq.data, i, j)) {
+                    printf("ERROR: DQ of group %d differs at row %d column %d: expected %d got %d\n",
+                           g + 1, j, i, DQPix(expInput->group[g].dq.data, i, j),
+                           DQPix(gotInput->group[g].dq.data, i, j));
+                    return ERROR_RETURN;
+                }
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int ramp_test_case(int samp_rej, int countrate) {
+    WF3Info wf3;
+    MultiNicmosGroup viaFitsamps, viaBatches;
+    SingleNicmosGroup expected, got;
+    int nExpected, nGot, test_status = HSTCAL_OK;
+
+    printf("==== fitCleanRamps vs fitsamps (samp_rej %d, %s) ====\n", samp_rej,
+           countrate ? "countrates" : "counts");
+
+    setup_wf3(&wf3, samp_rej, countrate);
+    initMultiNicmosGroup(&viaFitsamps);
+    initMultiNicmosGroup(&viaBatches);
+    initSingleNicmosGroup(&expected);
+    initSingleNicmosGroup(&got);
+    if (setup_stack(&viaFitsamps, 31 + samp_rej, countrate) ||
+        setup_stack(&viaBatches, 31 + samp_rej, countrate) ||
+        allocSingleNicmosGroup(&expected, NX, NY) || allocSingleNicmosGroup(&got, NX, NY)) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    nExpected = fitRamps(&wf3, &viaFitsamps, &expected, 0);
+    nGot = fitRamps(&wf3, &viaBatches, &got, 1);
+    if (nExpected < 0 || nGot < 0) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+    if (nExpected != nGot) {
+        printf("ERROR: %d unstable pixels, expected %d\n", nGot, nExpected);
+        test_status = ERROR_RETURN;
+        goto cleanup;
+    }
+    test_status = compare_fits(&viaFitsamps, &expected, &viaBatches, &got);
+
+cleanup:
+    freeMultiNicmosGroup(&viaFitsamps);
+    freeMultiNicmosGroup(&viaBatches);
+    freeSingleNicmosGroup(&expected);
+    freeSingleNicmosGroup(&got);
+
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+
+    test_status += ramp_test_case(0, 0);
+    test_status += ramp_test_case(0, 1);
+    test_status += ramp_test_case(2, 0);
+    /* Too few samples left for any batch */
+    test_status += ramp_test_case(NGROUPS - 3, 0);
+
+    return test_status;
+}
@@ -0,0 +1,482 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "hstcal_imagestack.h"
+#include "hstcal_bitmask.h"
+#include "hstcal_crrej.h"
+
+/* crrejBandIteration() must give the averages, errors, DQ, CR masks and number of
+   rejected pixels of the scrolling buffers of rej_loop (wf3rej), iteration after
+   iteration, for a synthetic stack with cosmic rays, excluded DQ flags, SPILL flags in
+   the input DQ and an image without exposure.
+*/
+
+#define NIMGS 4
+#define NX 45
+#define NY 37
+#define NITER 4
+#define CRFLAG 8192
+
+#define SQ(x) ((x) * (x))
+
+static const float efac[NIMGS] = {1.f, 1.5f, 0.f, 2.f};
+static const float skyval[NIMGS] = {10.f, 12.5f, 0.f, 7.f};
+static const float sigmas[NITER] = {8.f, 6.f, 6.f, 4.f};
+static const short dqpat = 4 | 32;
+static const short maskdq = CRREJ_MASK_OK | CRREJ_MASK_EXCLUDE | CRREJ_MASK_HIT | CRREJ_MASK_SPILL;
+
+/* A single amp version of the WFC3 noise model */
+typedef struct {
+    const ImageStack * stack;
+    float exp2[NIMGS];
+    float gain2;
+    float noise2;
+    float scale;
+    int width;
+} TestNoise;
+
+static void testPixels(const void * data, int img, int line, float * pic) {
+    const TestNoise * model = data;
+    const float * sci = model->stack->sci + ((size_t)img*NY + line)*NX;
+    int i;
+
+    for (i = 0; i < NX; i++)
+        pic[i] = (sci[i] - skyval[img]) / efac[img];
+}
+
+static void testThresholds(const void * data, int img, int line, int iter, float sig2,
+        const float * ave, float * pic, float * th, float * spth, float * fwd) {
+    const TestNoise * model = data;
+    const float * sci = model->stack->sci + ((size_t)img*NY + line)*NX;
+    int i;
+
+    (void) iter;
+    testPixels(data, img, line, pic);
+    for (i = 0; i < NX; i++) {
+        float dum = ave[i]*efac[img] + skyval[img];
+        float val = (dum > 0.) ? dum : 0.;
+        float pixsky = (dum-skyval[img] > 0.) ? dum-skyval[img] : 0.;
+        th[i] = sig2 * ((model->noise2 + val/model->gain2 + SQ(model->scale * pixsky))) / model->exp2[img];
+        spth[i] = sig2 * ((model->noise2 + val/model->gain2)) / model->exp2[img];
+    }
+    memcpy(fwd, (line <= model->width) ? sci : pic, NX * sizeof(float));
+}
+
+static void testAddVariance(const void * data, int img, int line, const float * pic,
+        const char * use, float * sumvar) {
+    const TestNoise * model = data;
+    int i;
+
+    (void) line;
+    for (i = 0; i < NX; i++) {
+        if (use[i]) {
+            float dum = pic[i]*efac[img] + skyval[img];
+            float val = (dum > 0.) ? dum : 0.;
+            sumvar[i] += model->noise2 + val/model->gain2;
+        }
+    }
+}
+
+static float testVariance(const void * data, float sumvar, float pixexp) {
+    (void) data;
+    return (sqrt(sumvar)/pixexp);
+}
+
+/* The output of the rejection, and its initial guess */
+typedef struct {
+    FloatTwoDArray ave;
+    FloatTwoDArray avevar;
+    ShortTwoDArray dq;
+    ShortTwoDArray dq2;
+    float efacsum[NX*NY];
+    int nrej;
+    BitMask crmask;
+} RejResult;
+
+static int setup_result(RejResult * r, const ImageStack * stack) {
+    int i, j, k;
+
+    initFloatData(&r->ave);
+    initFloatData(&r->avevar);
+    initShortData(&r->dq);
+    initShortData(&r->dq2);
+    initBitMask(&r->crmask);
+    if (allocFloatData(&r->ave, NX, NY, True) || allocFloatData(&r->avevar, NX, NY, True) ||
+        allocShortData(&r->dq, NX, NY, True) || allocShortData(&r->dq2, NX, NY, True) ||
+        allocBitMask(&r->crmask, NX, NIMGS * NY)) {
+        return OUT_OF_MEMORY;
+    }
+
+    /* The mean of the normalized images, as the initial guess */
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            float sum = 0.f, n = 0.f;
+            for (k = 0; k < NIMGS; k++) {
+                if (efac[k] > 0.) {
+                    sum += (stack->sci[((size_t)k*NY + j)*NX + i] - skyval[k]) / efac[k];
+                    n += 1.f;
+                }
+            }
+            Pix(r->ave, i, j) = sum / n;
+            Pix(r->avevar, i, j) = 5.f;
+            DQSetPix(r->dq, i, j, CRFLAG);
+            DQSetPix(r->dq2, i, j, CRREJ_MASK_OK);
+            r->efacsum[j*NX + i] = 0.f;
+        }
+    }
+    r->nrej = 0;
+
+    return HSTCAL_OK;
+}
+
+static void free_result(RejResult * r) {
+    freeFloatData(&r->ave);
+    freeFloatData(&r->avevar);
+    freeShortData(&r->dq);
+    freeShortData(&r->dq2);
+    freeBitMask(&r->crmask);
+}
+
+/* The scrolling buffers of rej_loop, without shading correction, serially */
+static void reference_rej(const ImageStack * stack, const TestNoise * model, float psig2,
+        float rej2, RejResult * r) {
+    const int width = model->width;
+    const int buffheight = 1 + 2*width;
+    const short nocr = ~CRFLAG;
+    const short nospill = ~CRREJ_MASK_SPILL;
+    float **pic[NIMGS], **thresh[NIMGS], **spthresh[NIMGS];
+    short **mask[NIMGS];
+    float zerofbuf[NX], sum[NX], sumvar[NX], buf[NX];
+    short zerosbuf[NX], bufdq[NX];
+    int iter, line, n, k, i, ii, jj, j2, jndx, bufftop;
+
+    memset(zerofbuf, 0, sizeof(zerofbuf));
+    memset(zerosbuf, 0, sizeof(zerosbuf));
+    for (k = 0; k < NIMGS; k++) {
+        mask[k] = allocShortBuff(buffheight, NX);
+        pic[k] = allocFloatBuff(buffheight, NX);
+        thresh[k] = allocFloatBuff(buffheight, NX);
+        spthresh[k] = allocFloatBuff(buffheight, NX);
+    }
+
+    for (iter = 0; iter < NITER; iter++) {
+        const float sig2 = SQ(sigmas[iter]);
+
+        if (iter > 0) {
+            memset(r->efacsum, 0, sizeof(r->efacsum));
+            r->nrej = 0;
+            for (k = 0; k < NIMGS; k++) {
+                for (j2 = 0; j2 < buffheight; j2++) {
+                    memcpy(mask[k][j2], zerosbuf, sizeof(zerosbuf));
+                }
+            }
+        }
+
+        for (line = 0; line < NY; line++) {
+            memcpy(sum, zerofbuf, sizeof(sum));
+            memcpy(sumvar, zerofbuf, sizeof(sumvar));
+
+            if (line > 0) {
+                bufftop = line + width;
+                for (k = 0; k < NIMGS; k++) {
+                    if (bufftop < NY) {
+                        getStackSciLine(stack, k, bufftop, buf);
+                        getStackDqLine(stack, k, bufftop, bufdq);
+                        for (i = 0; i < NX; i++) {
+                            buf[i] = (efac[k] > 0.) ? (buf[i] - skyval[k]) / efac[k] : 0.;
+                        }
+                    } else {
+                        memcpy(buf, zerofbuf, sizeof(buf));
+                        memcpy(bufdq, zerosbuf, sizeof(bufdq));
+                    }
+                    scrollShortBuff(bufdq, line, NY, buffheight, NX, mask[k], zerosbuf);
+                    scrollFloatBuff(buf, line, NY, buffheight, NX, pic[k], zerofbuf);
+                    scrollFloatBuff(buf, line, NY, buffheight, NX, thresh[k], zerofbuf);
+                    scrollFloatBuff(buf, line, NY, buffheight, NX, spthresh[k], zerofbuf);
+                }
+            } else {
+                for (k = 0; k < NIMGS; k++) {
+                    InitFloatSect(pic[k], buf, stack, getStackSciLine, k, line, width, NX);
+                    InitFloatSect(thresh[k], buf, stack, getStackSciLine, k, line, width, NX);
+                    InitFloatSect(spthresh[k], buf, stack, getStackSciLine, k, line, width, NX);
+                    InitShortSect(mask[k], bufdq, stack, k, line, width, NX);
+                    for (ii = 0; ii < buffheight; ii++) {
+                        for (i = 0; i < NX; i++) {
+                            pic[k][ii][i] = (efac[k] > 0.) ? (pic[k][ii][i] - skyval[k]) / efac[k] : 0.;
+                        }
+                    }
+                }
+            }
+
+            for (n = 0; n < NIMGS; n++) {
+                const float efacn = efac[n];
+                if (efacn <= 0.)
+                    continue;
+
+                memcpy(bufdq, mask[n][width], sizeof(bufdq));
+                for (i = 0; i < NX; i++) {
+                    float dum = Pix(r->ave, i, line)*efacn/1.f + skyval[n];
+                    float val = (dum > 0.) ? dum : 0.;
+                    float pixsky = (dum-skyval[n] > 0.) ? dum-skyval[n] : 0.;
+                    thresh[n][width][i] = sig2 *
+                        ((model->noise2 + val/model->gain2 + SQ(model->scale * pixsky))) / model->exp2[n];
+                    spthresh[n][width][i] = sig2 * ((model->noise2 + val/model->gain2)) / model->exp2[n];
+                }
+
+                for (i = 0; i < NX; i++) {
+                    if (((bufdq[i] & dqpat) != CRREJ_MASK_OK) && (bufdq[i] != CRREJ_MASK_SPILL)) {
+                        mask[n][width][i] = CRREJ_MASK_EXCLUDE;
+                    }
+                }
+
+                for (i = 0; i < NX; i++) {
+                    if (SQ(pic[n][width][i] - Pix(r->ave, i, line)) > thresh[n][width][i] &&
+                        mask[n][width][i] != CRREJ_MASK_EXCLUDE) {
+                        mask[n][width][i] = CRREJ_MASK_HIT;
+                        if (width == 0) continue;
+                        for (jj = 0; jj < buffheight; jj++) {
+                            jndx = line - width + jj;
+                            if (jndx < 0 || jndx >= NY) continue;
+                            j2 = SQ(width - jj);
+                            for (ii = i-width; ii <= i+width; ii++) {
+                                if ((float)(SQ(ii-i)+j2) > rej2) continue;
+                                if (ii >= NX || ii < 0) continue;
+                                if (SQ(pic[n][jj][ii] - Pix(r->ave, ii, jndx)) <= psig2*spthresh[n][jj][ii]) continue;
+                                if (mask[n][jj][ii] != CRREJ_MASK_HIT) {
+                                    mask[n][jj][ii] = CRREJ_MASK_SPILL;
+                                }
+                            }
+                        }
+                    }
+                }
+
+                for (i = 0; i < NX; i++) {
+                    if ((mask[n][width][i] & maskdq) == CRREJ_MASK_OK) {
+                        sum[i] += pic[n][width][i] * efacn;
+                        r->efacsum[line*NX + i] += efacn;
+                    }
+                }
+
+                if (iter == NITER-1) {
+                    for (i = 0; i < NX; i++) {
+                        if ((mask[n][width][i] & maskdq) == CRREJ_MASK_OK) {
+                            float dum = pic[n][width][i]*efacn + skyval[n];
+                            float val = (dum > 0.) ? dum : 0.;
+                            sumvar[i] += model->noise2 + val/model->gain2;
+                        }
+                    }
+                    for (i = 0; i < NX; i++) {
+                        short sval;
+                        bufdq[i] = bufdq[i] | DQPix(r->dq2, i, line);
+                        bufdq[i] = bufdq[i] & nocr;
+                        bufdq[i] = bufdq[i] & nospill;
+                        sval = bufdq[i] | DQPix(r->dq, i, line);
+                        if (mask[n][width][i] == CRREJ_MASK_HIT || mask[n][width][i] == CRREJ_MASK_SPILL) {
+                            bufdq[i] = bufdq[i] | CRFLAG;
+                            r->nrej++;
+                        } else
+                            sval = sval & nocr;
+                        DQSetPix(r->dq2, i, line, bufdq[i]);
+                        DQSetPix(r->dq, i, line, sval);
+                    }
+                    packBitRow(bitMaskRow(&r->crmask, n * NY + line), bufdq, NX, CRFLAG);
+                }
+            }
+
+            for (i = 0; i < NX; i++) {
+                const float pixexp = r->efacsum[line*NX + i];
+                if (pixexp > 0.) {
+                    Pix(r->ave, i, line) = (sum[i] / pixexp)/(1 + 0.f/pixexp);
+                    if (iter == NITER-1) {
+                        Pix(r->avevar, i, line) = sqrt(sumvar[i])/pixexp;
+                    }
+                } else if (iter == NITER-1) {
+                    Pix(r->ave, i, line) = -1.f;
+                    Pix(r->avevar, i, line) = -1.f;
+                }
+            }
+        }
+    }
+
+    for (k = 0; k < NIMGS; k++) {
+        freeFloatBuff(pic[k], buffheight);
+        freeFloatBuff(thresh[k], buffheight);
+        freeFloatBuff(spthresh[k], buffheight);
+        freeShortBuff(mask[k], buffheight);
+    }
+}
+
+/* Sky, flat field and noise, with cosmic rays of a few pixels and input DQ flags */
+static int setup_stack(ImageStack * stack, unsigned seed) {
+    const short dqvalues[] = {4, 32, 16, CRREJ_MASK_SPILL, 4 | 16, 512};
+    int i, j, k;
+
+    initImageStack(stack);
+    stack->nimgs = NIMGS;
+    stack->nx = NX;
+    stack->ny = NY;
+    stack->inMemory = True;
+    stack->sci = malloc((size_t)NIMGS*NX*NY * sizeof(*stack->sci));
+    stack->dq = calloc((size_t)NIMGS*NX*NY, sizeof(*stack->dq));
+    if (!stack->sci || !stack->dq) {
+        return OUT_OF_MEMORY;
+    }
+
+    srand(seed);
+    for (k = 0; k < NIMGS; k++) {
+        float * sci = stack->sci + (size_t)k*NX*NY;
+        short * dq = stack->dq + (size_t)k*NX*NY;
+        for (j = 0; j < NY; j++) {
+            for (i = 0; i < NX; i++) {
+                sci[j*NX + i] = skyval[k] + efac[k] * (200.f + 0.5f * i +
+                                8.f * (2.f * rand() / (float)RAND_MAX - 1.f));
+                if (rand() % 17 == 0) {
+                    dq[j*NX + i] = dqvalues[rand() % (sizeof(dqvalues) / sizeof(*dqvalues))];
+                }
+            }
+        }
+        /* Cosmic rays, some on flagged pixels, with fainter tails */
+        for (j = 0; j < 12; j++) {
+            const int x = rand() % NX, y = rand() % NY;
+            const float peak = 500.f + 3000.f * rand() / (float)RAND_MAX;
+            sci[y*NX + x] += peak;
+            if (x+1 < NX)
+                sci[y*NX + x+1] += 0.2f * peak;
+            if (y+1 < NY)
+                sci[(y+1)*NX + x] += 0.05f * peak;
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int compare_results(const RejResult * expected, const RejResult * got) {
+    int i, j;
+
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            float ea = Pix(expected->ave, i, j), ga = Pix(got->ave, i, j);
+            float ev = Pix(expected->avevar, i, j), gv = Pix(got->avevar, i, j);
+            if (memcmp(&ea, &ga, sizeof(ea)) != 0 || memcmp(&ev, &gv, sizeof(ev)) != 0) {
+                printf("ERROR: differs at row %d column %d: expected %.9g +- %.9g got %.9g +- %.9g\n",
+                       j, i, ea, ev, ga, gv);
+                return ERROR_RETURN;
+            }
+            if (DQPix(expected->dq, i, j) != DQPix(got->dq, i, j) ||
+                DQPix(expected->dq2, i, j) != DQPix(got->dq2, i, j)) {
+                printf("ERROR: DQ differs at row %d column %d: expected %d, %d got %d, %d\n", j, i,
+                       DQPix(expected->dq, i, j), DQPix(expected->dq2, i, j),
+                       DQPix(got->dq, i, j), DQPix(got->dq2, i, j));
+                return ERROR_RETURN;
+            }
+        }
+    }
+    for (j = 0; j < NIMGS * NY; j++) {
+        if (memcmp(bitMaskRow(&expected->crmask, j), bitMaskRow(&got->crmask, j),
+                   expected->crmask.nwords * sizeof(BitWord)) != 0) {
+            printf("ERROR: CR mask of image %d differs at row %d\n", j / NY, j % NY);
+            return ERROR_RETURN;
+        }
+    }
+    if (expected->nrej != got->nrej) {
+        printf("ERROR: %d pixels rejected, expected %d\n", got->nrej, expected->nrej);
+        return ERROR_RETURN;
+    }
+
+    return HSTCAL_OK;
+}
+
+static int rej_test_case(float radius, float thresh, float scale) {
+    ImageStack stack;
+    TestNoise model;
+    CRRejBands bands;
+    RejResult expected, got;
+    const float rej2 = SQ(radius);
+    const float psig2 = (thresh <= 0.) ? -1. : SQ(thresh);
+    float shadline[NX];
+    int iter, k, test_status = HSTCAL_OK;
+
+    printf("==== crrejBandIteration vs scrolling buffers (radius %g, thresh %g, scale %g) ====\n",
+           radius, thresh, scale);
+
+    initCRRejBands(&bands);
+    if (setup_stack(&stack, (unsigned)(100 * radius + 10 * thresh)) ||
+        setup_result(&expected, &stack) || setup_result(&got, &stack)) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    model.stack = &stack;
+    for (k = 0; k < NIMGS; k++) {
+        model.exp2[k] = SQ(efac[k]);
+    }
+    model.gain2 = 1.5f;
+    model.noise2 = 16.f;
+    model.scale = scale;
+    model.width = (int) ceil(radius);
+
+    reference_rej(&stack, &model, psig2, rej2, &expected);
+
+    memset(shadline, 0, sizeof(shadline));
+    if (allocCRRejBands(&bands, &stack, model.width, rej2)) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+    bands.efac = efac;
+    bands.dqpat = dqpat;
+    bands.maskdq = maskdq;
+    bands.crflag = CRFLAG;
+    bands.psig2 = psig2;
+    bands.fillval = -1.f;
+    bands.shadline = shadline;
+    bands.instrument.data = &model;
+    bands.instrument.thresholds = testThresholds;
+    bands.instrument.pixels = testPixels;
+    bands.instrument.addVariance = testAddVariance;
+    bands.instrument.variance = testVariance;
+
+    for (iter = 0; iter < NITER && !test_status; iter++) {
+        const Bool retest = (iter == 0 || sigmas[iter] != sigmas[iter-1]);
+        if (iter > 0) {
+            got.nrej = 0;
+        }
+        if ((test_status = crrejBandIteration(&bands, iter, NITER, SQ(sigmas[iter]), retest,
+                                              &got.ave, &got.avevar, got.efacsum, &got.dq,
+                                              &got.dq2, &got.nrej, &got.crmask))) {
+            printf("ERROR: crrejBandIteration failed with status %d\n", test_status);
+        }
+    }
+
+    if (!test_status) {
+        test_status = compare_results(&expected, &got);
+    }
+    if (!test_status && expected.nrej == 0) {
+        printf("ERROR: nothing was rejected\n");
+        test_status = ERROR_RETURN;
+    }
+
+cleanup:
+    freeCRRejBands(&bands);
+    free_result(&expected);
+    free_result(&got);
+    free(stack.sci);
+    free(stack.dq);
+
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+
+    test_status += rej_test_case(1.5f, 3.5f, 0.f);
+    /* No spill threshold, every pixel within the radius of a hit spills */
+    test_status += rej_test_case(2.1f, 0.f, 0.02f);
+    /* Hits only */
+    test_status += rej_test_case(0.f, 3.5f, 0.f);
+    test_status += rej_test_case(1.f, 5.f, 0.05f);
+
+    return test_status;
+}
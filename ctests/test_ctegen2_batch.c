@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "ctegen2.h"
+
+/* forwardModelBatch() must reproduce forwardModel() (materialised trap pixel map) and
+   forwardModelWithTrapCoeffs() bit for bit for every accepted case, and report rejected
+   cases through CTEForwardModelCase::status without touching their output.
+*/
+
+#define N_TRAPS 8
+#define CTE_LEN 30
+#define N_ROWS 96
+#define N_SCALE_COLUMNS 48
+
+typedef struct {
+    int nx;
+    int ny;
+    double scale_frac;
+    unsigned razColumnOffset;
+} TestGeometry;
+
+static int setup_cte_pars(CTEParamsFast *pars) {
+    int w, i;
+
+    initCTEParamsFast(pars, N_TRAPS, N_ROWS, N_SCALE_COLUMNS, N_SCALE_COLUMNS, 1);
+    if (allocateCTEParamsFast(pars)) {
+        return OUT_OF_MEMORY;
+    }
+    pars->cte_traps = N_TRAPS;
+    pars->cte_len = CTE_LEN;
+    pars->n_par = 3;
+
+    for (w = 0; w < N_TRAPS; w++) {
+        pars->wcol_data[w] = w + 1;
+        pars->qlevq_data[w] = 5. * (w + 1) * (w + 1);
+        pars->dpdew_data[w] = 1.;
+    }
+    for (i = 0; i < N_SCALE_COLUMNS; i++) {
+        pars->iz_data[i] = i;
+        pars->scale512[i] = 20. + (i % 7);
+        pars->scale1024[i] = 40. + (i % 5);
+        pars->scale1536[i] = 60. + (i % 3);
+        pars->scale2048[i] = 80. + (i % 11);
+    }
+
+    /* Trail profiles indexed [trap*CTE_LEN + transfer]. */
+    pars->rprof = malloc(sizeof(*pars->rprof));
+    pars->cprof = malloc(sizeof(*pars->cprof));
+    if (!pars->rprof || !pars->cprof) {
+        return OUT_OF_MEMORY;
+    }
+    initFloatHdrData(pars->rprof);
+    initFloatHdrData(pars->cprof);
+    if (allocFloatHdrData(pars->rprof, CTE_LEN, N_TRAPS, True) ||
+        allocFloatHdrData(pars->cprof, CTE_LEN, N_TRAPS, True)) {
+        return OUT_OF_MEMORY;
+    }
+    for (w = 0; w < N_TRAPS; w++) {
+        float total = 0.;
+        for (i = 0; i < CTE_LEN; i++) {
+            float decay = expf(-(i + 1) / (2.f + w));
+            total += decay;
+            pars->rprof->data.data[w*CTE_LEN + i] = decay;
+            pars->cprof->data.data[w*CTE_LEN + i] = total;
+        }
+        for (i = 0; i < CTE_LEN; i++) {
+            pars->rprof->data.data[w*CTE_LEN + i] /= total;
+            pars->cprof->data.data[w*CTE_LEN + i] = 1.f - pars->cprof->data.data[w*CTE_LEN + i] / total;
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int setup_image(SingleGroup *image, int nx, int ny, unsigned seed) {
+    int i, j;
+
+    initSingleGroup(image);
+    if (allocSingleGroup(image, nx, ny, True)) {
+        return OUT_OF_MEMORY;
+    }
+    image->sci.data.storageOrder = COLUMNMAJOR;
+    srand(seed);
+    for (j = 0; j < nx; j++) {
+        for (i = 0; i < ny; i++) {
+            float value = 20.f * rand() / (float)RAND_MAX;
+            if (rand() % 17 == 0) {
+                value += 3000.f * rand() / (float)RAND_MAX;
+            }
+            PixColumnMajor(image->sci.data, i, j) = value;
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int compare_images(const SingleGroup *expected, const SingleGroup *got, const char *what) {
+    int i, j;
+
+    for (j = 0; j < expected->sci.data.nx; j++) {
+        for (i = 0; i < expected->sci.data.ny; i++) {
+            float e = PixColumnMajor(expected->sci.data, i, j);
+            float g = PixColumnMajor(got->sci.data, i, j);
+            if (memcmp(&e, &g, sizeof(e)) != 0) {
+                printf("ERROR: %s differs at row %d column %d: expected %.9g got %.9g\n",
+                       what, i, j, e, g);
+                return ERROR_RETURN;
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+/* Runs forwardModel() and forwardModelWithTrapCoeffs() for one geometry and checks
+   the batch output of that case against both. */
+static int check_case(const CTEForwardModelCase *simCase, CTEParamsFast *ctePars) {
+    int test_status = HSTCAL_OK;
+    const int nx = simCase->input->sci.data.nx;
+    const int ny = simCase->input->sci.data.ny;
+    CTEParamsFast pars = *ctePars;
+    SingleGroup trapPixelMap, viaMap, viaCoeffs;
+    TrapColumnCoeffs trapCoeffs;
+
+    pars.scale_frac = simCase->scale_frac;
+    pars.razColumnOffset = simCase->razColumnOffset;
+
+    initSingleGroup(&trapPixelMap);
+    initSingleGroup(&viaMap);
+    initSingleGroup(&viaCoeffs);
+    initTrapColumnCoeffs(&trapCoeffs);
+    if (allocSingleGroup(&trapPixelMap, nx, ny, True) ||
+        allocSingleGroup(&viaMap, nx, ny, True) ||
+        allocSingleGroup(&viaCoeffs, nx, ny, True) ||
+        allocTrapColumnCoeffs(&trapCoeffs, nx, ny)) {
+        test_status = OUT_OF_MEMORY;
+    }
+
+    if (!test_status &&
+        (populateTrapPixelMap(&trapPixelMap, &pars) ||
+         forwardModel(simCase->input, &viaMap, &trapPixelMap, &pars))) {
+        printf("ERROR: forwardModel() failed\n");
+        test_status = ERROR_RETURN;
+    }
+    if (!test_status &&
+        (populateTrapColumnCoeffs(&trapCoeffs, &pars) ||
+         forwardModelWithTrapCoeffs(simCase->input, &viaCoeffs, &trapCoeffs, &pars))) {
+        printf("ERROR: forwardModelWithTrapCoeffs() failed\n");
+        test_status = ERROR_RETURN;
+    }
+    if (!test_status) {
+        test_status = compare_images(&viaMap, simCase->output, "batch vs forwardModel()");
+    }
+    if (!test_status) {
+        test_status = compare_images(&viaCoeffs, simCase->output, "batch vs forwardModelWithTrapCoeffs()");
+    }
+
+    freeTrapColumnCoeffs(&trapCoeffs);
+    freeSingleGroup(&viaCoeffs);
+    freeSingleGroup(&viaMap);
+    freeSingleGroup(&trapPixelMap);
+    return test_status;
+}
+
+static int batch_test_case() {
+    /* Cases 0 & 1 share a geometry and so a trap table, case 2 has its own,
+       case 3 is rejected for mismatched output dimensions. */
+    const TestGeometry geometry[] = {
+        {40, N_ROWS, 0.5, 0},
+        {40, N_ROWS, 1.3, 0},
+        {25, N_ROWS - 7, 0.8, 5},
+        {16, N_ROWS, 1.0, 0},
+    };
+    const unsigned nCases = sizeof(geometry) / sizeof(*geometry);
+    const unsigned rejected = 3;
+    SingleGroup input[4], output[4];
+    CTEForwardModelCase cases[4];
+    CTEParamsFast pars;
+    int test_status = HSTCAL_OK;
+    int ret;
+    unsigned k;
+
+    printf("==== forwardModelBatch (%u cases) ====\n", nCases);
+
+    for (k = 0; k < nCases; k++) {
+        initSingleGroup(&input[k]);
+        initSingleGroup(&output[k]);
+    }
+    if (setup_cte_pars(&pars)) {
+        test_status = OUT_OF_MEMORY;
+    }
+    for (k = 0; k < nCases && !test_status; k++) {
+        const int outNx = (k == rejected) ? geometry[k].nx + 1 : geometry[k].nx;
+        if (setup_image(&input[k], geometry[k].nx, geometry[k].ny, 17 + k) ||
+            allocSingleGroup(&output[k], outNx, geometry[k].ny, True)) {
+            test_status = OUT_OF_MEMORY;
+        }
+        cases[k].input = &input[k];
+        cases[k].output = &output[k];
+        cases[k].scale_frac = geometry[k].scale_frac;
+        cases[k].razColumnOffset = geometry[k].razColumnOffset;
+        cases[k].status = -1;
+    }
+
+    if (!test_status && (ret = forwardModelBatch(cases, 0, &pars)) != HSTCAL_OK) {
+        printf("ERROR: empty batch returned %d\n", ret);
+        test_status = ERROR_RETURN;
+    }
+    if (!test_status && (ret = forwardModelBatch(cases, nCases, &pars)) != HSTCAL_OK) {
+        printf("ERROR: forwardModelBatch() returned %d\n", ret);
+        test_status = ERROR_RETURN;
+    }
+
+    for (k = 0; k < nCases && !test_status; k++) {
+        if (k == rejected) {
+            int i;
+            if (cases[k].status != SIZE_MISMATCH) {
+                printf("ERROR: case %u status %d, expected SIZE_MISMATCH\n", k, cases[k].status);
+                test_status = ERROR_RETURN;
+            }
+            for (i = 0; i < output[k].sci.data.nx * output[k].sci.data.ny; i++) {
+                if (output[k].sci.data.data[i] != 0.f) {
+                    printf("ERROR: rejected case %u output was written\n", k);
+                    test_status = ERROR_RETURN;
+                    break;
+                }
+            }
+            continue;
+        }
+        if (cases[k].status != HSTCAL_OK) {
+            printf("ERROR: case %u status %d, expected HSTCAL_OK\n", k, cases[k].status);
+            test_status = ERROR_RETURN;
+        } else {
+            test_status = check_case(&cases[k], &pars);
+        }
+    }
+
+    for (k = 0; k < nCases; k++) {
+        freeSingleGroup(&output[k]);
+        freeSingleGroup(&input[k]);
+    }
+    freeCTEParamsFast(&pars);
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+
+    test_status += batch_test_case();
+
+    return test_status;
+}
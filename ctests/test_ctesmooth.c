@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "ctegen2.h"
+
+/* cteSmoothImage() must reproduce the previous implementation, which materialised
+   the adjustment and readnoise images and scaled the pixels in a separate pass, bit
+   for bit, both when it runs all 100 iterations and when it stops early.
+*/
+
+/* The previous cteSmoothImage(), serially */
+static int reference_smooth(const SingleGroup *input, SingleGroup *output, double ampReadNoise) {
+    const unsigned nRows = input->sci.data.ny;
+    const unsigned nColumns = input->sci.data.nx;
+    const float * obs_loc[3];
+    const float * rsz_loc[3];
+    SingleGroup adjustment, readNoise;
+    unsigned iter, i, j;
+
+    copySingleGroup(output, input, COLUMNMAJOR);
+    if (ampReadNoise < 0.1) {
+        return HSTCAL_OK;
+    }
+
+    initSingleGroup(&adjustment);
+    initSingleGroup(&readNoise);
+    if (allocSingleGroup(&adjustment, nColumns, nRows, False) ||
+        allocSingleGroup(&readNoise, nColumns, nRows, False)) {
+        freeSingleGroup(&adjustment);
+        freeSingleGroup(&readNoise);
+        return OUT_OF_MEMORY;
+    }
+    adjustment.sci.data.storageOrder = COLUMNMAJOR;
+    readNoise.sci.data.storageOrder = COLUMNMAJOR;
+
+    for (iter = 0; iter < 100; ++iter) {
+        double rms = 0, nrms = 0;
+
+        for (i = 0; i < nColumns; ++i) {
+            unsigned imid = i;
+            if (i == 0)
+                imid = 1;
+            else if (i == nColumns-1)
+                imid = nColumns-2;
+
+            obs_loc[0] = input->sci.data.data + (imid-1)*nRows;
+            obs_loc[1] = obs_loc[0] + nRows;
+            obs_loc[2] = obs_loc[1] + nRows;
+
+            rsz_loc[0] = output->sci.data.data + (imid-1)*nRows;
+            rsz_loc[1] = rsz_loc[0] + nRows;
+            rsz_loc[2] = rsz_loc[1] + nRows;
+
+            for (j = 0; j < nRows; ++j)
+                PixColumnMajor(adjustment.sci.data, j, i) = find_dadjFast(1+i-imid, j, nRows, obs_loc, rsz_loc, ampReadNoise);
+        }
+
+        for (i = 0; i < nColumns; ++i) {
+            for (j = 0; j < nRows; ++j) {
+                PixColumnMajor(output->sci.data, j, i) += (PixColumnMajor(adjustment.sci.data, j, i)*0.75);
+                PixColumnMajor(readNoise.sci.data, j, i) = (PixColumnMajor(input->sci.data, j, i) - PixColumnMajor(output->sci.data, j, i));
+            }
+        }
+
+        for (j = 0; j < nColumns; ++j) {
+            for (i = 0; i < nRows; ++i) {
+                if (fabs(PixColumnMajor(input->sci.data, i, j)) > 0.1 ||
+                    fabs(PixColumnMajor(output->sci.data, i, j)) > 0.1) {
+                    double tmp = PixColumnMajor(readNoise.sci.data, i, j);
+                    rms += tmp*tmp;
+                    ++nrms;
+                }
+            }
+        }
+
+        if ((ampReadNoise - sqrt(rms/nrms)) < 0.00001)
+            break;
+    }
+
+    freeSingleGroup(&adjustment);
+    freeSingleGroup(&readNoise);
+    return HSTCAL_OK;
+}
+
+/* Flat sky plus noise of the given rms, with a few stars and cosmic rays */
+static int setup_image(SingleGroup *image, int nx, int ny, float noise, unsigned seed) {
+    int i, j;
+
+    initSingleGroup(image);
+    if (allocSingleGroup(image, nx, ny, True)) {
+        return OUT_OF_MEMORY;
+    }
+    image->sci.data.storageOrder = COLUMNMAJOR;
+    srand(seed);
+    for (j = 0; j < nx; j++) {
+        for (i = 0; i < ny; i++) {
+            float value = 30.f + noise * (2.f * rand() / (float)RAND_MAX - 1.f);
+            if (rand() % 23 == 0) {
+                value += 2000.f * rand() / (float)RAND_MAX;
+            }
+            PixColumnMajor(image->sci.data, i, j) = value;
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int smooth_test_case(int nx, int ny, float noise, double readNoise) {
+    SingleGroup input, expected, got;
+    CTEParamsFast pars;
+    int i, j, test_status = HSTCAL_OK;
+
+    printf("==== cteSmoothImage vs previous implementation (%d x %d, noise %g, readnoise %g) ====\n",
+           nx, ny, noise, readNoise);
+
+    initCTEParamsFast(&pars, 0, ny, nx, 0, 1);
+    initSingleGroup(&expected);
+    initSingleGroup(&got);
+    if (setup_image(&input, nx, ny, noise, 17 * nx + ny) ||
+        allocSingleGroup(&expected, nx, ny, True) ||
+        allocSingleGroup(&got, nx, ny, True)) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+    expected.sci.data.storageOrder = COLUMNMAJOR;
+    got.sci.data.storageOrder = COLUMNMAJOR;
+
+    if ((test_status = reference_smooth(&input, &expected, readNoise))) {
+        goto cleanup;
+    }
+    if ((test_status = cteSmoothImage(&input, &got, &pars, readNoise))) {
+        printf("ERROR: cteSmoothImage failed with status %d\n", test_status);
+        goto cleanup;
+    }
+
+    for (j = 0; j < nx && !test_status; j++) {
+        for (i = 0; i < ny; i++) {
+            float e = PixColumnMajor(expected.sci.data, i, j);
+            float g = PixColumnMajor(got.sci.data, i, j);
+            if (memcmp(&e, &g, sizeof(e)) != 0) {
+                printf("ERROR: differs at row %d column %d: expected %.9g got %.9g\n", i, j, e, g);
+                test_status = ERROR_RETURN;
+                break;
+            }
+        }
+    }
+
+cleanup:
+    freeSingleGroup(&input);
+    freeSingleGroup(&expected);
+    freeSingleGroup(&got);
+
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+
+    /* Stops early, once the readnoise removed reaches the readnoise */
+    test_status += smooth_test_case(37, 53, 20.f, 4.);
+    /* Runs all 100 iterations */
+    test_status += smooth_test_case(64, 40, 3.f, 5.);
+    test_status += smooth_test_case(3, 2, 10.f, 4.);
+    /* Below 0.1 the image is only copied */
+    test_status += smooth_test_case(8, 8, 10.f, 0.05);
+
+    return test_status;
+}
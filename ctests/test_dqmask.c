@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "hstcal_dqmask.h"
+
+/* orDQMask() must flag exactly the pixels that the previous per-row loop, DQINormal()
+   of the instruments' doDQI, flagged for each run of the mask in turn, and so must
+   orDQRun(), for whole and fractional shifts and for runs partly or wholly off the
+   DQ array. A mask made from the rows of a bad pixel table must be that of the rows
+   its filter selects and adjusts. Also checks the mask cache.
+*/
+
+#define DQ_NX 61
+#define DQ_NY 47
+#define N_MASKS 200
+
+static const short flags[] = {4, 8, 16, 32, 256, 4 | 256, 1024};
+
+/* A random run about the DQ array, some of them partly or wholly off it and a few
+   that flag nothing. */
+static void random_run(DQMask *mask) {
+    const int axis = (rand() % 20 == 0) ? 3 : 1 + rand() % 2;
+    const int x = rand() % (DQ_NX + 40) - 20;
+    const int y = rand() % (DQ_NY + 40) - 20;
+    const int length = (rand() % 25 == 0) ? 0 : 1 + rand() % 30;
+    const short flag = (rand() % 25 == 0) ? 0 : flags[rand() % (sizeof(flags) / sizeof(*flags))];
+
+    addDQRun(mask, x, y, length, axis, flag);
+}
+
+typedef void (*ApplyRun)(const DQRun *, ShortTwoDArray *, const double ltv[2]);
+
+/* The previous DQINormal(), as in the instruments' doDQI */
+static void reference_dqinormal(const DQRun *tabrow, ShortTwoDArray *ydq, const double ltv[2]) {
+    int xstart, ystart;
+    int xlow, xhigh;
+    int ylow, yhigh;
+    int i, j;
+    short sum_dq;
+
+    xstart = tabrow->x + ltv[0];
+    ystart = tabrow->y + ltv[1];
+
+    if (tabrow->axis == 1) {
+        xlow = xstart;
+        xhigh = xstart + tabrow->length - 1;
+        if (xhigh < 0 || xlow >= ydq->nx || ystart < 0 || ystart >= ydq->ny)
+            return;
+        if (xlow < 0)
+            xlow = 0;
+        if (xhigh >= ydq->nx)
+            xhigh = ydq->nx - 1;
+        j = ystart;
+        for (i = xlow; i <= xhigh; i++) {
+            sum_dq = tabrow->flag | PDQPix(ydq, i, j);
+            PDQSetPix(ydq, i, j, sum_dq);
+        }
+    } else if (tabrow->axis == 2) {
+        ylow = ystart;
+        yhigh = ystart + tabrow->length - 1;
+        if (xstart < 0 || xstart >= ydq->nx || yhigh < 0 || ylow >= ydq->ny)
+            return;
+        if (ylow < 0)
+            ylow = 0;
+        if (yhigh >= ydq->ny)
+            yhigh = ydq->ny - 1;
+        i = xstart;
+        for (j = ylow; j <= yhigh; j++) {
+            sum_dq = tabrow->flag | PDQPix(ydq, i, j);
+            PDQSetPix(ydq, i, j, sum_dq);
+        }
+    }
+}
+
+static void fill_dq(ShortTwoDArray *dq, unsigned seed) {
+    int i, j;
+
+    for (j = 0; j < dq->ny; j++) {
+        for (i = 0; i < dq->nx; i++) {
+            PDQPix(dq, i, j) = ((7 * i + 13 * j + seed) % 10 == 0) ? 2 : 0;
+        }
+    }
+}
+
+static int compare_rows(const ShortTwoDArray *expected, const ShortTwoDArray *got,
+        int m, const double ltv[2]) {
+    int i, j;
+
+    for (j = 0; j < expected->ny; j++) {
+        for (i = 0; i < expected->nx; i++) {
+            if (PDQPix(expected, i, j) != PDQPix(got, i, j)) {
+                printf("ERROR: mask %d ltv (%g, %g) differs at row %d column %d: "
+                       "expected %d got %d\n", m, ltv[0], ltv[1], j, i,
+                       PDQPix(expected, i, j), PDQPix(got, i, j));
+                return ERROR_RETURN;
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+/* Applies one mask with each shift, both as a whole and run by run. */
+static int apply_test_case(DQMask *mask, int m, ApplyRun applyRun, ShortTwoDArray *viaRuns,
+        ShortTwoDArray *viaMask) {
+    const double shifts[][2] = {
+        {0., 0.}, {3., -5.}, {-7., 12.}, {-40., 0.}, {0., 60.}, {-100., -100.},
+        {0.5, -0.5}, {2.7, -3.2}, {-0.3, 0.3}, {-19.9, 19.9}
+    };
+    int s, k, test_status = HSTCAL_OK;
+
+    for (s = 0; s < (int)(sizeof(shifts) / sizeof(*shifts)) && !test_status; s++) {
+        const unsigned seed = 1000 * m + s;
+        fill_dq(viaRuns, seed);
+        fill_dq(viaMask, seed);
+        for (k = 0; k < mask->nruns; k++) {
+            applyRun(&mask->runs[k], viaRuns, shifts[s]);
+        }
+        orDQMask(mask, viaMask, shifts[s]);
+        test_status = compare_rows(viaRuns, viaMask, m, shifts[s]);
+    }
+
+    return test_status;
+}
+
+static int mask_test_case(const char *name, ApplyRun applyRun) {
+    ShortTwoDArray viaRuns, viaMask;
+    DQMask mask;
+    int m, k, nruns, test_status = HSTCAL_OK;
+
+    printf("==== orDQMask vs %s (%d masks) ====\n", name, N_MASKS + 1);
+
+    initShortData(&viaRuns);
+    initShortData(&viaMask);
+    if (allocShortData(&viaRuns, DQ_NX, DQ_NY, True) ||
+        allocShortData(&viaMask, DQ_NX, DQ_NY, True)) {
+        freeShortData(&viaRuns);
+        freeShortData(&viaMask);
+        return OUT_OF_MEMORY;
+    }
+
+    srand(4321);
+    for (m = 0; m < N_MASKS && !test_status; m++) {
+        initDQMask(&mask);
+        nruns = (m == 0) ? 0 : rand() % 150;
+        for (k = 0; k < nruns; k++) {
+            random_run(&mask);
+        }
+        if (compileDQMask(&mask)) {
+            test_status = OUT_OF_MEMORY;
+        } else if (nruns && !mask.spans) {
+            printf("ERROR: mask %d was not rasterised\n", m);
+            test_status = ERROR_RETURN;
+        } else {
+            test_status = apply_test_case(&mask, m, applyRun, &viaRuns, &viaMask);
+        }
+        freeDQMask(&mask);
+    }
+
+    /* A bounding box too large to rasterise, applied run by run */
+    if (!test_status) {
+        initDQMask(&mask);
+        addDQRun(&mask, 5, 5, 20, 1, 16);
+        addDQRun(&mask, 40, -10, 30, 2, 32);
+        addDQRun(&mask, 100000, 100000, 10, 1, 64);
+        if (compileDQMask(&mask)) {
+            test_status = OUT_OF_MEMORY;
+        } else if (mask.spans) {
+            printf("ERROR: a mask over %d x %d pixels was rasterised\n", 100000, 100000);
+            test_status = ERROR_RETURN;
+        } else {
+            test_status = apply_test_case(&mask, N_MASKS, applyRun, &viaRuns, &viaMask);
+        }
+        freeDQMask(&mask);
+    }
+
+    freeShortData(&viaRuns);
+    freeShortData(&viaMask);
+    return test_status;
+}
+
+/* Selects the rows of chip 1 or of any chip, and moves those right of column 30
+   as ToWF3RawCoords() does for four-amp readouts. */
+static Bool select_row(const BpixTable *bpix, BpixRow *row, const void *selection) {
+    const int chip = *(const int *)selection;
+
+    if (row->chip != chip && row->chip != -999)
+        return False;
+    if (row->run.x >= 30)
+        row->run.x += 8;
+    return True;
+}
+
+static int bpix_test_case() {
+    const double ltv[2] = {-2., 3.};
+    const int chip = 1;
+    BpixTable bpix = {NULL, 0, 0, False, False, False, 0, NULL};
+    BpixRow rows[300], copy[300];
+    ShortTwoDArray expected, got;
+    DQMask *mask;
+    int r, test_status = HSTCAL_OK;
+
+    printf("==== makeBpixMask vs DQINormal of the selected rows ====\n");
+
+    initShortData(&expected);
+    initShortData(&got);
+    if (allocShortData(&expected, DQ_NX, DQ_NY, True) ||
+        allocShortData(&got, DQ_NX, DQ_NY, True)) {
+        freeShortData(&expected);
+        freeShortData(&got);
+        return OUT_OF_MEMORY;
+    }
+    fill_dq(&expected, 7);
+    fill_dq(&got, 7);
+
+    srand(99);
+    memset(rows, 0, sizeof(rows));
+    for (r = 0; r < 300; r++) {
+        rows[r].run.axis = 1 + rand() % 2;
+        rows[r].run.x = rand() % (DQ_NX + 20) - 10;
+        rows[r].run.y = rand() % (DQ_NY + 20) - 10;
+        rows[r].run.length = 1 + rand() % 20;
+        rows[r].run.flag = flags[rand() % (sizeof(flags) / sizeof(*flags))];
+        rows[r].chip = (rand() % 5 == 0) ? -999 : 1 + rand() % 2;
+    }
+    memcpy(copy, rows, sizeof(rows));
+    bpix.nrows = 300;
+    bpix.rows = rows;
+
+    /* The rows the filter selects, adjusted as it does, in table order */
+    for (r = 0; r < bpix.nrows; r++) {
+        BpixRow row = rows[r];
+        if (select_row(&bpix, &row, &chip))
+            reference_dqinormal(&row.run, &expected, ltv);
+    }
+
+    if (makeBpixMask(&bpix, "bpix test", select_row, &chip, &mask)) {
+        test_status = OUT_OF_MEMORY;
+    } else if (findDQMask("bpix test") != mask) {
+        printf("ERROR: the mask was not cached by its key\n");
+        test_status = ERROR_RETURN;
+    } else {
+        orDQMask(mask, &got, ltv);
+        test_status = compare_rows(&expected, &got, 0, ltv);
+    }
+    if (!test_status && memcmp(copy, rows, sizeof(rows)) != 0) {
+        printf("ERROR: the table rows were modified\n");
+        test_status = ERROR_RETURN;
+    }
+
+    clearDQMaskCache();
+    freeShortData(&expected);
+    freeShortData(&got);
+    return test_status;
+}
+
+static int cache_test_case() {
+    char key[16];
+    DQMask *first, *mask;
+    int i;
+
+    printf("==== findDQMask, newDQMask, clearDQMaskCache ====\n");
+
+    if (!(first = newDQMask("bpix 0"))) {
+        return OUT_OF_MEMORY;
+    }
+    if (addDQRun(first, 1, 2, 3, 1, 4) || findDQMask("bpix 0") != first ||
+        findDQMask("bpix") != NULL) {
+        printf("ERROR: cached mask not found by its key\n");
+        return ERROR_RETURN;
+    }
+
+    /* Keep "bpix 0" in use while filling the cache, so another one is replaced */
+    for (i = 1; i <= 20; i++) {
+        sprintf(key, "bpix %d", i);
+        if (!newDQMask(key) || findDQMask("bpix 0") != first) {
+            printf("ERROR: the most recently used mask was replaced at %d\n", i);
+            return ERROR_RETURN;
+        }
+    }
+    if (findDQMask("bpix 1") != NULL || findDQMask("bpix 20") == NULL ||
+        first->nruns != 1) {
+        printf("ERROR: the least recently used masks were not replaced\n");
+        return ERROR_RETURN;
+    }
+
+    clearDQMaskCache();
+    if (findDQMask("bpix 0") != NULL || findDQMask("bpix 20") != NULL ||
+        first->key != NULL || first->runs != NULL) {
+        printf("ERROR: masks left after clearDQMaskCache()\n");
+        return ERROR_RETURN;
+    }
+
+    /* The cache can be filled again */
+    mask = newDQMask("bpix 0");
+    if (!mask || findDQMask("bpix 0") != mask) {
+        printf("ERROR: cache not usable after clearDQMaskCache()\n");
+        return ERROR_RETURN;
+    }
+    clearDQMaskCache();
+
+    return HSTCAL_OK;
+}
+
+int main(void) {
+    int test_status=0;
+
+    test_status += mask_test_case("DQINormal", reference_dqinormal);
+    test_status += mask_test_case("orDQRun", orDQRun);
+    test_status += bpix_test_case();
+    test_status += cache_test_case();
+
+    return test_status;
+}
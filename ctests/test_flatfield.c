@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "wf3dq.h"
+#include "hstcal_flatfield.h"
+
+/* Dividing an image by several flats with divFlatFields() must give the same
+   science, error and data quality arrays as dividing it by each flat in turn with
+   div1d(), line by line, bit for bit. That includes flats with zeros, images large
+   enough to be divided in parallel, and a flat of the wrong size, which must leave
+   the image unchanged. Also checks that the flat cache keeps to its memory budget
+   and never replaces the two most recently used flats.
+*/
+
+#define MAX_FLATS 3
+
+int div1d (SingleGroup *, int, SingleGroupLine *);
+
+static void setup_image(SingleGroup *x, unsigned seed) {
+    int i, j;
+
+    srand(seed);
+    for (j = 0; j < x->sci.data.ny; j++) {
+        for (i = 0; i < x->sci.data.nx; i++) {
+            Pix(x->sci.data, i, j) = (rand() % 5000 - 100) / 7.f;
+            Pix(x->err.data, i, j) = rand() % 300 / 11.f;
+            DQSetPix(x->dq.data, i, j, (rand() % 6 == 0) ? 1 << (rand() % 14) : 0);
+        }
+    }
+}
+
+static void setup_flat(FlatField *flat, unsigned seed) {
+    size_t k;
+
+    srand(seed);
+    for (k = 0; k < (size_t)flat->nx * flat->ny; k++) {
+        flat->sci[k] = (rand() % 50 == 0) ? 0.f : 0.5f + rand() / (float)RAND_MAX;
+        flat->err[k] = rand() / (float)RAND_MAX / 100.f;
+        flat->dq[k] = (rand() % 9 == 0) ? 1 << (rand() % 14) : 0;
+    }
+}
+
+/* The previous doFlat(): each flat divided into x line by line with div1d() */
+static int reference_divide(SingleGroup *x, FlatField **flats, int nflats) {
+    SingleGroupLine line;
+    int j, k, status = HSTCAL_OK;
+
+    initSingleGroupLine(&line);
+    if (allocSingleGroupLine(&line, x->sci.data.nx)) {
+        return OUT_OF_MEMORY;
+    }
+    for (k = 0; k < nflats && !status; k++) {
+        for (j = 0; j < x->sci.data.ny && !status; j++) {
+            const size_t row = (size_t)j * flats[k]->nx;
+            memcpy(line.sci.line, flats[k]->sci + row, flats[k]->nx * sizeof(float));
+            memcpy(line.err.line, flats[k]->err + row, flats[k]->nx * sizeof(float));
+            memcpy(line.dq.line, flats[k]->dq + row, flats[k]->nx * sizeof(short));
+            status = div1d(x, j, &line);
+        }
+    }
+    freeSingleGroupLine(&line);
+    return status;
+}
+
+static int same_image(const SingleGroup *expected, const SingleGroup *got) {
+    const size_t npix = (size_t)expected->sci.data.nx * expected->sci.data.ny;
+
+    if (memcmp(expected->sci.data.data, got->sci.data.data, npix * sizeof(float)) != 0) {
+        printf("ERROR: the science arrays differ\n");
+        return ERROR_RETURN;
+    }
+    if (memcmp(expected->err.data.data, got->err.data.data, npix * sizeof(float)) != 0) {
+        printf("ERROR: the error arrays differ\n");
+        return ERROR_RETURN;
+    }
+    if (memcmp(expected->dq.data.data, got->dq.data.data, npix * sizeof(short)) != 0) {
+        printf("ERROR: the data quality arrays differ\n");
+        return ERROR_RETURN;
+    }
+    return HSTCAL_OK;
+}
+
+static int divide_test_case(int nx, int ny, int nflats) {
+    FlatField flatData[MAX_FLATS];
+    FlatField *flats[MAX_FLATS];
+    SingleGroup expected, got;
+    int k, test_status = HSTCAL_OK;
+
+    printf("==== divFlatFields vs div1d (%d x %d, %d flats) ====\n", nx, ny, nflats);
+
+    initSingleGroup(&expected);
+    initSingleGroup(&got);
+    for (k = 0; k < nflats; k++) {
+        initFlatField(&flatData[k]);
+        flats[k] = &flatData[k];
+    }
+    if (allocSingleGroup(&expected, nx, ny, True) || allocSingleGroup(&got, nx, ny, True)) {
+        test_status = OUT_OF_MEMORY;
+    }
+    for (k = 0; k < nflats && !test_status; k++) {
+        flats[k]->nx = nx;
+        flats[k]->ny = ny;
+        flats[k]->sci = malloc((size_t)nx * ny * sizeof(float));
+        flats[k]->err = malloc((size_t)nx * ny * sizeof(float));
+        flats[k]->dq = malloc((size_t)nx * ny * sizeof(short));
+        if (!flats[k]->sci || !flats[k]->err || !flats[k]->dq) {
+            test_status = OUT_OF_MEMORY;
+        } else {
+            setup_flat(flats[k], 17 * nx + k);
+        }
+    }
+
+    if (!test_status) {
+        setup_image(&expected, nx + ny);
+        setup_image(&got, nx + ny);
+        if (reference_divide(&expected, flats, nflats)) {
+            printf("ERROR: div1d failed\n");
+            test_status = ERROR_RETURN;
+        } else if (divFlatFields(&got, flats, nflats, BADFLAT)) {
+            printf("ERROR: divFlatFields failed\n");
+            test_status = ERROR_RETURN;
+        } else {
+            test_status = same_image(&expected, &got);
+        }
+    }
+
+    /* A flat one column or one row short is refused before anything is divided */
+    for (k = 0; k < 2 && !test_status && nflats > 1; k++) {
+        FlatField *last = flats[nflats - 1];
+        setup_image(&expected, nx + ny);
+        setup_image(&got, nx + ny);
+        if (k == 0)
+            last->nx--;
+        else
+            last->ny--;
+        if (divFlatFields(&got, flats, nflats, BADFLAT) != SIZE_MISMATCH) {
+            printf("ERROR: a flat of %d x %d was accepted\n", last->nx, last->ny);
+            test_status = ERROR_RETURN;
+        } else {
+            test_status = same_image(&expected, &got);
+        }
+        last->nx = nx;
+        last->ny = ny;
+    }
+
+    for (k = 0; k < nflats; k++) {
+        freeFlatField(&flatData[k]);
+    }
+    freeSingleGroup(&expected);
+    freeSingleGroup(&got);
+    return test_status;
+}
+
+static int cache_test_case(void) {
+    /* 100 MB each, so that only two fit in the budget */
+    const int big = 3163;
+    char key[16];
+    FlatField *first, *second, *flat;
+    int i;
+
+    printf("==== newFlatField, findFlatField, clearFlatFieldCache ====\n");
+
+    /* Small flats: the least recently used of four is replaced */
+    for (i = 0; i < 4; i++) {
+        sprintf(key, "small %d", i);
+        if (!newFlatField(key, 10, 10)) {
+            return OUT_OF_MEMORY;
+        }
+    }
+    if (!findFlatField("small 0") || !newFlatField("small 4", 10, 10)) {
+        return OUT_OF_MEMORY;
+    }
+    if (!findFlatField("small 0") || findFlatField("small 1") ||
+        !findFlatField("small 2") || !findFlatField("small 4")) {
+        printf("ERROR: the least recently used small flat was not the one replaced\n");
+        return ERROR_RETURN;
+    }
+    clearFlatFieldCache();
+
+    /* Large flats: replaced to keep to the budget, even with slots free */
+    if (!(first = newFlatField("big 0", big, big)) ||
+        !newFlatField("small", 10, 10) ||
+        !(second = newFlatField("big 1", big, big))) {
+        return OUT_OF_MEMORY;
+    }
+    if (findFlatField("big 0") != first || !findFlatField("small") ||
+        findFlatField("big 1") != second) {
+        printf("ERROR: large flats within the budget were replaced\n");
+        return ERROR_RETURN;
+    }
+    if (!(flat = newFlatField("big 2", big, big))) {
+        return OUT_OF_MEMORY;
+    }
+    if (findFlatField("big 0") || !findFlatField("small") ||
+        findFlatField("big 1") != second || findFlatField("big 2") != flat) {
+        printf("ERROR: the cache was not kept to its budget\n");
+        return ERROR_RETURN;
+    }
+
+    /* A flat over the budget by itself still leaves the two most recent */
+    if (!(flat = newFlatField("huge", 2 * big, 2 * big))) {
+        return OUT_OF_MEMORY;
+    }
+    if (findFlatField("small") || findFlatField("big 1") != second ||
+        !findFlatField("big 2") || findFlatField("huge") != flat) {
+        printf("ERROR: the two most recently used flats were replaced\n");
+        return ERROR_RETURN;
+    }
+
+    clearFlatFieldCache();
+    if (findFlatField("big 1") || findFlatField("huge") || second->key || second->sci) {
+        printf("ERROR: flats left after clearFlatFieldCache()\n");
+        return ERROR_RETURN;
+    }
+
+    return HSTCAL_OK;
+}
+
+int main(void) {
+    int test_status=0;
+
+    test_status += divide_test_case(17, 9, 1);
+    test_status += divide_test_case(33, 20, 2);
+    /* Large enough to be divided in parallel */
+    test_status += divide_test_case(400, 250, 3);
+    test_status += cache_test_case();
+
+    return test_status;
+}
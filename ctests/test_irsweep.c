@@ -0,0 +1,459 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "hstcal.h"
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "wf3.h"
+#include "wf3info.h"
+#include "irsweep.h"
+
+/* Sweeping the IR reads once (doSweepIR) must give the same groups, exposure
+   times and units as the previous ZOFFCORR, NOISCORR and UNITCORR steps, which
+   went through all groups one step after the other, including when the noise
+   calculation stops at an ERR array populated before and when some groups are
+   already in countrates. NLINCORR and DARKCORR read their reference files and
+   are left out of the sweep; darkRow() and darkMean() must make and subtract the
+   same dark as the previous DARKCORR, which interpolated or extrapolated whole
+   dark images and took MEANDARK from stats().
+*/
+
+#define NX 41
+#define NY 23
+#define NGROUPS 6
+#define T0 2.9f
+#define DT 25.f
+#define ZTIME 1.5
+
+/* The previous zoffcorr(), noiscalc() and unitcorr() */
+static void reference_zoffcorr(WF3Info *wf3, SingleNicmosGroup *input, SingleNicmosGroup *zoff) {
+    int i, j;
+
+    for (j = 0; j < input->sci.data.ny; j++) {
+        for (i = 0; i < input->sci.data.nx; i++) {
+            Pix(input->sci.data, i, j) -= Pix(zoff->sci.data, i, j);
+            DQSetPix(input->dq.data, i, j, DQPix(input->dq.data, i, j) | DQPix(zoff->dq.data, i, j));
+            Pix(input->intg.data, i, j) -= Pix(zoff->intg.data, i, j);
+        }
+    }
+    wf3->exptime[wf3->group-1] -= ZTIME;
+}
+
+static void reference_noise(WF3Info *wf3, SingleNicmosGroup *input, int amp, int ibeg, int iend, int jbeg, int jend) {
+    const float gain = wf3->atodgain[amp];
+    const float rn2 = wf3->readnoise[amp] * wf3->readnoise[amp];
+    int i, j;
+
+    for (j = jbeg; j < jend; j++) {
+        for (i = ibeg; i < iend; i++) {
+            float signal = Pix(input->sci.data, i, j);
+            float noise = sqrt(rn2 + fabs(signal * gain));
+            Pix(input->err.data, i, j) = noise / gain;
+        }
+    }
+}
+
+static int reference_noiscalc(WF3Info *wf3, SingleNicmosGroup *input) {
+    const int ibeg = wf3->trimx[0], iend = input->err.data.nx - wf3->trimx[1];
+    const int jbeg = wf3->trimy[0], jend = input->err.data.ny - wf3->trimy[1];
+    const int ampx = wf3->ampx + wf3->offsetx - wf3->trimx[0];
+    const int ampy = wf3->ampy + wf3->offsety - wf3->trimy[0];
+    int i, j;
+
+    for (j = jbeg; j < jend; j++) {
+        for (i = ibeg; i < iend; i++) {
+            if (Pix(input->err.data, i, j) != 0.) {
+                return 1;
+            }
+        }
+    }
+
+    reference_noise(wf3, input, 1, ibeg, ampx, jbeg, ampy);
+    reference_noise(wf3, input, 2, ampx, iend, jbeg, ampy);
+    reference_noise(wf3, input, 0, ibeg, ampx, ampy, jend);
+    reference_noise(wf3, input, 3, ampx, iend, ampy, jend);
+    return 0;
+}
+
+static int reference_unitcorr(WF3Info *wf3, SingleNicmosGroup *input) {
+    int PutKeyStr (Hdr *, char *, char *, char *);
+    const int ibeg = wf3->trimx[0], iend = input->sci.data.nx - wf3->trimx[1];
+    const int jbeg = wf3->trimy[0], jend = input->sci.data.ny - wf3->trimy[1];
+    float time;
+    int i, j;
+
+    if (wf3->bunit[wf3->group-1] == COUNTRATE) {
+        return 0;
+    }
+    if (wf3->group == wf3->ngroups) {
+        time = 1.0 / wf3->sampzero;
+        for (j = jbeg; j < jend; j++) {
+            for (i = ibeg; i < iend; i++) {
+                Pix(input->sci.data, i, j) *= time;
+                Pix(input->err.data, i, j) *= time;
+            }
+        }
+    } else {
+        for (j = jbeg; j < jend; j++) {
+            for (i = ibeg; i < iend; i++) {
+                time = Pix(input->intg.data, i, j);
+                if (time != 0) {
+                    Pix(input->sci.data, i, j) /= time;
+                    Pix(input->err.data, i, j) /= time;
+                } else {
+                    Pix(input->sci.data, i, j) = 0.0;
+                    Pix(input->err.data, i, j) = 0.0;
+                }
+            }
+        }
+    }
+    if (PutKeyStr(&input->sci.hdr, "BUNIT", "COUNTS/S", "") ||
+        PutKeyStr(&input->err.hdr, "BUNIT", "COUNTS/S", "")) {
+        return OUT_OF_MEMORY;
+    }
+    wf3->bunit[wf3->group-1] = COUNTRATE;
+    return 0;
+}
+
+/* The steps in pipeline order, each through all groups */
+static int reference_steps(WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *zoff) {
+    if (wf3->zoffcorr == PERFORM) {
+        for (wf3->group = wf3->ngroups; wf3->group >= 1; wf3->group--) {
+            reference_zoffcorr(wf3, &input->group[wf3->group-1], zoff);
+        }
+    }
+    if (wf3->noiscorr == PERFORM) {
+        for (wf3->group = wf3->ngroups; wf3->group >= 1; wf3->group--) {
+            if (reference_noiscalc(wf3, &input->group[wf3->group-1])) {
+                break;
+            }
+        }
+    }
+    if (wf3->unitcorr == PERFORM) {
+        for (wf3->group = wf3->ngroups; wf3->group >= 1; wf3->group--) {
+            if (reference_unitcorr(wf3, &input->group[wf3->group-1])) {
+                return OUT_OF_MEMORY;
+            }
+        }
+    }
+    return HSTCAL_OK;
+}
+
+/* Group g is read NGROUPS-1-g reads after the zeroth read; the ERR array of
+   group errGroup (1-based, 0 for none) has been populated before and the groups
+   from rateGroup (1-based, 0 for none) down are already in countrates. The
+   zeroth read image is made too when zoff is given. */
+static int setup_stack(MultiNicmosGroup *input, SingleNicmosGroup *zoff, int errGroup, int rateGroup) {
+    int g, i, j;
+
+    if (allocMultiNicmosGroup(input, NGROUPS)) {
+        return OUT_OF_MEMORY;
+    }
+    for (g = 0; g < NGROUPS; g++) {
+        if (allocSingleNicmosGroup(&input->group[g], NX, NY)) {
+            return OUT_OF_MEMORY;
+        }
+    }
+    if (zoff && (allocSingleNicmosGroup(zoff, NX, NY) ||
+                 addDoubleKw(&zoff->sci.hdr, "SAMPTIME", ZTIME, ""))) {
+        return OUT_OF_MEMORY;
+    }
+
+    srand(NX * errGroup + rateGroup);
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            const float rate = 20.f * rand() / (float)RAND_MAX - 1.f;
+            const float bias = 100.f * rand() / (float)RAND_MAX;
+            const short zdq = (rand() % 17 == 0) ? 8 : 0;
+
+            if (zoff) {
+                Pix(zoff->sci.data, i, j) = bias + rate * T0;
+                Pix(zoff->intg.data, i, j) = T0;
+                DQSetPix(zoff->dq.data, i, j, zdq);
+            }
+            for (g = 0; g < NGROUPS; g++) {
+                SingleNicmosGroup *group = &input->group[g];
+                const float t = T0 + (NGROUPS - 1 - g) * DT;
+
+                Pix(group->sci.data, i, j) = bias + rate * t + 3.f * rand() / (float)RAND_MAX;
+                Pix(group->err.data, i, j) = (g + 1 == errGroup) ? 7.f : 0.f;
+                DQSetPix(group->dq.data, i, j, (rand() % 13 == 0) ? 4 : 0);
+                /* A few pixels are read at the same time as in the zeroth read */
+                Pix(group->intg.data, i, j) = (rand() % 29 == 0) ? T0 : t;
+                Pix(group->smpl.data, i, j) = 1;
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static void setup_wf3(WF3Info *wf3, int zoffcorr, int rateGroup) {
+    void WF3Init (WF3Info *);
+    int g;
+
+    WF3Init(wf3);
+    wf3->ngroups = NGROUPS;
+    wf3->zoffcorr = zoffcorr;
+    wf3->noiscorr = PERFORM;
+    wf3->nlincorr = OMIT;
+    wf3->darkcorr = OMIT;
+    wf3->unitcorr = PERFORM;
+    wf3->flatcorr = OMIT;
+    wf3->sampzero = T0;
+    wf3->trimx[0] = 5;
+    wf3->trimx[1] = 5;
+    wf3->trimy[0] = 5;
+    wf3->trimy[1] = 5;
+    /* Amp boundaries away from the middle */
+    wf3->ampx = 14;
+    wf3->ampy = 9;
+    for (g = 0; g < NAMPS; g++) {
+        wf3->atodgain[g] = 2.2f + 0.1f * g;
+        wf3->readnoise[g] = 18.f + g;
+    }
+    for (g = 0; g < NGROUPS; g++) {
+        wf3->exptime[g] = T0 + (NGROUPS - 1 - g) * DT;
+        wf3->bunit[g] = (rateGroup && g + 1 <= rateGroup) ? COUNTRATE : COUNTS;
+    }
+}
+
+static int same_float(float e, float g) {
+    return memcmp(&e, &g, sizeof(e)) == 0;
+}
+
+static int compare_group(const SingleNicmosGroup *e, const SingleNicmosGroup *o, int g) {
+    int i, j;
+
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            if (!same_float(Pix(e->sci.data, i, j), Pix(o->sci.data, i, j)) ||
+                !same_float(Pix(e->err.data, i, j), Pix(o->err.data, i, j)) ||
+                !same_float(Pix(e->intg.data, i, j), Pix(o->intg.data, i, j)) ||
+                DQPix(e->dq.data, i, j) != DQPix(o->dq.data, i, j)) {
+                printf("ERROR: group %d differs at row %d column %d: expected %.9g +- %.9g "
+                       "(dq %d, %g s) got %.9g +- %.9g (dq %d, %g s)\n", g, j, i,
+                       Pix(e->sci.data, i, j), Pix(e->err.data, i, j), DQPix(e->dq.data, i, j),
+                       Pix(e->intg.data, i, j), Pix(o->sci.data, i, j), Pix(o->err.data, i, j),
+                       DQPix(o->dq.data, i, j), Pix(o->intg.data, i, j));
+                return ERROR_RETURN;
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int compare_stacks(const WF3Info *expWf3, const MultiNicmosGroup *expected,
+        const WF3Info *gotWf3, const MultiNicmosGroup *got) {
+    char expUnit[CHAR_LINE_LENGTH+1], gotUnit[CHAR_LINE_LENGTH+1];
+    int g;
+
+    for (g = 0; g < NGROUPS; g++) {
+        const SingleNicmosGroup *e = &expected->group[g], *o = &got->group[g];
+
+        if (expWf3->exptime[g] != gotWf3->exptime[g] || expWf3->bunit[g] != gotWf3->bunit[g]) {
+            printf("ERROR: group %d has exptime %g and units %d, expected %g and %d\n", g + 1,
+                   gotWf3->exptime[g], gotWf3->bunit[g], expWf3->exptime[g], expWf3->bunit[g]);
+            return ERROR_RETURN;
+        }
+        expUnit[0] = gotUnit[0] = '\0';
+        getKeyS((Hdr *)&e->sci.hdr, "BUNIT", expUnit);
+        getKeyS((Hdr *)&o->sci.hdr, "BUNIT", gotUnit);
+        if (strcmp(expUnit, gotUnit) != 0) {
+            printf("ERROR: group %d has BUNIT '%s', expected '%s'\n", g + 1, gotUnit, expUnit);
+            return ERROR_RETURN;
+        }
+        if (compare_group(e, o, g + 1)) {
+            return ERROR_RETURN;
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int sweep_test_case(int zoffcorr, int errGroup, int rateGroup) {
+    WF3Info expWf3, gotWf3;
+    MultiNicmosGroup viaSteps, viaSweep;
+    SingleNicmosGroup zoff;
+    IRSweep sweep;
+    int g, test_status = HSTCAL_OK;
+
+    printf("==== doSweepIR vs step by step (zoffcorr %s, ERR populated in group %d, "
+           "countrates from group %d) ====\n", zoffcorr == PERFORM ? "on" : "off", errGroup, rateGroup);
+
+    setup_wf3(&expWf3, zoffcorr, rateGroup);
+    setup_wf3(&gotWf3, zoffcorr, rateGroup);
+    initMultiNicmosGroup(&viaSteps);
+    initMultiNicmosGroup(&viaSweep);
+    initSingleNicmosGroup(&zoff);
+    if (setup_stack(&viaSteps, &zoff, errGroup, rateGroup) ||
+        setup_stack(&viaSweep, NULL, errGroup, rateGroup) ||
+        reference_steps(&expWf3, &viaSteps, &zoff)) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    if ((test_status = doSweepIR(&gotWf3, &viaSweep, &zoff, NULL, &sweep))) {
+        printf("ERROR: doSweepIR failed with status %d\n", test_status);
+        goto cleanup;
+    }
+    if ((test_status = compare_stacks(&expWf3, &viaSteps, &gotWf3, &viaSweep))) {
+        goto cleanup;
+    }
+
+    /* What doNoisIR and doUnitIR report */
+    if (sweep.noisskip != errGroup) {
+        printf("ERROR: noise calculation stopped at group %d, expected %d\n", sweep.noisskip, errGroup);
+        test_status = ERROR_RETURN;
+    }
+    for (g = 0; g < NGROUPS && !test_status; g++) {
+        if (sweep.unitskip[g] != (rateGroup && g + 1 <= rateGroup)) {
+            printf("ERROR: group %d %s skipped by UNITCORR\n", g + 1, sweep.unitskip[g] ? "was" : "was not");
+            test_status = ERROR_RETURN;
+        }
+    }
+
+cleanup:
+    freeMultiNicmosGroup(&viaSteps);
+    freeMultiNicmosGroup(&viaSweep);
+    freeSingleNicmosGroup(&zoff);
+
+    return test_status;
+}
+
+/* The previous dark of a read, made from whole reference images as by
+   dark_interp() and dark_extrap(), subtracted by darkcorr() */
+static void reference_darkcorr(WF3Info *wf3, SingleNicmosGroup *input, SingleNicmosGroup *d1,
+        SingleNicmosGroup *d2, DarkTypes type, float frac, float *mean) {
+    void aadd (SingleNicmosGroup *, SingleNicmosGroup *);
+    void asub (SingleNicmosGroup *, SingleNicmosGroup *);
+    void amulk (SingleNicmosGroup *, float);
+    void asub_noref (WF3Info *, SingleNicmosGroup *, SingleNicmosGroup *);
+    const short dqmask = 4+8+16+32+128+256+512;
+    double sumx = 0;
+    int i, j, npix = 0;
+
+    if (type == INTERP) {
+        asub(d2, d1);
+        amulk(d2, frac);
+        aadd(d1, d2);
+    } else if (type == EXTRAP) {
+        amulk(d1, frac);
+    }
+    asub_noref(wf3, input, d1);
+
+    /* The mean that stats() gave */
+    *mean = 0;
+    for (j = wf3->trimy[0]; j < NY - wf3->trimy[1]; j++) {
+        for (i = wf3->trimx[0]; i < NX - wf3->trimx[1]; i++) {
+            const float val = Pix(d1->sci.data, i, j);
+            if (!(dqmask & DQPix(d1->dq.data, i, j)) && val > -FLT_MAX && val < FLT_MAX) {
+                sumx += val;
+                npix++;
+            }
+        }
+    }
+    if (npix > 0) {
+        *mean = sumx / npix;
+    }
+}
+
+/* A dark reference group, with some pixels flagged in and out of the MEANDARK
+   mask and a few overflowing ones */
+static int setup_dark(SingleNicmosGroup *dark, unsigned seed, float level) {
+    int i, j;
+
+    if (allocSingleNicmosGroup(dark, NX, NY)) {
+        return OUT_OF_MEMORY;
+    }
+    srand(seed);
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            const int r = rand() % 40;
+            Pix(dark->sci.data, i, j) = (r == 0) ? INFINITY : (r == 3) ? -INFINITY : level * (1.f + rand() / (float)RAND_MAX);
+            Pix(dark->err.data, i, j) = 0.1f * level * rand() / (float)RAND_MAX;
+            DQSetPix(dark->dq.data, i, j, (r == 1) ? 32 : (r == 2) ? 1024 : 0);
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int dark_test_case(DarkTypes type, float frac) {
+    WF3Info wf3;
+    MultiNicmosGroup viaImages, viaRows;
+    SingleNicmosGroup d1, d2, ref1, ref2;
+    DarkData dark;
+    float expMean, gotMean;
+    int j, test_status = HSTCAL_OK;
+
+    printf("==== darkRow/darkMean vs whole dark images (%s, factor %g) ====\n",
+           type == MATCH ? "match" : type == INTERP ? "interpolated" : "extrapolated", frac);
+
+    setup_wf3(&wf3, OMIT, 0);
+    wf3.group = 2;
+    initMultiNicmosGroup(&viaImages);
+    initMultiNicmosGroup(&viaRows);
+    initSingleNicmosGroup(&d1);
+    initSingleNicmosGroup(&d2);
+    initSingleNicmosGroup(&ref1);
+    initSingleNicmosGroup(&ref2);
+    if (setup_stack(&viaImages, NULL, 0, 0) || setup_stack(&viaRows, NULL, 0, 0) ||
+        setup_dark(&d1, 5, 20.f) || setup_dark(&d2, 6, 90.f) ||
+        setup_dark(&ref1, 5, 20.f) || setup_dark(&ref2, 6, 90.f)) {
+        test_status = OUT_OF_MEMORY;
+        goto cleanup;
+    }
+
+    reference_darkcorr(&wf3, &viaImages.group[1], &ref1, &ref2, type, frac, &expMean);
+
+    dark.type = type;
+    dark.frac = frac;
+    dark.d1 = &d1;
+    dark.d2 = (type == INTERP) ? &d2 : NULL;
+    for (j = 0; j < NY; j++) {
+        darkRow(&wf3, &viaRows.group[1], &dark, j);
+    }
+    if ((test_status = darkMean(&wf3, &viaRows.group[1], &dark))) {
+        printf("ERROR: darkMean failed with status %d\n", test_status);
+        goto cleanup;
+    }
+
+    if ((test_status = compare_group(&viaImages.group[1], &viaRows.group[1], 2))) {
+        goto cleanup;
+    }
+    gotMean = 0;
+    getKeyF(&viaRows.group[1].sci.hdr, "MEANDARK", &gotMean);
+    if (!same_float(expMean, gotMean)) {
+        printf("ERROR: MEANDARK is %.9g, expected %.9g\n", gotMean, expMean);
+        test_status = ERROR_RETURN;
+    }
+
+cleanup:
+    freeMultiNicmosGroup(&viaImages);
+    freeMultiNicmosGroup(&viaRows);
+    freeSingleNicmosGroup(&d1);
+    freeSingleNicmosGroup(&d2);
+    freeSingleNicmosGroup(&ref1);
+    freeSingleNicmosGroup(&ref2);
+
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+
+    test_status += sweep_test_case(PERFORM, 0, 0);
+    test_status += sweep_test_case(OMIT, 0, 0);
+    /* Noise stops at a read processed before, lower groups keep their ERR */
+    test_status += sweep_test_case(PERFORM, 3, 0);
+    test_status += sweep_test_case(PERFORM, 0, 2);
+    test_status += dark_test_case(MATCH, 1.f);
+    test_status += dark_test_case(INTERP, 0.37f);
+    test_status += dark_test_case(EXTRAP, 1.8f);
+
+    return test_status;
+}
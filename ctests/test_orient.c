@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "hstcal_orient.h"
+
+/* reorientFloatData() must move every pixel where the orientation says, and applying
+   the inverse orientation must restore the original array. getOrientedFloatSect()
+   and putOrientedFloatSect() must round trip a section without touching the rest.
+*/
+
+static const Orientation orients[] = {
+    ORIENT_IDENTITY, ORIENT_FLIP_X, ORIENT_FLIP_Y, ORIENT_ROTATE_180,
+    ORIENT_TRANSPOSE, ORIENT_TRANSPOSE_FLIP_X, ORIENT_TRANSPOSE_FLIP_Y, ORIENT_ANTITRANSPOSE
+};
+
+/* A transpose followed by an x flip is undone by a transpose followed by a y flip and
+   vice versa, all other orientations are their own inverse. */
+static Orientation inverse(const Orientation orient) {
+    if (orient == ORIENT_TRANSPOSE_FLIP_X)
+        return ORIENT_TRANSPOSE_FLIP_Y;
+    if (orient == ORIENT_TRANSPOSE_FLIP_Y)
+        return ORIENT_TRANSPOSE_FLIP_X;
+    return orient;
+}
+
+static int setup_array(FloatTwoDArray *a, int nx, int ny) {
+    int x, y;
+
+    initFloatData(a);
+    if (allocFloatData(a, nx, ny, False)) {
+        return OUT_OF_MEMORY;
+    }
+    for (y = 0; y < ny; y++) {
+        for (x = 0; x < nx; x++) {
+            Pix(*a, x, y) = y * nx + x;
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+/* Where the source pixel (x,y) lands in the onx by ony output, per the header:
+   transpose first, then flip in the output frame. */
+static void oriented_position(const Orientation orient, int onx, int ony, int x, int y, int *ox, int *oy) {
+    *ox = (orient & ORIENT_TRANSPOSE) ? y : x;
+    *oy = (orient & ORIENT_TRANSPOSE) ? x : y;
+    if (orient & ORIENT_FLIP_X)
+        *ox = onx - 1 - *ox;
+    if (orient & ORIENT_FLIP_Y)
+        *oy = ony - 1 - *oy;
+}
+
+static int reorient_test_case(int nx, int ny) {
+    FloatTwoDArray a;
+    int k, x, y, test_status = HSTCAL_OK;
+
+    printf("==== reorientFloatData round trips (%d x %d) ====\n", nx, ny);
+
+    for (k = 0; k < (int)(sizeof(orients) / sizeof(*orients)) && !test_status; k++) {
+        const Orientation orient = orients[k];
+        const int onx = (orient & ORIENT_TRANSPOSE) ? ny : nx;
+        const int ony = (orient & ORIENT_TRANSPOSE) ? nx : ny;
+
+        if (setup_array(&a, nx, ny)) {
+            return OUT_OF_MEMORY;
+        }
+        if ((test_status = reorientFloatData(&a, orient))) {
+            printf("ERROR: orientation %d failed with status %d\n", orient, test_status);
+            freeFloatData(&a);
+            break;
+        }
+        if (a.nx != onx || a.ny != ony) {
+            printf("ERROR: orientation %d gave %d x %d, expected %d x %d\n", orient, a.nx, a.ny, onx, ony);
+            test_status = SIZE_MISMATCH;
+        }
+        for (y = 0; y < ny && !test_status; y++) {
+            for (x = 0; x < nx; x++) {
+                int ox, oy;
+                oriented_position(orient, onx, ony, x, y, &ox, &oy);
+                if (Pix(a, ox, oy) != y * nx + x) {
+                    printf("ERROR: orientation %d put pixel (%d,%d) at (%d,%d) got %g\n",
+                           orient, x, y, ox, oy, Pix(a, ox, oy));
+                    test_status = ERROR_RETURN;
+                    break;
+                }
+            }
+        }
+
+        if (!test_status && (test_status = reorientFloatData(&a, inverse(orient)))) {
+            printf("ERROR: inverse of orientation %d failed with status %d\n", orient, test_status);
+        }
+        if (!test_status && (a.nx != nx || a.ny != ny)) {
+            printf("ERROR: inverse of orientation %d gave %d x %d\n", orient, a.nx, a.ny);
+            test_status = SIZE_MISMATCH;
+        }
+        for (y = 0; y < ny && !test_status; y++) {
+            for (x = 0; x < nx; x++) {
+                if (Pix(a, x, y) != y * nx + x) {
+                    printf("ERROR: orientation %d and its inverse moved pixel (%d,%d)\n", orient, x, y);
+                    test_status = ERROR_RETURN;
+                    break;
+                }
+            }
+        }
+        freeFloatData(&a);
+    }
+
+    return test_status;
+}
+
+static int sect_test_case(int nx, int ny, int x0, int y0, int snx, int sny) {
+    FloatTwoDArray a;
+    double *sect;
+    int k, x, y, test_status = HSTCAL_OK;
+
+    printf("==== getOrientedFloatSect/putOrientedFloatSect (%d x %d at %d,%d of %d x %d) ====\n",
+           snx, sny, x0, y0, nx, ny);
+
+    if (!(sect = malloc((size_t)snx * sny * sizeof(*sect)))) {
+        return OUT_OF_MEMORY;
+    }
+    if (setup_array(&a, nx, ny)) {
+        free(sect);
+        return OUT_OF_MEMORY;
+    }
+
+    for (k = 0; k < 4 && !test_status; k++) {
+        const Orientation orient = orients[k];
+        if ((test_status = getOrientedFloatSect(&a, x0, y0, snx, sny, orient, sect))) {
+            printf("ERROR: get with orientation %d failed with status %d\n", orient, test_status);
+            break;
+        }
+        for (y = 0; y < sny && !test_status; y++) {
+            for (x = 0; x < snx; x++) {
+                const int ix = x0 + ((orient & ORIENT_FLIP_X) ? snx - 1 - x : x);
+                const int iy = y0 + ((orient & ORIENT_FLIP_Y) ? sny - 1 - y : y);
+                if (sect[y * snx + x] != iy * nx + ix) {
+                    printf("ERROR: orientation %d section pixel (%d,%d) is %g, expected %d\n",
+                           orient, x, y, sect[y * snx + x], iy * nx + ix);
+                    test_status = ERROR_RETURN;
+                    break;
+                }
+            }
+        }
+
+        /* Put back a marked copy, then undo the mark */
+        for (y = 0; y < snx * sny; y++) {
+            sect[y] += 0.5;
+        }
+        if (!test_status && (test_status = putOrientedFloatSect(&a, x0, y0, snx, sny, orient, sect))) {
+            printf("ERROR: put with orientation %d failed with status %d\n", orient, test_status);
+            break;
+        }
+        for (y = 0; y < ny && !test_status; y++) {
+            for (x = 0; x < nx; x++) {
+                const int inside = x >= x0 && x < x0 + snx && y >= y0 && y < y0 + sny;
+                if (Pix(a, x, y) != y * nx + x + (inside ? 0.5f : 0.f)) {
+                    printf("ERROR: orientation %d put %g at (%d,%d)\n", orient, Pix(a, x, y), x, y);
+                    test_status = ERROR_RETURN;
+                    break;
+                }
+                Pix(a, x, y) = y * nx + x;
+            }
+        }
+    }
+
+    /* Transposed sections are rejected */
+    if (!test_status && getOrientedFloatSect(&a, x0, y0, snx, sny, ORIENT_TRANSPOSE, sect) != INVALID_VALUE) {
+        printf("ERROR: a transposed section was not rejected\n");
+        test_status = ERROR_RETURN;
+    }
+
+    freeFloatData(&a);
+    free(sect);
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+
+    test_status += reorient_test_case(1, 1);
+    test_status += reorient_test_case(5, 3);
+    test_status += reorient_test_case(4, 4);
+    /* Several transpose tiles, with partial tiles along both edges */
+    test_status += reorient_test_case(75, 41);
+    /* Enough pixels for the threaded paths */
+    test_status += reorient_test_case(301, 263);
+    test_status += sect_test_case(11, 9, 2, 3, 6, 5);
+    test_status += sect_test_case(11, 9, 0, 0, 11, 9);
+
+    return test_status;
+}
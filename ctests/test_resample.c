@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "hstcal_resample.h"
+
+/* unbinFloat(), unbinShort(), binFloat() and binShort() checked bit for bit against
+   the per-pixel loops they replaced in bin2d, unbin2d and unbinsect (InterpInfo and
+   InterpDQInfo called for every pixel), and WFC3 unbin2d() against the same loops,
+   with its data quality taken from the input rows of the last output row.
+*/
+
+#define MAX_BIN 5
+
+int unbin2d (SingleGroup *a, SingleGroup *b);
+
+static const int sizes[] = {1, 2, 3, 7, 16};
+
+/* InterpInfo, with (clamp) or without the checks that keep p and q within 0 and 1.
+   With a single pixel InterpInfo returned i = -1; that pixel is now repeated. */
+static void interp_info(float ai, int npts, int clamp, int *i, int *i1, float *p, float *q) {
+    *i = (int) ai;
+    *i = (*i < 0) ? 0 : *i;
+    *i = (*i >= npts - 1) ? (npts - 2) : *i;
+    *q = ai - *i;
+    if (clamp) {
+        *q = (*q < 0.0) ? 0.0F : *q;
+        *q = (*q > 1.0) ? 1.0F : *q;
+    }
+    *p = 1.0F - *q;
+    *i1 = *i + 1;
+    if (npts < 2) {
+        *i = *i1 = 0;
+        *q = 0.0F;
+        *p = 1.0F;
+    }
+}
+
+/* InterpDQInfo, with i2 = i1 where only one pixel is used */
+static void interp_dq_info(float ai, int npts, int *i1, int *i2) {
+    int num_i;
+
+    *i1 = (int) ai;
+    *i2 = *i1 + 1;
+    num_i = (ai == (float)(*i1)) ? 1 : 2;
+    if (*i1 <= 0) {
+        *i1 = 0;
+        num_i = 1;
+    }
+    if (*i1 >= npts - 1) {
+        *i1 = npts - 1;
+        num_i = 1;
+    }
+    if (num_i == 1) {
+        *i2 = *i1;
+    }
+}
+
+static float error_value(float value, ResampleKind kind) {
+    if (kind == RESAMPLE_ERROR_POSITIVE) {
+        return (value > 0.0) ? sqrt(value) : 0.0;
+    }
+    return sqrt(value);
+}
+
+/* The unbin2d loops for one float array of inx by iny pixels. */
+static void ref_unbin_float(const float *a, int inx, int iny, float *b, int binx, int biny,
+        int clamp, ResampleKind kind) {
+    const int onx = inx * binx;
+    const int ony = iny * biny;
+    const float xoffset = (float)(binx - 1) / 2.0F;
+    const float yoffset = (float)(biny - 1) / 2.0F;
+    float ai, aj, p, q, r, s, value;
+    int m, n, i, i1, j, j1;
+
+    for (n = 0; n < ony; n++) {
+        aj = ((float)n - yoffset) / (float)biny;
+        interp_info(aj, iny, clamp, &j, &j1, &r, &s);
+        for (m = 0; m < onx; m++) {
+            ai = ((float)m - xoffset) / (float)binx;
+            interp_info(ai, inx, clamp, &i, &i1, &p, &q);
+            if (binx == 1 && biny == 1) {
+                b[n*onx + m] = a[n*inx + m];
+            } else if (binx == 1) {
+                const float e1 = a[j*inx + m], e2 = a[j1*inx + m];
+                if (kind == RESAMPLE_VALUE) {
+                    b[n*onx + m] = r * e1 + s * e2;
+                } else {
+                    value = r * e1*e1 + s * e2*e2;
+                    b[n*onx + m] = error_value(value, kind);
+                }
+            } else if (biny == 1) {
+                const float e1 = a[n*inx + i], e2 = a[n*inx + i1];
+                if (kind == RESAMPLE_VALUE) {
+                    b[n*onx + m] = p * e1 + q * e2;
+                } else {
+                    value = p * e1*e1 + q * e2*e2;
+                    b[n*onx + m] = error_value(value, kind);
+                }
+            } else {
+                const float e1 = a[j*inx + i], e2 = a[j*inx + i1];
+                const float e3 = a[j1*inx + i], e4 = a[j1*inx + i1];
+                if (kind == RESAMPLE_VALUE) {
+                    b[n*onx + m] = p * r * e1 + q * r * e2 + p * s * e3 + q * s * e4;
+                } else {
+                    value = p * r * e1*e1 + q * r * e2*e2 + p * s * e3*e3 + q * s * e4*e4;
+                    b[n*onx + m] = error_value(value, kind);
+                }
+            }
+        }
+    }
+}
+
+/* The unbin2d data quality loops. With lastRow, the rows are those of the last output
+   row when both axes are expanded, as in WFC3 and STIS unbin2d. */
+static void ref_unbin_short(const short *a, int inx, int iny, short *b, int binx, int biny,
+        int lastRow) {
+    const int onx = inx * binx;
+    const int ony = iny * biny;
+    const float xoffset = (float)(binx - 1) / 2.0F;
+    const float yoffset = (float)(biny - 1) / 2.0F;
+    int m, n, i1, i2, j1, j2;
+
+    for (n = 0; n < ony; n++) {
+        const int row = (lastRow && binx > 1 && biny > 1) ? ony - 1 : n;
+        interp_dq_info(((float)row - yoffset) / (float)biny, iny, &j1, &j2);
+        if (biny == 1) {
+            j1 = j2 = n;
+        }
+        for (m = 0; m < onx; m++) {
+            interp_dq_info(((float)m - xoffset) / (float)binx, inx, &i1, &i2);
+            if (binx == 1) {
+                i1 = i2 = m;
+            }
+            b[n*onx + m] = a[j1*inx + i1] | a[j1*inx + i2] | a[j2*inx + i1] | a[j2*inx + i2];
+        }
+    }
+}
+
+static void fill_float(float *v, int n, int kind) {
+    int i;
+    for (i = 0; i < n; i++) {
+        v[i] = (float)rand() / RAND_MAX * 200.f;
+        /* Zero errors, for RESAMPLE_ERROR_POSITIVE */
+        if (kind != RESAMPLE_VALUE && rand() % 5 == 0) {
+            v[i] = 0.f;
+        }
+    }
+}
+
+static void fill_short(short *v, int n) {
+    int i;
+    for (i = 0; i < n; i++) {
+        v[i] = (rand() % 3 == 0) ? (short)(1 << (rand() % 15)) : 0;
+    }
+}
+
+static int same_floats(const float *expected, const float *got, int n) {
+    return memcmp(expected, got, n * sizeof(*got)) == 0;
+}
+
+static int unbin_test_case(int inx, int iny, int binx, int biny, int clamp) {
+    const int onx = inx * binx;
+    const int ony = iny * biny;
+    const ResampleKind kinds[] = {RESAMPLE_VALUE, RESAMPLE_ERROR, RESAMPLE_ERROR_POSITIVE};
+    float *a = malloc(inx * iny * sizeof(*a));
+    float *b = malloc(onx * ony * sizeof(*b));
+    float *expected = malloc(onx * ony * sizeof(*expected));
+    short *da = malloc(inx * iny * sizeof(*da));
+    short *db = malloc(onx * ony * sizeof(*db));
+    short *dexpected = malloc(onx * ony * sizeof(*dexpected));
+    float **in = floatRows(a, inx, iny);
+    float **out = floatRows(b, onx, ony);
+    short **din = shortRows(da, inx, iny);
+    short **dout = shortRows(db, onx, ony);
+    UnbinAxis xaxis, yaxis;
+    const UnbinAxis *x = (binx > 1) ? &xaxis : NULL;
+    const UnbinAxis *y = (biny > 1) ? &yaxis : NULL;
+    int k, n, test_status = HSTCAL_OK;
+
+    initUnbinAxis(&xaxis);
+    initUnbinAxis(&yaxis);
+    if (!a || !b || !expected || !da || !db || !dexpected || !in || !out || !din || !dout ||
+        makeUnbinAxis(&xaxis, inx, binx, clamp) || makeUnbinAxis(&yaxis, iny, biny, clamp)) {
+        test_status = OUT_OF_MEMORY;
+    }
+
+    for (k = 0; k < (int)(sizeof(kinds) / sizeof(*kinds)) && !test_status; k++) {
+        fill_float(a, inx * iny, kinds[k]);
+        ref_unbin_float(a, inx, iny, expected, binx, biny, clamp, kinds[k]);
+        unbinFloat(in, out, onx, ony, x, y, kinds[k]);
+        if (!same_floats(expected, b, onx * ony)) {
+            printf("ERROR: unbinFloat %dx%d by %dx%d clamp=%d kind=%d differs\n",
+                   inx, iny, binx, biny, clamp, kinds[k]);
+            test_status = ERROR_RETURN;
+        }
+    }
+
+    /* A single pixel is repeated */
+    if (!test_status && inx == 1 && iny == 1) {
+        fill_float(a, 1, RESAMPLE_VALUE);
+        unbinFloat(in, out, onx, ony, x, y, RESAMPLE_VALUE);
+        for (n = 0; n < onx * ony; n++) {
+            if (b[n] != a[0]) {
+                printf("ERROR: unbinFloat of one pixel by %dx%d: %g at %d, expected %g\n",
+                       binx, biny, b[n], n, a[0]);
+                test_status = ERROR_RETURN;
+                break;
+            }
+        }
+    }
+
+    if (!test_status) {
+        fill_short(da, inx * iny);
+        ref_unbin_short(da, inx, iny, dexpected, binx, biny, 0);
+        unbinShort(din, dout, onx, ony, x, y);
+        if (memcmp(dexpected, db, onx * ony * sizeof(*db)) != 0) {
+            printf("ERROR: unbinShort %dx%d by %dx%d differs\n", inx, iny, binx, biny);
+            test_status = ERROR_RETURN;
+        }
+    }
+
+    freeUnbinAxis(&xaxis);
+    freeUnbinAxis(&yaxis);
+    free(in); free(out); free(din); free(dout);
+    free(a); free(b); free(expected);
+    free(da); free(db); free(dexpected);
+    return test_status;
+}
+
+/* bin2d of the nx*binx by ny*biny subset at (x0,y0) of an anx by any array */
+static int bin_test_case(int nx, int ny, int binx, int biny, int avg) {
+    const int x0 = 3, y0 = 2;
+    const int anx = x0 + nx * binx + 4;
+    const int any = y0 + ny * biny + 1;
+    const float weight = binx * biny;
+    float *a = malloc(anx * any * sizeof(*a));
+    float *b = malloc(nx * ny * sizeof(*b));
+    float *expected = malloc(nx * ny * sizeof(*expected));
+    short *da = malloc(anx * any * sizeof(*da));
+    short *db = malloc(nx * ny * sizeof(*db));
+    float **in = floatRows(a + y0 * anx + x0, anx, ny * biny);
+    float **out = floatRows(b, nx, ny);
+    short **din = shortRows(da + y0 * anx + x0, anx, ny * biny);
+    short **dout = shortRows(db, nx, ny);
+    int k, m, n, i, j, test_status = HSTCAL_OK;
+
+    if (!a || !b || !expected || !da || !db || !in || !out || !din || !dout) {
+        test_status = OUT_OF_MEMORY;
+    }
+
+    for (k = 0; k < 2 && !test_status; k++) {
+        const ResampleKind kind = k ? RESAMPLE_ERROR : RESAMPLE_VALUE;
+        fill_float(a, anx * any, kind);
+        for (n = 0; n < ny; n++) {
+            for (m = 0; m < nx; m++) {
+                float sum = 0.;
+                for (j = y0 + n*biny; j < y0 + (n+1)*biny; j++)
+                    for (i = x0 + m*binx; i < x0 + (m+1)*binx; i++)
+                        sum += kind == RESAMPLE_VALUE ? a[j*anx + i] : a[j*anx + i] * a[j*anx + i];
+                if (binx == 1 && biny == 1)
+                    expected[n*nx + m] = a[(y0 + n)*anx + x0 + m];
+                else if (kind == RESAMPLE_VALUE)
+                    expected[n*nx + m] = avg ? sum / weight : sum;
+                else
+                    expected[n*nx + m] = avg ? sqrt(sum) / weight : sqrt(sum);
+            }
+        }
+        binFloat(in, out, nx, ny, binx, biny, avg, kind);
+        if (!same_floats(expected, b, nx * ny)) {
+            printf("ERROR: binFloat by %dx%d avg=%d kind=%d differs\n", binx, biny, avg, kind);
+            test_status = ERROR_RETURN;
+        }
+    }
+
+    if (!test_status) {
+        fill_short(da, anx * any);
+        binShort(din, dout, nx, ny, binx, biny);
+        for (n = 0; n < ny && !test_status; n++) {
+            for (m = 0; m < nx; m++) {
+                short dq = 0;
+                for (j = y0 + n*biny; j < y0 + (n+1)*biny; j++)
+                    for (i = x0 + m*binx; i < x0 + (m+1)*binx; i++)
+                        dq |= da[j*anx + i];
+                if (db[n*nx + m] != dq) {
+                    printf("ERROR: binShort by %dx%d differs at (%d,%d)\n", binx, biny, m, n);
+                    test_status = ERROR_RETURN;
+                    break;
+                }
+            }
+        }
+    }
+
+    free(in); free(out); free(din); free(dout);
+    free(a); free(b); free(expected); free(da); free(db);
+    return test_status;
+}
+
+/* WFC3 unbin2d: clamped weights, and the data quality of every output row taken from
+   the input rows of the last one when both axes are expanded. */
+static int unbin2d_test_case(int inx, int iny, int binx, int biny) {
+    const int onx = inx * binx;
+    const int ony = iny * biny;
+    SingleGroup a, b;
+    float *expected = malloc(onx * ony * sizeof(*expected));
+    short *dexpected = malloc(onx * ony * sizeof(*dexpected));
+    int test_status = HSTCAL_OK;
+
+    initSingleGroup(&a);
+    initSingleGroup(&b);
+    if (!expected || !dexpected ||
+        allocSingleGroup(&a, inx, iny, True) || allocSingleGroup(&b, onx, ony, True)) {
+        test_status = OUT_OF_MEMORY;
+    }
+
+    if (!test_status) {
+        fill_float(a.sci.data.data, inx * iny, RESAMPLE_VALUE);
+        fill_float(a.err.data.data, inx * iny, RESAMPLE_ERROR);
+        fill_short(a.dq.data.data, inx * iny);
+        if (unbin2d(&a, &b)) {
+            printf("ERROR: unbin2d %dx%d by %dx%d failed\n", inx, iny, binx, biny);
+            test_status = ERROR_RETURN;
+        }
+    }
+    if (!test_status) {
+        ref_unbin_float(a.sci.data.data, inx, iny, expected, binx, biny, 1, RESAMPLE_VALUE);
+        test_status |= !same_floats(expected, b.sci.data.data, onx * ony);
+        ref_unbin_float(a.err.data.data, inx, iny, expected, binx, biny, 1, RESAMPLE_ERROR);
+        test_status |= !same_floats(expected, b.err.data.data, onx * ony);
+        ref_unbin_short(a.dq.data.data, inx, iny, dexpected, binx, biny, 1);
+        test_status |= memcmp(dexpected, b.dq.data.data, onx * ony * sizeof(*dexpected)) != 0;
+        if (test_status) {
+            printf("ERROR: unbin2d %dx%d by %dx%d differs\n", inx, iny, binx, biny);
+        }
+    }
+
+    freeSingleGroup(&a);
+    freeSingleGroup(&b);
+    free(expected);
+    free(dexpected);
+    return test_status;
+}
+
+int main(void) {
+    const int nsizes = sizeof(sizes) / sizeof(*sizes);
+    int binx, biny, clamp, avg, i, j, test_status=0;
+
+    srand(2468);
+
+    printf("==== unbinFloat, unbinShort (bin 1 to %d) ====\n", MAX_BIN);
+    for (clamp = 0; clamp < 2; clamp++)
+        for (binx = 1; binx <= MAX_BIN; binx++)
+            for (biny = 1; biny <= MAX_BIN; biny++)
+                for (i = 0; i < nsizes; i++)
+                    for (j = 0; j < nsizes; j++)
+                        test_status += unbin_test_case(sizes[i], sizes[j], binx, biny, clamp);
+    /* Large enough to be expanded in parallel */
+    test_status += unbin_test_case(200, 150, 2, 3, 0);
+    test_status += unbin_test_case(200, 150, 4, 1, 1);
+
+    printf("==== binFloat, binShort (bin 1 to %d) ====\n", MAX_BIN);
+    for (avg = 0; avg < 2; avg++)
+        for (binx = 1; binx <= MAX_BIN; binx++)
+            for (biny = 1; biny <= MAX_BIN; biny++)
+                test_status += bin_test_case(13, 9, binx, biny, avg);
+    test_status += bin_test_case(300, 100, 3, 3, 1);
+
+    printf("==== WFC3 unbin2d ====\n");
+    for (binx = 1; binx <= MAX_BIN; binx += 2)
+        for (biny = 1; biny <= MAX_BIN; biny++)
+            for (i = 0; i < nsizes; i++)
+                test_status += unbin2d_test_case(sizes[i], sizes[nsizes - 1 - i], binx, biny);
+
+    return test_status;
+}
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hstcalerr.h"
+#include "trlbuf.h"
+#include "hstcal_robuststats.h"
+
+/* resistmean() must give the same mean, stddev, min and max as the previous
+   implementation, which sorted copies of the values for every median and copied
+   the unrejected values to new arrays at each round, bit for bit. That includes
+   values holding NaNs, values with no spread, and values that are all rejected.
+*/
+
+#define PFLAG -9999.
+
+/* The previous sort(), for the 1-based array[1..n] */
+static int reference_sort(float array[], int n) {
+    int l = 1, m = n, jstack = 0, auxStack[51];
+    float a, t;
+
+    for (;;) {
+        if (m - l < 7) {
+            int i, j;
+            for (j = l + 1; j <= m; j++) {
+                a = array[j];
+                for (i = j - 1; i >= l; i--) {
+                    if (array[i] <= a)
+                        break;
+                    array[i + 1] = array[i];
+                }
+                array[i + 1] = a;
+            }
+            if (jstack == 0)
+                break;
+            m = auxStack[jstack--];
+            l = auxStack[jstack--];
+        } else {
+            int k = (l + m) / 2, i, j;
+            t = array[k]; array[k] = array[l + 1]; array[l + 1] = t;
+            if (array[l] > array[m]) {
+                t = array[l]; array[l] = array[m]; array[m] = t;
+            }
+            if (array[l + 1] > array[m]) {
+                t = array[l + 1]; array[l + 1] = array[m]; array[m] = t;
+            }
+            if (array[l] > array[l + 1]) {
+                t = array[l]; array[l] = array[l + 1]; array[l + 1] = t;
+            }
+            i = l + 1;
+            j = m;
+            a = array[l + 1];
+            for (;;) {
+                do i++; while (array[i] < a);
+                do j--; while (array[j] > a);
+                if (j < i)
+                    break;
+                t = array[i]; array[i] = array[j]; array[j] = t;
+            }
+            array[l + 1] = array[j];
+            array[j] = a;
+            jstack += 2;
+            if (jstack > 50)
+                return 1;
+            if (m - i + 1 >= j - l) {
+                auxStack[jstack] = m;
+                auxStack[jstack - 1] = i;
+                m = j - 1;
+            } else {
+                auxStack[jstack] = j - 1;
+                auxStack[jstack - 1] = l;
+                l = i;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The previous findRMedian(), findMean() and findSigma() */
+static float reference_median(const float *arr, int npts) {
+    float *tarr, median;
+
+    if (npts == 0)
+        return 0.0;
+    if (npts == 1)
+        return arr[0];
+    tarr = malloc(npts * sizeof(*tarr));
+    memcpy(tarr, arr, npts * sizeof(*tarr));
+    reference_sort(tarr - 1, npts);
+    if ((npts % 2) == 0)
+        median = 0.5 * (tarr[npts/2-1] + tarr[npts/2]);
+    else
+        median = tarr[npts/2];
+    free(tarr);
+    return median;
+}
+
+static float reference_mean(const float *in, int npts) {
+    double sum = 0.;
+    int i;
+
+    for (i = 0; i < npts; i++)
+        sum += in[i];
+    return (float)(sum / (double)npts);
+}
+
+static float reference_sigma(const float *arr, int npts, float mean) {
+    double stdv, sum2 = 0.;
+    int i;
+
+    if (npts <= 1)
+        return 0.;
+    for (i = 0; i < npts; i++)
+        sum2 += arr[i] * arr[i];
+    stdv = (double)(npts / (npts - 1.)) * ((sum2 / (double)npts) - (double)mean * mean);
+    return (stdv >= 0.) ? (float)sqrt((float)stdv) : 0.f;
+}
+
+/* One round of clipping, as wheregood() and the copies around it did it */
+static int reference_clip(const float *in, int npts, float median, float cutoff, float *out) {
+    int i, n = 0;
+
+    for (i = 0; i < npts; i++) {
+        float absdev = fabsf(in[i] - median);
+        if (absdev > cutoff)
+            absdev = PFLAG;
+        if (absdev != PFLAG)
+            out[n++] = in[i];
+    }
+    return n;
+}
+
+/* The previous resistmean() */
+static void reference_resistmean(const float *in, int npix, float sigrej, float *mean,
+        float *sigmean, float *min, float *max) {
+    float *tempdata, *tempdata2, *absdev;
+    float median, medabsdev, cutoff;
+    const double correction = -0.15405+0.90723*sigrej - 0.23584*sigrej*sigrej+0.020142*sigrej*sigrej*sigrej;
+    double sum = 0.;
+    int i, npix1, npix2;
+
+    tempdata = calloc(npix, sizeof(*tempdata));
+    tempdata2 = calloc(npix, sizeof(*tempdata2));
+    absdev = calloc(npix, sizeof(*absdev));
+    *min = 0;
+    *max = 0;
+    for (i = 0; i < npix; i++) {
+        tempdata[i] = in[i];
+        sum += tempdata[i];
+        if (tempdata[i] < *min) *min = tempdata[i];
+        if (tempdata[i] > *max) *max = tempdata[i];
+    }
+    *mean = (float)(sum / (double)npix);
+    median = reference_median(tempdata, npix);
+    for (i = 0; i < npix; i++)
+        absdev[i] = fabsf(tempdata[i] - median);
+    medabsdev = reference_median(absdev, npix) / 0.6745;
+    if (medabsdev < 1.0E-24)
+        medabsdev = reference_mean(absdev, npix) / 0.8;
+    cutoff = sigrej * medabsdev;
+    npix1 = reference_clip(tempdata, npix, median, cutoff, tempdata2);
+
+    *mean = reference_mean(tempdata2, npix1);
+    *sigmean = reference_sigma(tempdata2, npix1, *mean);
+    if (sigrej <= 4.5)
+        *sigmean = *sigmean / correction;
+    cutoff = sigrej * (*sigmean);
+    median = reference_median(tempdata2, npix1);
+    npix2 = reference_clip(tempdata2, npix1, median, cutoff, tempdata);
+
+    *mean = reference_mean(tempdata, npix2);
+    *sigmean = reference_sigma(tempdata, npix2, *mean);
+    if (sigrej <= 4.5)
+        *sigmean = *sigmean / correction;
+
+    free(absdev);
+    free(tempdata);
+    free(tempdata2);
+}
+
+static int same_float(float a, float b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+enum Values {SCATTERED, WITH_NANS, CONSTANT, TWO_VALUES};
+
+static const char *valueNames[] = {"scattered", "with NaNs", "constant", "two values"};
+
+static int resistmean_test_case(enum Values kind, int npix, float sigrej) {
+    float *in, *copy;
+    float expected[4], got[4];
+    int i, k, test_status = HSTCAL_OK;
+
+    printf("==== resistmean vs previous implementation (%d values %s, sigrej %g) ====\n",
+           npix, valueNames[kind], sigrej);
+
+    in = malloc(npix * sizeof(*in));
+    copy = malloc(npix * sizeof(*copy));
+    if (!in || !copy) {
+        free(in);
+        free(copy);
+        return OUT_OF_MEMORY;
+    }
+    srand(npix);
+    for (i = 0; i < npix; i++) {
+        /* Bias-like levels with a few hot and cold outliers */
+        in[i] = 1200.f + 15.f * (rand() / (float)RAND_MAX - 0.5f);
+        if (rand() % 25 == 0)
+            in[i] += (rand() % 2 ? 1.f : -1.f) * 3000.f * rand() / (float)RAND_MAX;
+        if (kind == WITH_NANS && rand() % 10 == 0)
+            in[i] = NAN;
+        if (kind == CONSTANT)
+            in[i] = (i % 9 < 4) ? 4.25f : 3.25f;
+        if (kind == TWO_VALUES)
+            in[i] = (i < npix / 2) ? 1.f : 2.f;
+    }
+    memcpy(copy, in, npix * sizeof(*in));
+
+    reference_resistmean(in, npix, sigrej, &expected[0], &expected[1], &expected[2], &expected[3]);
+    if (resistmean(in, npix, sigrej, &got[0], &got[1], &got[2], &got[3])) {
+        printf("ERROR: resistmean failed\n");
+        test_status = ERROR_RETURN;
+    }
+    for (k = 0; k < 4 && !test_status; k++) {
+        if (!same_float(expected[k], got[k])) {
+            printf("ERROR: mean, stddev, min, max are %.9g %.9g %.9g %.9g, expected %.9g %.9g %.9g %.9g\n",
+                   got[0], got[1], got[2], got[3], expected[0], expected[1], expected[2], expected[3]);
+            test_status = ERROR_RETURN;
+        }
+    }
+    if (!test_status && memcmp(in, copy, npix * sizeof(*in)) != 0) {
+        printf("ERROR: the input values were modified\n");
+        test_status = ERROR_RETURN;
+    }
+
+    free(in);
+    free(copy);
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+    float mean, sigmean, min, max;
+
+    if (InitTrlBuf()) {
+        return OUT_OF_MEMORY;
+    }
+    SetTrlQuietMode(YES);
+
+    test_status += resistmean_test_case(SCATTERED, 1, 3.f);
+    test_status += resistmean_test_case(SCATTERED, 2, 3.f);
+    test_status += resistmean_test_case(SCATTERED, 9, 3.f);
+    test_status += resistmean_test_case(SCATTERED, 1000, 3.f);
+    test_status += resistmean_test_case(SCATTERED, 1001, 5.f);
+    test_status += resistmean_test_case(WITH_NANS, 513, 3.f);
+    test_status += resistmean_test_case(WITH_NANS, 40, 2.5f);
+    /* Most values equal the median, so the mean absolute deviation is used */
+    test_status += resistmean_test_case(CONSTANT, 101, 3.f);
+    /* The median falls between the two values, so nothing is left within a zero cutoff */
+    test_status += resistmean_test_case(TWO_VALUES, 10, 0.f);
+    test_status += resistmean_test_case(SCATTERED, 64, 0.f);
+
+    printf("==== resistmean of no values ====\n");
+    if (resistmean(&mean, 0, 3.f, &mean, &sigmean, &min, &max) != 1) {
+        printf("ERROR: an empty array was accepted\n");
+        test_status += ERROR_RETURN;
+    }
+
+    CloseTrlBuf(&trlbuf);
+    return test_status;
+}
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "hstcal_select.h"
+
+/* sortStackFloat(), selectFloat()/selectDouble() and medianFloat()/medianDouble()
+   checked against qsort() (and, for stacks holding NaNs, against a plain stable
+   insertion sort, as qsort() does not order NaNs).
+*/
+
+#define N_LANES 70 /* more than one block of sortStackFloat() lanes */
+#define MAX_STACK 40
+
+typedef struct {
+    float value;
+    int index;
+} Pair;
+
+static int compare_pairs(const void *a, const void *b) {
+    const Pair *x = a;
+    const Pair *y = b;
+    if (x->value < y->value) return -1;
+    if (y->value < x->value) return 1;
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static int compare_floats(const void *a, const void *b) {
+    const float x = *(const float *)a;
+    const float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Random values, drawn from only a few distinct ones when ties is set. */
+static float random_value(int ties) {
+    if (ties) {
+        return (float)(rand() % 4);
+    }
+    return (float)rand() / RAND_MAX * 2000.f - 1000.f;
+}
+
+static int same_float(float a, float b) {
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+/* The reference for one pixel: qsort of (value, position) pairs, i.e. a stable sort,
+   or a stable insertion sort when the pixel holds a NaN. */
+static void reference_sort(Pair *pairs, int count) {
+    int j, hasNaN = 0;
+
+    for (j = 0; j < count; j++) {
+        hasNaN |= isnan(pairs[j].value);
+    }
+    if (!hasNaN) {
+        qsort(pairs, count, sizeof(*pairs), compare_pairs);
+        return;
+    }
+    for (j = 1; j < count; j++) {
+        Pair p = pairs[j];
+        int position = j;
+        while (position > 0 && pairs[position-1].value > p.value) {
+            pairs[position] = pairs[position-1];
+            position--;
+        }
+        pairs[position] = p;
+    }
+}
+
+static int sort_stack_test_case(int n, int ties, int useCount) {
+    const int stride = N_LANES + 3;
+    float *v = malloc((size_t)n * stride * sizeof(*v));
+    int *idx = malloc((size_t)n * stride * sizeof(*idx));
+    Pair *pairs = malloc((size_t)N_LANES * n * sizeof(*pairs));
+    int count[N_LANES];
+    int k, l, test_status = 0;
+
+    if (!v || !idx || !pairs) {
+        free(v); free(idx); free(pairs);
+        return 1;
+    }
+
+    for (l = 0; l < N_LANES; l++) {
+        /* Some pixels hold a NaN or an infinity, which must still sort ahead of the
+           padding beyond count. */
+        const int special = rand() % 8;
+        count[l] = useCount ? rand() % (n + 1) : n;
+        for (k = 0; k < n; k++) {
+            float value = random_value(ties);
+            if (special == 0 && rand() % 3 == 0) {
+                value = NAN;
+            } else if (special == 1 && rand() % 3 == 0) {
+                value = (rand() % 2) ? INFINITY : -INFINITY;
+            }
+            v[(size_t)k*stride + l] = value;
+            pairs[l*n + k].value = value;
+            pairs[l*n + k].index = k;
+        }
+        reference_sort(pairs + l*n, count[l]);
+    }
+
+    sortStackFloat(v, idx, useCount ? count : NULL, n, N_LANES, stride);
+
+    for (l = 0; l < N_LANES && !test_status; l++) {
+        for (k = 0; k < count[l]; k++) {
+            const Pair *expected = &pairs[l*n + k];
+            if (!same_float(v[(size_t)k*stride + l], expected->value) ||
+                idx[(size_t)k*stride + l] != expected->index) {
+                printf("ERROR: sortStackFloat n=%d ties=%d count=%d lane %d position %d: "
+                       "expected %g (from %d) got %g (from %d)\n", n, ties, count[l], l, k,
+                       expected->value, expected->index,
+                       v[(size_t)k*stride + l], idx[(size_t)k*stride + l]);
+                test_status = 1;
+                break;
+            }
+        }
+    }
+
+    free(v);
+    free(idx);
+    free(pairs);
+    return test_status;
+}
+
+/* Fills v with one of several orderings: random, few distinct values, sorted,
+   reversed and all equal. */
+static void fill_array(float *v, int n, int kind) {
+    int i;
+    for (i = 0; i < n; i++) {
+        switch (kind) {
+            case 0: v[i] = random_value(0); break;
+            case 1: v[i] = random_value(1); break;
+            case 2: v[i] = (float)i; break;
+            case 3: v[i] = (float)(n - i); break;
+            default: v[i] = 7.f; break;
+        }
+    }
+}
+
+static int select_test_case(int n, int kind) {
+    float *v = malloc(n * sizeof(*v));
+    float *work = malloc(n * sizeof(*work));
+    float *sorted = malloc(n * sizeof(*sorted));
+    double *dwork = malloc(n * sizeof(*dwork));
+    double *dsorted = malloc(n * sizeof(*dsorted));
+    /* Every k for small arrays, the ends and middle for large ones */
+    const int nk = (n <= MAX_STACK) ? n : 5;
+    int i, j, test_status = 0;
+
+    if (!v || !work || !sorted || !dwork || !dsorted) {
+        test_status = 1;
+        goto done;
+    }
+
+    fill_array(v, n, kind);
+    memcpy(sorted, v, n * sizeof(*v));
+    qsort(sorted, n, sizeof(*sorted), compare_floats);
+    for (i = 0; i < n; i++) {
+        dsorted[i] = v[i];
+    }
+    qsort(dsorted, n, sizeof(*dsorted), compare_doubles);
+
+    for (j = 0; j < nk && !test_status; j++) {
+        const int k = (n <= MAX_STACK) ? j : (int)((long)j * (n - 1) / (nk - 1));
+        float got;
+        double dgot;
+
+        memcpy(work, v, n * sizeof(*v));
+        got = selectFloat(work, n, k);
+        if (got != sorted[k] || work[k] != sorted[k]) {
+            printf("ERROR: selectFloat n=%d kind=%d k=%d: expected %g got %g\n",
+                   n, kind, k, sorted[k], got);
+            test_status = 1;
+        }
+        for (i = 0; i < n && !test_status; i++) {
+            if ((i < k && work[i] > got) || (i > k && work[i] < got)) {
+                printf("ERROR: selectFloat n=%d kind=%d k=%d: not partitioned at %d\n",
+                       n, kind, k, i);
+                test_status = 1;
+            }
+        }
+
+        for (i = 0; i < n; i++) {
+            dwork[i] = v[i];
+        }
+        dgot = selectDouble(dwork, n, k);
+        if (dgot != dsorted[k]) {
+            printf("ERROR: selectDouble n=%d kind=%d k=%d: expected %g got %g\n",
+                   n, kind, k, dsorted[k], dgot);
+            test_status = 1;
+        }
+    }
+
+    if (!test_status) {
+        const float expected = (n % 2) ? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2]) / 2.F;
+        const double dexpected = (n % 2) ? dsorted[n/2] : (dsorted[n/2 - 1] + dsorted[n/2]) / 2.;
+        float got;
+        double dgot;
+
+        memcpy(work, v, n * sizeof(*v));
+        got = medianFloat(work, n);
+        for (i = 0; i < n; i++) {
+            dwork[i] = v[i];
+        }
+        dgot = medianDouble(dwork, n);
+        if (got != expected || dgot != dexpected) {
+            printf("ERROR: median n=%d kind=%d: expected %g/%g got %g/%g\n",
+                   n, kind, expected, dexpected, got, dgot);
+            test_status = 1;
+        }
+    }
+
+done:
+    free(v);
+    free(work);
+    free(sorted);
+    free(dwork);
+    free(dsorted);
+    return test_status;
+}
+
+int main(void) {
+    const int large[] = {1000, 4097, 100000};
+    int n, kind, i, test_status=0;
+
+    srand(1234);
+
+    printf("==== sortStackFloat (n = 1 to %d) ====\n", MAX_STACK);
+    for (n = 1; n <= MAX_STACK; n++) {
+        test_status += sort_stack_test_case(n, 0, 0);
+        test_status += sort_stack_test_case(n, 1, 0);
+        test_status += sort_stack_test_case(n, 0, 1);
+        test_status += sort_stack_test_case(n, 1, 1);
+    }
+
+    printf("==== selectFloat, selectDouble, medianFloat, medianDouble ====\n");
+    for (kind = 0; kind < 5; kind++) {
+        for (n = 1; n <= MAX_STACK; n++) {
+            test_status += select_test_case(n, kind);
+        }
+        for (i = 0; i < (int)(sizeof(large) / sizeof(*large)); i++) {
+            test_status += select_test_case(large[i], kind);
+        }
+    }
+
+    return test_status;
+}
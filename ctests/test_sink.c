@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hstio.h"
+#include "hstcalerr.h"
+#include "trlbuf.h"
+#include "wf3.h"
+#include "wf3info.h"
+#include "wf3dq.h"
+#include "doccd.h"
+
+/* Flagging the sink pixels from the catalogue of a SINKFILE imset must set the
+   same DQ bits as the previous implementation, which turned the DQ, SCI and
+   reference images into RAZ format and scanned every pixel of the reference.
+   That includes sinks near the first and last rows, trails ended by a zero,
+   a fraction, a negative value, a date or 1000, sinks turned on after the
+   exposure, and a catalogue reused for a later exposure.
+*/
+
+#define NX (RAZ_COLS/2)
+#define NY RAZ_ROWS
+#define SINKFILE "test_snk.fits"
+
+int makedqRAZ(SingleGroup *, SingleGroup *);
+int makeSciSingleRAZ(SingleGroup *, SingleGroup *);
+int undodqRAZ(SingleGroup *, SingleGroup *);
+int makeFloatRaz(FloatTwoDArray *, FloatTwoDArray *, int);
+
+/* The previous SinkDetect(), given the reference image of the imset */
+static int reference_sinkdetect(double expstart, SingleGroup *x, FloatTwoDArray *ref) {
+    int i, j, jj;
+    short dqval = 0;
+    float scipix;
+    float refdate = 50000.;
+    int keep_going = 1;
+    SingleGroup raz;
+    FloatTwoDArray sinkraz;
+
+    initSingleGroup(&raz);
+    initFloatData(&sinkraz);
+    if (allocSingleGroup(&raz, RAZ_COLS/2, RAZ_ROWS, True) ||
+        allocFloatData(&sinkraz, RAZ_COLS/2, RAZ_ROWS, True)) {
+        freeSingleGroup(&raz);
+        freeFloatData(&sinkraz);
+        return OUT_OF_MEMORY;
+    }
+    makedqRAZ(x, &raz);
+    makeSciSingleRAZ(x, &raz);
+    makeFloatRaz(ref, &sinkraz, x->group_num);
+
+    scipix = 0.;
+    for (i = 0; i < (RAZ_COLS/2); i++) {
+        for (j = 0; j < RAZ_ROWS; j++) {
+            if ((PPix(&sinkraz,i,j) > refdate) && (expstart > PPix(&sinkraz,i,j))) {
+                keep_going = 1;
+
+                dqval = TRAP | DQPix(raz.dq.data, i, j);
+                DQSetPix(raz.dq.data, i, j, dqval);
+                scipix = Pix(raz.sci.data,i,j);
+
+                if (j > 0 && PPix(&sinkraz,i,j-1) < 0) {
+                    dqval = TRAP | DQPix(raz.dq.data, i, j-1);
+                    DQSetPix(raz.dq.data, i, j-1, dqval);
+                }
+
+                for (jj = j+1; jj < RAZ_ROWS; jj++) {
+                    if ((int) PPix(&sinkraz,i,jj) == 0)
+                        keep_going = 0;
+                    if (PPix(&sinkraz,i,jj) > refdate)
+                        keep_going = 0;
+                    if (0. < PPix(&sinkraz,i,jj) && PPix(&sinkraz,i,jj) < 1000. && keep_going) {
+                        if (scipix <= PPix(&sinkraz,i,jj)) {
+                            dqval = TRAP | DQPix(raz.dq.data, i, jj);
+                            DQSetPix(raz.dq.data, i, jj, dqval);
+                        }
+                    } else {
+                        keep_going = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    undodqRAZ(x, &raz);
+
+    freeSingleGroup(&raz);
+    freeFloatData(&sinkraz);
+    return HSTCAL_OK;
+}
+
+/* A sink at (x,y) with its downstream pixel and upstream trail, which runs
+   in the direction dir and may run off the image or into other sinks */
+static void add_sink(FloatTwoDArray *ref, int x, int y, int dir) {
+    static const float ends[] = {0.f, 0.5f, -1.f, 1000.f, 57000.f};
+    const int ntrail = rand() % 12;
+    int k;
+
+    PPix(ref, x, y) = 55000.f + rand() % 4000;
+    if (rand() % 2 && y - dir >= 0 && y - dir < NY)
+        PPix(ref, x, y - dir) = -1.f;
+    for (k = 1; k <= ntrail && y + k * dir >= 0 && y + k * dir < NY; k++)
+        PPix(ref, x, y + k * dir) = (k == 1) ? 999.f : 1.f + rand() % 999;
+    if (y + k * dir >= 0 && y + k * dir < NY && rand() % 2)
+        PPix(ref, x, y + k * dir) = ends[rand() % 5];
+}
+
+static void setup_ref(FloatTwoDArray *ref, int extver) {
+    const int dir = (extver == 1) ? 1 : -1;
+    static const int edges[] = {0, 1, NY - 2, NY - 1};
+    int n, e;
+
+    srand(53 + extver);
+    for (n = 0; n < 20000; n++)
+        add_sink(ref, rand() % NX, rand() % NY, dir);
+    /* Sinks whose downstream pixel or trail is at the edge of the chip */
+    for (e = 0; e < 4; e++)
+        for (n = 0; n < 20; n++)
+            add_sink(ref, rand() % NX, edges[e], dir);
+    /* Trail values that belong to no sink */
+    for (n = 0; n < 2000; n++)
+        PPix(ref, rand() % NX, rand() % NY) = 1.f + rand() % 999;
+}
+
+static int setup_group(SingleGroup *x, int extver) {
+    int i, j;
+
+    initSingleGroup(x);
+    if (allocSingleGroup(x, NX, NY, True)) {
+        return OUT_OF_MEMORY;
+    }
+    x->group_num = extver;
+
+    srand(71 + extver);
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            /* Some equal to the trail values they are compared with */
+            Pix(x->sci.data, i, j) = (rand() % 4 == 0) ? 1200.f : rand() % 1000 + 0.5f * (rand() % 2);
+            if (rand() % 7 == 0)
+                DQSetPix(x->dq.data, i, j, 1 << (rand() % 14));
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int compare_dq(const SingleGroup *expected, const SingleGroup *got) {
+    int i, j;
+
+    for (j = 0; j < NY; j++) {
+        for (i = 0; i < NX; i++) {
+            if (DQPix(expected->dq.data, i, j) != DQPix(got->dq.data, i, j)) {
+                printf("ERROR: DQ differs at row %d column %d: expected %d got %d\n",
+                       j, i, DQPix(expected->dq.data, i, j), DQPix(got->dq.data, i, j));
+                return ERROR_RETURN;
+            }
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+static int sink_test_case(int extver) {
+    void WF3Init (WF3Info *);
+    static const double expstart[] = {57000.5, 60000.};
+    WF3Info wf3;
+    FloatTwoDArray ref;
+    SingleGroup expected, got;
+    int e, test_status = HSTCAL_OK;
+
+    initFloatData(&ref);
+    initSingleGroup(&expected);
+    initSingleGroup(&got);
+    if (allocFloatData(&ref, NX, NY, True)) {
+        return OUT_OF_MEMORY;
+    }
+    setup_ref(&ref, extver);
+
+    WF3Init(&wf3);
+    strcpy(wf3.sink.name, SINKFILE);
+    if (makeSinkCatalog(SINKFILE, extver, &ref)) {
+        printf("ERROR: makeSinkCatalog failed\n");
+        freeFloatData(&ref);
+        return ERROR_RETURN;
+    }
+
+    /* The second exposure uses the catalogue kept from the first */
+    for (e = 0; e < 2 && !test_status; e++) {
+        printf("==== SinkDetect vs RAZ scan (imset %d, EXPSTART %g) ====\n",
+               extver, expstart[e]);
+
+        wf3.expstart = expstart[e];
+        if (setup_group(&expected, extver) || setup_group(&got, extver) ||
+            reference_sinkdetect(expstart[e], &expected, &ref)) {
+            test_status = OUT_OF_MEMORY;
+        } else if (SinkDetect(&wf3, &got)) {
+            printf("ERROR: SinkDetect failed\n");
+            test_status = ERROR_RETURN;
+        } else {
+            test_status = compare_dq(&expected, &got);
+        }
+        freeSingleGroup(&expected);
+        freeSingleGroup(&got);
+    }
+
+    clearSinkCatalogs();
+    freeFloatData(&ref);
+    return test_status;
+}
+
+int main(void) {
+    int test_status=0;
+
+    if (InitTrlBuf()) {
+        return OUT_OF_MEMORY;
+    }
+    SetTrlQuietMode(YES);
+
+    test_status += sink_test_case(1);
+    test_status += sink_test_case(2);
+
+    CloseTrlBuf(&trlbuf);
+    return test_status;
+}
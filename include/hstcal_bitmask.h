@@ -0,0 +1,79 @@
+#ifndef HSTCAL_BITMASK_INCL
+#define HSTCAL_BITMASK_INCL
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Packed bit masks, one bit per pixel, e.g. the CR hits of a stack of images.
+ *
+ * A mask holds nrows rows of nx bits, each row starting on a word boundary so that
+ * rows are combined, counted and shifted a word (64 pixels) at a time. Bit x of a row
+ * is bit x % 64 of word x / 64, pixels to the right being in the higher bits. The bits
+ * of a row beyond nx are kept clear.
+ */
+
+typedef uint64_t BitWord;
+
+#define BITWORD_BITS 64
+
+// Words of a row of nx bits
+#define BITROW_WORDS(nx) (((size_t)(nx) + BITWORD_BITS - 1) / BITWORD_BITS)
+
+typedef struct {
+    int nx;          // bits per row
+    int nrows;
+    size_t nwords;   // words per row
+    BitWord * bits;
+} BitMask;
+
+void initBitMask(BitMask * mask);
+/* Allocates a mask of nrows rows of nx bits, all clear.
+ * Returns HSTCAL_OK or OUT_OF_MEMORY.
+ */
+int allocBitMask(BitMask * mask, const int nx, const int nrows);
+void freeBitMask(BitMask * mask);
+void clearBitMask(BitMask * mask);
+
+static inline BitWord * bitMaskRow(const BitMask * mask, const int row)
+{
+    return mask->bits + (size_t)row * mask->nwords;
+}
+
+static inline void setBit(BitWord * row, const int x)
+{
+    row[x / BITWORD_BITS] |= (BitWord)1 << (x % BITWORD_BITS);
+}
+
+static inline void clearBit(BitWord * row, const int x)
+{
+    row[x / BITWORD_BITS] &= ~((BitWord)1 << (x % BITWORD_BITS));
+}
+
+static inline int testBit(const BitWord * row, const int x)
+{
+    return (int)((row[x / BITWORD_BITS] >> (x % BITWORD_BITS)) & 1);
+}
+
+// dst |= src over nwords words
+void orBitRow(BitWord * dst, const BitWord * src, const size_t nwords);
+// Bits set in a row, or in the whole mask
+size_t countBitRow(const BitWord * row, const size_t nwords);
+size_t countBitMask(const BitMask * mask);
+// Whether any bit of a row is set
+int anyBitRow(const BitWord * row, const size_t nwords);
+
+/* Neighbourhood dilation: sets bit x of dst when bit x - d of src is set for any
+ * shift lo <= d <= hi, i.e. src moved right by lo up to hi pixels (left for negative
+ * shifts). Bits shifted past either end of the nx bits are dropped.
+ */
+void dilateBitRow(BitWord * dst, const BitWord * src, const int nx, const int lo, const int hi);
+
+/* Conversion from and to flag arrays of nx pixels:
+ * packBitRow sets the bits of the pixels with all of 'flag' set, leaving the others
+ * as they are. unpackBitRow sets 'flag' on the pixels whose bit is set and clears it
+ * from all others.
+ */
+void packBitRow(BitWord * row, const short * flags, const int nx, const short flag);
+void unpackBitRow(const BitWord * row, short * flags, const int nx, const short flag);
+
+#endif
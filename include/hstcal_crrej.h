@@ -0,0 +1,187 @@
+#ifndef HSTCAL_CRREJ_INCL
+#define HSTCAL_CRREJ_INCL
+
+#include "hstio.h"
+#include "hstcal_imagestack.h"
+#include "hstcal_bitmask.h"
+
+/* Cosmic ray rejection of CR-SPLIT images, shared by ACS, WFC3 & STIS:
+ *
+ *     - the parallel resolution of hits and spills below, used by all three,
+ *     - the band rejection engine of ACS & WFC3 further down, to which each
+ *       instrument plugs in its noise model,
+ *     - the line buffers of the scrolling (streamed) rejection.
+ *
+ * The band engine only runs on stacks held in memory without a shading correction.
+ * Streamed stacks and SHADCORR still go through the scrolling loops of acsrej_loop
+ * and rej_loop, which remain separate copies of each other. STIS cs2 keeps its own
+ * loop and only shares the resolution of hits and spills.
+ *
+ * The CR masks of the images written back to their DQ are BitMasks of nimgs*ny rows,
+ * row img*ny + line holding line 'line' of image 'img'.
+ */
+
+/* Parallel resolution of cosmic ray hits and their spill neighbourhoods.
+ *
+ * The serial rejection scans an image in raster order, marking a pixel as a HIT when
+ * it exceeds its threshold and is not excluded by its DQ, and marking the pixels
+ * within the rejection radius of each HIT as SPILL when they exceed the spill
+ * threshold. As SPILL pixels are never excluded, whether a DQ-excluded pixel becomes
+ * a HIT depends on the hits scanned before it. All other pixels are decided by their
+ * own values alone.
+ *
+ * The caller therefore computes the per pixel tests of a whole image in parallel and
+ * records them as flags:
+ *
+ *     CRREJ_HIT           above threshold and not excluded, a hit regardless of
+ *                         its neighbours
+ *     CRREJ_PENDING       above threshold but excluded, a hit only if a hit earlier
+ *                         in the scan spills onto it first
+ *     CRREJ_UNLOCK_PRIOR  ... and a spill from one of the previous rows does so
+ *     CRREJ_UNLOCK_LEFT   ... and a spill from the left in the same row does so
+ *
+ * resolveCRHits() then settles the (rare) pending pixels in scan order, after which
+ * CRREJ_HIT marks exactly the pixels the serial scan would have detected. Pending
+ * pixels keep CRREJ_PENDING, so that the flags of an image can be partly retested and
+ * resolved again.
+ * markCRNeighbours() sets which sides of each pixel have a hit within the radius,
+ * from which the caller derives the final mask of every pixel independently.
+ *
+ * The high byte of the flags, from CRREJ_USER up, is left to the caller, e.g. for
+ * the spill tests.
+ */
+
+#define CRREJ_HIT            0x0001
+#define CRREJ_PENDING        0x0002
+#define CRREJ_UNLOCK_PRIOR   0x0004
+#define CRREJ_UNLOCK_LEFT    0x0008
+#define CRREJ_NEAR_PRIOR     0x0010 // hit within the radius in a previous row
+#define CRREJ_NEAR_LEFT      0x0020 // hit within the radius to the left in the same row
+#define CRREJ_NEAR_RIGHT     0x0040 // hit within the radius to the right in the same row
+#define CRREJ_NEAR_NEXT      0x0080 // hit within the radius in a following row
+#define CRREJ_NEAR_ANY       (CRREJ_NEAR_PRIOR | CRREJ_NEAR_LEFT | CRREJ_NEAR_RIGHT | CRREJ_NEAR_NEXT)
+#define CRREJ_USER           0x0100
+
+/* Offsets (dx,dy), other than (0,0), of the pixels within the rejection radius,
+ * i.e. with (float)(dx*dx + dy*dy) <= rej2 for |dx|,|dy| <= width. Offsets are
+ * ordered by dy then dx, those with a given dy start at rowStart[dy+width].
+ */
+typedef struct {
+    int width;
+    int nOffsets;
+    int * dx;
+    int * dy;
+    int * rowStart; // 2*width + 2 entries
+} CRNeighbourhood;
+
+void initCRNeighbourhood(CRNeighbourhood * nb);
+/* Returns HSTCAL_OK or OUT_OF_MEMORY. */
+int allocCRNeighbourhood(CRNeighbourhood * nb, const int width, const float rej2);
+void freeCRNeighbourhood(CRNeighbourhood * nb);
+
+/* flags holds ny rows of nx pixels of a single image.
+ * Both return HSTCAL_OK or OUT_OF_MEMORY.
+ */
+int resolveCRHits(unsigned short * flags, const int nx, const int ny, const CRNeighbourhood * nb);
+int markCRNeighbours(unsigned short * flags, const int nx, const int ny, const CRNeighbourhood * nb);
+
+/* Mask values of the ACS & WFC3 rejection */
+#define CRREJ_MASK_OK        (short)0
+#define CRREJ_MASK_SPILL     (short)2
+#define CRREJ_MASK_EXCLUDE   (short)4
+#define CRREJ_MASK_HIT       (short)8
+
+/* The noise model of an instrument, each callback computing one line of nx pixels of
+ * image 'img'. Callbacks are called concurrently for different lines.
+ */
+typedef struct {
+    const void * data; // passed back to the callbacks
+    /* The normalized pixel values 'pic' and, from the average 'ave' of the previous
+     * iteration, the detection threshold 'th', the spill threshold 'spth' and the
+     * threshold 'fwd' of spills from previous lines. A pixel is detected when
+     * SQ(pic - ave) > th and spills when !(SQ(pic - ave) <= psig2*spth). */
+    void (*thresholds)(const void * data, int img, int line, int iter, float sig2,
+            const float * ave, float * pic, float * th, float * spth, float * fwd);
+    // The normalized pixel values only
+    void (*pixels)(const void * data, int img, int line, float * pic);
+    /* Add the variance of the pixels accumulated in the last iteration, those with
+     * 'use' set, to 'sumvar'. */
+    void (*addVariance)(const void * data, int img, int line, const float * pic,
+            const char * use, float * sumvar);
+    // The variance of the average from the summed variances and exposure of a pixel
+    float (*variance)(const void * data, float sumvar, float pixexp);
+} CRRejInstrument;
+
+/* Rejection of a stack held in memory, in parallel bands of lines, with the same
+ * results as the scrolling buffers of acsrej & wf3rej:
+ *
+ *     - the tests of every pixel of every image are computed by line, from the
+ *       instrument's thresholds, and classified as flags (see above),
+ *     - the hits of each image are resolved and their neighbourhoods marked,
+ *     - each band of lines is then masked, accumulated and averaged by a single
+ *       thread, combining the images of a line in order, so that the sums, DQ & CR
+ *       masks are those of the serial scan.
+ *
+ * Between iterations only the pixels whose average changed are tested again while
+ * sigma stays the same ('retest' not set), and only the pixels where an image changed
+ * from accumulated to rejected or back are summed again, from scratch and in order.
+ * The first and last iterations still sum every pixel, the last one computing the
+ * variance, DQ & CR masks of all of them, and a new sigma retests every pixel. Only
+ * iterations in between that repeat a sigma are thus cheaper, which the usual
+ * CRREJTAB sigma lists (e.g. "6,5,4") do not have.
+ * As in the scrolling buffers, a spill onto a previous line is not reflected in its
+ * mask.
+ */
+typedef struct {
+    const ImageStack * stack; // in memory
+    const float * efac;       // exposure of each image, those <= 0 are ignored
+    short dqpat;              // input DQ flags excluded from detection
+    short maskdq;             // mask values rejected from the average
+    short crflag;             // output DQ flag of the CR hits and spills
+    float psig2;              // square of the spill sigma, -1 for none
+    float fillval;            // average of pixels without any exposure
+    const float * shadline;   // nx ZEROes without shading correction
+    CRRejInstrument instrument;
+    CRNeighbourhood nb;
+    unsigned short ** flags;  // flags of each image, kept across iterations
+    char * changed;           // average changed in the last iteration
+} CRRejBands;
+
+void initCRRejBands(CRRejBands * bands);
+/* Allocates the flags of all images of the stack. Returns HSTCAL_OK or OUT_OF_MEMORY. */
+int allocCRRejBands(CRRejBands * bands, const ImageStack * stack, const int width, const float rej2);
+void freeCRRejBands(CRRejBands * bands);
+
+/* One iteration: 'ave' is updated, and on the last iteration (iter == niter-1)
+ * 'avevar', 'dq', 'dq2' (the DQ of the images' masks), 'nrej' & 'crmask'.
+ * Returns HSTCAL_OK or OUT_OF_MEMORY.
+ */
+int crrejBandIteration(CRRejBands * bands, const int iter, const int niter, const float sig2,
+        const Bool retest, FloatTwoDArray * ave, FloatTwoDArray * avevar, float * efacsum,
+        ShortTwoDArray * dq, ShortTwoDArray * dq2, int * nrej, BitMask * crmask);
+
+/* Line buffers of the scrolling rejection, of 'lines' lines of 'numpix' pixels,
+ * scrolled up one line at a time.
+ */
+float **allocFloatBuff (int lines, int numpix);
+short **allocShortBuff (int lines, int numpix);
+void freeFloatBuff (float **sect, int lines);
+void freeShortBuff (short **sect, int lines);
+void scrollFloatBuff (float *sect, int line, int nlines, int bufflines, int numpix,
+                      float **subsect, float *zero);
+void scrollShortBuff (short *ssect, int line, int nlines, int bufflines, int numpix,
+                      short **subssect, short *szero);
+void InitFloatSect (float **sect, float *buf, const ImageStack *stack,
+                    int (*getline)(const ImageStack *, const int, const int, float *),
+                    int img, int line, int width, int dimx);
+void InitShortSect (short **sect, short *sbuf, const ImageStack *stack,
+                    int img, int line, int width, int dimx);
+
+/* Lines of shading correction, as ZEROes (getShadLine) and ONEs (getShadcorr)
+ * when no correction is applied, shadf_x == 0.
+ */
+void getShadLine (float **shad, int line, int nlines, int dimx, float *shadline);
+void getShadcorr (float **shad, int line, int nlines, int dimx, float efacn,
+                  int shadf_x, float *shadline);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef HSTCAL_CRSKY_INCL
+#define HSTCAL_CRSKY_INCL
+
+#include "hstio.h"
+#include "hstcal_imagestack.h"
+
+/* Sky levels of the images of a CR-SPLIT, shared by ACSREJ & WF3REJ.
+ *
+ * The "mode" sky is the peak of a histogram of the good pixels of each image, binned
+ * from the range of the first image. The "mean" sky is the resistant mean of the good
+ * pixels of each image.
+ *
+ * When the stack is held in memory the images are read in place and the lines of an
+ * image are split over the threads, each filling a histogram of its own that are then
+ * summed, or gathering the good pixels of its lines in order. Results are the same as
+ * a serial scan. A streaming stack is read one line at a time as before.
+ *
+ * 'scale' multiplies every pixel value, e.g. to rescale count rates to counts.
+ */
+
+typedef struct {
+    int nbins;
+    float hwidth; // bin width
+    float hmin;   // lower edge of the first bin
+} CRSkyBinning;
+
+/* Binning of the histograms from the minimum and mean of the pixels of image 'img'
+ * without any of the 'badinpdq' flags: bins of (at least) one between the minimum,
+ * or minval if greater, and as far above the mean, with between minbins and maxbins bins.
+ * Returns HSTCAL_OK or OUT_OF_MEMORY.
+ */
+int crSkyBinning(const ImageStack * stack, const int img, const float scale, const short badinpdq,
+        const int minval, const int minbins, const int maxbins, CRSkyBinning * bin);
+
+/* Histogram of the pixels of image 'img' with a DQ of 0, into the caller's nbins long
+ * histgrm. Returns HSTCAL_OK or OUT_OF_MEMORY.
+ */
+int crSkyHistogram(const ImageStack * stack, const int img, const float scale, const CRSkyBinning * bin,
+        int * histgrm);
+
+/* Copy the pixels of image 'img' with a DQ of 0, in raster order, into the caller's
+ * nx*ny long skyarr and set their count. Returns HSTCAL_OK or OUT_OF_MEMORY.
+ */
+int crSkyGoodPixels(const ImageStack * stack, const int img, const float scale, float * skyarr, int * npt);
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef HSTCAL_DQMASK_INCL
+#define HSTCAL_DQMASK_INCL
+
+#include "hstio.h"
+
+/* Data quality masks rasterised from the rows of a bad pixel table (BPIXTAB).
+ *
+ * Each selected table row is a run of 'length' pixels along x (axis 1) or y (axis 2)
+ * from (x,y), zero indexed in the reference coordinates of the table, to be ORed with
+ * 'flag'. Compiling a mask ORs all its runs into a raster over their bounding box,
+ * kept as spans of equal flag value per row, so that applying the mask to a DQ array
+ * is one OR per flagged pixel with no per-row bounds work.
+ *
+ * Masks are kept in a small cache keyed by a string naming the table and the
+ * selection (chip, amp, gain, binning, ...) they were made for, so that a selection
+ * is read and rasterised once per process. The cache is not thread safe.
+ */
+
+typedef struct {
+    int x, y;        // first pixel
+    int length;      // pixels flagged along axis
+    int axis;        // 1: along x, 2: along y
+    short flag;
+} DQRun;
+
+typedef struct {
+    int x;           // first pixel
+    int length;
+    short flag;
+} DQSpan;
+
+typedef struct {
+    char * key;              // selection the mask was made for, NULL when unused
+    unsigned long lastUse;
+    int nruns;
+    int maxruns;
+    DQRun * runs;
+    // Bounding box of the runs, and the spans of row y0 + j at
+    // spans[rowStart[j]] to spans[rowStart[j+1] - 1]. spans is NULL until the
+    // mask is compiled, or if the box is too large to rasterise.
+    int x0, y0;
+    int nx, ny;
+    int * rowStart;
+    DQSpan * spans;
+} DQMask;
+
+void initDQMask(DQMask * mask);
+void freeDQMask(DQMask * mask);
+
+/* Appends a run, returns HSTCAL_OK or OUT_OF_MEMORY. */
+int addDQRun(DQMask * mask, const int x, const int y, const int length, const int axis,
+        const short flag);
+
+/* Rasterises the runs, returns HSTCAL_OK or OUT_OF_MEMORY. */
+int compileDQMask(DQMask * mask);
+
+/* OR the flags of one run, or of a whole mask, into dq, with the reference pixel
+ * (x,y) at (x + ltv[0], y + ltv[1]) of dq; pixels off dq are ignored. This is
+ * exactly the per-row assignment of the instruments' doDQI, shifts with a fractional
+ * part included (the shifted start pixel is truncated to an integer).
+ */
+void orDQRun(const DQRun * run, ShortTwoDArray * dq, const double ltv[2]);
+void orDQMask(const DQMask * mask, ShortTwoDArray * dq, const double ltv[2]);
+
+/* The cached mask for key, or NULL if there is none. */
+DQMask * findDQMask(const char * key);
+/* An empty mask for key in the cache, replacing the least recently used one if the
+ * cache is full; NULL if out of memory. A mask that could not be filled should be
+ * released with freeDQMask, which also removes it from the cache.
+ */
+DQMask * newDQMask(const char * key);
+/* Frees every cached mask, once the last exposure of a run has been processed. */
+void clearDQMaskCache(void);
+
+/* Bad pixel tables
+ *
+ * The rows of a BPIXTAB are read once and kept, for the masks of every selection made
+ * from them. Besides the run of each row (PIX1, PIX2, LENGTH, AXIS and VALUE, made
+ * zero indexed), the columns that an instrument selects rows by are read as it asks
+ * in a BpixFormat. Each instrument keeps its own table, and selects and adjusts the
+ * rows for a mask with a filter of its own.
+ */
+
+#define BPIX_CBUF 31
+
+typedef struct {
+    DQRun run;
+    char text[BPIX_CBUF+1];      // the text column, CCDAMP or OPT_ELEM
+    int chip;                    // CCDCHIP
+    int gaini;                   // CCDGAIN of an integer column
+    float gain;                  // CCDGAIN, also of an integer column
+} BpixRow;
+
+typedef struct {
+    const char * textColumn;     // optional text column, NULL if none
+    int textLength;              // characters of it read
+    const char * textDefault;    // text of the rows if the column is missing
+    Bool readChip;               // CCDCHIP, required
+    Bool readGain;               // CCDGAIN, optional
+    Bool readSize;               // SIZAXIS1 and SIZAXIS2 header keywords, required
+    Bool readEmpty;              // check the columns and header of a table with no rows
+} BpixFormat;
+
+typedef struct {
+    char * name;                 // table the rows were read from, NULL if none
+    int axlen1, axlen2;          // SIZAXIS1, SIZAXIS2
+    Bool hasText, hasGain;       // optional columns found
+    Bool intGain;                // CCDGAIN is an integer column
+    int nrows;
+    BpixRow * rows;
+} BpixTable;
+
+/* Reads the rows of table name into bpix, unless they are there already. Returns
+ * HSTCAL_OK, OPEN_FAILED, left to the caller to report, or COLUMN_NOT_FOUND,
+ * TABLE_ERROR or OUT_OF_MEMORY, reported with trlerror; bpix is then left empty. A table with no rows is not checked unless the
+ * format asks for it.
+ */
+int loadBpixTable(BpixTable * bpix, const char * name, const BpixFormat * format);
+void freeBpixTable(BpixTable * bpix);
+
+/* Whether a row of a bad pixel table is selected for a mask, given what the mask is
+ * selected for. The row is a copy, and the filter may adjust its run.
+ */
+typedef Bool (* BpixFilter)(const BpixTable * bpix, BpixRow * row, const void * selection);
+
+/* A new mask in the cache for key, of the rows of bpix that filter selects, compiled.
+ * Returns HSTCAL_OK or OUT_OF_MEMORY, reported with trlerror.
+ */
+int makeBpixMask(const BpixTable * bpix, const char * key, BpixFilter filter,
+        const void * selection, DQMask ** mask);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef HSTCAL_FLATFIELD_INCL
+#define HSTCAL_FLATFIELD_INCL
+
+#include "hstio.h"
+
+/* Flat fields prepared for one science image, i.e. read for its chip, trimmed to its
+ * subarray window and scaled as the pipeline applies them (e.g. divided by the gain),
+ * so that the same flats are not read again for the following exposures.
+ *
+ * Flats are kept in a small cache keyed by a string naming the file and everything
+ * the preparation depends on. At most four are kept, a few flats of both chips of a
+ * detector, in no more than 256 MB between them; a full-frame flat takes some 84 MB.
+ * The least recently used are replaced first, but the two most recently used are
+ * always kept, so a flat obtained from the cache stays valid while no more than two
+ * others are added. The cache should be cleared once the last exposure of a run has
+ * been processed. The cache is not thread safe.
+ */
+
+typedef struct {
+    char * key;              // what the flat was prepared for, NULL when unused
+    unsigned long lastUse;
+    int nx, ny;
+    float * sci;             // nx * ny values of each array
+    float * err;
+    short * dq;
+} FlatField;
+
+void initFlatField(FlatField * flat);
+void freeFlatField(FlatField * flat);
+
+/* The cached flat for key, or NULL if there is none. */
+FlatField * findFlatField(const char * key);
+/* A flat of nx by ny pixels for key in the cache, replacing the least recently used
+ * one if the cache is full; NULL if out of memory. A flat that could not be filled
+ * should be released with freeFlatField, which also removes it from the cache.
+ */
+FlatField * newFlatField(const char * key, const int nx, const int ny);
+// Frees every cached flat
+void clearFlatFieldCache(void);
+
+// Copies the first flat->nx pixels of a line into row j of the flat
+void putFlatFieldLine(FlatField * flat, const int j, const SingleGroupLine * line);
+
+/* Divides x in-place by each of the nflats flats in turn, in one pass over the rows
+ * of x: the science data are divided, the errors combined and the data quality ORed,
+ * with badflag set where a flat is zero, exactly as by div1d line by line. Returns
+ * HSTCAL_OK, or SIZE_MISMATCH (leaving x unchanged) if a flat is not the size of x.
+ */
+int divFlatFields(SingleGroup * x, FlatField * const * flats, const int nflats,
+        const short badflag);
+
+#endif
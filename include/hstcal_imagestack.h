@@ -0,0 +1,65 @@
+#ifndef HSTCAL_IMAGESTACK_INCL
+#define HSTCAL_IMAGESTACK_INCL
+
+#include <stddef.h>
+#include "hstio.h"
+
+/* The SCI, (optional) ERR & DQ extensions of a set of equally sized input images,
+ * e.g. the members of a CR-SPLIT, for algorithms that make several passes over all
+ * of them (sky, initial guess and every rejection iteration).
+ *
+ * openImageStack() reads every input into memory once when the whole stack fits the
+ * given memory budget. Otherwise the stack is streamed and the line getters read from
+ * the open images, as the callers previously did themselves. Callers thus have a
+ * single code path and get identical lines either way.
+ *
+ * A streamed stack holds the budget's worth of lines: two bands of bandLines lines of
+ * each image, the largest that fit. A band is read when a line of it is first asked
+ * for, and the next band of that image is then read by a background thread while the
+ * current one is used, so that reading overlaps the caller's work. With a budget too
+ * small for bands of a single line, lines are read one at a time.
+ *
+ * HSTIO is not thread safe, so while bands are being read ahead the caller must not
+ * use HSTIO itself. syncImageStack() waits for the pending reads, after which the
+ * caller may do so until its next call to a line getter. A full pass over the lines
+ * of an image leaves nothing pending.
+ *
+ * The stack keeps pointers to the caller's descriptor arrays, not copies, so images
+ * closed and reopened by the caller (e.g. to write back DQ) are picked up.
+ */
+typedef struct {
+    int nimgs;
+    int nx;
+    int ny;
+    Bool inMemory;
+    IODescPtr * sciDesc;
+    IODescPtr * errDesc; // NULL if ERR not used
+    IODescPtr * dqDesc;
+    float * sci; // inMemory only, image k line j at sci + ((size_t)k*ny + j)*nx
+    float * err;
+    short * dq;
+    Hdr * dqHdr; // streaming only, attached to dqDesc for null (constant) arrays
+    Hdr * errHdr;
+    int bandLines; // streaming in bands only, lines per band
+    struct ImageStackBands * bands;
+} ImageStack;
+
+/* Bytes needed to hold a stack in memory. */
+size_t imageStackBytes(const int nimgs, const int nx, const int ny, const Bool withErr);
+
+void initImageStack(ImageStack * stack);
+/* memoryBudget is in bytes, 0 forces streaming line by line. iperr may be NULL.
+ * Returns HSTCAL_OK, OUT_OF_MEMORY or IO_ERROR. */
+int openImageStack(ImageStack * stack, IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
+        const int nimgs, const int nx, const int ny, const size_t memoryBudget);
+void freeImageStack(ImageStack * stack);
+/* Wait for the bands being read ahead, if any. */
+void syncImageStack(const ImageStack * stack);
+
+/* Copy line 'line' of image 'img' into the caller's nx long buffer. The getters of a
+ * streamed stack must be called from one thread at a time. */
+int getStackSciLine(const ImageStack * stack, const int img, const int line, float * buf);
+int getStackErrLine(const ImageStack * stack, const int img, const int line, float * buf);
+int getStackDqLine(const ImageStack * stack, const int img, const int line, short * buf);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef HSTCAL_ORIENT_INCL
+#define HSTCAL_ORIENT_INCL
+
+#include "hstio.h"
+
+/* Geometric reorientation of 2D arrays, e.g. to bring an amp's readout corner to
+ * the lower left or to rotate serial trails into the parallel direction.
+ *
+ * Every orientation is an optional transpose followed by optional flips, with the
+ * flips applied in the (possibly transposed) output frame:
+ *
+ *     ORIENT_FLIP_X     mirror about the central column, i.e. left <-> right
+ *     ORIENT_FLIP_Y     mirror about the central row, i.e. top <-> bottom
+ *     ORIENT_TRANSPOSE  (x,y) -> (y,x), nx and ny are swapped
+ *
+ * Combinations are bitwise ORs of these, e.g. (ORIENT_TRANSPOSE | ORIENT_FLIP_X) is a
+ * transpose followed by a side to side flip, which is a 90 degree rotation.
+ *
+ * Each reorientation is a single pass over the data. Transposes are cache blocked
+ * and all passes are multithreaded when built with OpenMP.
+ */
+
+typedef enum {
+    ORIENT_IDENTITY = 0,
+    ORIENT_FLIP_X = 1,
+    ORIENT_FLIP_Y = 2,
+    ORIENT_ROTATE_180 = ORIENT_FLIP_X | ORIENT_FLIP_Y,
+    ORIENT_TRANSPOSE = 4,
+    ORIENT_TRANSPOSE_FLIP_X = ORIENT_TRANSPOSE | ORIENT_FLIP_X,
+    ORIENT_TRANSPOSE_FLIP_Y = ORIENT_TRANSPOSE | ORIENT_FLIP_Y,
+    ORIENT_ANTITRANSPOSE = ORIENT_TRANSPOSE | ORIENT_FLIP_X | ORIENT_FLIP_Y
+} Orientation;
+
+/* Reorients the array. Flips are done in place and also work on subsection views.
+ * Transposes are not in place: they are written to a newly allocated buffer which then
+ * replaces the array's own, so they temporarily need twice the memory and require the
+ * array to own its entire buffer (data == buffer, nx == tot_nx & ny == tot_ny).
+ * Returns HSTCAL_OK, SIZE_MISMATCH, INVALID_VALUE or OUT_OF_MEMORY.
+ */
+int reorientFloatData(FloatTwoDArray * array, const Orientation orient);
+
+/* Copy the nx by ny section starting at (x0,y0) of a row major float array to or
+ * from a contiguous row major double array holding the section flipped as per orient.
+ * Only flips are supported, i.e. orient must not include ORIENT_TRANSPOSE.
+ */
+int getOrientedFloatSect(const FloatTwoDArray * src, const int x0, const int y0, const int nx, const int ny,
+        const Orientation orient, double * dst);
+int putOrientedFloatSect(FloatTwoDArray * dst, const int x0, const int y0, const int nx, const int ny,
+        const Orientation orient, const double * src);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef HSTCAL_RESAMPLE_INCL
+#define HSTCAL_RESAMPLE_INCL
+
+#include "hstio.h"
+
+/* Kernels for binning (bin2d) and for expanding by linear interpolation (unbin2d,
+ * unbinsect) the planes of an image set, one output row at a time and the rows in
+ * parallel. The arithmetic of each pixel is that of the instruments' loops, done in
+ * the same order, so that the results are the same to the bit.
+ *
+ * Planes are given as arrays of row pointers, so that both the 2-D arrays of a
+ * SingleGroup and the lines of a section can be resampled.
+ */
+
+/* Where the output pixels along one axis of an expanded image come from, worked out
+ * once per axis rather than for every pixel, as InterpInfo and InterpDQInfo do.
+ */
+typedef struct {
+    int n;          // output pixels along the axis
+    int * k0;       // value at m is p[m] * in[k0[m]] + q[m] * in[k1[m]]
+    int * k1;
+    float * p;
+    float * q;
+    int * d0;       // data quality at m is in[d0[m]] | in[d1[m]]
+    int * d1;
+} UnbinAxis;
+
+typedef enum {
+    RESAMPLE_VALUE,             // interpolated or summed values
+    RESAMPLE_ERROR,             // errors, combined in quadrature
+    RESAMPLE_ERROR_POSITIVE     // errors, zero where the sum of squares is not positive
+} ResampleKind;
+
+void initUnbinAxis(UnbinAxis * axis);
+/* The weights for expanding nin pixels by bin; returns HSTCAL_OK or OUT_OF_MEMORY.
+ * With clamp the weights are kept within 0 and 1, so that the pixels beyond the first
+ * and last centres repeat them (WFC3); otherwise they are extrapolated (ACS, STIS).
+ * A single input pixel is repeated.
+ */
+int makeUnbinAxis(UnbinAxis * axis, const int nin, const int bin, const int clamp);
+void freeUnbinAxis(UnbinAxis * axis);
+
+/* Expands the nx by ny plane out from in. x or y NULL means the axis is not expanded
+ * (in and out have the same size along it); if both are, in is copied.
+ */
+void unbinFloat(float * const * in, float * const * out, const int nx, const int ny,
+        const UnbinAxis * x, const UnbinAxis * y, const ResampleKind kind);
+void unbinShort(short * const * in, short * const * out, const int nx, const int ny,
+        const UnbinAxis * x, const UnbinAxis * y);
+
+/* Bins in, whose rows start at the corner of the subset, into the nx by ny plane out,
+ * summing (or averaging if avg) binx by biny pixels; data quality is ORed.
+ */
+void binFloat(float * const * in, float * const * out, const int nx, const int ny,
+        const int binx, const int biny, const int avg, const ResampleKind kind);
+void binShort(short * const * in, short * const * out, const int nx, const int ny,
+        const int binx, const int biny);
+
+/* Row pointers, data + j*stride for j < ny or the lines of a section; NULL if out of
+ * memory. Release with free.
+ */
+float ** floatRows(float * data, const int stride, const int ny);
+short ** shortRows(short * data, const int stride, const int ny);
+float ** floatLineRows(FloatHdrLine * lines, const int n);
+short ** shortLineRows(ShortHdrLine * lines, const int n);
+
+#endif
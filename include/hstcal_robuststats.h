@@ -0,0 +1,20 @@
+#ifndef HSTCAL_ROBUSTSTATS_INCL
+#define HSTCAL_ROBUSTSTATS_INCL
+
+/* Robust statistics of an array of values.
+ *
+ * resistmean computes the mean and stddev of the npix values of in after two rounds
+ * of clipping at sigrej times the (truncation corrected) spread about the median,
+ * modeled on the IDL resistant_mean procedure. min and max are those of all values,
+ * starting from zero. in is not modified. Returns 0, or 1 for an empty array or an
+ * allocation failure.
+ *
+ * TODO: moving the doStat routines of ACS and STIS onto this module, and OpenMP
+ * reductions for its sums, are tracked as a request of their own. Both change the
+ * summation order, and so the statistics keywords, which this module has so far
+ * kept bit for bit.
+ */
+int resistmean(float * in, int npix, float sigrej, float * mean, float * sigmean,
+        float * min, float * max);
+
+#endif
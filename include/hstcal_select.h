@@ -0,0 +1,39 @@
+#ifndef HSTCAL_SELECT_INCL
+#define HSTCAL_SELECT_INCL
+
+/* Medians and order statistics, without allocation.
+ *
+ * Stack sorts order the values of many pixels at once, e.g. the pixels of a line
+ * across a stack of images, to take their medians. Value k of pixel i is at
+ * v[k*stride + i], so consecutive pixels are consecutive in memory. Stacks of up to
+ * SELECT_NETWORK_MAX values are sorted by a sorting network applied to all pixels in
+ * SIMD lanes, larger ones by insertion per pixel.
+ *
+ * Selection of a single array uses introselect (quickselect falling back to heapsort),
+ * reordering the array in place.
+ */
+
+#define SELECT_NETWORK_MAX 16
+
+/* Sort the first count[i] of the n values of each of the nlanes pixels (all n if
+ * count is NULL) in ascending order, equal values keeping their original order. idx,
+ * of the same layout as v, is set to the original position of each sorted value. The
+ * results are those of a stable insertion sort, including for pixels with NaNs. The
+ * values of a pixel beyond count[i] are overwritten.
+ */
+void sortStackFloat(float * v, int * idx, const int * count, const int n, const int nlanes,
+        const int stride);
+
+/* The k-th smallest (from 0) of the n values of v, which are reordered so that v[k]
+ * is that value, those before it are not greater and those after it are not less.
+ */
+float selectFloat(float * v, const int n, const int k);
+double selectDouble(double * v, const int n, const int k);
+
+/* The median of the n > 0 values of v, the mean of the two middle values for even n.
+ * v is reordered in an unspecified order, not sorted.
+ */
+float medianFloat(float * v, const int n);
+double medianDouble(double * v, const int n);
+
+#endif
@@ -39,5 +39,8 @@ void trlkwerr (const char *keyword, const char *filename);
 void trlfilerr (const char *filename);
 void printfAndFlush (const char *message);
 void trlGitInfo(void);
+int trlBeginCapture (void);
+char * trlEndCapture (void);
+void trlFlushCapture (const char *captured);
 
 #endif
@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hstcal_bitmask.h"
+#include "hstcalerr.h"
+
+void initBitMask(BitMask * mask)
+{
+    mask->nx = 0;
+    mask->nrows = 0;
+    mask->nwords = 0;
+    mask->bits = NULL;
+}
+
+int allocBitMask(BitMask * mask, const int nx, const int nrows)
+{
+    initBitMask(mask);
+    if (nx <= 0 || nrows <= 0)
+        return HSTCAL_OK;
+
+    mask->nwords = BITROW_WORDS(nx);
+    if (!(mask->bits = calloc(mask->nwords * nrows, sizeof(*mask->bits))))
+    {
+        initBitMask(mask);
+        return OUT_OF_MEMORY;
+    }
+    mask->nx = nx;
+    mask->nrows = nrows;
+    return HSTCAL_OK;
+}
+
+void freeBitMask(BitMask * mask)
+{
+    free(mask->bits);
+    initBitMask(mask);
+}
+
+void clearBitMask(BitMask * mask)
+{
+    if (mask->bits)
+        memset(mask->bits, 0, mask->nwords * mask->nrows * sizeof(*mask->bits));
+}
+
+void orBitRow(BitWord * dst, const BitWord * src, const size_t nwords)
+{
+    size_t w;
+    for (w = 0; w < nwords; ++w)
+        dst[w] |= src[w];
+}
+
+static int popCount(BitWord word)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    int n = 0;
+    for (; word; word &= word - 1)
+        ++n;
+    return n;
+#endif
+}
+
+size_t countBitRow(const BitWord * row, const size_t nwords)
+{
+    size_t n = 0;
+    size_t w;
+    for (w = 0; w < nwords; ++w)
+        n += popCount(row[w]);
+    return n;
+}
+
+size_t countBitMask(const BitMask * mask)
+{
+    return mask->bits ? countBitRow(mask->bits, mask->nwords * mask->nrows) : 0;
+}
+
+int anyBitRow(const BitWord * row, const size_t nwords)
+{
+    BitWord any = 0;
+    size_t w;
+    for (w = 0; w < nwords; ++w)
+        any |= row[w];
+    return any != 0;
+}
+
+/* Word w of src shifted right (towards higher x) by d pixels, or left for d < 0. */
+static BitWord shiftedWord(const BitWord * src, const size_t nwords, const size_t w, const int d)
+{
+    const size_t q = (size_t)(d < 0 ? -d : d) / BITWORD_BITS;
+    const int r = (d < 0 ? -d : d) % BITWORD_BITS;
+    BitWord word = 0;
+
+    if (d >= 0)
+    {
+        if (w >= q)
+            word = src[w - q] << r;
+        if (r && w >= q + 1)
+            word |= src[w - q - 1] >> (BITWORD_BITS - r);
+    }
+    else
+    {
+        if (w + q < nwords)
+            word = src[w + q] >> r;
+        if (r && w + q + 1 < nwords)
+            word |= src[w + q + 1] << (BITWORD_BITS - r);
+    }
+    return word;
+}
+
+void dilateBitRow(BitWord * dst, const BitWord * src, const int nx, const int lo, const int hi)
+{
+    const size_t nwords = BITROW_WORDS(nx);
+    const int tail = nx % BITWORD_BITS;
+    size_t w;
+    int d;
+
+    if (nx <= 0)
+        return;
+
+    for (w = 0; w < nwords; ++w)
+    {
+        BitWord word = 0;
+        for (d = lo; d <= hi; ++d)
+            word |= shiftedWord(src, nwords, w, d);
+        dst[w] |= word;
+    }
+    // Keep the bits beyond nx clear
+    if (tail)
+        dst[nwords - 1] &= ((BitWord)1 << tail) - 1;
+}
+
+void packBitRow(BitWord * row, const short * flags, const int nx, const short flag)
+{
+    int x0;
+
+    for (x0 = 0; x0 < nx; x0 += BITWORD_BITS)
+    {
+        const int n = (nx - x0 < BITWORD_BITS) ? nx - x0 : BITWORD_BITS;
+        BitWord word = 0;
+        int b;
+        for (b = 0; b < n; ++b)
+            word |= (BitWord)((flags[x0 + b] & flag) == flag) << b;
+        row[x0 / BITWORD_BITS] |= word;
+    }
+}
+
+void unpackBitRow(const BitWord * row, short * flags, const int nx, const short flag)
+{
+    const short noflag = ~flag;
+    int x0;
+
+    for (x0 = 0; x0 < nx; x0 += BITWORD_BITS)
+    {
+        const int n = (nx - x0 < BITWORD_BITS) ? nx - x0 : BITWORD_BITS;
+        const BitWord word = row[x0 / BITWORD_BITS];
+        int b;
+        for (b = 0; b < n; ++b)
+            flags[x0 + b] = ((word >> b) & 1) ? (flags[x0 + b] | flag) : (flags[x0 + b] & noflag);
+    }
+}
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hstcal_crrej.h"
+
+/* ------------------------------------------------------------------*/
+/*                          allocFloatBuff                           */
+/* ------------------------------------------------------------------*/
+float **allocFloatBuff (int lines, int numpix) {
+    float **sect;
+    int i;
+
+    sect = (float **) calloc (lines, sizeof(float *));
+
+    for (i=0; i<lines; i++) {
+        sect[i] = (float *) calloc (numpix, sizeof(float));
+    }
+
+    return (sect);
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          allocShortBuff                           */
+/* ------------------------------------------------------------------*/
+short **allocShortBuff (int lines, int numpix) {
+    short **sect;
+    int i;
+
+    sect = (short **) calloc (lines, sizeof(short *));
+
+    for (i=0; i<lines; i++) {
+        sect[i] = (short *) calloc (numpix, sizeof(short));
+    }
+
+    return (sect);
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          freeFloatBuff                            */
+/* ------------------------------------------------------------------*/
+void freeFloatBuff (float **sect, int lines) {
+    int i;
+
+    for (i=0; i<lines; i++) free(sect[i]);
+    free (sect);
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          freeShortBuff                            */
+/* ------------------------------------------------------------------*/
+void freeShortBuff (short **sect, int lines) {
+    int i;
+
+    for (i=0; i<lines; i++) free(sect[i]);
+    free (sect);
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          scrollFloatBuff                          */
+/* ------------------------------------------------------------------*/
+
+/* This function will scroll a subsection up a 2-d array */
+void scrollFloatBuff (float *sect, int line, int nlines, int bufflines,
+                      int numpix, float **subsect, float *zero) {
+/* Parameters:
+**	float *sect         i: line from input image (2-d array)
+**	int line            i: line number from image to add to sub-section
+**	int nlines          i: number of lines in original image
+**	int bufflines       i: number of lines in subsection
+**	int numpix          i: number of pixels per line
+**	float **subsect     o: scrolled subsection
+*/
+
+    int i;
+    float *begptr; /* Use for first line in buffer */
+
+    /* If there is only one line in the buffer, simply copy it out */
+    if (bufflines == 1) {
+        memcpy (subsect[0], sect, numpix * sizeof(float));
+        return;
+    }
+
+    begptr = *subsect; /* Save first line in buffer */
+
+    /* Shift lines in the buffer up,
+    **	moving subsect[1] into subssect[0], and so on..
+    */
+    for (i=0; i < bufflines-1; i++) {
+        *(subsect+i) = *(subsect+i+1);
+    }
+
+    /* Now, put pointer from first line back as last line
+    **  This recycles the pointer; the data will be overwritten.
+    */
+    *(subsect + bufflines -1) = begptr;
+
+    /* Finally, copy in new data into last line of buffer.
+    **	If the line we want to write to buffer is valid,...
+    */
+    if (line < nlines && bufflines > 1) {
+        /* Copy new line into last line of buffer. */
+        memcpy (subsect[bufflines-1], sect, numpix * sizeof(float));
+    } else {
+        /* Otherwise, set buffer values to default values */
+        memcpy (subsect[bufflines-1], zero, numpix * sizeof(float));
+    }
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          scrollShortBuff                          */
+/* ------------------------------------------------------------------*/
+
+/* This function will scroll a subsection up a 2-d array */
+void scrollShortBuff (short *ssect, int line, int nlines, int bufflines,
+                      int numpix, short **subssect, short *szero) {
+/* Parameters:
+**	short *ssect         i: line from input DQ image (2-d short array)
+**	int line            i: line number from sect to add to sub-section
+**	int nlines          i: number of lines in original section
+**	int bufflines       i: number of lines in subsection
+**	int numpix          i: number of pixels per line
+**	short **ssubsect     o: scrolled subsection
+*/
+
+    int i;
+    short *begsptr; /* Use for first line in buffer */
+
+    /* If there is only one line in the buffer, simply copy it out */
+    if (bufflines == 1) {
+        memcpy (subssect[0], ssect, numpix * sizeof(short));
+        return;
+    }
+
+    begsptr = *subssect; /* Save first line in buffer */
+
+    /* Shift lines in the buffer up,
+    **	moving subsect[1] into subssect[0], and so on..
+    */
+    for (i=0; i < bufflines-1; i++) {
+        subssect[i] = subssect[i+1];
+    }
+
+    /* Now, put pointer from first line back as last line */
+    *(subssect + bufflines - 1) = begsptr;
+
+    /* Finally, copy in new data into last line of buffer.
+    **	If the line we want to read in is valid,...
+    */
+    if (line < nlines && bufflines > 1) {
+        /* Copy new line into last line of buffer. */
+        memcpy (subssect[bufflines-1], ssect, numpix * sizeof(short));
+    } else {
+        /* Otherwise, set buffer values to default values */
+        memcpy (subssect[bufflines-1], szero, numpix * sizeof(short));
+    }
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          InitFloatSect                            */
+/* ------------------------------------------------------------------*/
+void InitFloatSect (float **sect, float *buf, const ImageStack *stack,
+                    int (*getline)(const ImageStack *, const int, const int,
+                                   float *),
+                    int img, int line, int width, int dimx) {
+/* This routine performs all the initial bookkeeping for the scrolling
+   data buffers.
+   - Initializes the scrolling buffer by populating it with the first
+     lines of data from the image.
+
+   Parameters:
+   float     **sect  i/o: scrolling buffer
+   float     *buf    i: single line of scratch space
+   ImageStack *stack i: input images
+   getline   i: stack line getter for the extension to buffer (SCI or ERR)
+   int       img     i: index of working image (image being processed)
+   int       line    i: number of current line from working image
+   int       width   i: number of lines in buffer on either side of current line
+   int       dimx    i: number of pixels in each line
+*/
+    int     l;
+
+    /* Fill initial buffer with first lines of image */
+    for (l = 0; l <= width; l++) {
+        getline (stack, img, line+l, buf);
+        /* Copy new line into last line of buffer. */
+        memcpy (sect[width+l], buf, dimx * sizeof(float));
+    }
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          InitShortSect                            */
+/* ------------------------------------------------------------------*/
+void InitShortSect (short **sect, short *sbuf, const ImageStack *stack,
+                    int img, int line, int width, int dimx) {
+/* This routine performs all the initial bookkeeping for the scrolling
+   data buffers.
+   - Initializes the scrolling buffer by populating it with the first
+     lines of data from the image.
+
+   Parameters:
+   short     **sect  i/o: scrolling buffer
+   short     *sbuf   i: single line of scratch space
+   ImageStack *stack i: input images
+   int       img     i: index of working image (image being processed)
+   int       line    i: number of current line from working image
+   int       width   i: number of lines in buffer on either side of current line
+   int       dimx    i: number of pixels in each line
+*/
+    int     l;
+
+    /* Fill initial buffer with first lines of image */
+    for (l = 0; l <= width; l++) {
+        getStackDqLine (stack, img, line+l, sbuf);
+        /* Copy new line into last line of buffer. */
+        memcpy (sect[width+l], sbuf, dimx * sizeof(short));
+    }
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          getShadLine                              */
+/* ------------------------------------------------------------------*/
+void getShadLine (float **shad, int line, int nlines, int dimx,
+                  float *shadline) {
+/* Parameters:
+	shad                i: shadfile buffer
+	line                i: line number from input image we are working with
+	nlines              i: number of lines in shadfile buffer
+	dimx                i: size of shad buffer
+	shadline            o: line of shadfile data to be applied to image
+*/
+    int offset;
+
+    offset = line % nlines;
+
+    /* Copy appropriate line from buffer into shadline */
+    memcpy (shadline, shad[offset], dimx * sizeof(float));
+}
+
+
+/* ------------------------------------------------------------------*/
+/*                          getShadcorr                              */
+/* ------------------------------------------------------------------*/
+void getShadcorr (float **shad, int line, int nlines, int dimx,
+                  float efacn, int shadf_x, float *shadline) {
+/* Parameters:
+    shad                i: shadfile buffer
+    line                i: line number from input image we are working with
+    nlines              i: number of lines in shadfile buffer
+    efacn               i: fraction of exposure time for image
+    dimx                i: size of shad buffer
+    shadf_x             i: number of pixels in input shadfile line
+                         [This will be ZERO if no shading correction is applied]
+    shadline            o: line of shadfile data to be applied to image
+*/
+    int offset;
+    int i;
+
+    offset = line % nlines;
+
+    /* Copy appropriate line from buffer into shadline */
+    memcpy (shadline, shad[offset], dimx * sizeof(float));
+
+    /* Only when doing shading correction, perform this expensive
+        math operation (as multkline).
+    */
+    if (shadf_x > 0) {
+        float k = 1./efacn;
+        if (k != 1.) {
+            for (i = 0; i < dimx; i++)
+                shadline[i] = k * shadline[i];
+        }
+    }
+
+    /* Always make sure that shadline is either 1 or 1+1/efacn,
+        to avoid divide by zero errors.
+    */
+    for (i = 0; i < dimx; i++)
+        shadline[i] = shadline[i] + 1.f;
+}
@@ -0,0 +1,646 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+# ifdef _OPENMP
+#include <omp.h>
+# endif
+
+#include "hstcal_crrej.h"
+#include "hstcalerr.h"
+
+// Band engine flags, on top of the above
+#define SPILL_PRIOR (CRREJ_USER)      // spills when marked from a previous line
+#define SPILL_ROW   (CRREJ_USER << 1) // spills when marked from its own line
+#define COUNTED     (CRREJ_USER << 2) // accumulated in the last iteration
+#define OVER        (CRREJ_USER << 3) // above the detection threshold, tests only
+
+void initCRNeighbourhood(CRNeighbourhood * nb)
+{
+    nb->width = 0;
+    nb->nOffsets = 0;
+    nb->dx = NULL;
+    nb->dy = NULL;
+    nb->rowStart = NULL;
+}
+
+void freeCRNeighbourhood(CRNeighbourhood * nb)
+{
+    free(nb->dx);
+    free(nb->dy);
+    free(nb->rowStart);
+    initCRNeighbourhood(nb);
+}
+
+static int withinRadius(const int dx, const int dy, const float rej2)
+{
+    // Same comparison as the serial rejection loops
+    return !((float)(dx*dx + dy*dy) > rej2) && (dx || dy);
+}
+
+int allocCRNeighbourhood(CRNeighbourhood * nb, const int width, const float rej2)
+{
+    const int size = 2*width + 1;
+    int n = 0;
+
+    initCRNeighbourhood(nb);
+    nb->width = width;
+    nb->dx = malloc(size*size*sizeof(*nb->dx));
+    nb->dy = malloc(size*size*sizeof(*nb->dy));
+    nb->rowStart = malloc((size+1)*sizeof(*nb->rowStart));
+    if (!nb->dx || !nb->dy || !nb->rowStart)
+    {
+        freeCRNeighbourhood(nb);
+        return OUT_OF_MEMORY;
+    }
+
+    {int dy;
+    for (dy = -width; dy <= width; ++dy)
+    {
+        nb->rowStart[dy+width] = n;
+        {int dx;
+        for (dx = -width; dx <= width; ++dx)
+        {
+            if (!withinRadius(dx, dy, rej2))
+                continue;
+            nb->dx[n] = dx;
+            nb->dy[n] = dy;
+            ++n;
+        }}
+    }}
+    nb->rowStart[size] = n;
+    nb->nOffsets = n;
+
+    return HSTCAL_OK;
+}
+
+/* Pending pixels are settled one at a time in scan order, so that a pending pixel
+ * turned into a hit spills onto the pending pixels after it, exactly as in the serial
+ * scan. Only rows holding pending pixels are visited. Their HIT is recomputed, so the
+ * flags can be resolved again after retesting some pixels.
+ */
+int resolveCRHits(unsigned short * flags, const int nx, const int ny, const CRNeighbourhood * nb)
+{
+    char * rowPending = malloc(ny*sizeof(*rowPending));
+    if (!rowPending)
+        return OUT_OF_MEMORY;
+
+    {int j;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (j = 0; j < ny; ++j)
+    {
+        const unsigned short * row = flags + (size_t)j*nx;
+        char pending = 0;
+        {int i;
+        for (i = 0; i < nx; ++i)
+            pending |= (row[i] & CRREJ_PENDING) != 0;
+        }
+        rowPending[j] = pending;
+    }}
+
+    // Offsets before a pixel in scan order, i.e. previous rows then the left of its own
+    const int nBefore = nb->nOffsets ? nb->rowStart[nb->width] + (nb->rowStart[nb->width+1] - nb->rowStart[nb->width])/2 : 0;
+
+    {int j;
+    for (j = 0; j < ny; ++j)
+    {
+        if (!rowPending[j])
+            continue;
+
+        unsigned short * row = flags + (size_t)j*nx;
+        {int i;
+        for (i = 0; i < nx; ++i)
+        {
+            if (!(row[i] & CRREJ_PENDING))
+                continue;
+
+            unsigned short hit = 0;
+            {int k;
+            for (k = 0; k < nBefore && !hit; ++k)
+            {
+                const int x = i + nb->dx[k];
+                const int y = j + nb->dy[k];
+                const unsigned short unlock = nb->dy[k] < 0 ? CRREJ_UNLOCK_PRIOR : CRREJ_UNLOCK_LEFT;
+                if (!(row[i] & unlock) || x < 0 || x >= nx || y < 0)
+                    continue;
+                if (flags[(size_t)y*nx + x] & CRREJ_HIT)
+                    hit = CRREJ_HIT;
+            }}
+            row[i] = (row[i] & ~CRREJ_HIT) | hit;
+        }}
+    }}
+
+    free(rowPending);
+    return HSTCAL_OK;
+}
+
+/* The hits of each row are first packed into a bit row. Each row (contiguous bands of
+ * rows per thread) is then marked by dilating the hit rows within 'width' of it, a word
+ * of 64 pixels at a time, so threads only write to their own band. The offsets of the
+ * neighbourhood at a given dy are the contiguous dx from -e to e (but 0 when dy is 0),
+ * so each hit row is shifted by that range.
+ */
+int markCRNeighbours(unsigned short * flags, const int nx, const int ny, const CRNeighbourhood * nb)
+{
+    const int width = nb->width;
+    int nthreads = 1;
+    BitMask hits, near;
+    char * rowHits;
+
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    rowHits = malloc(ny*sizeof(*rowHits));
+    if (!rowHits || allocBitMask(&hits, nx, ny) != HSTCAL_OK)
+    {
+        free(rowHits);
+        return OUT_OF_MEMORY;
+    }
+    // Prior, next, left & right bit rows of each thread
+    if (allocBitMask(&near, nx, 4*nthreads) != HSTCAL_OK)
+    {
+        freeBitMask(&hits);
+        free(rowHits);
+        return OUT_OF_MEMORY;
+    }
+
+    {int j;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (j = 0; j < ny; ++j)
+    {
+        BitWord * hitRow = bitMaskRow(&hits, j);
+        packBitRow(hitRow, (const short *)(flags + (size_t)j*nx), nx, CRREJ_HIT);
+        rowHits[j] = anyBitRow(hitRow, hits.nwords);
+    }}
+
+    {int j;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (j = 0; j < ny; ++j)
+    {
+#ifdef _OPENMP
+        const int t = omp_get_thread_num();
+#else
+        const int t = 0;
+#endif
+        BitWord * prior = bitMaskRow(&near, 4*t);
+        BitWord * next = bitMaskRow(&near, 4*t + 1);
+        BitWord * left = bitMaskRow(&near, 4*t + 2);
+        BitWord * right = bitMaskRow(&near, 4*t + 3);
+        unsigned short * row = flags + (size_t)j*nx;
+
+        memset(prior, 0, 4*near.nwords*sizeof(*prior));
+
+        // dy is the offset from the hit to this row
+        {int dy;
+        for (dy = -width; dy <= width; ++dy)
+        {
+            const int source = j - dy;
+            if (source < 0 || source >= ny || !rowHits[source])
+                continue;
+
+            const int first = nb->rowStart[dy+width];
+            if (first == nb->rowStart[dy+width+1])
+                continue;
+
+            const int extent = -nb->dx[first];
+            const BitWord * hitRow = bitMaskRow(&hits, source);
+            if (dy > 0)
+                dilateBitRow(prior, hitRow, nx, -extent, extent);
+            else if (dy < 0)
+                dilateBitRow(next, hitRow, nx, -extent, extent);
+            else
+            {
+                dilateBitRow(left, hitRow, nx, 1, extent);
+                dilateBitRow(right, hitRow, nx, -extent, -1);
+            }
+        }}
+
+        {int i;
+        for (i = 0; i < nx; ++i)
+        {
+            row[i] = (row[i] & ~CRREJ_NEAR_ANY) |
+                     (testBit(prior, i) ? CRREJ_NEAR_PRIOR : 0) |
+                     (testBit(next, i) ? CRREJ_NEAR_NEXT : 0) |
+                     (testBit(left, i) ? CRREJ_NEAR_LEFT : 0) |
+                     (testBit(right, i) ? CRREJ_NEAR_RIGHT : 0);
+        }}
+    }}
+
+    freeBitMask(&near);
+    freeBitMask(&hits);
+    free(rowHits);
+    return HSTCAL_OK;
+}
+
+void initCRRejBands(CRRejBands * bands)
+{
+    memset(bands, 0, sizeof(*bands));
+    initCRNeighbourhood(&bands->nb);
+}
+
+void freeCRRejBands(CRRejBands * bands)
+{
+    if (bands->flags)
+    {
+        int k;
+        for (k = 0; k < bands->stack->nimgs; ++k)
+            free(bands->flags[k]);
+        free(bands->flags);
+    }
+    free(bands->changed);
+    freeCRNeighbourhood(&bands->nb);
+    bands->flags = NULL;
+    bands->changed = NULL;
+}
+
+int allocCRRejBands(CRRejBands * bands, const ImageStack * stack, const int width, const float rej2)
+{
+    const size_t npix = (size_t)stack->nx * stack->ny;
+
+    bands->stack = stack;
+    bands->flags = calloc(stack->nimgs, sizeof(*bands->flags));
+    bands->changed = calloc(npix, sizeof(*bands->changed));
+    if (!bands->flags || !bands->changed || allocCRNeighbourhood(&bands->nb, width, rej2))
+    {
+        freeCRRejBands(bands);
+        return OUT_OF_MEMORY;
+    }
+    {int k;
+    for (k = 0; k < stack->nimgs; ++k)
+    {
+        if (!(bands->flags[k] = calloc(npix, sizeof(*bands->flags[k]))))
+        {
+            freeCRRejBands(bands);
+            return OUT_OF_MEMORY;
+        }
+    }}
+    return HSTCAL_OK;
+}
+
+/* Mask value of a pixel at the time it is tested for a CR, given whether it was
+ * marked as SPILL from a previous line and from its left.
+ */
+static short maskAtTest(const short m0, const short dqpat, const Bool prior, const Bool left)
+{
+    short m = m0;
+
+    if (prior && m != CRREJ_MASK_HIT)
+        m = CRREJ_MASK_SPILL;
+    if (((m & dqpat) != CRREJ_MASK_OK) && (m != CRREJ_MASK_SPILL))
+        m = CRREJ_MASK_EXCLUDE;
+    if (left && m != CRREJ_MASK_HIT)
+        m = CRREJ_MASK_SPILL;
+    return m;
+}
+
+// Flags of a pixel from its input DQ and tests
+static unsigned short classifyTests(const short m0, const short dqpat, const unsigned short tests)
+{
+    const unsigned short spill = tests & (SPILL_PRIOR | SPILL_ROW);
+    unsigned short unlock = 0;
+
+    if (!(tests & OVER))
+        return spill;
+    if (maskAtTest(m0, dqpat, False, False) != CRREJ_MASK_EXCLUDE)
+        return spill | CRREJ_HIT;
+
+    if ((spill & SPILL_PRIOR) && maskAtTest(m0, dqpat, True, False) != CRREJ_MASK_EXCLUDE)
+        unlock |= CRREJ_UNLOCK_PRIOR;
+    if ((spill & SPILL_ROW) && maskAtTest(m0, dqpat, False, True) != CRREJ_MASK_EXCLUDE)
+        unlock |= CRREJ_UNLOCK_LEFT;
+    return unlock ? (spill | CRREJ_PENDING | unlock) : spill;
+}
+
+/* Final mask value of a pixel from its resolved flags, as left by the scrolling
+ * buffers. 'center' is the value copied to the output DQ, i.e. before the pixel's own
+ * line was processed.
+ */
+static short finalMask(const short m0, const short dqpat, const unsigned short fl, short * center)
+{
+    const Bool prior = (fl & CRREJ_NEAR_PRIOR) && (fl & SPILL_PRIOR);
+    const Bool left = (fl & CRREJ_NEAR_LEFT) && (fl & SPILL_ROW);
+    const Bool right = (fl & CRREJ_NEAR_RIGHT) && (fl & SPILL_ROW);
+    short m;
+
+    *center = (prior && m0 != CRREJ_MASK_HIT) ? CRREJ_MASK_SPILL : m0;
+    m = maskAtTest(m0, dqpat, prior, left);
+    if (fl & CRREJ_HIT)
+        m = CRREJ_MASK_HIT;
+    if (right && m != CRREJ_MASK_HIT)
+        m = CRREJ_MASK_SPILL;
+    return m;
+}
+
+// The detection & spill tests of a line, free of branches so as to vectorize
+static void testLine(const int nx, const Bool first, const float psig2,
+        const float * restrict pic, const float * restrict ave, const float * restrict th,
+        const float * restrict spth, const float * restrict fwd, unsigned short * restrict tests)
+{
+    const unsigned short prior = first ? 0 : SPILL_PRIOR;
+    int i;
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (i = 0; i < nx; ++i)
+    {
+        const float diff = (pic[i] - ave[i]) * (pic[i] - ave[i]);
+        tests[i] = (diff > th[i] ? OVER : 0) |
+                   (!(diff <= psig2*spth[i]) ? SPILL_ROW : 0) |
+                   (!(diff <= psig2*fwd[i]) ? prior : 0);
+    }
+}
+
+// Thread local line buffers
+typedef struct {
+    float * pic;
+    float * th;
+    float * spth;
+    float * fwd;
+    float * sum;
+    float * sumvar;
+    unsigned short * tests;
+    short * bufdq;
+    short * bufmask;
+    char * use;
+    char * redo;
+} BandLines;
+
+static void freeBandLines(BandLines * lines)
+{
+    free(lines->pic);
+    free(lines->th);
+    free(lines->spth);
+    free(lines->fwd);
+    free(lines->sum);
+    free(lines->sumvar);
+    free(lines->tests);
+    free(lines->bufdq);
+    free(lines->bufmask);
+    free(lines->use);
+    free(lines->redo);
+}
+
+static int allocBandLines(BandLines * lines, const size_t n)
+{
+    lines->pic = malloc(n*sizeof(*lines->pic));
+    lines->th = malloc(n*sizeof(*lines->th));
+    lines->spth = malloc(n*sizeof(*lines->spth));
+    lines->fwd = malloc(n*sizeof(*lines->fwd));
+    lines->sum = malloc(n*sizeof(*lines->sum));
+    lines->sumvar = malloc(n*sizeof(*lines->sumvar));
+    lines->tests = malloc(n*sizeof(*lines->tests));
+    lines->bufdq = malloc(n*sizeof(*lines->bufdq));
+    lines->bufmask = malloc(n*sizeof(*lines->bufmask));
+    lines->use = malloc(n*sizeof(*lines->use));
+    lines->redo = malloc(n*sizeof(*lines->redo));
+    if (!lines->pic || !lines->th || !lines->spth || !lines->fwd || !lines->sum || !lines->sumvar ||
+        !lines->tests || !lines->bufdq || !lines->bufmask || !lines->use || !lines->redo)
+        return OUT_OF_MEMORY; // freed by the caller
+    return HSTCAL_OK;
+}
+
+/* Tests of image 'img', all lines when 'retest' is set, otherwise only the pixels
+ * whose average changed. */
+static void testImage(CRRejBands * bands, BandLines * lines, const int img, const int iter,
+        const float sig2, const Bool retest, const FloatTwoDArray * ave)
+{
+    const CRRejInstrument * inst = &bands->instrument;
+    const int nx = bands->stack->nx;
+    const int ny = bands->stack->ny;
+
+    {int line;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+#endif
+    for (line = 0; line < ny; ++line)
+    {
+#ifdef _OPENMP
+        const BandLines * tl = lines + omp_get_thread_num();
+#else
+        const BandLines * tl = lines;
+#endif
+        const size_t offset = (size_t)line*nx;
+        const short * indq = bands->stack->dq + (size_t)img*nx*ny + offset;
+        const char * chg = bands->changed + offset;
+        unsigned short * fl = bands->flags[img] + offset;
+        const float * aveLine = &PPix(ave, 0, line);
+
+        if (!retest && !memchr(chg, 1, nx))
+            continue;
+
+        inst->thresholds(inst->data, img, line, iter, sig2, aveLine, tl->pic, tl->th, tl->spth, tl->fwd);
+        testLine(nx, line == 0, bands->psig2, tl->pic, aveLine, tl->th, tl->spth, tl->fwd, tl->tests);
+
+        {int i;
+        for (i = 0; i < nx; ++i)
+        {
+            if (!retest && !chg[i])
+                continue;
+            fl[i] = (fl[i] & COUNTED) | classifyTests(indq[i], bands->dqpat, tl->tests[i]);
+        }}
+    }}
+}
+
+int crrejBandIteration(CRRejBands * bands, const int iter, const int niter, const float sig2,
+        const Bool retest, FloatTwoDArray * ave, FloatTwoDArray * avevar, float * efacsum,
+        ShortTwoDArray * dq, ShortTwoDArray * dq2, int * nrej, BitMask * crmask)
+{
+    const CRRejInstrument * inst = &bands->instrument;
+    const ImageStack * stack = bands->stack;
+    const int nimgs = stack->nimgs;
+    const int nx = stack->nx;
+    const int ny = stack->ny;
+    const Bool last = iter == niter-1;
+    const Bool full = iter == 0 || last;
+    const short maskdq = bands->maskdq;
+    const short nocr = ~bands->crflag;
+    const short nospill = ~CRREJ_MASK_SPILL;
+    int nthreads = 1;
+    int nrejected = 0;
+    int ret = HSTCAL_OK;
+    BandLines * lines;
+
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    if (!(lines = calloc(nthreads, sizeof(*lines))))
+        return OUT_OF_MEMORY;
+    {int t;
+    for (t = 0; t < nthreads && !ret; ++t)
+        ret = allocBandLines(&lines[t], nx);
+    }
+    if (ret)
+        goto cleanup;
+
+    // Tests, then hits and their neighbourhoods
+    {int k;
+    for (k = 0; k < nimgs; ++k)
+    {
+        if (bands->efac[k] <= 0.)
+            continue;
+        testImage(bands, lines, k, iter, sig2, retest, ave);
+        if ((ret = resolveCRHits(bands->flags[k], nx, ny, &bands->nb)) ||
+            (ret = markCRNeighbours(bands->flags[k], nx, ny, &bands->nb)))
+            goto cleanup;
+    }}
+
+    // Mask, accumulate and average, each thread a contiguous band of lines
+    {int line;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) reduction(+:nrejected)
+#endif
+    for (line = 0; line < ny; ++line)
+    {
+#ifdef _OPENMP
+        const BandLines * tl = lines + omp_get_thread_num();
+#else
+        const BandLines * tl = lines;
+#endif
+        const size_t offset = (size_t)line*nx;
+        char * chg = bands->changed + offset;
+        float * sum = tl->sum;
+        float * sumvar = tl->sumvar;
+        short * bufdq = tl->bufdq;
+        short * bufmask = tl->bufmask;
+        char * use = tl->use;
+        char * redo = tl->redo;
+        int i, k;
+
+        memset(sum, 0, nx*sizeof(*sum));
+        memset(sumvar, 0, nx*sizeof(*sumvar));
+        memset(redo, full, nx*sizeof(*redo));
+        if (full)
+        {
+            for (i = 0; i < nx; ++i)
+                efacsum[offset+i] = 0.;
+        }
+
+        for (k = 0; k < nimgs; ++k)
+        {
+            const float efacn = bands->efac[k];
+            const short * indq = stack->dq + (size_t)k*nx*ny + offset;
+            unsigned short * fl = bands->flags[k] + offset;
+
+            if (efacn <= 0.)
+                continue;
+
+            for (i = 0; i < nx; ++i)
+            {
+                unsigned short counted;
+                bufmask[i] = finalMask(indq[i], bands->dqpat, fl[i], &bufdq[i]);
+                counted = ((bufmask[i] & maskdq) == CRREJ_MASK_OK) ? COUNTED : 0;
+                use[i] = counted != 0;
+                if ((fl[i] & COUNTED) != counted)
+                {
+                    fl[i] ^= COUNTED;
+                    redo[i] = 1;
+                }
+            }
+
+            if (full)
+            {
+                inst->pixels(inst->data, k, line, tl->pic);
+                for (i = 0; i < nx; ++i)
+                {
+                    if (use[i])
+                    {
+                        sum[i] += tl->pic[i] * efacn;
+                        efacsum[offset+i] += efacn;
+                    }
+                }
+                if (last)
+                    inst->addVariance(inst->data, k, line, tl->pic, use, sumvar);
+            }
+
+            // DQ and CR mask on the last iteration
+            if (last)
+            {
+                for (i = 0; i < nx; ++i)
+                {
+                    short sval;
+                    bufdq[i] = bufdq[i] | PDQPix(dq2, i, line);
+                    bufdq[i] = bufdq[i] & nocr;
+                    bufdq[i] = bufdq[i] & nospill;
+                    sval = bufdq[i] | PDQPix(dq, i, line);
+
+                    if (bufmask[i] == CRREJ_MASK_HIT || bufmask[i] == CRREJ_MASK_SPILL)
+                    {
+                        bufdq[i] = bufdq[i] | bands->crflag;
+                        nrejected++;
+                    }
+                    else
+                        sval = sval & nocr;
+
+                    PDQSetPix(dq2, i, line, bufdq[i]);
+                    PDQSetPix(dq, i, line, sval);
+                }
+                packBitRow(bitMaskRow(crmask, k*ny + line), bufdq, nx, bands->crflag);
+            }
+        }
+
+        // Sum again the pixels whose rejections changed
+        if (!full && memchr(redo, 1, nx))
+        {
+            for (i = 0; i < nx; ++i)
+            {
+                if (redo[i])
+                    efacsum[offset+i] = 0.;
+            }
+            for (k = 0; k < nimgs; ++k)
+            {
+                const float efacn = bands->efac[k];
+                const unsigned short * fl = bands->flags[k] + offset;
+
+                if (efacn <= 0.)
+                    continue;
+
+                inst->pixels(inst->data, k, line, tl->pic);
+                for (i = 0; i < nx; ++i)
+                {
+                    if (redo[i] && (fl[i] & COUNTED))
+                    {
+                        sum[i] += tl->pic[i] * efacn;
+                        efacsum[offset+i] += efacn;
+                    }
+                }
+            }
+        }
+
+        // The new average after the rejection
+        for (i = 0; i < nx; ++i)
+        {
+            const float pixexp = efacsum[offset+i];
+            chg[i] = 0;
+            if (!redo[i])
+                continue;
+            if (pixexp > 0.)
+            {
+                const float newave = (sum[i] / pixexp)/(1 + bands->shadline[i]/pixexp);
+                chg[i] = newave != PPix(ave, i, line);
+                PPix(ave, i, line) = newave;
+                if (last)
+                    PPix(avevar, i, line) = inst->variance(inst->data, sumvar[i], pixexp);
+            }
+            else if (last)
+            {
+                PPix(ave, i, line) = bands->fillval;
+                PPix(avevar, i, line) = bands->fillval;
+            }
+        }
+    }}
+    *nrej += nrejected;
+
+cleanup:
+    {int t;
+    for (t = 0; t < nthreads; ++t)
+        freeBandLines(&lines[t]);
+    }
+    free(lines);
+    return ret;
+}
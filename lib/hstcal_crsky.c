@@ -0,0 +1,279 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+# ifdef _OPENMP
+#include <omp.h>
+# endif
+
+#include "hstcal_crsky.h"
+#include "hstcalerr.h"
+
+/* Line 'line' of image 'img', in place when the stack is in memory, otherwise read
+ * into the caller's buffers. */
+static void skyLine(const ImageStack * stack, const int img, const int line,
+        float * abuf, short * bbuf, const float ** a, const short ** b)
+{
+    if (stack->inMemory)
+    {
+        const size_t offset = ((size_t)img*stack->ny + line)*stack->nx;
+        *a = stack->sci + offset;
+        *b = stack->dq + offset;
+        return;
+    }
+    getStackSciLine(stack, img, line, abuf);
+    getStackDqLine(stack, img, line, bbuf);
+    *a = abuf;
+    *b = bbuf;
+}
+
+static int skyThreads(const ImageStack * stack)
+{
+# ifdef _OPENMP
+    if (stack->inMemory)
+        return omp_get_max_threads();
+# endif
+    (void) stack;
+    return 1;
+}
+
+int crSkyBinning(const ImageStack * stack, const int img, const float scale, const short badinpdq,
+        const int minval, const int minbins, const int maxbins, CRSkyBinning * bin)
+{
+    const int nx = stack->nx;
+    float * abuf = NULL;
+    short * bbuf = NULL;
+    float data_min = INT_MAX;
+    float sum = 0.;
+    float mean;
+    int npt = 0;
+    int min, max, nbins;
+    int line;
+
+    if (!stack->inMemory)
+    {
+        abuf = malloc(nx*sizeof(*abuf));
+        bbuf = malloc(nx*sizeof(*bbuf));
+        if (!abuf || !bbuf)
+        {
+            free(abuf);
+            free(bbuf);
+            return OUT_OF_MEMORY;
+        }
+    }
+
+    /* The float sum is accumulated in raster order, as it always was, so that
+     * the binning is unchanged. */
+    for (line = 0; line < stack->ny; ++line)
+    {
+        const float * a;
+        const short * b;
+        int i;
+
+        skyLine(stack, img, line, abuf, bbuf, &a, &b);
+        for (i = 0; i < nx; ++i)
+        {
+            if ((b[i] & badinpdq) == 0)
+            {
+                const float v = a[i] * scale;
+                data_min = (v < data_min) ? v : data_min;
+                sum += v;
+                npt++;
+            }
+        }
+    }
+    free(abuf);
+    free(bbuf);
+
+    /* MIN is min of good data or minval, whichever is greater, MAX is as far above
+     * the mean, so that the mean falls in the center of the range. */
+    if (npt == 0)
+        npt = 1;
+    min = (data_min < minval) ? minval : data_min;
+    mean = (sum > 0.) ? (int) ((sum / (float)npt) + 1) : 1;
+    max = 2 * mean - min;
+
+    /* Bins of 1 (DN), at least minbins and at most maxbins of them */
+    nbins = max - min + 1;
+    if (nbins < minbins)
+    {
+        nbins = minbins;
+        bin->hwidth = (float)nbins / (float)minbins;
+    }
+    else if (nbins > maxbins)
+    {
+        bin->hwidth = (float)nbins / (float)maxbins;
+        nbins = maxbins;
+    }
+    else
+        bin->hwidth = 1.;
+    bin->nbins = nbins;
+    bin->hmin = (float)min;
+    return HSTCAL_OK;
+}
+
+static void addToHistogram(const float * a, const short * b, const int nx, const float scale,
+        const CRSkyBinning * bin, int * histgrm)
+{
+    int i;
+    for (i = 0; i < nx; ++i)
+    {
+        if (b[i] == 0)
+        {
+            const float v = a[i] * scale;
+            /* Adjust the bin position by the width of each bin */
+            if (fabs((v - bin->hmin) / bin->hwidth) < INT_MAX)
+            {
+                const int h = (int)((v - bin->hmin) / bin->hwidth);
+                if (h >= 0 && h < bin->nbins)
+                    histgrm[h]++;
+            }
+        }
+    }
+}
+
+int crSkyHistogram(const ImageStack * stack, const int img, const float scale, const CRSkyBinning * bin,
+        int * histgrm)
+{
+    const int nthreads = skyThreads(stack);
+    int * hists;
+    int line;
+
+    memset(histgrm, 0, bin->nbins*sizeof(*histgrm));
+
+    if (!stack->inMemory)
+    {
+        float * abuf = malloc(stack->nx*sizeof(*abuf));
+        short * bbuf = malloc(stack->nx*sizeof(*bbuf));
+        if (!abuf || !bbuf)
+        {
+            free(abuf);
+            free(bbuf);
+            return OUT_OF_MEMORY;
+        }
+        for (line = 0; line < stack->ny; ++line)
+        {
+            const float * a;
+            const short * b;
+            skyLine(stack, img, line, abuf, bbuf, &a, &b);
+            addToHistogram(a, b, stack->nx, scale, bin, histgrm);
+        }
+        free(abuf);
+        free(bbuf);
+        return HSTCAL_OK;
+    }
+
+    /* A histogram per thread, counts are then summed exactly */
+    if (!(hists = calloc((size_t)nthreads*bin->nbins, sizeof(*hists))))
+        return OUT_OF_MEMORY;
+
+# ifdef _OPENMP
+    #pragma omp parallel for schedule(static) num_threads(nthreads)
+# endif
+    for (line = 0; line < stack->ny; ++line)
+    {
+# ifdef _OPENMP
+        int * hist = hists + (size_t)omp_get_thread_num()*bin->nbins;
+# else
+        int * hist = hists;
+# endif
+        const float * a;
+        const short * b;
+        skyLine(stack, img, line, NULL, NULL, &a, &b);
+        addToHistogram(a, b, stack->nx, scale, bin, hist);
+    }
+
+    {int t, h;
+    for (t = 0; t < nthreads; ++t)
+    {
+        const int * hist = hists + (size_t)t*bin->nbins;
+        for (h = 0; h < bin->nbins; ++h)
+            histgrm[h] += hist[h];
+    }}
+    free(hists);
+    return HSTCAL_OK;
+}
+
+static int copyGoodPixels(const float * a, const short * b, const int nx, const float scale, float * dst)
+{
+    int n = 0;
+    int i;
+    for (i = 0; i < nx; ++i)
+    {
+        if (b[i] == 0)
+            dst[n++] = a[i] * scale;
+    }
+    return n;
+}
+
+static int countGoodPixels(const short * b, const int nx)
+{
+    int n = 0;
+    int i;
+# ifdef _OPENMP
+    #pragma omp simd reduction(+:n)
+# endif
+    for (i = 0; i < nx; ++i)
+        n += (b[i] == 0);
+    return n;
+}
+
+int crSkyGoodPixels(const ImageStack * stack, const int img, const float scale, float * skyarr, int * npt)
+{
+    int * start;
+    int line;
+
+    *npt = 0;
+
+    if (!stack->inMemory)
+    {
+        float * abuf = malloc(stack->nx*sizeof(*abuf));
+        short * bbuf = malloc(stack->nx*sizeof(*bbuf));
+        if (!abuf || !bbuf)
+        {
+            free(abuf);
+            free(bbuf);
+            return OUT_OF_MEMORY;
+        }
+        for (line = 0; line < stack->ny; ++line)
+        {
+            const float * a;
+            const short * b;
+            skyLine(stack, img, line, abuf, bbuf, &a, &b);
+            *npt += copyGoodPixels(a, b, stack->nx, scale, skyarr + *npt);
+        }
+        free(abuf);
+        free(bbuf);
+        return HSTCAL_OK;
+    }
+
+    /* Count the good pixels of every line, then copy each line to its offset so
+     * that the pixels keep their raster order. */
+    if (!(start = malloc((stack->ny + 1)*sizeof(*start))))
+        return OUT_OF_MEMORY;
+
+    start[0] = 0;
+# ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+# endif
+    for (line = 0; line < stack->ny; ++line)
+        start[line+1] = countGoodPixels(stack->dq + ((size_t)img*stack->ny + line)*stack->nx, stack->nx);
+    for (line = 0; line < stack->ny; ++line)
+        start[line+1] += start[line];
+
+# ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+# endif
+    for (line = 0; line < stack->ny; ++line)
+    {
+        const float * a;
+        const short * b;
+        skyLine(stack, img, line, NULL, NULL, &a, &b);
+        copyGoodPixels(a, b, stack->nx, scale, skyarr + start[line]);
+    }
+
+    *npt = start[stack->ny];
+    free(start);
+    return HSTCAL_OK;
+}
@@ -0,0 +1,544 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hstcal_dqmask.h"
+#include "hstcalerr.h"
+#include "trlbuf.h"
+#include "xtables.h"
+
+// Masks kept, a few chips, amps and gains of one or two tables
+#define DQMASK_CACHE_SIZE 8
+
+// Largest bounding box rasterised, masks beyond this are applied run by run
+#define DQMASK_MAX_PIXELS ((size_t)1 << 26)
+
+static DQMask cache[DQMASK_CACHE_SIZE];
+static unsigned long useCount = 0;
+
+void initDQMask(DQMask * mask)
+{
+    mask->key = NULL;
+    mask->lastUse = 0;
+    mask->nruns = 0;
+    mask->maxruns = 0;
+    mask->runs = NULL;
+    mask->x0 = 0;
+    mask->y0 = 0;
+    mask->nx = 0;
+    mask->ny = 0;
+    mask->rowStart = NULL;
+    mask->spans = NULL;
+}
+
+void freeDQMask(DQMask * mask)
+{
+    free(mask->key);
+    free(mask->runs);
+    free(mask->rowStart);
+    free(mask->spans);
+    initDQMask(mask);
+}
+
+int addDQRun(DQMask * mask, const int x, const int y, const int length, const int axis,
+        const short flag)
+{
+    DQRun * run;
+
+    if (mask->nruns == mask->maxruns)
+    {
+        const int maxruns = mask->maxruns ? 2 * mask->maxruns : 256;
+        DQRun * runs = realloc(mask->runs, maxruns * sizeof(*runs));
+        if (!runs)
+            return OUT_OF_MEMORY;
+        mask->runs = runs;
+        mask->maxruns = maxruns;
+    }
+    run = &mask->runs[mask->nruns++];
+    run->x = x;
+    run->y = y;
+    run->length = length;
+    run->axis = axis;
+    run->flag = flag;
+    return HSTCAL_OK;
+}
+
+// Runs that flag nothing are left out of the raster
+static int isBlankRun(const DQRun * run)
+{
+    return run->flag == 0 || run->length <= 0 || (run->axis != 1 && run->axis != 2);
+}
+
+int compileDQMask(DQMask * mask)
+{
+    long xmin = LONG_MAX, xmax = LONG_MIN;
+    long ymin = LONG_MAX, ymax = LONG_MIN;
+    short * plane;
+    size_t npix;
+    int nspans;
+    int k, i, j;
+
+    free(mask->rowStart);
+    free(mask->spans);
+    mask->rowStart = NULL;
+    mask->spans = NULL;
+    mask->x0 = mask->y0 = 0;
+    mask->nx = mask->ny = 0;
+
+    for (k = 0; k < mask->nruns; ++k)
+    {
+        const DQRun * run = &mask->runs[k];
+        const long xend = run->x + (run->axis == 1 ? (long)run->length - 1 : 0);
+        const long yend = run->y + (run->axis == 2 ? (long)run->length - 1 : 0);
+
+        if (isBlankRun(run))
+            continue;
+        if (run->x < xmin)
+            xmin = run->x;
+        if (run->y < ymin)
+            ymin = run->y;
+        if (xend > xmax)
+            xmax = xend;
+        if (yend > ymax)
+            ymax = yend;
+    }
+
+    if (xmax < xmin)
+        npix = 0;
+    else if (xmax - xmin >= INT_MAX || ymax - ymin >= INT_MAX)
+        return HSTCAL_OK;
+    else
+        npix = (size_t)(xmax - xmin + 1) * (size_t)(ymax - ymin + 1);
+    if (npix > DQMASK_MAX_PIXELS)
+        return HSTCAL_OK;
+
+    if (npix)
+    {
+        mask->x0 = (int)xmin;
+        mask->y0 = (int)ymin;
+        mask->nx = (int)(xmax - xmin + 1);
+        mask->ny = (int)(ymax - ymin + 1);
+    }
+
+    if (!(plane = calloc(npix ? npix : 1, sizeof(*plane))))
+        return OUT_OF_MEMORY;
+
+    for (k = 0; k < mask->nruns; ++k)
+    {
+        const DQRun * run = &mask->runs[k];
+        short * p;
+        size_t step;
+
+        if (isBlankRun(run))
+            continue;
+        p = plane + (size_t)(run->y - mask->y0) * mask->nx + (run->x - mask->x0);
+        step = (run->axis == 1) ? 1 : (size_t)mask->nx;
+        for (i = 0; i < run->length; ++i, p += step)
+            *p |= run->flag;
+    }
+
+    // Spans of equal flag, counted then stored
+    nspans = 0;
+    for (j = 0; j < mask->ny; ++j)
+    {
+        const short * row = plane + (size_t)j * mask->nx;
+        for (i = 0; i < mask->nx; ++i)
+            if (row[i] && (i == 0 || row[i] != row[i-1]))
+                ++nspans;
+    }
+
+    mask->rowStart = malloc((mask->ny + 1) * sizeof(*mask->rowStart));
+    mask->spans = malloc((nspans ? nspans : 1) * sizeof(*mask->spans));
+    if (!mask->rowStart || !mask->spans)
+    {
+        free(plane);
+        free(mask->rowStart);
+        free(mask->spans);
+        mask->rowStart = NULL;
+        mask->spans = NULL;
+        return OUT_OF_MEMORY;
+    }
+
+    nspans = 0;
+    for (j = 0; j < mask->ny; ++j)
+    {
+        const short * row = plane + (size_t)j * mask->nx;
+        mask->rowStart[j] = nspans;
+        for (i = 0; i < mask->nx; ++i)
+        {
+            if (!row[i])
+                continue;
+            if (i == 0 || row[i] != row[i-1])
+            {
+                mask->spans[nspans].x = mask->x0 + i;
+                mask->spans[nspans].length = 0;
+                mask->spans[nspans].flag = row[i];
+                ++nspans;
+            }
+            ++mask->spans[nspans-1].length;
+        }
+    }
+    mask->rowStart[mask->ny] = nspans;
+
+    free(plane);
+    return HSTCAL_OK;
+}
+
+void orDQRun(const DQRun * run, ShortTwoDArray * dq, const double ltv[2])
+{
+    // Truncated as the assignment of a double to an int in doDQI
+    const int xstart = run->x + ltv[0];
+    const int ystart = run->y + ltv[1];
+    int low, high;
+    int i;
+
+    if (run->axis == 1)
+    {
+        low = xstart;
+        high = xstart + run->length - 1;
+        if (high < 0 || low >= dq->nx || ystart < 0 || ystart >= dq->ny)
+            return;
+        if (low < 0)
+            low = 0;
+        if (high >= dq->nx)
+            high = dq->nx - 1;
+        for (i = low; i <= high; ++i)
+            PDQPix(dq, i, ystart) |= run->flag;
+    }
+    else if (run->axis == 2)
+    {
+        low = ystart;
+        high = ystart + run->length - 1;
+        if (xstart < 0 || xstart >= dq->nx || high < 0 || low >= dq->ny)
+            return;
+        if (low < 0)
+            low = 0;
+        if (high >= dq->ny)
+            high = dq->ny - 1;
+        for (i = low; i <= high; ++i)
+            PDQPix(dq, xstart, i) |= run->flag;
+    }
+}
+
+// Whether v is a whole number of pixels, so that the raster can be shifted by it
+static int isWholeShift(const double v)
+{
+    return v == floor(v) && fabs(v) < INT_MAX / 4;
+}
+
+void orDQMask(const DQMask * mask, ShortTwoDArray * dq, const double ltv[2])
+{
+    int dx, dy;
+    int j, k;
+
+    if (!mask->spans || !isWholeShift(ltv[0]) || !isWholeShift(ltv[1]))
+    {
+        for (k = 0; k < mask->nruns; ++k)
+            orDQRun(&mask->runs[k], dq, ltv);
+        return;
+    }
+
+    dx = (int)ltv[0];
+    dy = (int)ltv[1];
+    for (j = 0; j < mask->ny; ++j)
+    {
+        const int y = mask->y0 + j + dy;
+        short * row;
+
+        if (y < 0 || y >= dq->ny)
+            continue;
+        row = &PDQPix(dq, 0, y);
+        for (k = mask->rowStart[j]; k < mask->rowStart[j+1]; ++k)
+        {
+            const DQSpan * span = &mask->spans[k];
+            int low = span->x + dx;
+            int high = low + span->length - 1;
+            int i;
+
+            if (high < 0 || low >= dq->nx)
+                continue;
+            if (low < 0)
+                low = 0;
+            if (high >= dq->nx)
+                high = dq->nx - 1;
+            for (i = low; i <= high; ++i)
+                row[i] |= span->flag;
+        }
+    }
+}
+
+DQMask * findDQMask(const char * key)
+{
+    int i;
+
+    for (i = 0; i < DQMASK_CACHE_SIZE; ++i)
+    {
+        if (cache[i].key && strcmp(cache[i].key, key) == 0)
+        {
+            cache[i].lastUse = ++useCount;
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+DQMask * newDQMask(const char * key)
+{
+    DQMask * mask = &cache[0];
+    int i;
+
+    for (i = 0; i < DQMASK_CACHE_SIZE; ++i)
+    {
+        if (!cache[i].key)
+        {
+            mask = &cache[i];
+            break;
+        }
+        if (cache[i].lastUse < mask->lastUse)
+            mask = &cache[i];
+    }
+
+    freeDQMask(mask);
+    if (!(mask->key = malloc(strlen(key) + 1)))
+        return NULL;
+    strcpy(mask->key, key);
+    mask->lastUse = ++useCount;
+    return mask;
+}
+
+void clearDQMaskCache(void)
+{
+    int i;
+
+    for (i = 0; i < DQMASK_CACHE_SIZE; ++i)
+        freeDQMask(&cache[i]);
+    useCount = 0;
+}
+
+void freeBpixTable(BpixTable * bpix)
+{
+    free(bpix->name);
+    free(bpix->rows);
+    bpix->name = NULL;
+    bpix->axlen1 = bpix->axlen2 = 0;
+    bpix->hasText = bpix->hasGain = False;
+    bpix->intGain = False;
+    bpix->nrows = 0;
+    bpix->rows = NULL;
+}
+
+typedef struct {
+    IRAFPointer tp;
+    IRAFPointer cp_xstart, cp_ystart, cp_length, cp_axis, cp_flag;
+    IRAFPointer cp_text, cp_chip, cp_gain;
+} BpixColumns;
+
+// Finds the columns and reads the header of an open table, closing it on error
+static int openBpixColumns(BpixColumns * col, BpixTable * bpix, const BpixFormat * format)
+{
+    col->cp_text = col->cp_chip = col->cp_gain = 0;
+    c_tbcfnd1(col->tp, "PIX1", &col->cp_xstart);
+    c_tbcfnd1(col->tp, "PIX2", &col->cp_ystart);
+    c_tbcfnd1(col->tp, "LENGTH", &col->cp_length);
+    c_tbcfnd1(col->tp, "AXIS", &col->cp_axis);
+    c_tbcfnd1(col->tp, "VALUE", &col->cp_flag);
+    if (format->textColumn)
+        c_tbcfnd1(col->tp, format->textColumn, &col->cp_text);
+    if (format->readChip)
+        c_tbcfnd1(col->tp, "CCDCHIP", &col->cp_chip);
+    if (format->readGain)
+        c_tbcfnd1(col->tp, "CCDGAIN", &col->cp_gain);
+    if (col->cp_xstart == 0 || col->cp_ystart == 0 || col->cp_length == 0 ||
+        col->cp_axis == 0 || col->cp_flag == 0 || (format->readChip && col->cp_chip == 0))
+    {
+        c_tbtclo(col->tp);
+        trlerror("Column not found in BPIXTAB.");
+        return COLUMN_NOT_FOUND;
+    }
+
+    if (col->cp_gain != 0)
+    {
+        char colname[SZ_COLNAME+1], colunits[SZ_COLUNITS+1], colfmt[SZ_COLFMT+1];
+        int colnum, datatype, lendata, lenfmt;
+
+        c_tbcinf(col->cp_gain, &colnum, colname, colunits, colfmt, &datatype, &lendata, &lenfmt);
+        bpix->intGain = (datatype == IRAF_INT);
+    }
+    bpix->hasText = (col->cp_text != 0);
+    bpix->hasGain = (col->cp_gain != 0);
+
+    // How large a full-size data quality array should be
+    if (format->readSize)
+    {
+        bpix->axlen1 = c_tbhgti(col->tp, "SIZAXIS1");
+        if (c_iraferr())
+        {
+            c_tbtclo(col->tp);
+            trlerror("Couldn't get SIZAXIS1 from BPIXTAB header.");
+            return TABLE_ERROR;
+        }
+        bpix->axlen2 = c_tbhgti(col->tp, "SIZAXIS2");
+        if (c_iraferr())
+        {
+            c_tbtclo(col->tp);
+            trlerror("Couldn't get SIZAXIS2 from BPIXTAB header.");
+            return TABLE_ERROR;
+        }
+    }
+
+    return HSTCAL_OK;
+}
+
+// Reads one row (one indexed) of the table, with the pixel made zero indexed
+static int readBpixRow(const BpixColumns * col, const int row, const BpixTable * bpix,
+        const BpixFormat * format, BpixRow * tabrow)
+{
+    if (col->cp_text != 0)
+    {
+        c_tbegtt(col->tp, col->cp_text, row, tabrow->text, format->textLength);
+        if (c_iraferr())
+            return TABLE_ERROR;
+    }
+    else if (format->textDefault)
+        strcpy(tabrow->text, format->textDefault);
+    if (col->cp_chip != 0)
+    {
+        c_tbegti(col->tp, col->cp_chip, row, &tabrow->chip);
+        if (c_iraferr())
+            return TABLE_ERROR;
+    }
+    if (col->cp_gain != 0)
+    {
+        if (bpix->intGain)
+        {
+            c_tbegti(col->tp, col->cp_gain, row, &tabrow->gaini);
+            tabrow->gain = tabrow->gaini;
+        }
+        else
+            c_tbegtr(col->tp, col->cp_gain, row, &tabrow->gain);
+        if (c_iraferr())
+            return TABLE_ERROR;
+    }
+
+    c_tbegti(col->tp, col->cp_xstart, row, &tabrow->run.x);
+    if (c_iraferr())
+        return TABLE_ERROR;
+    tabrow->run.x--;
+    c_tbegti(col->tp, col->cp_ystart, row, &tabrow->run.y);
+    if (c_iraferr())
+        return TABLE_ERROR;
+    tabrow->run.y--;
+    c_tbegti(col->tp, col->cp_length, row, &tabrow->run.length);
+    if (c_iraferr())
+        return TABLE_ERROR;
+    c_tbegti(col->tp, col->cp_axis, row, &tabrow->run.axis);
+    if (c_iraferr())
+        return TABLE_ERROR;
+    c_tbegts(col->tp, col->cp_flag, row, &tabrow->run.flag);
+    if (c_iraferr())
+        return TABLE_ERROR;
+
+    if (tabrow->run.axis != 1 && tabrow->run.axis != 2)
+    {
+        trlerror("Axis = %d in BPIXTAB, but it must be 1 or 2.", tabrow->run.axis);
+        return TABLE_ERROR;
+    }
+    if (tabrow->run.length <= 0)
+    {
+        trlerror("Length = %d in BPIXTAB, but it must be positive.", tabrow->run.length);
+        return TABLE_ERROR;
+    }
+
+    return HSTCAL_OK;
+}
+
+int loadBpixTable(BpixTable * bpix, const char * name, const BpixFormat * format)
+{
+    BpixColumns col;
+    int nrows, row;
+    int status;
+
+    if (bpix->name && strcmp(bpix->name, name) == 0)
+        return HSTCAL_OK;
+    freeBpixTable(bpix);
+
+    col.tp = c_tbtopn((char *)name, IRAF_READ_ONLY, 0);
+    if (c_iraferr())
+        return OPEN_FAILED;
+
+    nrows = c_tbpsta(col.tp, TBL_NROWS);
+    if (nrows < 1)
+        nrows = 0;
+    if ((nrows > 0 || format->readEmpty) &&
+        (status = openBpixColumns(&col, bpix, format)))
+    {
+        freeBpixTable(bpix);
+        return status;
+    }
+
+    bpix->rows = calloc(nrows > 0 ? nrows : 1, sizeof(*bpix->rows));
+    bpix->name = malloc(strlen(name) + 1);
+    if (!bpix->rows || !bpix->name)
+    {
+        c_tbtclo(col.tp);
+        freeBpixTable(bpix);
+        trlerror("Out of memory for BPIXTAB rows.");
+        return OUT_OF_MEMORY;
+    }
+
+    for (row = 1; row <= nrows; ++row)
+    {
+        if ((status = readBpixRow(&col, row, bpix, format, &bpix->rows[row-1])))
+        {
+            c_tbtclo(col.tp);
+            freeBpixTable(bpix);
+            trlerror("Error reading BPIXTAB.");
+            return status;
+        }
+    }
+
+    c_tbtclo(col.tp);
+    if (c_iraferr())
+    {
+        freeBpixTable(bpix);
+        return TABLE_ERROR;
+    }
+
+    strcpy(bpix->name, name);
+    bpix->nrows = nrows;
+    return HSTCAL_OK;
+}
+
+int makeBpixMask(const BpixTable * bpix, const char * key, BpixFilter filter,
+        const void * selection, DQMask ** mask)
+{
+    BpixRow tabrow;
+    int row;
+
+    if ((*mask = newDQMask(key)) == NULL)
+    {
+        trlerror("Out of memory for BPIXTAB mask.");
+        return OUT_OF_MEMORY;
+    }
+
+    for (row = 0; row < bpix->nrows; ++row)
+    {
+        tabrow = bpix->rows[row];
+        if (!filter(bpix, &tabrow, selection))
+            continue;
+        if (addDQRun(*mask, tabrow.run.x, tabrow.run.y, tabrow.run.length, tabrow.run.axis,
+                tabrow.run.flag))
+            break;
+    }
+
+    if (row < bpix->nrows || compileDQMask(*mask))
+    {
+        freeDQMask(*mask);
+        *mask = NULL;
+        trlerror("Out of memory for BPIXTAB mask.");
+        return OUT_OF_MEMORY;
+    }
+
+    return HSTCAL_OK;
+}
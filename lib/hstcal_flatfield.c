@@ -0,0 +1,187 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hstcal_flatfield.h"
+#include "hstcalerr.h"
+
+#define FLATFIELD_CACHE_SIZE 4
+
+/* Bytes the cached flats may take between them: the pixel-to-pixel flats of both
+ * chips of a full-frame exposure, or more subarray flats. */
+#define FLATFIELD_CACHE_BYTES ((size_t)256 << 20)
+
+/* The most recently used flats, those of the image being flat fielded, are kept
+ * even over the budget. */
+#define FLATFIELD_CACHE_KEEP 2
+
+/* Images smaller than this are divided serially, threading overheads dominate. */
+#define FLATFIELD_MIN_PARALLEL_PIXELS 65536
+
+static FlatField cache[FLATFIELD_CACHE_SIZE];
+static unsigned long useCount = 0;
+
+void initFlatField(FlatField * flat)
+{
+    flat->key = NULL;
+    flat->lastUse = 0;
+    flat->nx = 0;
+    flat->ny = 0;
+    flat->sci = NULL;
+    flat->err = NULL;
+    flat->dq = NULL;
+}
+
+void freeFlatField(FlatField * flat)
+{
+    free(flat->key);
+    free(flat->sci);
+    free(flat->err);
+    free(flat->dq);
+    initFlatField(flat);
+}
+
+FlatField * findFlatField(const char * key)
+{
+    int i;
+
+    for (i = 0; i < FLATFIELD_CACHE_SIZE; ++i)
+    {
+        if (cache[i].key && strcmp(cache[i].key, key) == 0)
+        {
+            cache[i].lastUse = ++useCount;
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+void clearFlatFieldCache(void)
+{
+    int i;
+
+    for (i = 0; i < FLATFIELD_CACHE_SIZE; ++i)
+        freeFlatField(&cache[i]);
+    useCount = 0;
+}
+
+static size_t flatFieldBytes(const size_t npix)
+{
+    return npix * (sizeof(*cache[0].sci) + sizeof(*cache[0].err) + sizeof(*cache[0].dq));
+}
+
+FlatField * newFlatField(const char * key, const int nx, const int ny)
+{
+    FlatField * flat;
+    FlatField * oldest;
+    const size_t npix = (size_t)nx * ny;
+    size_t bytes;
+    int i, nused;
+
+    // Replace the least recently used flats until there is a free slot and the new
+    // flat fits in the budget, or only the ones to keep are left
+    for (;;)
+    {
+        flat = NULL;
+        oldest = NULL;
+        bytes = flatFieldBytes(npix);
+        nused = 0;
+        for (i = 0; i < FLATFIELD_CACHE_SIZE; ++i)
+        {
+            if (!cache[i].key)
+            {
+                if (!flat)
+                    flat = &cache[i];
+                continue;
+            }
+            ++nused;
+            bytes += flatFieldBytes((size_t)cache[i].nx * cache[i].ny);
+            if (!oldest || cache[i].lastUse < oldest->lastUse)
+                oldest = &cache[i];
+        }
+        if ((flat && bytes <= FLATFIELD_CACHE_BYTES) || nused <= FLATFIELD_CACHE_KEEP)
+            break;
+        freeFlatField(oldest);
+    }
+
+    flat->key = malloc(strlen(key) + 1);
+    flat->sci = malloc((npix ? npix : 1) * sizeof(*flat->sci));
+    flat->err = malloc((npix ? npix : 1) * sizeof(*flat->err));
+    flat->dq = malloc((npix ? npix : 1) * sizeof(*flat->dq));
+    if (!flat->key || !flat->sci || !flat->err || !flat->dq)
+    {
+        freeFlatField(flat);
+        return NULL;
+    }
+    strcpy(flat->key, key);
+    flat->lastUse = ++useCount;
+    flat->nx = nx;
+    flat->ny = ny;
+    return flat;
+}
+
+void putFlatFieldLine(FlatField * flat, const int j, const SingleGroupLine * line)
+{
+    const size_t row = (size_t)j * flat->nx;
+
+    memcpy(flat->sci + row, line->sci.line, flat->nx * sizeof(*flat->sci));
+    memcpy(flat->err + row, line->err.line, flat->nx * sizeof(*flat->err));
+    memcpy(flat->dq + row, line->dq.line, flat->nx * sizeof(*flat->dq));
+}
+
+// Row j of x divided by row j of flat, as div1d
+static void divFlatRow(SingleGroup * x, const FlatField * flat, const int j, const short badflag)
+{
+    const int nx = x->sci.data.nx;
+    const size_t row = (size_t)j * flat->nx;
+    const float * fsci = flat->sci + row;
+    const float * ferr = flat->err + row;
+    const short * fdq = flat->dq + row;
+    float * sci = &Pix(x->sci.data, 0, j);
+    float * err = &Pix(x->err.data, 0, j);
+    short * dq = &DQPix(x->dq.data, 0, j);
+    int i;
+
+    for (i = 0; i < nx; ++i)
+    {
+        const float a_sci = sci[i];
+        const float b_sci = fsci[i];
+
+        if (b_sci == 0.)
+        {
+            // Flag divide by zero as lost data
+            dq[i] |= badflag;
+        }
+        else
+        {
+            const float a_expr = err[i] / b_sci;
+            const float b_expr = ferr[i] * a_sci / b_sci / b_sci;
+            sci[i] = a_sci / b_sci;
+            err[i] = sqrt(a_expr * a_expr + b_expr * b_expr);
+        }
+    }
+    for (i = 0; i < x->dq.data.nx; ++i)
+        dq[i] |= fdq[i];
+}
+
+int divFlatFields(SingleGroup * x, FlatField * const * flats, const int nflats,
+        const short badflag)
+{
+    const int ny = x->sci.data.ny;
+    int j, k;
+
+    for (k = 0; k < nflats; ++k)
+        if (flats[k]->nx != x->sci.data.nx || flats[k]->ny < ny || x->dq.data.nx > flats[k]->nx)
+            return SIZE_MISMATCH;
+
+    // Each row is divided by all flats while it is in cache
+# ifdef _OPENMP
+    #pragma omp parallel for schedule(static) private(k) \
+        if ((size_t)x->sci.data.nx * ny >= FLATFIELD_MIN_PARALLEL_PIXELS)
+# endif
+    for (j = 0; j < ny; ++j)
+        for (k = 0; k < nflats; ++k)
+            divFlatRow(x, flats[k], j, badflag);
+
+    return HSTCAL_OK;
+}
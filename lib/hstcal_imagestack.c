@@ -0,0 +1,524 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+#include "hstcal_imagestack.h"
+#include "hstcalerr.h"
+
+// State of the second band buffer of an image
+#define BAND_EMPTY   0
+#define BAND_QUEUED  1 // waiting for the reader thread
+#define BAND_READING 2
+#define BAND_READY   3
+
+/* The two band buffers of an image. The caller's thread reads lines from buffer 'cur'
+ * and alone changes 'cur' & 'first', the reader thread fills the other buffer. */
+typedef struct {
+    float * sci[2];
+    float * err[2];
+    short * dq[2];
+    int first[2]; // first line held, -1 if none
+    int ret[2];   // status of the read
+    int cur;
+    int state;    // of buffer 1 - cur
+} StackBand;
+
+struct ImageStackBands {
+    const ImageStack * stack;
+    StackBand * img;
+#ifdef HAVE_PTHREADS
+    pthread_t reader;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int * queue;  // images whose next band is to be read, in order
+    int head;
+    int nqueued;
+    Bool reading;
+    Bool paused;  // the caller's thread is reading
+    Bool quit;
+#endif
+};
+
+size_t imageStackBytes(const int nimgs, const int nx, const int ny, const Bool withErr)
+{
+    const size_t bytesPerPixel = sizeof(float) + sizeof(short) + (withErr ? sizeof(float) : 0);
+    return (size_t)nimgs * (size_t)nx * (size_t)ny * bytesPerPixel;
+}
+
+void initImageStack(ImageStack * stack)
+{
+    stack->nimgs = 0;
+    stack->nx = 0;
+    stack->ny = 0;
+    stack->inMemory = False;
+    stack->sciDesc = NULL;
+    stack->errDesc = NULL;
+    stack->dqDesc = NULL;
+    stack->sci = NULL;
+    stack->err = NULL;
+    stack->dq = NULL;
+    stack->dqHdr = NULL;
+    stack->errHdr = NULL;
+    stack->bandLines = 0;
+    stack->bands = NULL;
+}
+
+static void freeStackBands(ImageStack * stack);
+
+void freeImageStack(ImageStack * stack)
+{
+    freeStackBands(stack);
+    if (stack->dqHdr)
+    {
+        int k;
+        for (k = 0; k < stack->nimgs; ++k)
+            freeHdr(&stack->dqHdr[k]);
+        free(stack->dqHdr);
+    }
+    if (stack->errHdr)
+    {
+        int k;
+        for (k = 0; k < stack->nimgs; ++k)
+            freeHdr(&stack->errHdr[k]);
+        free(stack->errHdr);
+    }
+    free(stack->sci);
+    free(stack->err);
+    free(stack->dq);
+    initImageStack(stack);
+}
+
+/* Null (constant) DQ & ERR arrays are expanded from the NPIX1/PIXVALUE keywords of the
+ * header last attached to their descriptor by getHeader(). */
+static Hdr * attachHeaders(IODescPtr desc[], const int nimgs)
+{
+    Hdr * hdr = malloc(nimgs * sizeof(*hdr));
+    if (!hdr)
+        return NULL;
+    {int k;
+    for (k = 0; k < nimgs; ++k)
+    {
+        initHdr(&hdr[k]);
+        getHeader(desc[k], &hdr[k]);
+    }}
+    return hdr;
+}
+
+static int loadFloatImage(IODescPtr desc, const int nx, const int ny, float * data)
+{
+    int j;
+    for (j = 0; j < ny; ++j)
+    {
+        getFloatLine(desc, j, data + (size_t)j*nx);
+        if (hstio_err())
+            return IO_ERROR;
+    }
+    return HSTCAL_OK;
+}
+
+static int loadShortImage(IODescPtr desc, const int nx, const int ny, short * data)
+{
+    int j;
+    for (j = 0; j < ny; ++j)
+    {
+        getShortLine(desc, j, data + (size_t)j*nx);
+        if (hstio_err())
+            return IO_ERROR;
+    }
+    return HSTCAL_OK;
+}
+
+/* Read the whole stack, one image at a time so that each file is read sequentially. */
+static int loadImageStack(ImageStack * stack)
+{
+    const size_t imageSize = (size_t)stack->nx * stack->ny;
+    int k;
+    int ret;
+
+    for (k = 0; k < stack->nimgs; ++k)
+    {
+        Hdr hdr;
+
+        if ((ret = loadFloatImage(stack->sciDesc[k], stack->nx, stack->ny, stack->sci + k*imageSize)))
+            return ret;
+
+        if (stack->errDesc)
+        {
+            initHdr(&hdr);
+            getHeader(stack->errDesc[k], &hdr);
+            ret = loadFloatImage(stack->errDesc[k], stack->nx, stack->ny, stack->err + k*imageSize);
+            freeHdr(&hdr);
+            if (ret)
+                return ret;
+        }
+
+        initHdr(&hdr);
+        getHeader(stack->dqDesc[k], &hdr);
+        ret = loadShortImage(stack->dqDesc[k], stack->nx, stack->ny, stack->dq + k*imageSize);
+        freeHdr(&hdr);
+        if (ret)
+            return ret;
+    }
+    return HSTCAL_OK;
+}
+
+/* Read the band of image 'img' starting at line 'first' into buffer 'b', one
+ * extension at a time so that each is read sequentially. */
+static int readBand(const ImageStack * stack, const int img, const int b, const int first)
+{
+    const StackBand * band = &stack->bands->img[img];
+    const int nx = stack->nx;
+    const int last = (first + stack->bandLines < stack->ny) ? first + stack->bandLines : stack->ny;
+    int j;
+
+    for (j = first; j < last; ++j)
+    {
+        if (getFloatLine(stack->sciDesc[img], j, band->sci[b] + (size_t)(j - first)*nx))
+            return IO_ERROR;
+    }
+    if (stack->errDesc)
+    {
+        for (j = first; j < last; ++j)
+        {
+            if (getFloatLine(stack->errDesc[img], j, band->err[b] + (size_t)(j - first)*nx))
+                return IO_ERROR;
+        }
+    }
+    for (j = first; j < last; ++j)
+    {
+        if (getShortLine(stack->dqDesc[img], j, band->dq[b] + (size_t)(j - first)*nx))
+            return IO_ERROR;
+    }
+    return HSTCAL_OK;
+}
+
+#ifdef HAVE_PTHREADS
+static void * bandReader(void * arg)
+{
+    struct ImageStackBands * bands = arg;
+
+    pthread_mutex_lock(&bands->lock);
+    for (;;)
+    {
+        StackBand * band;
+        int img, b, ret;
+
+        while (!bands->quit && (bands->nqueued == 0 || bands->paused))
+            pthread_cond_wait(&bands->cond, &bands->lock);
+        if (bands->quit)
+            break;
+
+        img = bands->queue[bands->head];
+        bands->head = (bands->head + 1) % bands->stack->nimgs;
+        bands->nqueued--;
+        band = &bands->img[img];
+        b = 1 - band->cur;
+        band->state = BAND_READING;
+        bands->reading = True;
+        pthread_mutex_unlock(&bands->lock);
+
+        ret = readBand(bands->stack, img, b, band->first[b]);
+
+        pthread_mutex_lock(&bands->lock);
+        band->ret[b] = ret;
+        band->state = BAND_READY;
+        bands->reading = False;
+        pthread_cond_broadcast(&bands->cond);
+    }
+    pthread_mutex_unlock(&bands->lock);
+    return NULL;
+}
+#endif
+
+static void freeStackBands(ImageStack * stack)
+{
+    struct ImageStackBands * bands = stack->bands;
+
+    if (!bands)
+        return;
+#ifdef HAVE_PTHREADS
+    if (bands->queue)
+    {
+        pthread_mutex_lock(&bands->lock);
+        bands->quit = True;
+        pthread_cond_broadcast(&bands->cond);
+        pthread_mutex_unlock(&bands->lock);
+        pthread_join(bands->reader, NULL);
+        pthread_cond_destroy(&bands->cond);
+        pthread_mutex_destroy(&bands->lock);
+        free(bands->queue);
+    }
+#endif
+    if (bands->img)
+    {
+        int k, b;
+        for (k = 0; k < stack->nimgs; ++k)
+        {
+            for (b = 0; b < 2; ++b)
+            {
+                free(bands->img[k].sci[b]);
+                free(bands->img[k].err[b]);
+                free(bands->img[k].dq[b]);
+            }
+        }
+        free(bands->img);
+    }
+    free(bands);
+    stack->bands = NULL;
+    stack->bandLines = 0;
+}
+
+/* Band buffers of bandLines lines for every image, and the reader thread. On failure
+ * the stack is left streaming line by line. */
+static int allocStackBands(ImageStack * stack, const int bandLines)
+{
+    const size_t bandSize = (size_t)bandLines * stack->nx;
+    struct ImageStackBands * bands;
+    int k, b;
+
+    if (!(bands = calloc(1, sizeof(*bands))))
+        return OUT_OF_MEMORY;
+    stack->bands = bands;
+    stack->bandLines = bandLines;
+    bands->stack = stack;
+
+    if (!(bands->img = calloc(stack->nimgs, sizeof(*bands->img))))
+    {
+        freeStackBands(stack);
+        return OUT_OF_MEMORY;
+    }
+    for (k = 0; k < stack->nimgs; ++k)
+    {
+        StackBand * band = &bands->img[k];
+        band->state = BAND_EMPTY;
+        for (b = 0; b < 2; ++b)
+        {
+            band->first[b] = -1;
+            band->sci[b] = malloc(bandSize * sizeof(*band->sci[b]));
+            band->dq[b] = malloc(bandSize * sizeof(*band->dq[b]));
+            if (stack->errDesc)
+                band->err[b] = malloc(bandSize * sizeof(*band->err[b]));
+            if (!band->sci[b] || !band->dq[b] || (stack->errDesc && !band->err[b]))
+            {
+                freeStackBands(stack);
+                return OUT_OF_MEMORY;
+            }
+        }
+    }
+
+#ifdef HAVE_PTHREADS
+    if (!(bands->queue = malloc(stack->nimgs * sizeof(*bands->queue))))
+    {
+        freeStackBands(stack);
+        return OUT_OF_MEMORY;
+    }
+    pthread_mutex_init(&bands->lock, NULL);
+    pthread_cond_init(&bands->cond, NULL);
+    if (pthread_create(&bands->reader, NULL, bandReader, bands))
+    {
+        // Bands are then read when needed, without reading ahead
+        pthread_cond_destroy(&bands->cond);
+        pthread_mutex_destroy(&bands->lock);
+        free(bands->queue);
+        bands->queue = NULL;
+    }
+#endif
+    return HSTCAL_OK;
+}
+
+void syncImageStack(const ImageStack * stack)
+{
+#ifdef HAVE_PTHREADS
+    struct ImageStackBands * bands = stack->bands;
+    if (!bands || !bands->queue)
+        return;
+    pthread_mutex_lock(&bands->lock);
+    while (bands->nqueued || bands->reading)
+        pthread_cond_wait(&bands->cond, &bands->lock);
+    pthread_mutex_unlock(&bands->lock);
+#else
+    (void) stack;
+#endif
+}
+
+/* Make the band holding 'line' of image 'img' current, from the band read ahead or
+ * read now, then have the next one read ahead. Returns the status of its read. */
+static int useBand(const ImageStack * stack, const int img, const int line)
+{
+    struct ImageStackBands * bands = stack->bands;
+    StackBand * band = &bands->img[img];
+    const int first = line - line % stack->bandLines;
+
+    if (band->first[band->cur] == first)
+        return band->ret[band->cur];
+
+#ifdef HAVE_PTHREADS
+    if (bands->queue)
+    {
+        int other;
+
+        pthread_mutex_lock(&bands->lock);
+        // The other buffer can't be reused while it is being filled
+        while (band->state == BAND_QUEUED || band->state == BAND_READING)
+            pthread_cond_wait(&bands->cond, &bands->lock);
+
+        other = 1 - band->cur;
+        if (band->state == BAND_READY && band->first[other] == first)
+        {
+            band->cur = other;
+            band->state = BAND_EMPTY;
+        }
+        else
+        {
+            // Read it now, with the reader thread idle
+            bands->paused = True;
+            while (bands->reading)
+                pthread_cond_wait(&bands->cond, &bands->lock);
+            pthread_mutex_unlock(&bands->lock);
+            band->first[band->cur] = first;
+            band->ret[band->cur] = readBand(stack, img, band->cur, first);
+            pthread_mutex_lock(&bands->lock);
+            bands->paused = False;
+        }
+
+        if (first + stack->bandLines < stack->ny)
+        {
+            other = 1 - band->cur;
+            band->first[other] = first + stack->bandLines;
+            band->state = BAND_QUEUED;
+            bands->queue[(bands->head + bands->nqueued) % stack->nimgs] = img;
+            bands->nqueued++;
+        }
+        pthread_cond_broadcast(&bands->cond);
+        pthread_mutex_unlock(&bands->lock);
+        return band->ret[band->cur];
+    }
+#endif
+
+    band->first[band->cur] = first;
+    band->ret[band->cur] = readBand(stack, img, band->cur, first);
+    return band->ret[band->cur];
+}
+
+int openImageStack(ImageStack * stack, IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
+        const int nimgs, const int nx, const int ny, const size_t memoryBudget)
+{
+    const size_t imageSize = (size_t)nx * ny;
+    int ret;
+
+    initImageStack(stack);
+    stack->nimgs = nimgs;
+    stack->nx = nx;
+    stack->ny = ny;
+    stack->sciDesc = ipsci;
+    stack->errDesc = iperr;
+    stack->dqDesc = ipdq;
+
+    if (memoryBudget > 0 && imageStackBytes(nimgs, nx, ny, iperr != NULL) <= memoryBudget)
+    {
+        stack->sci = malloc(nimgs * imageSize * sizeof(*stack->sci));
+        stack->dq = malloc(nimgs * imageSize * sizeof(*stack->dq));
+        if (iperr)
+            stack->err = malloc(nimgs * imageSize * sizeof(*stack->err));
+
+        if (stack->sci && stack->dq && (!iperr || stack->err))
+        {
+            if ((ret = loadImageStack(stack)))
+            {
+                freeImageStack(stack);
+                return ret;
+            }
+            stack->inMemory = True;
+            return HSTCAL_OK;
+        }
+
+        // The budget is advisory, fall back to streaming if the allocation fails
+        free(stack->sci);
+        free(stack->err);
+        free(stack->dq);
+        stack->sci = NULL;
+        stack->err = NULL;
+        stack->dq = NULL;
+    }
+
+    if (!(stack->dqHdr = attachHeaders(ipdq, nimgs)))
+        return OUT_OF_MEMORY;
+    if (iperr && !(stack->errHdr = attachHeaders(iperr, nimgs)))
+        return OUT_OF_MEMORY;
+
+    // Two bands of every image within the budget, none if too small for a line
+    if (memoryBudget > 0)
+    {
+        const size_t lineBytes = imageStackBytes(nimgs, nx, 1, iperr != NULL);
+        size_t bandLines = memoryBudget / (2 * lineBytes);
+        if (bandLines > (size_t)ny)
+            bandLines = ny;
+        if (bandLines > 0 && allocStackBands(stack, (int)bandLines))
+            return OUT_OF_MEMORY;
+    }
+
+    return HSTCAL_OK;
+}
+
+int getStackSciLine(const ImageStack * stack, const int img, const int line, float * buf)
+{
+    if (line < 0 || line >= stack->ny)
+        return SIZE_MISMATCH;
+    if (stack->bands)
+    {
+        const StackBand * band;
+        int ret = useBand(stack, img, line);
+        band = &stack->bands->img[img];
+        memcpy(buf, band->sci[band->cur] + (size_t)(line - band->first[band->cur])*stack->nx,
+                stack->nx*sizeof(*buf));
+        return ret;
+    }
+    if (!stack->inMemory)
+        return getFloatLine(stack->sciDesc[img], line, buf) ? IO_ERROR : HSTCAL_OK;
+
+    memcpy(buf, stack->sci + ((size_t)img*stack->ny + line)*stack->nx, stack->nx*sizeof(*buf));
+    return HSTCAL_OK;
+}
+
+int getStackErrLine(const ImageStack * stack, const int img, const int line, float * buf)
+{
+    if (!stack->errDesc || line < 0 || line >= stack->ny)
+        return SIZE_MISMATCH;
+    if (stack->bands)
+    {
+        const StackBand * band;
+        int ret = useBand(stack, img, line);
+        band = &stack->bands->img[img];
+        memcpy(buf, band->err[band->cur] + (size_t)(line - band->first[band->cur])*stack->nx,
+                stack->nx*sizeof(*buf));
+        return ret;
+    }
+    if (!stack->inMemory)
+        return getFloatLine(stack->errDesc[img], line, buf) ? IO_ERROR : HSTCAL_OK;
+
+    memcpy(buf, stack->err + ((size_t)img*stack->ny + line)*stack->nx, stack->nx*sizeof(*buf));
+    return HSTCAL_OK;
+}
+
+int getStackDqLine(const ImageStack * stack, const int img, const int line, short * buf)
+{
+    if (line < 0 || line >= stack->ny)
+        return SIZE_MISMATCH;
+    if (stack->bands)
+    {
+        const StackBand * band;
+        int ret = useBand(stack, img, line);
+        band = &stack->bands->img[img];
+        memcpy(buf, band->dq[band->cur] + (size_t)(line - band->first[band->cur])*stack->nx,
+                stack->nx*sizeof(*buf));
+        return ret;
+    }
+    if (!stack->inMemory)
+        return getShortLine(stack->dqDesc[img], line, buf) ? IO_ERROR : HSTCAL_OK;
+
+    memcpy(buf, stack->dq + ((size_t)img*stack->ny + line)*stack->nx, stack->nx*sizeof(*buf));
+    return HSTCAL_OK;
+}
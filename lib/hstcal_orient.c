@@ -0,0 +1,253 @@
+#include <stdlib.h>
+
+# ifdef _OPENMP
+#include <omp.h>
+# endif
+
+#include "hstcal_orient.h"
+#include "hstcalerr.h"
+
+/* Square tile edge for the blocked transposes, a tile of both the source and the
+ * destination fits in L1 for all supported pixel types.
+ */
+#define ORIENT_TILE 32
+
+/* Arrays smaller than this are reoriented serially, threading overheads dominate. */
+#define ORIENT_MIN_PARALLEL_PIXELS 65536
+
+static Bool isValidOrientation(const Orientation orient)
+{
+    return !(orient & ~ORIENT_ANTITRANSPOSE);
+}
+
+static Bool ownsEntireBuffer(const void * data, const void * buffer, const int nx, const int ny,
+        const int tot_nx, const int tot_ny)
+{
+    return data == buffer && nx == tot_nx && ny == tot_ny;
+}
+
+/*
+   Flips (no transpose) are done in place one row pair at a time. The inner loops are
+   unit stride, or reversed unit stride, so vectorize.
+*/
+static void flipFloat(float * data, const size_t stride, const unsigned nx, const unsigned ny, const Orientation orient)
+{
+    const Bool flipX = (orient & ORIENT_FLIP_X) != 0;
+    const Bool flipY = (orient & ORIENT_FLIP_Y) != 0;
+    const Bool runParallel = (size_t)nx*ny >= ORIENT_MIN_PARALLEL_PIXELS;
+
+    if (flipY)
+    {
+        {unsigned i;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) if(runParallel)
+#endif
+        for (i = 0; i < ny/2; ++i)
+        {
+            float * restrict top = data + i*stride;
+            float * restrict bottom = data + (ny-1-i)*stride;
+            {unsigned j;
+            if (flipX)
+            {
+                for (j = 0; j < nx; ++j)
+                {
+                    const float temp = top[j];
+                    top[j] = bottom[nx-1-j];
+                    bottom[nx-1-j] = temp;
+                }
+            }
+            else
+            {
+                for (j = 0; j < nx; ++j)
+                {
+                    const float temp = top[j];
+                    top[j] = bottom[j];
+                    bottom[j] = temp;
+                }
+            }}
+        }}
+    }
+
+    //Rows still needing reversal, i.e. all of them or, if also flipped in y, only an odd central row
+    const unsigned firstRow = flipY ? ny/2 : 0;
+    const unsigned endRow = flipY ? (ny % 2 ? ny/2 + 1 : ny/2) : ny;
+    if (!flipX || firstRow >= endRow)
+        return;
+
+    {unsigned i;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) if(runParallel && endRow - firstRow > 1)
+#endif
+    for (i = firstRow; i < endRow; ++i)
+    {
+        float * row = data + i*stride;
+        {unsigned j;
+        for (j = 0; j < nx/2; ++j)
+        {
+            const float temp = row[j];
+            row[j] = row[nx-1-j];
+            row[nx-1-j] = temp;
+        }}
+    }}
+}
+
+/*
+   Out of place, cache blocked transpose of the contiguous nx by ny array 'in' into the
+   ny by nx array 'out', with any flips folded into the destination index. Source pixel
+   (x,y) lands at output (y,x), (ny-1-y,x) for FLIP_X and (y,nx-1-x) for FLIP_Y.
+*/
+static void transposeFloat(const float * restrict in, const unsigned nx, const unsigned ny,
+        float * restrict out, const Orientation orient)
+{
+    const Bool flipX = (orient & ORIENT_FLIP_X) != 0;
+    const Bool flipY = (orient & ORIENT_FLIP_Y) != 0;
+    const Bool runParallel = (size_t)nx*ny >= ORIENT_MIN_PARALLEL_PIXELS;
+
+    {unsigned yTile, xTile;
+#ifdef _OPENMP
+    #pragma omp parallel for collapse(2) schedule(static) if(runParallel)
+#endif
+    for (yTile = 0; yTile < ny; yTile += ORIENT_TILE)
+    {
+        for (xTile = 0; xTile < nx; xTile += ORIENT_TILE)
+        {
+            const unsigned yEnd = yTile + ORIENT_TILE < ny ? yTile + ORIENT_TILE : ny;
+            const unsigned xEnd = xTile + ORIENT_TILE < nx ? xTile + ORIENT_TILE : nx;
+            {unsigned x;
+            for (x = xTile; x < xEnd; ++x)
+            {
+                float * outRow = out + (size_t)(flipY ? nx-1-x : x)*ny;
+                {unsigned y;
+                if (flipX)
+                {
+                    for (y = yTile; y < yEnd; ++y)
+                        outRow[ny-1-y] = in[(size_t)y*nx + x];
+                }
+                else
+                {
+                    for (y = yTile; y < yEnd; ++y)
+                        outRow[y] = in[(size_t)y*nx + x];
+                }}
+            }}
+        }
+    }}
+}
+
+int reorientFloatData(FloatTwoDArray * array, const Orientation orient)
+{
+    if (!array || !array->data)
+        return ALLOCATION_PROBLEM;
+    if (!isValidOrientation(orient))
+        return INVALID_VALUE;
+    if (orient == ORIENT_IDENTITY)
+        return HSTCAL_OK;
+
+    const unsigned nx = array->nx;
+    const unsigned ny = array->ny;
+
+    if (!(orient & ORIENT_TRANSPOSE))
+    {
+        flipFloat(array->data, array->tot_nx, nx, ny, orient);
+        return HSTCAL_OK;
+    }
+
+    if (!ownsEntireBuffer(array->data, array->buffer, array->nx, array->ny, array->tot_nx, array->tot_ny))
+        return SIZE_MISMATCH;
+
+    float * transposed = malloc((size_t)nx*ny*sizeof(*transposed));
+    if (!transposed)
+        return OUT_OF_MEMORY;
+    transposeFloat(array->data, nx, ny, transposed, orient);
+
+    //Hand the new buffer over to the array, this saves copying the result back
+    free(array->buffer);
+    array->buffer = transposed;
+    array->data = transposed;
+    array->nx = array->tot_nx = ny;
+    array->ny = array->tot_ny = nx;
+    return HSTCAL_OK;
+}
+
+static int checkOrientedSect(const FloatTwoDArray * array, const int x0, const int y0, const int nx, const int ny,
+        const Orientation orient)
+{
+    if (!array || !array->data)
+        return ALLOCATION_PROBLEM;
+    if (!isValidOrientation(orient) || (orient & ORIENT_TRANSPOSE))
+        return INVALID_VALUE;
+    if (x0 < 0 || y0 < 0 || nx < 0 || ny < 0 || x0 + nx > array->nx || y0 + ny > array->ny)
+        return SIZE_MISMATCH;
+    return HSTCAL_OK;
+}
+
+int getOrientedFloatSect(const FloatTwoDArray * src, const int x0, const int y0, const int nx, const int ny,
+        const Orientation orient, double * dst)
+{
+    int status;
+    if ((status = checkOrientedSect(src, x0, y0, nx, ny, orient)))
+        return status;
+    if (!dst)
+        return ALLOCATION_PROBLEM;
+
+    const Bool flipX = (orient & ORIENT_FLIP_X) != 0;
+    const Bool flipY = (orient & ORIENT_FLIP_Y) != 0;
+    const Bool runParallel = (size_t)nx*ny >= ORIENT_MIN_PARALLEL_PIXELS;
+
+    {int i;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) if(runParallel)
+#endif
+    for (i = 0; i < ny; ++i)
+    {
+        const float * restrict srcRow = &PPix(src, x0, flipY ? y0+ny-1-i : y0+i);
+        double * restrict dstRow = dst + (size_t)i*nx;
+        {int j;
+        if (flipX)
+        {
+            for (j = 0; j < nx; ++j)
+                dstRow[j] = srcRow[nx-1-j];
+        }
+        else
+        {
+            for (j = 0; j < nx; ++j)
+                dstRow[j] = srcRow[j];
+        }}
+    }}
+    return HSTCAL_OK;
+}
+
+int putOrientedFloatSect(FloatTwoDArray * dst, const int x0, const int y0, const int nx, const int ny,
+        const Orientation orient, const double * src)
+{
+    int status;
+    if ((status = checkOrientedSect(dst, x0, y0, nx, ny, orient)))
+        return status;
+    if (!src)
+        return ALLOCATION_PROBLEM;
+
+    const Bool flipX = (orient & ORIENT_FLIP_X) != 0;
+    const Bool flipY = (orient & ORIENT_FLIP_Y) != 0;
+    const Bool runParallel = (size_t)nx*ny >= ORIENT_MIN_PARALLEL_PIXELS;
+
+    {int i;
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) if(runParallel)
+#endif
+    for (i = 0; i < ny; ++i)
+    {
+        float * restrict dstRow = &PPix(dst, x0, flipY ? y0+ny-1-i : y0+i);
+        const double * restrict srcRow = src + (size_t)i*nx;
+        {int j;
+        if (flipX)
+        {
+            for (j = 0; j < nx; ++j)
+                dstRow[nx-1-j] = (float) srcRow[j];
+        }
+        else
+        {
+            for (j = 0; j < nx; ++j)
+                dstRow[j] = (float) srcRow[j];
+        }}
+    }}
+    return HSTCAL_OK;
+}
@@ -0,0 +1,381 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hstcal_resample.h"
+#include "hstcalerr.h"
+
+/* Images smaller than this are resampled serially, threading overheads dominate. */
+#define RESAMPLE_MIN_PARALLEL_PIXELS 65536
+
+void initUnbinAxis(UnbinAxis * axis)
+{
+    axis->n = 0;
+    axis->k0 = NULL;
+    axis->k1 = NULL;
+    axis->p = NULL;
+    axis->q = NULL;
+    axis->d0 = NULL;
+    axis->d1 = NULL;
+}
+
+void freeUnbinAxis(UnbinAxis * axis)
+{
+    free(axis->k0);
+    free(axis->k1);
+    free(axis->p);
+    free(axis->q);
+    free(axis->d0);
+    free(axis->d1);
+    initUnbinAxis(axis);
+}
+
+int makeUnbinAxis(UnbinAxis * axis, const int nin, const int bin, const int clamp)
+{
+    const int n = nin * bin;
+    const size_t size = n > 0 ? n : 1;
+    const float offset = (float)(bin - 1) / 2.0F;
+    int m;
+
+    freeUnbinAxis(axis);
+    axis->k0 = malloc(size * sizeof(*axis->k0));
+    axis->k1 = malloc(size * sizeof(*axis->k1));
+    axis->p = malloc(size * sizeof(*axis->p));
+    axis->q = malloc(size * sizeof(*axis->q));
+    axis->d0 = malloc(size * sizeof(*axis->d0));
+    axis->d1 = malloc(size * sizeof(*axis->d1));
+    if (!axis->k0 || !axis->k1 || !axis->p || !axis->q || !axis->d0 || !axis->d1)
+    {
+        freeUnbinAxis(axis);
+        return OUT_OF_MEMORY;
+    }
+    axis->n = n;
+
+    for (m = 0; m < n; ++m)
+    {
+        const float ai = ((float)m - offset) / (float)bin;
+        int i, i1, i2, num;
+        float q;
+
+        // InterpInfo
+        i = (int)ai;
+        i = (i < 0) ? 0 : i;
+        i = (i >= nin - 1) ? (nin - 2) : i;
+        q = ai - i;
+        if (clamp)
+        {
+            q = (q < 0.0) ? 0.0F : q;
+            q = (q > 1.0) ? 1.0F : q;
+        }
+        if (nin < 2)
+        {
+            i = 0;
+            q = 0.0F;
+        }
+        axis->k0[m] = i;
+        axis->k1[m] = (nin < 2) ? i : i + 1;
+        axis->q[m] = q;
+        axis->p[m] = 1.0F - q;
+
+        // InterpDQInfo, with d1 = d0 where only one pixel is used
+        i1 = (int)ai;
+        i2 = i1 + 1;
+        num = (ai == (float)i1) ? 1 : 2;
+        if (i1 <= 0)
+        {
+            i1 = 0;
+            num = 1;
+        }
+        if (i1 >= nin - 1)
+        {
+            i1 = nin - 1;
+            num = 1;
+        }
+        axis->d0[m] = i1;
+        axis->d1[m] = (num == 1) ? i1 : i2;
+    }
+    return HSTCAL_OK;
+}
+
+static float errorValue(const float value, const ResampleKind kind)
+{
+    if (kind == RESAMPLE_ERROR_POSITIVE)
+        return (value > 0.0) ? sqrt(value) : 0.0;
+    return sqrt(value);
+}
+
+// Row interpolated along x only
+static void unbinRowX(const float * restrict a, const UnbinAxis * x, const int nx,
+        const ResampleKind kind, float * restrict out)
+{
+    const int * restrict k0 = x->k0;
+    const int * restrict k1 = x->k1;
+    const float * restrict p = x->p;
+    const float * restrict q = x->q;
+    int m;
+
+    if (kind == RESAMPLE_VALUE)
+    {
+# ifdef _OPENMP
+        #pragma omp simd
+# endif
+        for (m = 0; m < nx; ++m)
+            out[m] = p[m] * a[k0[m]] + q[m] * a[k1[m]];
+    }
+    else
+    {
+        for (m = 0; m < nx; ++m)
+        {
+            const float e1 = a[k0[m]];
+            const float e2 = a[k1[m]];
+            const float value = p[m] * e1*e1 + q[m] * e2*e2;
+            out[m] = errorValue(value, kind);
+        }
+    }
+}
+
+// Row interpolated between input rows a0 and a1 with weights r and s, and along x
+static void unbinRowXY(const float * restrict a0, const float * restrict a1, const float r,
+        const float s, const UnbinAxis * x, const int nx, const ResampleKind kind,
+        float * restrict out)
+{
+    int m;
+
+    if (!x)
+    {
+        if (kind == RESAMPLE_VALUE)
+        {
+            for (m = 0; m < nx; ++m)
+                out[m] = r * a0[m] + s * a1[m];
+        }
+        else
+        {
+            for (m = 0; m < nx; ++m)
+            {
+                const float e1 = a0[m];
+                const float e2 = a1[m];
+                const float value = r * e1*e1 + s * e2*e2;
+                out[m] = errorValue(value, kind);
+            }
+        }
+    }
+    else
+    {
+        const int * restrict k0 = x->k0;
+        const int * restrict k1 = x->k1;
+        const float * restrict p = x->p;
+        const float * restrict q = x->q;
+
+        if (kind == RESAMPLE_VALUE)
+        {
+# ifdef _OPENMP
+            #pragma omp simd
+# endif
+            for (m = 0; m < nx; ++m)
+                out[m] = p[m] * r * a0[k0[m]] + q[m] * r * a0[k1[m]] +
+                         p[m] * s * a1[k0[m]] + q[m] * s * a1[k1[m]];
+        }
+        else
+        {
+            for (m = 0; m < nx; ++m)
+            {
+                const float e1 = a0[k0[m]];
+                const float e2 = a0[k1[m]];
+                const float e3 = a1[k0[m]];
+                const float e4 = a1[k1[m]];
+                const float value = p[m] * r * e1*e1 + q[m] * r * e2*e2 +
+                                    p[m] * s * e3*e3 + q[m] * s * e4*e4;
+                out[m] = errorValue(value, kind);
+            }
+        }
+    }
+}
+
+void unbinFloat(float * const * in, float * const * out, const int nx, const int ny,
+        const UnbinAxis * x, const UnbinAxis * y, const ResampleKind kind)
+{
+    int n;
+
+# ifdef _OPENMP
+    #pragma omp parallel for schedule(static) \
+        if ((size_t)nx * ny >= RESAMPLE_MIN_PARALLEL_PIXELS)
+# endif
+    for (n = 0; n < ny; ++n)
+    {
+        if (y)
+            unbinRowXY(in[y->k0[n]], in[y->k1[n]], y->p[n], y->q[n], x, nx, kind, out[n]);
+        else if (x)
+            unbinRowX(in[n], x, nx, kind, out[n]);
+        else
+            memcpy(out[n], in[n], nx * sizeof(**out));
+    }
+}
+
+void unbinShort(short * const * in, short * const * out, const int nx, const int ny,
+        const UnbinAxis * x, const UnbinAxis * y)
+{
+    int n;
+
+# ifdef _OPENMP
+    #pragma omp parallel for schedule(static) \
+        if ((size_t)nx * ny >= RESAMPLE_MIN_PARALLEL_PIXELS)
+# endif
+    for (n = 0; n < ny; ++n)
+    {
+        const short * restrict a0 = in[y ? y->d0[n] : n];
+        const short * restrict a1 = in[y ? y->d1[n] : n];
+        short * restrict b = out[n];
+        int m;
+
+        if (x)
+        {
+            const int * restrict d0 = x->d0;
+            const int * restrict d1 = x->d1;
+# ifdef _OPENMP
+            #pragma omp simd
+# endif
+            for (m = 0; m < nx; ++m)
+                b[m] = a0[d0[m]] | a0[d1[m]] | a1[d0[m]] | a1[d1[m]];
+        }
+        else
+        {
+            for (m = 0; m < nx; ++m)
+                b[m] = a0[m] | a1[m];
+        }
+    }
+}
+
+/* One output row of bin2d, the input rows in[0] to in[biny-1]; binx is a constant
+ * where this is called for the common bin factors, so that the inner loop unrolls.
+ */
+static inline void binFloatRow(float * const * in, float * restrict out, const int nx,
+        const int binx, const int biny, const int avg, const ResampleKind kind)
+{
+    const float weight = binx * biny;
+    int m, i, j;
+
+    if (kind == RESAMPLE_VALUE)
+    {
+# ifdef _OPENMP
+        #pragma omp simd private(i, j)
+# endif
+        for (m = 0; m < nx; ++m)
+        {
+            float sum = 0.;
+            for (j = 0; j < biny; ++j)
+                for (i = 0; i < binx; ++i)
+                    sum += in[j][m*binx + i];
+            out[m] = avg ? sum / weight : sum;
+        }
+    }
+    else
+    {
+        for (m = 0; m < nx; ++m)
+        {
+            float sum_err = 0.;
+            for (j = 0; j < biny; ++j)
+                for (i = 0; i < binx; ++i)
+                    sum_err += in[j][m*binx + i] * in[j][m*binx + i];
+            out[m] = avg ? sqrt(sum_err) / weight : sqrt(sum_err);
+        }
+    }
+}
+
+void binFloat(float * const * in, float * const * out, const int nx, const int ny,
+        const int binx, const int biny, const int avg, const ResampleKind kind)
+{
+    int n;
+
+# ifdef _OPENMP
+    #pragma omp parallel for schedule(static) \
+        if ((size_t)nx * ny * binx * biny >= RESAMPLE_MIN_PARALLEL_PIXELS)
+# endif
+    for (n = 0; n < ny; ++n)
+    {
+        float * const * rows = in + (size_t)n * biny;
+
+        if (binx == 1 && biny == 1)
+            memcpy(out[n], rows[0], nx * sizeof(**out));
+        else if (binx == 1)
+            binFloatRow(rows, out[n], nx, 1, biny, avg, kind);
+        else if (binx == 2)
+            binFloatRow(rows, out[n], nx, 2, biny, avg, kind);
+        else if (binx == 3)
+            binFloatRow(rows, out[n], nx, 3, biny, avg, kind);
+        else if (binx == 4)
+            binFloatRow(rows, out[n], nx, 4, biny, avg, kind);
+        else
+            binFloatRow(rows, out[n], nx, binx, biny, avg, kind);
+    }
+}
+
+void binShort(short * const * in, short * const * out, const int nx, const int ny,
+        const int binx, const int biny)
+{
+    int n;
+
+# ifdef _OPENMP
+    #pragma omp parallel for schedule(static) \
+        if ((size_t)nx * ny * binx * biny >= RESAMPLE_MIN_PARALLEL_PIXELS)
+# endif
+    for (n = 0; n < ny; ++n)
+    {
+        short * const * rows = in + (size_t)n * biny;
+        short * restrict b = out[n];
+        int m, i, j;
+
+        for (m = 0; m < nx; ++m)
+            b[m] = 0;
+        for (j = 0; j < biny; ++j)
+        {
+            const short * restrict a = rows[j];
+            for (m = 0; m < nx; ++m)
+                for (i = 0; i < binx; ++i)
+                    b[m] |= a[m*binx + i];
+        }
+    }
+}
+
+float ** floatRows(float * data, const int stride, const int ny)
+{
+    float ** rows = malloc((ny > 0 ? ny : 1) * sizeof(*rows));
+    int j;
+
+    if (rows)
+        for (j = 0; j < ny; ++j)
+            rows[j] = data + (size_t)j * stride;
+    return rows;
+}
+
+short ** shortRows(short * data, const int stride, const int ny)
+{
+    short ** rows = malloc((ny > 0 ? ny : 1) * sizeof(*rows));
+    int j;
+
+    if (rows)
+        for (j = 0; j < ny; ++j)
+            rows[j] = data + (size_t)j * stride;
+    return rows;
+}
+
+float ** floatLineRows(FloatHdrLine * lines, const int n)
+{
+    float ** rows = malloc((n > 0 ? n : 1) * sizeof(*rows));
+    int j;
+
+    if (rows)
+        for (j = 0; j < n; ++j)
+            rows[j] = lines[j].line;
+    return rows;
+}
+
+short ** shortLineRows(ShortHdrLine * lines, const int n)
+{
+    short ** rows = malloc((n > 0 ? n : 1) * sizeof(*rows));
+    int j;
+
+    if (rows)
+        for (j = 0; j < n; ++j)
+            rows[j] = lines[j].line;
+    return rows;
+}
@@ -0,0 +1,238 @@
+# include <math.h>
+# include <float.h>
+# include <stdio.h>
+# include <stdlib.h>
+#include "hstcal.h"
+# include "trlbuf.h"
+# include "hstcal_select.h"
+# include "hstcal_robuststats.h"
+ 
+/* RESISTMEAN: Compute the clipped mean and stddev of  
+   the values that are passed in the array. This was modeled
+   on the resistant_mean procedure in IDL, and initially used
+   to calculate the statistics for the reference pixels in 
+   BLEVCORR for WFC3 IR images.
+
+   Since this was written to deal with the bias pixels in the
+   wfc3 arrays, I'm going to assume they wont exceed FLOAT
+   type numbers....the science array has the possibility to
+   go to float I believe, but the bias pixels should stay
+   lower than that. It complicates the sorting and arrays
+   to move stuff to float, but it can be done if necessary.
+
+   Megan Sosey  August 2008
+
+Processing outline:
+  -get the median of the input array
+  -subtract the median from every element in the array 
+  -get the absolute values of the resulting differences
+  -get the median of the absolute deviation array and divide by a constant 
+   with some logic attached
+  -compute the cutoff value in terms of the mean absolute deviation
+
+  -make a new array that contains just the values from the original
+   array where the absolute deviation is less than the cutoff value
+     
+  -get the average of the new array of "good" values
+  -compute the standard deviation of the new array
+  -correct the stddev to take into account the fact you left out values 
+   of the original sample
+  -recompute the cutoff using the corrected stddev
+  
+  -get a new array of good values using the new cutoff value
+  -recompute the mean of the remaining good values
+  -recompute the standard deviation of the remaining good values
+  -correct the stddev to take into account the fact you left out values
+   of the original sample
+  
+Revision history:
+
+ M. Sosey	Aug. 2008	Created initial version
+ H. Bushouse	10-Apr-2009	Modified findMean and findSigma routines to
+				use double precision in sums. Also some general
+				code cleanup throughout.
+*/
+
+/* The values are kept in one work array, in their original order, and
+   the values rejected at each round are squeezed out of it in place, so
+   that the sums are taken in the same order as before. The medians are
+   found by selection on a scratch copy instead of sorting, and the mean
+   and stddev of a round come from a single pass. The median absolute
+   deviation of the second round, which doesn't enter the cutoff, isn't
+   computed. */
+
+static float rmedian (const float *in, float *work, int npts);
+static int   rclip (float *arr, int npts, float median, float cutoff);
+static void  rmoments (const float *arr, int npts, float *mean, float *sigma);
+
+int resistmean (float *in, int npix, float sigrej, float *mean, 
+		float *sigmean, float *min, float *max) {
+
+/* Arguments:
+**	in	i: pointer to array of input values 
+**	npix	i: size of the input array
+**	sigrej	i: the sigma level for pixel rejection
+**	mean	o: mean value of unrejected pixels
+**	sigmean	o: standard deviation of unrejected pixels
+**		   (NOT the uncertainty or sigma of the mean)
+**      min	o: minimum of input values
+**      max	o: maximum of input values
+*/
+
+	/* Local variables */
+	int i;		  /* loop index */
+	float median;     /* median value of input array */
+	float medabsdev;  /* median of the absdev array */
+	float *tempdata;  /* array of good pixel values */
+	float *work;	  /* scratch array for the medians */
+	double sum;       /* sum of pixel values */
+	float cutoff;	  /* value limitation */
+	int   npix1, npix2;  /* number of pixels in temp arrays */
+    
+	/* Initialize the counters and results */
+	*mean = 0.;
+	*sigmean = 0.;
+	*min = 0;
+	*max = 0;
+
+	if (npix <= 0) {
+	    trlerror("Zero size array passed to resistmean");
+	    return (1);
+	}
+
+	/* allocate the work array for a copy of the data, followed
+	   by the scratch array */
+	tempdata = (float *) malloc(2 * (size_t)npix * sizeof(float));
+	if (tempdata == NULL) {
+	    trlerror("Memory allocation failure in resistmean");
+	    return (1);
+	}
+	work = tempdata + npix;
+
+	/* Copy the input array, computing the initial sum, min, max;
+	   min and max start from zero, as they always have */
+	sum = 0.;
+	for (i=0; i<npix; i++) {
+	     tempdata[i] = in[i];
+	     sum  += tempdata[i];
+	     if (tempdata[i] < *min) *min = tempdata[i];
+	     if (tempdata[i] > *max) *max = tempdata[i];
+	}
+
+	/* Compute the mean and median of the unrejected values */
+	*mean = (float) (sum/(double)npix);
+	median = rmedian (tempdata, work, npix);
+
+	/* Get the median of the absolute deviations from the median and
+	   divide by a constant with some logic attached */
+	for (i=0; i<npix; i++)
+	     work[i] = fabsf(tempdata[i] - median);
+	medabsdev = rmedian (work, work, npix) / 0.6745; 
+	if (medabsdev < 1.0E-24) {
+	    sum = 0.;
+	    for (i=0; i<npix; i++)
+		 sum += fabsf(tempdata[i] - median);
+	    medabsdev = (float)(sum/(double)npix) / 0.8;
+	}
+
+	/* Compute the cutoff value in terms of the median absolute deviation */
+	cutoff = (sigrej) * medabsdev;
+
+	/* Keep the values within the cutoff; npix1 is the count of
+	   unrejected pixels */
+	npix1 = rclip (tempdata, npix, median, cutoff);
+
+	/************ ROUND 2 ***********/
+
+	/* Compute the mean and stddev of the good values */
+	rmoments (tempdata, npix1, mean, sigmean);
+
+	/* Compensate sigma for truncation and compute new cutoff */
+ 	if (sigrej <= 4.5) {
+	    *sigmean = *sigmean / (-0.15405+0.90723*sigrej - 0.23584*sigrej*sigrej+0.020142*sigrej*sigrej*sigrej);
+	}
+ 	cutoff = sigrej * (*sigmean); 
+
+	/* Find the median of the good values and keep those within the
+	   new cutoff of it */
+	median = rmedian (tempdata, work, npix1);
+	npix2 = rclip (tempdata, npix1, median, cutoff);
+
+	/* Compute the mean and stddev of the latest array of good values */
+	rmoments (tempdata, npix2, mean, sigmean);
+
+	/* Compensate sigma for truncation :*/
+ 	if (sigrej <= 4.5) {
+	    *sigmean = *sigmean / (-0.15405+0.90723*sigrej-0.23584*sigrej*sigrej+0.020142*sigrej*sigrej*sigrej);
+	}
+
+	free(tempdata);
+
+	return (0);    	/* Successful return */
+}
+
+/* Median of the values of in, using work (which may be in itself) as
+   scratch space for the selection. Handles odd and even number of
+   inputs. */
+static float rmedian (const float *in, float *work, int npts) {
+
+	int i;
+
+	/* Check for trivial cases */
+	if (npts == 0)
+	    return(0.0);
+	else if (npts == 1)
+	    return(in[0]);
+
+	if (work != in) {
+	    for (i=0; i<npts; i++)
+		 work[i] = in[i];
+	}
+
+	return (medianFloat (work, npts));
+}
+
+/* Squeeze the values whose absolute deviation from median is beyond
+   cutoff out of the array, keeping the order of the others, and return
+   how many are left. */
+static int rclip (float *arr, int npts, float median, float cutoff) {
+
+	int i, n;
+
+	n = 0;
+	for (i=0; i<npts; i++) {
+	     if (!(fabsf(arr[i] - median) > cutoff))
+		 arr[n++] = arr[i];
+	}
+
+	return (n);
+}
+
+/* Mean and standard deviation of the array, as findMean and findSigma
+   give them, from one pass. */
+static void rmoments (const float *arr, int npts, float *mean, float *sigma) {
+
+	int i;
+	double sum, sum2, stdv, dmean;
+
+	sum = 0.;
+	sum2 = 0.;
+	for (i=0; i<npts; i++) {
+	     sum  += arr[i];
+	     sum2 += arr[i]*arr[i];
+	}
+
+	*mean = (float)(sum/(double)npts);
+
+	dmean = (double)(*mean);
+	if (npts <= 1) {
+	    stdv = 0.0;
+	} else {
+	    stdv = (double)(npts/(npts-1.))*((sum2/(double)npts) - dmean*dmean);
+	    if (stdv >= 0.)
+		stdv = sqrt ((float)stdv);
+	    else
+		stdv = 0.0;
+	}
+	*sigma = (float)stdv;
+}
@@ -0,0 +1,298 @@
+#include <stddef.h>
+#include <limits.h>
+#include <math.h>
+
+#include "hstcal_select.h"
+
+// Pixels sorted together by the networks, small enough for their stacks to stay in L1
+#define LANES 64
+
+// Comparators of Batcher's odd-even merge sort of SELECT_NETWORK_MAX values
+#define MAX_COMPARATORS 64
+
+/* The comparators (lo[c], hi[c]) of a network sorting n <= SELECT_NETWORK_MAX values.
+ * The network of the next power of two is built, dropping the comparators that involve
+ * positions from n up, which would hold values larger than all others. */
+static int buildNetwork(const int n, int * lo, int * hi)
+{
+    int size = 1;
+    int nc = 0;
+    int p, k, j, i;
+
+    while (size < n)
+        size <<= 1;
+
+    for (p = 1; p < size; p <<= 1)
+        for (k = p; k >= 1; k >>= 1)
+            for (j = k % p; j + k < size; j += 2*k)
+                for (i = 0; i < k && i + j + k < size; ++i)
+                {
+                    if ((i + j) / (2*p) != (i + j + k) / (2*p) || i + j + k >= n)
+                        continue;
+                    lo[nc] = i + j;
+                    hi[nc] = i + j + k;
+                    ++nc;
+                }
+    return nc;
+}
+
+/* Order the pairs of values and original positions of a lane, branch-free so that the
+ * lanes are vectorized. */
+static void compareExchange(float * restrict va, float * restrict vb, int * restrict ia, int * restrict ib,
+        const int nlanes)
+{
+    int l;
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for (l = 0; l < nlanes; ++l)
+    {
+        const float a = va[l];
+        const float b = vb[l];
+        const int x = ia[l];
+        const int y = ib[l];
+        const int swap = (b < a) | ((b == a) & (y < x));
+        va[l] = swap ? b : a;
+        vb[l] = swap ? a : b;
+        ia[l] = swap ? y : x;
+        ib[l] = swap ? x : y;
+    }
+}
+
+// Stable insertion sort of one pixel's strided values
+static void insertionSortLane(float * v, int * idx, const int count, const int stride)
+{
+    int j;
+
+    for (j = 0; j < count; ++j)
+        idx[(size_t)j*stride] = j;
+
+    for (j = 1; j < count; ++j)
+    {
+        const float value = v[(size_t)j*stride];
+        int position = j;
+
+        while (position > 0 && v[(size_t)(position-1)*stride] > value)
+        {
+            v[(size_t)position*stride] = v[(size_t)(position-1)*stride];
+            idx[(size_t)position*stride] = idx[(size_t)(position-1)*stride];
+            position--;
+        }
+        v[(size_t)position*stride] = value;
+        idx[(size_t)position*stride] = j;
+    }
+}
+
+void sortStackFloat(float * v, int * idx, const int * count, const int n, const int nlanes,
+        const int stride)
+{
+    float bv[SELECT_NETWORK_MAX][LANES];
+    int bi[SELECT_NETWORK_MAX][LANES];
+    char hasNaN[LANES];
+    int lo[MAX_COMPARATORS], hi[MAX_COMPARATORS];
+    int nc;
+    int first;
+
+    if (n > SELECT_NETWORK_MAX)
+    {
+        int l;
+        for (l = 0; l < nlanes; ++l)
+            insertionSortLane(v + l, idx + l, count ? count[l] : n, stride);
+        return;
+    }
+
+    nc = buildNetwork(n, lo, hi);
+
+    for (first = 0; first < nlanes; first += LANES)
+    {
+        const int nl = (nlanes - first < LANES) ? nlanes - first : LANES;
+        int k, l, c;
+
+        /* Copy the block, padding each pixel beyond its count with values that sort
+         * after all others. A NaN compares false with everything, so the network
+         * cannot reproduce where insertion leaves it, those pixels are sorted by
+         * insertion instead. */
+        for (l = 0; l < nl; ++l)
+            hasNaN[l] = 0;
+        for (k = 0; k < n; ++k)
+        {
+            const float * row = v + (size_t)k*stride + first;
+            for (l = 0; l < nl; ++l)
+            {
+                const int valid = !count || k < count[first + l];
+                bv[k][l] = valid ? row[l] : INFINITY;
+                bi[k][l] = valid ? k : INT_MAX;
+                hasNaN[l] |= valid && isnan(row[l]);
+            }
+        }
+
+        for (c = 0; c < nc; ++c)
+            compareExchange(bv[lo[c]], bv[hi[c]], bi[lo[c]], bi[hi[c]], nl);
+
+        for (k = 0; k < n; ++k)
+        {
+            float * row = v + (size_t)k*stride + first;
+            int * irow = idx + (size_t)k*stride + first;
+            for (l = 0; l < nl; ++l)
+            {
+                if (hasNaN[l])
+                    continue;
+                row[l] = bv[k][l];
+                irow[l] = bi[k][l];
+            }
+        }
+
+        for (l = 0; l < nl; ++l)
+        {
+            if (hasNaN[l])
+                insertionSortLane(v + first + l, idx + first + l, count ? count[first + l] : n, stride);
+        }
+    }
+}
+
+/* Introselect: quickselect with median of three pivots, falling back to heapsort of
+ * the remaining range after 2*log2(n) partitions, small ranges finished by insertion.
+ */
+#define DEFINE_SELECT(T, NAME) \
+static void NAME##Swap(T * v, const int a, const int b) \
+{ \
+    const T t = v[a]; \
+    v[a] = v[b]; \
+    v[b] = t; \
+} \
+\
+static void NAME##SiftDown(T * v, int root, const int n) \
+{ \
+    while (2*root + 1 < n) \
+    { \
+        int child = 2*root + 1; \
+        if (child + 1 < n && v[child] < v[child + 1]) \
+            ++child; \
+        if (!(v[root] < v[child])) \
+            return; \
+        NAME##Swap(v, root, child); \
+        root = child; \
+    } \
+} \
+\
+static void NAME##HeapSort(T * v, const int n) \
+{ \
+    int i; \
+    for (i = n/2 - 1; i >= 0; --i) \
+        NAME##SiftDown(v, i, n); \
+    for (i = n - 1; i > 0; --i) \
+    { \
+        NAME##Swap(v, 0, i); \
+        NAME##SiftDown(v, 0, i); \
+    } \
+} \
+\
+static void NAME##InsertionSort(T * v, const int n) \
+{ \
+    int j; \
+    for (j = 1; j < n; ++j) \
+    { \
+        const T value = v[j]; \
+        int position = j; \
+        while (position > 0 && v[position-1] > value) \
+        { \
+            v[position] = v[position-1]; \
+            position--; \
+        } \
+        v[position] = value; \
+    } \
+} \
+\
+T NAME(T * v, const int n, const int k) \
+{ \
+    int lo = 0; \
+    int hi = n - 1; \
+    int depth = 0; \
+    int m; \
+\
+    for (m = n; m > 1; m >>= 1) \
+        depth += 2; \
+\
+    while (hi - lo > SELECT_NETWORK_MAX) \
+    { \
+        const int mid = lo + (hi - lo)/2; \
+        T pivot; \
+        int i, j; \
+\
+        if (depth-- == 0) \
+        { \
+            NAME##HeapSort(v + lo, hi - lo + 1); \
+            return v[k]; \
+        } \
+\
+        if (v[mid] < v[lo]) \
+            NAME##Swap(v, mid, lo); \
+        if (v[hi] < v[lo]) \
+            NAME##Swap(v, hi, lo); \
+        if (v[hi] < v[mid]) \
+            NAME##Swap(v, hi, mid); \
+        pivot = v[mid]; \
+\
+        i = lo; \
+        j = hi; \
+        while (i <= j) \
+        { \
+            while (v[i] < pivot) \
+                ++i; \
+            while (pivot < v[j]) \
+                --j; \
+            if (i <= j) \
+            { \
+                NAME##Swap(v, i, j); \
+                ++i; \
+                --j; \
+            } \
+        } \
+\
+        if (k <= j) \
+            hi = j; \
+        else if (k >= i) \
+            lo = i; \
+        else \
+            return v[k]; \
+    } \
+\
+    NAME##InsertionSort(v + lo, hi - lo + 1); \
+    return v[k]; \
+}
+
+DEFINE_SELECT(float, selectFloat)
+DEFINE_SELECT(double, selectDouble)
+
+float medianFloat(float * v, const int n)
+{
+    const int k = n/2;
+    const float upper = selectFloat(v, n, k);
+    float lower;
+    int i;
+
+    if (n % 2)
+        return upper;
+
+    // The lower middle value is the largest of those before the upper one
+    lower = v[0];
+    for (i = 1; i < k; ++i)
+        lower = (v[i] > lower) ? v[i] : lower;
+    return (lower + upper) / 2.F;
+}
+
+double medianDouble(double * v, const int n)
+{
+    const int k = n/2;
+    const double upper = selectDouble(v, n, k);
+    double lower;
+    int i;
+
+    if (n % 2)
+        return upper;
+
+    lower = v[0];
+    for (i = 1; i < k; ++i)
+        lower = (v[i] > lower) ? v[i] : lower;
+    return (lower + upper) / 2.;
+}
@@ -70,6 +70,16 @@
     void trlfilerr (char *filename);
         - calls trlerror after building appropriate message
 
+    These hold back the messages of a task run concurrently with others:
+    int trlBeginCapture (void);
+        - messages from the calling thread are collected until
+            trlEndCapture instead of being output
+    char *trlEndCapture (void);
+        - stops collecting and returns the collected messages
+            (to be freed by the caller)
+    void trlFlushCapture (const char *captured);
+        - outputs messages returned by trlEndCapture, as trlmessage
+
     The remainder of the functions are NOT USED outside this file:
     static void CatTrlFile(FILE *ip, FILE *op);
         - appends ENTIRE input trailer file (ip) to output trailer file (op)
@@ -113,6 +123,12 @@ static int AppendTrlFile(void);
 
 struct TrlBuf trlbuf = {0};
 
+/* Messages of the calling thread collected by trlBeginCapture(), one per line */
+static char *trlcapture = NULL;
+#ifdef _OPENMP
+#pragma omp threadprivate(trlcapture)
+#endif
+
 int InitTrlFile (char *inlist, char *output)
 {
     /*
@@ -644,13 +660,33 @@ void trlmessage(const char *fmt, ...) {
     }
     va_end(args);
 
-    /* Send output to STDOUT and explicitly flush STDOUT, if desired */
-    if (trlbuf.quiet == NO) {
-        printfAndFlush (data);
+    /* Hold the message back if this thread is collecting its messages */
+    if (trlcapture) {
+        void * ptr = realloc(trlcapture, strlen(trlcapture) + strlen(data) + 2);
+        if (ptr) {
+            trlcapture = ptr;
+            strcat(trlcapture, data);
+            strcat(trlcapture, "\n");
+            free(data);
+            free(fmt_);
+            return;
+        }
+        /* Out of memory: output the message straight away instead */
     }
 
-    /* Send output to (temp) trailer file */
-    WriteTrlBuf (data);
+    /* Messages may be issued from concurrent tasks (e.g. ACSCTE --parallelAmps) */
+#ifdef _OPENMP
+    #pragma omp critical(trlbuf)
+#endif
+    {
+        /* Send output to STDOUT and explicitly flush STDOUT, if desired */
+        if (trlbuf.quiet == NO) {
+            printfAndFlush (data);
+        }
+
+        /* Send output to (temp) trailer file */
+        WriteTrlBuf (data);
+    }
     free(data);
     free(fmt_);
     data = NULL;
@@ -730,6 +766,48 @@ void printfAndFlush (const char *message) {
         fflush(stdout);
 }
 
+int trlBeginCapture (void)
+{
+    /* Collect the messages of the calling thread rather than outputting them,
+        so that concurrent tasks can each output theirs in a fixed order
+        once they are all done.
+    */
+    if (trlcapture)
+        return HSTCAL_OK;
+    trlcapture = calloc(1, sizeof(*trlcapture));
+    return trlcapture ? HSTCAL_OK : OUT_OF_MEMORY;
+}
+char * trlEndCapture (void)
+{
+    /* Stop collecting messages and return those collected, NULL if none.
+        The caller frees the returned string.
+    */
+    char * captured = trlcapture;
+    trlcapture = NULL;
+    if (captured && !*captured) {
+        free(captured);
+        captured = NULL;
+    }
+    return captured;
+}
+void trlFlushCapture (const char *captured)
+{
+    /* Output the messages returned by trlEndCapture(). Each line is passed to
+        trlmessage in turn, which produces the same output as the original
+        messages, including those containing newlines.
+    */
+    const char *line = captured;
+    const char *end;
+
+    if (!captured)
+        return;
+
+    while ((end = strchr(line, '\n')) != NULL) {
+        trlmessage("%.*s", (int)(end - line), line);
+        line = end + 1;
+    }
+}
+
 void trlGitInfo(void)
 {
     char * gitInfo = NULL;
@@ -35,6 +35,7 @@ typedef struct {
     int verbose;                    /* print additional info? */
     unsigned cteAlgorithmGen;       // specify 1 = gen1 or 2 = gen2
     unsigned nThreads;              // turn off OpenMP usage if 0|1
+    int parallelAmps;               // run the per-amp CTE corrections as concurrent tasks
 
     /* keywords and file names for reference files */
     RefFileInfo *refnames;
@@ -17,6 +17,9 @@
 # define    CRMASK      8
 # define    MAX_PAR     8
 
+/* default memory budget (MB) for holding all inputs in memory */
+# define    MEMBUDGET   1024.
+
 /*  define the parameter structure */
 typedef struct {
     char    tbname[CHAR_FNAME_LENGTH];      /* Name of CCDTAB to be read */
@@ -38,6 +41,7 @@ typedef struct {
     int     printtime;
     int     verbose;
     int     readnoise_only;
+    float   membudget;  /* in-core budget (MB) for the input stack, > 0 */
 } clpar;
 
 #endif /* INCL_ACSREJ_H */
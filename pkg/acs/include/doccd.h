@@ -0,0 +1,15 @@
+#ifndef INCL_DOCCD_H
+#define INCL_DOCCD_H
+
+#include "hstio.h"
+#include "acs.h"
+#include "acsinfo.h"
+
+/* Sink pixel detection, with the catalogues kept between exposures */
+int SinkDetect (ACSInfo *, SingleGroup *);
+void clearSinkCatalogs (void);
+
+/* The rows of the last BPIXTAB read, kept between exposures */
+void clearDQICache (void);
+
+#endif /* INCL_DOCCD_H */
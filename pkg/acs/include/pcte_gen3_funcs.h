@@ -2,6 +2,32 @@
    They are not meant to be used outside that module and they were static.
    We are only exposing them here so they can be tested in CI. */
 
+#ifndef PCTE_GEN3_FUNCS_INCL
+#define PCTE_GEN3_FUNCS_INCL
+
+#include <stdbool.h>
+#include "hstio.h"
+#include "acsinfo.h"
+#include "pcte.h"
+
 void transpose(FloatTwoDArray *amp);
 int rotateAmpData_acscte(FloatTwoDArray * amp, const unsigned ampID);
 int derotateAmpData_acscte(FloatTwoDArray * amp, const unsigned ampID);
+
+/* One amp's worth of CTE correction, serial (post-SM4 only) followed by parallel,
+   as queued by doCTE in docte.c with --parallelAmps */
+typedef struct {
+    unsigned imset;
+    unsigned nthAmp;
+    int ampID;
+    char * amploc;
+    char ccdamp[NAMPS+1];
+    Bool doSerial;
+    CTEParamsFast serialPars;
+    CTEParamsFast parallelPars; // shallow copy, trap tables are shared read only
+} AmpCTEJob;
+
+int doPCTEGen3 (ACSInfo *acs, CTEParamsFast * ctePars, SingleGroup * chipImage, const bool forwardModelOnly, char * corrType, char *ccdamp, int nthAmp, char *amploc, int ampID);
+int runAmpCTEJobs (ACSInfo * acs, SingleGroup * x, AmpCTEJob * jobs, const unsigned nJobs, const bool forwardModelOnly, const unsigned nThreads);
+
+#endif
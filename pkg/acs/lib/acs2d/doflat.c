@@ -7,8 +7,10 @@
 # include "acs.h"
 # include "acsinfo.h"
 # include "hstcalerr.h"
+# include "acsdq.h"
+# include "hstcal_flatfield.h"
 
-static int divFlat (SingleGroup *, char *, ACSInfo *);
+static int getFlat (SingleGroup *, char *, ACSInfo *, FlatField **);
 
 /* This routine divides x in-place by the flat fields.
  There are up to three flat fields.  They are read into SingleGroups,
@@ -28,6 +30,10 @@ static int divFlat (SingleGroup *, char *, ACSInfo *);
  the gain correction so that the gain will only be used to correct
  one ref file and not both, otherwise the gain will be applied twice
  to the science data.
+
+ The pixel-to-pixel and delta flats, with the spot flat applied, are
+ kept in memory for the following images and divided into x together,
+ in one pass.
  */
 
 int doFlat (ACSInfo *acs2d, int extver, SingleGroup *x) {
@@ -52,6 +58,8 @@ int doFlat (ACSInfo *acs2d, int extver, SingleGroup *x) {
 	Hdr phdr;
 	int update = NO;	/* Flag to determine whether hdr info needs to be updated*/
 	int scilines;
+	FlatField *flats[2];	/* flats to divide into x */
+	int nflats = 0;
   
 	int FindLine (SingleGroup *, SingleGroupLine *, int *,
                 int *, int *, int *, int *);
@@ -67,21 +75,27 @@ int doFlat (ACSInfo *acs2d, int extver, SingleGroup *x) {
   
 	/* apply pixel-to-pixel flat, if set to PERFORM */
 	if (acs2d->pfltcorr == PERFORM) {
-		if (divFlat (x, acs2d->pflt.name, acs2d)){
+		if (getFlat (x, acs2d->pflt.name, acs2d, &flats[nflats])){
 		  trlerror("Problem applying PFLTFILE %s... ", acs2d->pflt.name);
 		  return(status);
 		}
+		nflats++;
 	}
   
   
 	/* apply delta flat, if set to PERFORM */
 	if (acs2d->dfltcorr == PERFORM) {
-		if (divFlat (x, acs2d->dflt.name, acs2d) ){
+		if (getFlat (x, acs2d->dflt.name, acs2d, &flats[nflats]) ){
 		  trlerror("Problem applying DFLTFILE %s... ", acs2d->dflt.name);
 		  return (status);
 		}
+		nflats++;
 	}
   
+	/* Divide both flats into the science data at once. */
+	if (divFlatFields (x, flats, nflats, CALIBDEFECT))
+		return (status = SIZE_MISMATCH);
+  
 	lf = 0;
 	initHdr (&phdr);
   
@@ -191,7 +205,14 @@ int doFlat (ACSInfo *acs2d, int extver, SingleGroup *x) {
 	return (status);
 }
 
-static int divFlat (SingleGroup *x, char *flatname, ACSInfo *acs2d) {
+/* This routine gets a flat field as it is to be divided into x: the
+ IMSET for the chip of x, trimmed to the subarray of x and multiplied
+ by the shifted spot flat, if there is one.  The flat is read only if
+ it is not in the cache already.
+ */
+
+static int getFlat (SingleGroup *x, char *flatname, ACSInfo *acs2d,
+                    FlatField **flat) {
   
   extern int status;
   
@@ -207,16 +228,14 @@ static int divFlat (SingleGroup *x, char *flatname, ACSInfo *acs2d) {
   int scilines;           /* Number of lines in 'x' */
   SingleGroup inspot,outspot;
   SingleGroupLine spotline, strim;
-  float shiftx, shifty;
+  float shiftx = 0., shifty = 0.;
   time_t date;
+  char key[CHAR_LINE_LENGTH+1];	/* flat name, chip, window and spot */
   
 	int FindLine (SingleGroup *, SingleGroupLine *, int *,
                 int *, int *, int *, int *);
 	int DetCCDChip (char *, int, int, int *);
 	int trim1d (SingleGroupLine *, int, int, int, int, int, SingleGroupLine *);
-	int div1d (SingleGroup *, int, SingleGroupLine *);
-  void get_nsegn (int, int, int, int, float *, float*, float *, float *);
-	void multgn1d (SingleGroupLine *, int, int, int, float *, float);
   
   int GetSpotTab(char *, time_t, float *, float *);
   int shiftSpot(SingleGroup *, float, float, SingleGroup *);
@@ -248,20 +267,54 @@ static int divFlat (SingleGroup *x, char *flatname, ACSInfo *acs2d) {
    */
   scilines = x->sci.data.ny;
   
-  /* Check for existence of SPOTFLAT file... */
+  /* Get the shift of the SPOTFLAT file for this observation... */
 	if (acs2d->cfltcorr == PERFORM) {
+    parseObsDate(x->globalhdr, &date);
+    status = GetSpotTab(acs2d->spot.name, date, &shiftx, &shifty);
     
-    status = readSpotImage(acs2d->cflt.name, &inspot, &spotline);
+    trlmessage("SPOTTAB:  Using spot shift of: %0.2g  %0.2g",shiftx,shifty);
+    /* The shift is part of the cache key, so a SPOTTAB that can't be
+       read is an error here rather than being overwritten by the
+       status of shiftSpot. */
+    if (status) {
+      closeSingleGroupLine (&y);
+      freeSingleGroupLine (&y);
+      return (status);
+    }
+  }
+  
+  /* Use the flat read for an earlier image if there is one. */
+  snprintf (key, sizeof(key), "%s|%d|%d|%d|%d|%d|%d|%d|%s|%.9g|%.9g",
+            flatname, pchipext, ysame_size, y_x0, y_y0, x->sci.data.nx,
+            scilines, acs2d->cfltcorr == PERFORM,
+            acs2d->cfltcorr == PERFORM ? acs2d->cflt.name : "",
+            shiftx, shifty);
+  if ((*flat = findFlatField (key)) != NULL) {
+    closeSingleGroupLine (&y);
+    freeSingleGroupLine (&y);
+    return (status);
+  }
+  if ((*flat = newFlatField (key, x->sci.data.nx, scilines)) == NULL) {
+    closeSingleGroupLine (&y);
+    freeSingleGroupLine (&y);
+    trlerror("(doFlat) Out of memory.");
+    return (status = OUT_OF_MEMORY);
+  }
+  
+	if (acs2d->cfltcorr == PERFORM) {
+    
+    if (readSpotImage(acs2d->cflt.name, &inspot, &spotline)) {
+      freeFlatField (*flat);
+      *flat = NULL;
+      closeSingleGroupLine (&y);
+      freeSingleGroupLine (&y);
+      return (status);
+    }
     
     /* Initialize shifted spot arrays */
     initSingleGroup(&outspot);
     allocSingleGroup(&outspot, inspot.sci.data.nx, inspot.sci.data.ny, True);
     
-    parseObsDate(x->globalhdr, &date);
-    status = GetSpotTab(acs2d->spot.name, date, &shiftx, &shifty);
-    
-    trlmessage("SPOTTAB:  Using spot shift of: %0.2g  %0.2g",shiftx,shifty);
-
     /* Shift input spot flat
      Multiply PFLT with this shifted spot, outspot, when
      applying it to the data (line-by-line)...
@@ -285,8 +338,7 @@ static int divFlat (SingleGroup *x, char *flatname, ACSInfo *acs2d) {
         multlines(&y, &spotline);
       }
       
-      /* Now, apply flat-field */
-      div1d (x, line, &y);
+      putFlatFieldLine (*flat, line, &y);
       
     } /* End loop over input image lines, xline loop */
     
@@ -316,15 +368,14 @@ static int divFlat (SingleGroup *x, char *flatname, ACSInfo *acs2d) {
         multlines(&ytrim, &strim);
       }
       
-      /* Now, apply flat-field */
-      div1d (x, i, &ytrim);
+      putFlatFieldLine (*flat, i, &ytrim);
       
     } /* End loop over input image lines, xline loop */
     
     /* Clean up buffers... */
     freeSingleGroupLine (&ytrim);
     if (acs2d->cfltcorr == PERFORM) {
-      freeSingleGroupLine (&ytrim);
+      freeSingleGroupLine (&strim);
     }
   }
   
@@ -337,6 +388,12 @@ static int divFlat (SingleGroup *x, char *flatname, ACSInfo *acs2d) {
 	closeSingleGroupLine (&y);
 	freeSingleGroupLine (&y);
   
+  /* Don't keep a flat that could not be made. */
+  if (status) {
+    freeFlatField (*flat);
+    *flat = NULL;
+  }
+  
 	return (status);
   
 }
@@ -8,6 +8,7 @@
 #include "hstcal_memory.h"
 #include "hstcal.h"
 #include "hstio.h"
+#include "hstcal_orient.h"
 
 #include "acs.h"
 #include "acsinfo.h"
@@ -966,35 +967,19 @@ static int make_amp_array(const int arr_rows, const int arr_cols, SingleGroup *i
 
   extern int status;
 
-  /* iteration variables */
-  int i, j;
+  int AmpOrientation (const int, Orientation *);
 
-  /* variables for the image row/column we want */
-  int r,c;
+  Orientation orient;
 
-  for (i = 0; i < arr_rows; i++) {
-    for (j = 0; j < arr_cols; j++) {
-      if (amp == AMP_A) {
-        r = im->sci.data.ny - i - 1;
-        c = j;
-      } else if (amp == AMP_B) {
-        r = im->sci.data.ny - i - 1;
-        c = im->sci.data.nx - j - 1;
-      } else if (amp == AMP_C) {
-        r = i;
-        c = j;
-      } else if (amp == AMP_D) {
-        r = i;
-        c = im->sci.data.nx - j -1;
-      } else {
-        trlerror("Amp number not recognized, must be 0-3.");
-        status = ERROR_RETURN;
-        return status;
-      }
+  if ((status = AmpOrientation(amp, &orient)))
+    return status;
 
-      array[i*arr_cols + j] = Pix(im->sci.data, c, r);
-    }
-  }
+  /* a flipped amp is read from the far side of the image */
+  const int xbeg = (orient & ORIENT_FLIP_X) ? im->sci.data.nx - arr_cols : 0;
+  const int ybeg = (orient & ORIENT_FLIP_Y) ? im->sci.data.ny - arr_rows : 0;
+
+  if ((status = getOrientedFloatSect(&im->sci.data, xbeg, ybeg, arr_cols, arr_rows, orient, array)))
+    trlerror("Failed to extract amp array");
 
   return status;
 }
@@ -1008,35 +993,18 @@ static int unmake_amp_array(const int arr_rows, const int arr_cols, SingleGroup
 
   extern int status;
 
-  /* iteration variables */
-  int i, j;
+  int AmpOrientation (const int, Orientation *);
 
-  /* variables for the image row/column we want */
-  int r,c;
+  Orientation orient;
 
-  for (i = 0; i < arr_rows; i++) {
-    for (j = 0; j < arr_cols; j++) {
-      if (amp == AMP_A) {
-        r = im->sci.data.ny - i - 1;
-        c = j;
-      } else if (amp == AMP_B) {
-        r = im->sci.data.ny - i - 1;
-        c = im->sci.data.nx - j - 1;
-      } else if (amp == AMP_C) {
-        r = i;
-        c = j;
-      } else if (amp == AMP_D) {
-        r = i;
-        c = im->sci.data.nx - j -1;
-      } else {
-        trlerror("Amp number not recognized, must be 0-3.");
-        status = ERROR_RETURN;
-        return status;
-      }
+  if ((status = AmpOrientation(amp, &orient)))
+    return status;
 
-      Pix(im->sci.data, c, r) = (float) array[i*arr_cols + j];
-    }
-  }
+  const int xbeg = (orient & ORIENT_FLIP_X) ? im->sci.data.nx - arr_cols : 0;
+  const int ybeg = (orient & ORIENT_FLIP_Y) ? im->sci.data.ny - arr_rows : 0;
+
+  if ((status = putOrientedFloatSect(&im->sci.data, xbeg, ybeg, arr_cols, arr_rows, orient, array)))
+    trlerror("Failed to insert amp array");
 
   return status;
 }
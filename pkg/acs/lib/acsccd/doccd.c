@@ -41,6 +41,7 @@
 #include "hstcal_memory.h"
 #include "hstcalerr.h"
 #include "hstio.h"
+#include "doccd.h"
 
 static void dqiMsg (ACSInfo *, const int);
 static void BiasMsg (ACSInfo *, const int);
@@ -69,7 +70,6 @@ int DoCCD (ACSInfo *acs_info) {
     int dqiHistory (ACSInfo *, Hdr *);
     int doNoise (ACSInfo *, SingleGroup *, int *);
     int noiseHistory (Hdr *);
-    int SinkDetect (ACSInfo *, SingleGroup *);
     int sinkHistory(const ACSInfo *, Hdr *);
     int GetACSGrp (ACSInfo *, Hdr *);
     int OmitStep (int);
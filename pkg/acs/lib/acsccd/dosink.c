@@ -1,17 +1,49 @@
 /* ACS -- Detect and mark SINK pixels in the DQ array. */
 # include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
 
 #include "hstcal.h"
 # include "hstio.h"
 # include "acs.h"
 # include "acsinfo.h"
 # include "hstcalerr.h"
+# include "doccd.h"
 
 /* local mask values */
 # define SINKPIXEL (short)1024
 
 static int DetSinkChip (char *, int, int *);
 
+/* A run of non-zero pixels of a SNKCFILE column, from its first negative
+   pixel to the end of the run in the direction of traversal */
+typedef struct {
+    int x;          /* column */
+    int y;          /* first row */
+    int len;        /* number of pixels */
+    int val;        /* index of its first value in the catalogue */
+} SinkRun;
+
+/* The runs of one chip of a SNKCFILE, ordered by column and, within a
+   column, in the direction of traversal */
+typedef struct {
+    char name[CHAR_FNAME_LENGTH+1];  /* SNKCFILE, empty if not loaded */
+    int chip;
+    int extver;     /* imset of the chip */
+    Hdr hdr;        /* SCI header of the imset */
+    int refx;       /* size of the reference image */
+    int refy;
+    int dir;        /* row step of the traversal */
+    int nrun;
+    SinkRun *run;
+    float *val;     /* values of all runs */
+} SinkCatalog;
+
+static SinkCatalog sinkcat[2];  /* one for each WFC chip */
+
+static int getSinkCatalog (char *, int, SinkCatalog *);
+static void freeSinkCatalog (SinkCatalog *);
+
 
 /* See Section 6 of ACS ISR by Ryon & Grogin (2017).
    SINKCORR is based on WFC3/UVIS but not identical.
@@ -32,6 +64,13 @@ static int DetSinkChip (char *, int, int *);
    2. If downstream (-1) pixel == -1, set DQ to 1024.
    3. If upstream (+1 to +n) pixel > SCI, set DQ to 1024 until
       pixel <= SCI or pixel == 0 or pixel == another sink pixel.
+
+   Only the runs of non-zero pixels of a column that contain a sink or
+   downstream pixel can flag anything, and there are few of them. The
+   SNKCFILE chip is reduced once to a catalogue of these runs, from their
+   first negative pixel on, which is kept between calls; flagging an
+   exposure then only visits the pixels of the runs, walking them in the
+   order the column would be traversed.
 */
 int SinkDetect(ACSInfo *acs, SingleGroup *x) {
     /* arguments:
@@ -40,15 +79,17 @@ int SinkDetect(ACSInfo *acs, SingleGroup *x) {
     */
     extern int status;
 
-    int i, j, jdone, jend, jstep, n;  /* counters */
-    short *keep_going, dqval;
-    int extver;      /* get this imset from sink image */
-    int dimx, refx, dimy;
+    int i, j, k, r, n;  /* counters */
+    int jbeg, jend;     /* rows of a run within the image */
+    short dqval;
+    int dimx, dimy;
     int rx, ry;      /* for binning sink image down to size of x */
     int x0, y0;      /* offsets of sci image */
     int same_size;   /* true if no binning of ref image required */
-    float cur_sinkpix, *cur_sci;
-    FloatHdrData sinkref;  /* array to store sink image */
+    int keep_going, col;
+    float cur_sinkpix, cur_sci;
+    SinkCatalog *cat;  /* sink pixels of the chip */
+    SinkRun *run;
 
     int FindLineHdr(Hdr *, Hdr *, int, int, int *, int *, int *, int *, int *);
 
@@ -56,30 +97,23 @@ int SinkDetect(ACSInfo *acs, SingleGroup *x) {
         return (status);
 
     /* Initialize local variables */
-    extver = 1;
     rx = 1;
     ry = 1;
     x0 = 0;
     y0 = 0;
     same_size = 1;
-    jdone = 0;
     n = 0;
 
-    /* Compute correct extension version number to extract from
-       reference image to correspond to CHIP in science data. */
-    if (DetSinkChip(acs->sink.name, acs->chip, &extver))
+    /* Get the sink pixel runs of the chip from the reference image. */
+    cat = &sinkcat[acs->chip == 2];
+    if (getSinkCatalog (acs->sink.name, acs->chip, cat))
         return (status);
 
-    /* Get sink reference image. */
-    initFloatHdrData(&sinkref);
-    getFloatHD(acs->sink.name, "SCI", extver, &sinkref);
-
     /* Extract relevant portion from reference image. */
     dimx = x->sci.data.tot_nx;
     dimy = x->sci.data.tot_ny;
-    refx = sinkref.data.tot_nx;
 
-    if (FindLineHdr (&x->sci.hdr, &sinkref.hdr, dimx, refx,
+    if (FindLineHdr (&x->sci.hdr, &cat->hdr, dimx, cat->refx,
                      &same_size, &rx, &ry, &x0, &y0))
         return (status);
 
@@ -97,94 +131,217 @@ int SinkDetect(ACSInfo *acs, SingleGroup *x) {
         return (status = INVALID_VALUE);
     }
 
-    /* Always traverse from sink pixel head to tail. */
-    if (extver == 1) {
-        j = 0;
-        jend = dimy - 1;
-        jstep = 1;
-    } else {  /* extver == 2 */
-        j = dimy - 1;
-        jend = 0;
-        jstep = -1;
-    }
-
-    /* Allocate data array */
-    keep_going = (short *) calloc (dimx, sizeof(short));
-    if (keep_going == NULL) {
-        trlerror("Couldn't allocate memory for scratch array in SINKCORR.");
-        return (status = OUT_OF_MEMORY);
-    }
-    cur_sci = (float *) calloc (dimx, sizeof(float));
-    if (cur_sci == NULL) {
-        trlerror("Couldn't allocate memory for scratch array in SINKCORR.");
-        return (status = OUT_OF_MEMORY);
-    }
+    /* Flag sink pixels in input DQ, walking the runs of each column in
+       the direction of traversal from sink pixel head to tail. Each
+       run starts the tail afresh, since it follows a zero pixel or
+       the edge of the image; the science value at the last sink pixel
+       carries on through the column. */
+    col = -1;
+    cur_sci = 0;
+    for (r = 0; r < cat->nrun; r++) {
+        run = &cat->run[r];
+        i = run->x - x0;
+        if (i < 0 || i >= dimx)
+            continue;
+        if (run->x != col) {
+            col = run->x;
+            cur_sci = 0;
+        }
 
-    /* Flag sink pixels in input DQ. */
-    while (jdone == 0) {
-        for (i = 0; i < dimx; i++) {
+        /* The part of the run within the image */
+        jbeg = 0;
+        jend = run->len;
+        for (; jbeg < jend; jbeg++) {
+            j = run->y + jbeg * cat->dir - y0;
+            if (j >= 0 && j < dimy)
+                break;
+        }
+        for (; jend > jbeg; jend--) {
+            j = run->y + (jend-1) * cat->dir - y0;
+            if (j >= 0 && j < dimy)
+                break;
+        }
 
-            /* Sink image is always untrimmed fullframe.
-               While, since image at this point is still untrimmed. */
-            cur_sinkpix = Pix(sinkref.data, i + x0, j + y0);
+        keep_going = 0;
+        for (k = jbeg; k < jend; k++) {
+            j = run->y + k * cat->dir - y0;
+            cur_sinkpix = cat->val[run->val + k];
 
             /* This is either sink or downstream pixel, flag it.
                It comes with a tail upstream.
                Does not matter if it sits on another tail. */
             if (cur_sinkpix < 0) {
-                if (keep_going[i] == 0) {
-                    keep_going[i] = 1;
-                }
+                keep_going = 1;
                 if (cur_sinkpix < -1) {  /* The actual sink pixel */
-                    cur_sci[i] = Pix(x->sci.data, i, j);
+                    cur_sci = Pix(x->sci.data, i, j);
                 }
                 dqval = SINKPIXEL | DQPix(x->dq.data, i, j);
                 DQSetPix(x->dq.data, i, j, dqval);
                 n++;
 
-            /* This is upstream pixel. */
-            } else if (cur_sinkpix > 0) {
-                /* Tail is still continuous. */
-                if (keep_going[i] == 1) {
-                    /* This upstream pixel > SCI at sink pixel, flag it. */
-                    if (cur_sinkpix > cur_sci[i]) {
-                        dqval = SINKPIXEL | DQPix(x->dq.data, i, j);
-                        DQSetPix(x->dq.data, i, j, dqval);
-                        n++;
-                    /* Tail ended, stop flagging. */
-                    } else {
-                        keep_going[i] = 0;
-                    }
+            /* This is upstream pixel; the tail is still continuous. */
+            } else if (keep_going) {
+                /* This upstream pixel > SCI at sink pixel, flag it. */
+                if (cur_sinkpix > cur_sci) {
+                    dqval = SINKPIXEL | DQPix(x->dq.data, i, j);
+                    DQSetPix(x->dq.data, i, j, dqval);
+                    n++;
+                /* Tail ended, stop flagging. */
+                } else {
+                    keep_going = 0;
                 }
-
-            /* No sink pixel, stop flagging. */
-            } else if (keep_going[i] == 1) {
-                keep_going[i] = 0;
             }
-        } /* end i loop */
-
-        j += jstep;
-        if (jstep >= 0) {
-            if (j > jend)
-                jdone = 1;
-        } else {
-            if (j < jend)
-                jdone = 1;
         }
-    } /* end j loop */
+    }
 
     if (acs->verbose) {
         trlmessage("Sink pixels flagged = %d", n);
     }
 
-    free(keep_going);
-    free(cur_sci);
+    return (status);
+}
+
+
+/* Load the sink pixel runs of a chip from SNKCFILE, unless they are
+   already loaded. */
+static int getSinkCatalog (char *fname, int chip, SinkCatalog *cat) {
+    /* parameters:
+       char *fname        i: name of SNKCFILE
+       int chip           i: CHIP ID of the exposure
+       SinkCatalog *cat  io: sink pixel runs of the chip
+    */
+    extern int status;
+
+    int i, j, k, jbeg, jend, jstep;
+    int nrun, nval, len;
+    float pix;
+    FloatHdrData sinkref;  /* array to store sink image */
+
+    if (cat->name[0] != '\0' && cat->chip == chip &&
+        strcmp (cat->name, fname) == 0)
+        return (status);
+
+    freeSinkCatalog (cat);
+
+    /* Compute correct extension version number to extract from
+       reference image to correspond to CHIP in science data. */
+    if (DetSinkChip(fname, chip, &cat->extver))
+        return (status);
+
+    /* Get sink reference image. */
+    initFloatHdrData(&sinkref);
+    getFloatHD(fname, "SCI", cat->extver, &sinkref);
+
+    cat->refx = sinkref.data.tot_nx;
+    cat->refy = sinkref.data.tot_ny;
+
+    /* Always traverse from sink pixel head to tail. */
+    if (cat->extver == 1) {
+        jbeg = 0;
+        jend = cat->refy;
+        jstep = 1;
+    } else {  /* extver == 2 */
+        jbeg = cat->refy - 1;
+        jend = -1;
+        jstep = -1;
+    }
+    cat->dir = jstep;
+
+    /* Count the runs and their pixels, then fill in the catalogue.
+       A run ends at a pixel that is zero (or NaN); the pixels before
+       its first negative one cannot flag anything. */
+    cat->run = NULL;
+    cat->val = NULL;
+    for (k = 0; k < 2; k++) {
+        nrun = 0;
+        nval = 0;
+        for (i = 0; i < cat->refx; i++) {
+            len = 0;
+            for (j = jbeg; j != jend; j += jstep) {
+                pix = Pix(sinkref.data, i, j);
+                if (pix < 0 || (len > 0 && pix > 0)) {
+                    if (len == 0 && k == 1) {
+                        cat->run[nrun].x = i;
+                        cat->run[nrun].y = j;
+                        cat->run[nrun].val = nval;
+                    }
+                    if (k == 1)
+                        cat->val[nval] = pix;
+                    len++;
+                    nval++;
+                } else if (len > 0) {
+                    if (k == 1)
+                        cat->run[nrun].len = len;
+                    nrun++;
+                    len = 0;
+                }
+            }
+            if (len > 0) {
+                if (k == 1)
+                    cat->run[nrun].len = len;
+                nrun++;
+            }
+        }
+
+        if (k == 0) {
+            cat->run = (SinkRun *) malloc ((nrun > 0 ? nrun : 1) * sizeof(SinkRun));
+            cat->val = (float *) malloc ((nval > 0 ? nval : 1) * sizeof(float));
+            if (cat->run == NULL || cat->val == NULL) {
+                trlerror("Couldn't allocate memory for sink pixel catalogue in SINKCORR.");
+                free (cat->run);
+                free (cat->val);
+                cat->run = NULL;
+                cat->val = NULL;
+                freeFloatHdrData(&sinkref);
+                return (status = OUT_OF_MEMORY);
+            }
+        }
+    }
+    cat->nrun = nrun;
+
+    initHdr (&cat->hdr);
+    if (copyHdr (&cat->hdr, &sinkref.hdr)) {
+        trlerror("Couldn't copy the SNKCFILE header in SINKCORR.");
+        freeHdr (&cat->hdr);
+        free (cat->run);
+        free (cat->val);
+        cat->nrun = 0;
+        cat->run = NULL;
+        cat->val = NULL;
+        freeFloatHdrData(&sinkref);
+        return (status = OUT_OF_MEMORY);
+    }
+    strcpy (cat->name, fname);
+    cat->chip = chip;
+
     freeFloatHdrData(&sinkref);
 
     return (status);
 }
 
 
+static void freeSinkCatalog (SinkCatalog *cat) {
+
+    if (cat->name[0] != '\0')
+        freeHdr (&cat->hdr);
+    free (cat->run);
+    free (cat->val);
+    cat->name[0] = '\0';
+    cat->nrun = 0;
+    cat->run = NULL;
+    cat->val = NULL;
+}
+
+
+/* Free the catalogues kept between calls, once the last exposure of a run
+   has been processed. */
+void clearSinkCatalogs (void) {
+
+    freeSinkCatalog (&sinkcat[0]);
+    freeSinkCatalog (&sinkcat[1]);
+}
+
+
 /* Find the corresponding EXT from SNKCFILE. Adapted from DetCCDChip. */
 static int DetSinkChip (char *fname, int chip, int *extver) {
     /* parameters:
@@ -29,7 +29,8 @@ void InitCTETrl (char * input, char * output, const char * isuffix, const char *
  */
 int ACScte (char *input, char *output, CalSwitch *cte_sw,
             RefFileInfo *refnames, int printtime, int verbose,
-            const unsigned nThreads, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd, const bool forwardModelOnly) {
+            const unsigned nThreads, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd, const bool forwardModelOnly,
+            const bool parallelAmps) {
 
     extern int status;
 
@@ -89,6 +90,7 @@ int ACScte (char *input, char *output, CalSwitch *cte_sw,
     acs.printtime = printtime;
     acs.verbose = verbose;
     acs.nThreads = nThreads;
+    acs.parallelAmps = parallelAmps;
     acs.cteAlgorithmGen = cteAlgorithmGen;
 
     /* For debugging...
@@ -12,6 +12,7 @@
 # include <stdio.h>
 # include <time.h>
 # include <stdbool.h>
+# include <stdlib.h>
 
 #include "hstcal_memory.h"
 #include "hstcal.h"
@@ -25,6 +26,11 @@
 
 # include "../../../../ctegen2/ctegen2.h"
 # include "pcte.h"
+# include "pcte_gen3_funcs.h"
+
+# ifdef _OPENMP
+#  include <omp.h>
+# endif
 
 static void PCTEMsg (ACSInfo *, int);
 static int OscnTrimmed (Hdr*, Hdr *);
@@ -279,7 +285,7 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
         addPtr(&ptrParallelReg, &cteParallelPars, &freeCTEParamsFast);
         initCTEParamsFast(&cteParallelPars, TRAPS, 0, 0, nScaleTableColumns, acs_info->nThreads);
         cteParallelPars.refAndIamgeBinsIdenticle = True;
-        cteParallelPars.verbose = acs->verbose = 0 ? False : True;
+        cteParallelPars.verbose = acs->verbose ? True : False;
 
         if ((status = allocateCTEParamsFast(&cteParallelPars)))
         {
@@ -334,7 +340,28 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
           Loop over the imsets as the CTE is applied per amp
         */
         char ccdamp[strlen(AMPSTR1)+1]; // string to hold amps on current chip
+
+        // Initialised here as it is only loaded for serial processing but freed on every exit
+        initCTEParamsFast(&ctePars, TRAPS, 0, 0, nScaleTableColumns, acs_info->nThreads);
         addPtr(&ptrReg, &ctePars, &freeCTEParamsFast);
+
+        /* When processing amps concurrently, the corrections are queued here (each with
+           its own serial parameters) and only run once all PCTETAB sets have been read. */
+        AmpCTEJob * jobs = NULL;
+        unsigned nJobs = 0;
+        if (acs_info->parallelAmps)
+        {
+            jobs = calloc(acs_info->nimsets * NAMPS, sizeof(*jobs));
+            addPtr(&ptrReg, jobs, &free);
+            if (!jobs)
+            {
+                trlerror("(pctecorr) Out of memory.");
+                freeOnExit(&ptrReg);
+                freeOnExit(&ptrParallelReg);
+                return (status = OUT_OF_MEMORY);
+            }
+            trlmessage("(pctecorr) Amps will be processed concurrently.");
+        }
         {   unsigned i;
             for (i = 0; i < acs_info->nimsets; i++) {
 
@@ -362,6 +389,14 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
                     amplocInCalib = strchr(AMPCALIBORDER, ccdamp[nthAmp]); // This is a full string.
                     ampIDInCalib = amplocInCalib - AMPCALIBORDER; // This is a number.
 
+                    // Each queued job needs its own copy of the serial parameters
+                    CTEParamsFast * serialPars = &ctePars;
+                    if (acs_info->parallelAmps)
+                    {
+                        serialPars = &jobs[nJobs].serialPars;
+                        skipLoadPrimary = False;
+                    }
+
                     /*
                        Only perform the serial CTE correction for post-SM4 data.
                     */
@@ -383,11 +418,13 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
                         */
 
                         if (!skipLoadPrimary) {
-                            initCTEParamsFast(&ctePars, TRAPS, 0, 0, nScaleTableColumns, acs_info->nThreads);
+                            initCTEParamsFast(serialPars, TRAPS, 0, 0, nScaleTableColumns, acs_info->nThreads);
+                            if (serialPars != &ctePars)
+                                addPtr(&ptrReg, serialPars, &freeCTEParamsFast);
 
-                            ctePars.refAndIamgeBinsIdenticle = True;
-                            ctePars.verbose = acs->verbose = 0 ? False : True;
-                            if ((status = allocateCTEParamsFast(&ctePars)))
+                            serialPars->refAndIamgeBinsIdenticle = True;
+                            serialPars->verbose = acs->verbose ? True : False;
+                            if ((status = allocateCTEParamsFast(serialPars)))
                             {
                                 freeOnExit(&ptrReg);
                                 freeOnExit(&ptrParallelReg);
@@ -395,7 +432,7 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
                             }
                         }
 
-                        if ((status = loadPCTETAB(cteTabFilename, &ctePars, startOfSetInCalib, skipLoadPrimary)))
+                        if ((status = loadPCTETAB(cteTabFilename, serialPars, startOfSetInCalib, skipLoadPrimary)))
                         {
                             freeOnExit(&ptrReg);
                             freeOnExit(&ptrParallelReg);
@@ -403,14 +440,14 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
                         }
                         skipLoadPrimary = True;
 
-                        if ((status = getCTEParsFromImageHeader(&x[0], &ctePars)))
+                        if ((status = getCTEParsFromImageHeader(&x[0], serialPars)))
                         {
                             freeOnExit(&ptrReg);
                             freeOnExit(&ptrParallelReg);
                             return (status);
                         }
 
-                        ctePars.scale_frac = (acs->expstart - ctePars.cte_date0) / (ctePars.cte_date1 - ctePars.cte_date0);
+                        serialPars->scale_frac = (acs->expstart - serialPars->cte_date0) / (serialPars->cte_date1 - serialPars->cte_date0);
 
                         /*
                            Write the amp-dependent serial HISTORY information here.
@@ -418,19 +455,19 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
                         char amp_corrType[20] = "serial - Amp ";
                         strcat(amp_corrType, &ccdamp[nthAmp]);
                         amp_corrType[14] = '\0';
-                        if ((status = populateImageFileWithCTEKeywordValues(&x[0], &ctePars, amp_corrType)))
+                        if ((status = populateImageFileWithCTEKeywordValues(&x[0], serialPars, amp_corrType)))
                         {
                             freeOnExit(&ptrReg);
                             freeOnExit(&ptrParallelReg);
                             return (status);
                         }
 
-                        trlwarn("(pctecorr) IGNORING read noise level PCTERNOI from PCTETAB: %f. Using amp dependent values from CCDTAB instead", ctePars.rn_amp);
+                        trlwarn("(pctecorr) IGNORING read noise level PCTERNOI from PCTETAB: %f. Using amp dependent values from CCDTAB instead", serialPars->rn_amp);
                         trlmessage("(pctecorr) Readout simulation forward modeling iterations PCTENFOR: %i\n"
                                    "(pctecorr) Number of iterations used in the parallel transfer PCTENPAR: %i\n"
                                    "(pctecorr) CTE_FRAC: %f\n"
                                    "(pctecorr) The %s CTE processing parameters have been read.",
-                                   ctePars.n_forward, ctePars.n_par, ctePars.scale_frac, corrType);
+                                   serialPars->n_forward, serialPars->n_par, serialPars->scale_frac, corrType);
                     } // End if block for collecting and reporting serial CTE correction
 
                     /*
@@ -440,13 +477,26 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
                        in addition to the parallel correction information which is the same for all amps.
                     */
 
+                    if (acs_info->parallelAmps)
+                    {
+                        AmpCTEJob * job = &jobs[nJobs++];
+                        job->imset = i;
+                        job->nthAmp = nthAmp;
+                        job->ampID = ampID;
+                        job->amploc = amploc;
+                        strcpy(job->ccdamp, ccdamp);
+                        job->doSerial = acs_info->expstart >= SM4MJD;
+                        job->parallelPars = cteParallelPars; // doPCTEGen3 only updates the scalar members
+                        continue;
+                    }
+
                     clock_t begin = (double)clock();
 
                     /* Perform the serial CTE correction for only post-SM4 data */
                     if (acs_info->expstart >= SM4MJD) {
                         /* Serial correction */
                         strcpy(corrType, "serial");
-                        if ((status = doPCTEGen3(&acs[i], &ctePars, &x[i], forwardModelOnly, corrType, ccdamp, nthAmp, amploc, ampID)))
+                        if ((status = doPCTEGen3(&acs[i], serialPars, &x[i], forwardModelOnly, corrType, ccdamp, nthAmp, amploc, ampID)))
                         {
                             freeOnExit(&ptrReg);
                             freeOnExit(&ptrParallelReg);
@@ -469,6 +519,22 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
             }
         }
 
+        if (acs_info->parallelAmps)
+        {
+            clock_t begin = (double)clock();
+            if ((status = runAmpCTEJobs(acs, x, jobs, nJobs, forwardModelOnly, acs_info->nThreads)))
+            {
+                freeOnExit(&ptrReg);
+                freeOnExit(&ptrParallelReg);
+                return status;
+            }
+            double time_spent = ((double) clock()- begin +0.0) / CLOCKS_PER_SEC;
+            trlmessage("(pctecorr) CTE run time for all amps: %.2f(s) with %i procs/threads\n", time_spent/acs_info->nThreads, acs_info->nThreads);
+        }
+
+        freeOnExit(&ptrReg);
+        freeOnExit(&ptrParallelReg);
+
         PrSwitch("pctecorr", COMPLETE);
     }
 
@@ -527,6 +593,77 @@ int DoCTE (ACSInfo *acs_info, const bool forwardModelOnly) {
 }
 
 
+/* Run the queued amp corrections as concurrent tasks. Each amp is extracted from and
+   inserted back into its own columns of the chip, so the tasks do not overlap. The
+   available threads are split between the tasks, each using its share for the
+   column parallelism within doPCTEGen3. The trailer messages of each amp are held
+   back until all are done and then output in amp order.
+*/
+int runAmpCTEJobs (ACSInfo * acs, SingleGroup * x, AmpCTEJob * jobs, const unsigned nJobs, const bool forwardModelOnly, const unsigned nThreads) {
+
+    extern int status;
+
+    if (!nJobs)
+        return status;
+
+    int jobStatus[nJobs];
+    char * jobMessages[nJobs];
+
+#ifdef _OPENMP
+    const unsigned nConcurrent = nJobs < nThreads ? nJobs : (nThreads ? nThreads : 1);
+    const unsigned nInnerThreads = nThreads > nConcurrent ? nThreads / nConcurrent : 1;
+    const int maxActiveLevels = omp_get_max_active_levels();
+    omp_set_max_active_levels(2);
+#endif
+
+    {   unsigned k;
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(nConcurrent) schedule(dynamic, 1) shared(acs, x, jobs, jobStatus, jobMessages)
+#endif
+        for (k = 0; k < nJobs; ++k)
+        {
+#ifdef _OPENMP
+            omp_set_num_threads(nInnerThreads);
+#endif
+            AmpCTEJob * job = &jobs[k];
+            char corrType[20];
+            // Should the capture fail, the amp's messages are output straight away instead
+            trlBeginCapture();
+            jobStatus[k] = HSTCAL_OK;
+            if (job->doSerial)
+            {
+                strcpy(corrType, "serial");
+                jobStatus[k] = doPCTEGen3(&acs[job->imset], &job->serialPars, &x[job->imset], forwardModelOnly,
+                                          corrType, job->ccdamp, job->nthAmp, job->amploc, job->ampID);
+            }
+            if (jobStatus[k] == HSTCAL_OK)
+            {
+                strcpy(corrType, "parallel");
+                jobStatus[k] = doPCTEGen3(&acs[job->imset], &job->parallelPars, &x[job->imset], forwardModelOnly,
+                                          corrType, job->ccdamp, job->nthAmp, job->amploc, job->ampID);
+            }
+            jobMessages[k] = trlEndCapture();
+        }
+    }
+
+#ifdef _OPENMP
+    omp_set_max_active_levels(maxActiveLevels);
+#endif
+
+    // doPCTEGen3 leaves the global status alone, it is set once here from the first failure in amp order
+    status = HSTCAL_OK;
+    {   unsigned k;
+        for (k = 0; k < nJobs; ++k)
+        {
+            trlFlushCapture(jobMessages[k]);
+            free(jobMessages[k]);
+            if (status == HSTCAL_OK && jobStatus[k] != HSTCAL_OK)
+                status = jobStatus[k];
+        }
+    }
+    return status;
+}
+
 static void PCTEMsg (ACSInfo *acs, int extver) {
     int OmitStep (int);
     void PrSwitch (char *, int);
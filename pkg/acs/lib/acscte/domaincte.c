@@ -43,7 +43,7 @@ int doMainCTE (int argc, char **argv);
 
 static void printSyntax()
 {
-    printf ("syntax:  %s [--help] [-t] [-v] [-q] [--version] [--gitinfo] [-1|--nthreads <N>] [--ctegen <1|2>] [--pctetab <path>] [--forwardModelOnly] input [output]\n", program);
+    printf ("syntax:  %s [--help] [-t] [-v] [-q] [--version] [--gitinfo] [-1|--nthreads <N>] [--ctegen <1|2>] [--pctetab <path>] [--forwardModelOnly] [--parallelAmps] input [output]\n", program);
 }
 static void printHelp(void)
 {
@@ -62,6 +62,7 @@ int doMainCTE (int argc, char **argv) {
     unsigned cteAlgorithmGen = 0; //Use gen1cte algorithm rather than gen2 (default)
     unsigned nThreads = 0;
     bool forwardModelOnly = false;
+    bool parallelAmps = false; /* process amps as concurrent tasks? */
     char pcteTabNameFromCmd[CHAR_LINE_LENGTH];
     *pcteTabNameFromCmd = '\0';
     int too_many = 0;	/* too many command-line arguments? */
@@ -90,7 +91,7 @@ int doMainCTE (int argc, char **argv) {
 
     int ACScte (char *, char *, CalSwitch *, RefFileInfo *, int, int, int,
             const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd,
-            const bool forwardModelOnly);
+            const bool forwardModelOnly, const bool parallelAmps);
     int DefSwitch (char *);
     int MkName (char *, char *, char *, char *, char *, int);
     void WhichError (int);
@@ -228,6 +229,14 @@ int doMainCTE (int argc, char **argv) {
                 forwardModelOnly = true;
                 continue;
             }
+            else if (strncmp(argv[i], "--parallelAmps", 14) == 0)
+            {
+#ifndef _OPENMP
+                printf("WARNING: '--parallelAmps' used but OPENMP not found!\n");
+#endif
+                parallelAmps = true;
+                continue;
+            }
             else
             {
                 if (argv[i][1] == '-')
@@ -388,7 +397,7 @@ int doMainCTE (int argc, char **argv) {
 
         /* Calibrate the current input file. */
         if ((status = ACScte (input, output, &ccd_sw, &refnames, printtime, verbose,
-                              (int) nThreads, cteAlgorithmGen, pcteTabNameFromCmd, forwardModelOnly))) {
+                              (int) nThreads, cteAlgorithmGen, pcteTabNameFromCmd, forwardModelOnly, parallelAmps))) {
             trlerror("Error processing %s.", input);
             WhichError (status);
         }
@@ -6,6 +6,7 @@
 #include <time.h>
 
 #include "hstcal_memory.h"
+#include "hstcal_orient.h"
 #include "hstcal.h"
 #include "hstio.h"
 
@@ -33,8 +34,6 @@ static int alignAmpData(FloatTwoDArray * amp, const unsigned ampID);
 static int alignAmp(SingleGroup * amp, const unsigned ampID);
 static int rotateAmp(SingleGroup * amp, const unsigned ampID, bool derotate, char ccdamp);
 
-static void side2sideFlip(FloatTwoDArray *amp);
-static void top2bottomFlip(FloatTwoDArray *amp);
 
 int doPCTEGen3 (ACSInfo *acs, CTEParamsFast * ctePars, SingleGroup * chipImage, const bool forwardModelOnly, char * corrType, char *ccdamp, int nthAmp, char *amploc, int ampID)
 
@@ -45,7 +44,9 @@ int doPCTEGen3 (ACSInfo *acs, CTEParamsFast * ctePars, SingleGroup * chipImage,
        x      io: image to be calibrated; written to in-place
     */
 
-    extern int status;
+    // Local rather than the global status as amps may be corrected concurrently, see
+    // runAmpCTEJobs() in docte.c; the caller sets the global status from the return value.
+    int status = HSTCAL_OK;
 
     if (!acs || !ctePars || !chipImage)
         return (status = ALLOCATION_PROBLEM);
@@ -75,9 +76,9 @@ int doPCTEGen3 (ACSInfo *acs, CTEParamsFast * ctePars, SingleGroup * chipImage,
     trlmessage("(pctecorr) Read noise level from CCDTAB: %f.", ctePars->rn_amp);
 
     /* get amp array size */
-    if (get_amp_array_size_acs_cte(acs, chipImage, amploc, ccdamp,
+    if ((status = get_amp_array_size_acs_cte(acs, chipImage, amploc, ccdamp,
                                    &amp_xsize, &amp_ysize, &amp_xbeg,
-                                   &amp_xend, &amp_ybeg, &amp_yend))
+                                   &amp_xend, &amp_ybeg, &amp_yend)))
     {
         freeOnExit(&ptrReg);
         return (status);
@@ -197,19 +198,40 @@ int doPCTEGen3 (ACSInfo *acs, CTEParamsFast * ctePars, SingleGroup * chipImage,
     trlmessage("(pctecorr) ...complete.");
 
     trlmessage("(pctecorr) Creating charge trap image...");
+    // By default only the per-column trap scaling is held, from which the readout
+    // kernels evaluate each column of the trap pixel map as they go.
     SingleGroup trapPixelMap;
     initSingleGroup(&trapPixelMap);
     addPtr(&ptrReg, &trapPixelMap, &freeSingleGroup);
-    if (allocSingleGroupExts(&trapPixelMap, nColumns, nRows, SCIEXT, False) != 0)
+    TrapColumnCoeffs trapCoeffs;
+    initTrapColumnCoeffs(&trapCoeffs);
+    addPtr(&ptrReg, &trapCoeffs, &freeTrapColumnCoeffs);
+    if (ctePars->useTrapPixelMap)
     {
-        freeOnExit(&ptrReg);
-        return (status = OUT_OF_MEMORY);
+        if (allocSingleGroupExts(&trapPixelMap, nColumns, nRows, SCIEXT, False) != 0)
+        {
+            freeOnExit(&ptrReg);
+            return (status = OUT_OF_MEMORY);
+        }
+        setStorageOrder(&trapPixelMap, COLUMNMAJOR);
+        if ((status = populateTrapPixelMap(&trapPixelMap, ctePars)))
+        {
+            freeOnExit(&ptrReg);
+            return status;
+        }
     }
-    setStorageOrder(&trapPixelMap, COLUMNMAJOR);
-    if ((status = populateTrapPixelMap(&trapPixelMap, ctePars)))
+    else
     {
-        freeOnExit(&ptrReg);
-        return status;
+        if ((status = allocTrapColumnCoeffs(&trapCoeffs, nColumns, nRows)))
+        {
+            freeOnExit(&ptrReg);
+            return status;
+        }
+        if ((status = populateTrapColumnCoeffs(&trapCoeffs, ctePars)))
+        {
+            freeOnExit(&ptrReg);
+            return status;
+        }
     }
     trlmessage("(pctecorr) ...complete.");
 
@@ -218,7 +240,11 @@ int doPCTEGen3 (ACSInfo *acs, CTEParamsFast * ctePars, SingleGroup * chipImage,
     {
         trlmessage("(pctecorr) Running forward model simulation...");
         //perform CTE correction
-        if ((status = forwardModel(&smoothedImage, cteCorrectedImage, &trapPixelMap, ctePars)))
+        if (ctePars->useTrapPixelMap)
+            status = forwardModel(&smoothedImage, cteCorrectedImage, &trapPixelMap, ctePars);
+        else
+            status = forwardModelWithTrapCoeffs(&smoothedImage, cteCorrectedImage, &trapCoeffs, ctePars);
+        if (status)
         {
             freeOnExit(&ptrReg);
             return status;
@@ -228,13 +254,18 @@ int doPCTEGen3 (ACSInfo *acs, CTEParamsFast * ctePars, SingleGroup * chipImage,
     {
         trlmessage("(pctecorr) Running correction algorithm...");
         //perform CTE correction
-        if ((status = inverseCTEBlur(&smoothedImage, cteCorrectedImage, &trapPixelMap, ctePars)))
+        if (ctePars->useTrapPixelMap)
+            status = inverseCTEBlur(&smoothedImage, cteCorrectedImage, &trapPixelMap, ctePars);
+        else
+            status = inverseCTEBlurWithTrapCoeffs(&smoothedImage, cteCorrectedImage, &trapCoeffs, ctePars);
+        if (status)
         {
             freeOnExit(&ptrReg);
             return status;
         }
     }
     freePtr(&ptrReg, &trapPixelMap);
+    freePtr(&ptrReg, &trapCoeffs);
     trlmessage("(pctecorr) ...complete.");
 
     // add 10% correction to error in quadrature.
@@ -324,7 +355,7 @@ int doPCTEGen3 (ACSInfo *acs, CTEParamsFast * ctePars, SingleGroup * chipImage,
 
 static int extractAmp(SingleGroup * amp,  const SingleGroup * image, const unsigned ampID, CTEParamsFast * ctePars)
 {
-    extern int status;
+    int status = HSTCAL_OK;
 
     if (!amp || !amp->sci.data.data || !image || !image->sci.data.data)
         return (status = ALLOCATION_PROBLEM);
@@ -362,7 +393,7 @@ static int extractAmp(SingleGroup * amp,  const SingleGroup * image, const unsig
 */
 static int rotateAmp(SingleGroup * amp, const unsigned ampID, bool derotate, char ccdamp)
 {
-    extern int status;
+    int status = HSTCAL_OK;
 
     if (!amp)
         return (status = ALLOCATION_PROBLEM);
@@ -409,55 +440,45 @@ static int rotateAmp(SingleGroup * amp, const unsigned ampID, bool derotate, cha
 
 int rotateAmpData_acscte(FloatTwoDArray * amp, const unsigned ampID)
 {
-    extern int status;
+    int status = HSTCAL_OK;
     if (!amp || !amp->data)
         return (status = ALLOCATION_PROBLEM);
 
     /*
        Rotate the amp to put the serial trails in the same orientation
        as the parallel trails would be. A rotation requires a transpose
-       and then a flip. Always transpose the data first.
-    */
-    transpose(amp);
+       and then a flip, done here as a single reorientation pass.
 
-    /*
-      To complete the correct rotation, the flip either has to be
-      from side-to-side about the central column or top-to-bottom
-      about the central row.
+       To complete the correct rotation, the flip either has to be
+       from side-to-side about the central column or top-to-bottom
+       about the central row.
     */
-    if (ampID == AMP_B || ampID == AMP_C) {
-        side2sideFlip(amp);
-    } else {
-        top2bottomFlip(amp);
-    }
+    const Orientation orient = (ampID == AMP_B || ampID == AMP_C) ? ORIENT_TRANSPOSE_FLIP_X : ORIENT_TRANSPOSE_FLIP_Y;
+    if ((status = reorientFloatData(amp, orient)))
+        trlerror("(pctecorr) Failed to rotate amp data");
 
     return status;
 }
 
 int derotateAmpData_acscte(FloatTwoDArray * amp, const unsigned ampID)
 {
-    extern int status;
+    int status = HSTCAL_OK;
     if (!amp || !amp->data)
         return (status = ALLOCATION_PROBLEM);
 
     /*
        To derotate the amp, you are reversing the direction of the initial
-       rotation.  Always transpose the data first, and then apply the
-       side-to-side or top-to-bottom flip to put the amp back into its
-       original orientation so the parallel CTE correction can proceed.
-    */
-    transpose(amp);
+       rotation.  Transpose the data and then apply the side-to-side or
+       top-to-bottom flip to put the amp back into its original orientation
+       so the parallel CTE correction can proceed.
 
-    /*
-      The rotation here is in the opposite direction from the initial
-      rotation for the amp in question, so if a side-to-side flip were
-      done initially, now do a top-to-bottom flip (for example).
+       The rotation here is in the opposite direction from the initial
+       rotation for the amp in question, so if a side-to-side flip were
+       done initially, now do a top-to-bottom flip (for example).
     */
-    if (ampID == AMP_B || ampID == AMP_C) {
-        top2bottomFlip(amp);
-    } else {
-        side2sideFlip(amp);
-    }
+    const Orientation orient = (ampID == AMP_B || ampID == AMP_C) ? ORIENT_TRANSPOSE_FLIP_Y : ORIENT_TRANSPOSE_FLIP_X;
+    if ((status = reorientFloatData(amp, orient)))
+        trlerror("(pctecorr) Failed to derotate amp data");
 
     return status;
 }
@@ -467,57 +488,13 @@ int derotateAmpData_acscte(FloatTwoDArray * amp, const unsigned ampID)
 */
 void transpose(FloatTwoDArray * amp)
 {
-    FloatTwoDArray orig_amp;
-    const int nRows = amp->ny, nColumns = amp->nx;
-    int i, j;
-
-    initFloatData(&orig_amp);
-    allocFloatData(&orig_amp, nColumns, nRows, False);
-    for (i = 0; i < nRows; i++) {
-        for (j = 0; j < nColumns; j++) {
-            PPix(&orig_amp, j, i) = PPix(amp, j, i);
-        }
-    }
-
-    if (amp->tot_nx != amp->tot_ny) {
-        amp->nx = nRows;
-        amp->ny = nColumns;
-        j = amp->tot_nx;
-        i = amp->tot_ny;
-        amp->tot_nx = i;
-        amp->tot_ny = j;
-    }
-
-    for (i = 0; i < nRows; i++) {
-        for (j = 0; j < nColumns; j++) {
-            PPix(amp, i, j) = PPix(&orig_amp, j, i);
-        }
-    }
-
-    freeFloatData(&orig_amp);
-}
-
-/*
-   Flip the amp about the Y-axis central column (i.e., flip from left to right)
-*/
-static void side2sideFlip(FloatTwoDArray * amp)
-{
-    const unsigned nRows = amp->ny;
-    const unsigned nColumns = amp->nx;
-    float temp;
-
-    for (unsigned i = 0; i < nRows; i++) {
-        for (unsigned j = 0; j < nColumns/2; j++) {
-            temp = PPix(amp, j, i);
-            PPix(amp, j, i) = PPix(amp, nColumns - j - 1, i);
-            PPix(amp, nColumns - j - 1, i) = temp;
-        }
-    }
+    if (reorientFloatData(amp, ORIENT_TRANSPOSE))
+        trlerror("(pctecorr) Failed to transpose amp data");
 }
 
 static int insertAmp(SingleGroup * image, const SingleGroup * amp, const unsigned ampID, CTEParamsFast * ctePars)
 {
-    extern int status;
+    int status = HSTCAL_OK;
 
     if (!amp || !amp->sci.data.data || !image || !image->sci.data.data)
         return (status = ALLOCATION_PROBLEM);
@@ -544,7 +521,7 @@ static int insertAmp(SingleGroup * image, const SingleGroup * amp, const unsigne
 
 static int alignAmp(SingleGroup * amp, const unsigned ampID)
 {
-    extern int status;
+    int status = HSTCAL_OK;
     if (!amp)
         return (status = ALLOCATION_PROBLEM);
 
@@ -572,7 +549,7 @@ static int alignAmpData(FloatTwoDArray * amp, const unsigned ampID)
     //NOTE: There is a similar version of this in wfc3 - code changes should be reflected in both.
 
     //Align image quadrants such that the amps are at the bottom left, i.e. aligned with amp C.
-    extern int status;
+    int status = HSTCAL_OK;
 
     if (!amp || !amp->data)
         return (status = ALLOCATION_PROBLEM);
@@ -585,78 +562,17 @@ static int alignAmpData(FloatTwoDArray * amp, const unsigned ampID)
     if (amp->storageOrder != ROWMAJOR)
         return (status = ALLOCATION_PROBLEM);
 
-    //Flip about y axis, i.e. about central column
+    //Flip about y axis, i.e. about central column, for amps B & D.
+    //Only thing left is to flip AB chip upside down,
+    //i.e. flip about x axis (central row) for amps A & B.
+    Orientation orient = ORIENT_IDENTITY;
     if (ampID == AMP_B || ampID == AMP_D)
-    {
-        side2sideFlip(amp);
-    }
-
-    //Only thing left is to flip AB chip upside down
-    //Flip about x axis, i.e. central row
+        orient |= ORIENT_FLIP_X;
     if (ampID == AMP_A || ampID == AMP_B)
-    {
-        top2bottomFlip(amp);
-    }
+        orient |= ORIENT_FLIP_Y;
 
-    return status;
-}
-
-/*
-   Flip the amp about the X-axis central row (i.e., flip from top to bottom)
-
-   Note: This routine was originally in alignAmpData flow of processing.  It
-   is now encapsulated here as it is used multiple times due to the rotations
-   needed to accommodate the serial CTE correction.  The original OPENMP
-   specifications have been left intact.
-*/
-static void top2bottomFlip(FloatTwoDArray * amp)
-{
-
-    const unsigned nColumns = amp->nx;
-    const unsigned nRows = amp->ny;
-
-    Bool allocationFail = False;
-#ifdef _OPENMP
-    #pragma omp parallel shared(amp, allocationFail)
-#endif
-    {
-        float * tempRow = NULL;
-        size_t rowSize = nColumns*sizeof(*tempRow);
-        tempRow = malloc(rowSize);
-        if (!tempRow)
-        {
-#ifdef _OPENMP
-            #pragma omp critical(allocationCheck) // This really isn't needed
-#endif
-            {
-                allocationFail = True;
-            }
-        }
+    if ((status = reorientFloatData(amp, orient)))
+        trlerror("Failed to align amp data");
 
-#ifdef _OPENMP
-        #pragma omp barrier
-#endif
-        if (!allocationFail)
-        {
-            {   unsigned i;
-#ifdef _OPENMP
-                #pragma omp for schedule(static)
-#endif
-                for (i = 0; i < nRows/2; ++i)
-                {
-                    float * topRow = amp->data + i*nColumns;
-                    float * bottomRow = amp->data + (nRows-1-i)*nColumns;
-                    memcpy(tempRow, topRow, rowSize);
-                    memcpy(topRow, bottomRow, rowSize);
-                    memcpy(bottomRow, tempRow, rowSize);
-                }
-            }
-        }
-        if (tempRow)
-            free(tempRow);
-    }//close parallel block
-    if (allocationFail)
-    {
-        trlerror("Out of memory for 'tempRow' in 'alignAmpData'");
-    }
+    return status;
 }
@@ -5,6 +5,7 @@
 
 #include "hstcal.h"
 #include "hstio.h"
+#include "hstcal_orient.h"
 
 #include "acs.h"
 #include "acsinfo.h"
@@ -24,7 +25,7 @@ static int make_amp_array(const ACSInfo *acs, const SingleGroup *im,
                           const int xbeg, const int ybeg,
                           double amp_sci_array[arr1*arr2],
                           double amp_err_array[arr1*arr2]);
-static int unmake_amp_array(const ACSInfo *acs, const SingleGroup *im,
+static int unmake_amp_array(const ACSInfo *acs, SingleGroup *im,
                             const int amp,
                             const int arr1, const int arr2,
                             const int xbeg, const int ybeg,
@@ -46,7 +47,7 @@ int get_amp_array_size_acs_cte(const ACSInfo *acs, SingleGroup *x,
                               char *amploc, char *ccdamp,
                               int *xsize, int *ysize, int *xbeg, int *xend,
                               int *ybeg, int *yend) {
-    extern int status;
+    // The global status is left alone as this is called for amps corrected concurrently
 
     int bias_loc;
     int bias_ampx, bias_ampy;
@@ -80,11 +81,10 @@ int get_amp_array_size_acs_cte(const ACSInfo *acs, SingleGroup *x,
         *ysize = *yend - *ybeg;
     } else {
         trlerror("(pctecorr) Detector not supported: %i",acs->detector);
-        status = ERROR_RETURN;
-        return status;
+        return ERROR_RETURN;
     }
 
-    return status;
+    return HSTCAL_OK;
 }
 
 
@@ -98,97 +98,59 @@ static int make_amp_array(const ACSInfo *acs, const SingleGroup *im,
                           double amp_sci_array[arr1*arr2],
                           double amp_err_array[arr1*arr2]) {
 
-    extern int status;
+    int AmpOrientation (const int, Orientation *);
 
-    /* iteration variables */
-    int i, j;
-
-    /* variables for the image row/column we want */
-    int r, c;
+    // The global status is left alone as this is called for amps corrected concurrently
+    int status;
+    Orientation orient;
 
     if (acs->detector == WFC_CCD_DETECTOR) {
-        for (i = 0; i < arr1; i++) {
-            for (j = 0; j < arr2; j++) {
-                if (amp == AMP_A) {
-                    r = ybeg + arr1 - i - 1;
-                    c = xbeg + j;
-                } else if (amp == AMP_B) {
-                    r = ybeg + arr1 - i - 1;
-                    c = xbeg + arr2 - j - 1;
-                } else if (amp == AMP_C) {
-                    r = ybeg + i;
-                    c = xbeg + j;
-                } else if (amp == AMP_D) {
-                    r = ybeg + i;
-                    c = xbeg + arr2 - j -1;
-                } else {
-                    trlerror("Amp number not recognized, must be 0-3.");
-                    status = ERROR_RETURN;
-                    return status;
-                }
-
-                amp_sci_array[i*arr2 + j] = Pix(im->sci.data, c, r);
-                amp_err_array[i*arr2 + j] = Pix(im->err.data, c, r);
-            }
+        if ((status = AmpOrientation(amp, &orient)))
+            return status;
+
+        if ((status = getOrientedFloatSect(&im->sci.data, xbeg, ybeg, arr2, arr1, orient, amp_sci_array)) ||
+            (status = getOrientedFloatSect(&im->err.data, xbeg, ybeg, arr2, arr1, orient, amp_err_array))) {
+            trlerror("(pctecorr) Failed to extract amp array");
+            return status;
         }
     } else {
         trlerror("(pctecorr) Detector not supported: %i",acs->detector);
-        status = ERROR_RETURN;
-        return status;
+        return ERROR_RETURN;
     }
 
-    return status;
+    return HSTCAL_OK;
 }
 
 
 /* unmake_amp_array does the opposite of make_amp_array, it takes amp array
    views and puts them back into the single group in the right order.
 */
-static int unmake_amp_array(const ACSInfo *acs, const SingleGroup *im,
+static int unmake_amp_array(const ACSInfo *acs, SingleGroup *im,
                             const int amp,
                             const int arr1, const int arr2,
                             const int xbeg, const int ybeg,
                             double amp_sci_array[arr1*arr2],
                             double amp_err_array[arr1*arr2]) {
 
-    extern int status;
+    int AmpOrientation (const int, Orientation *);
 
-    /* iteration variables */
-    int i, j;
-
-    /* variables for the image row/column we want */
-    int r, c;
+    // The global status is left alone as this is called for amps corrected concurrently
+    int status;
+    Orientation orient;
 
     if (acs->detector == WFC_CCD_DETECTOR) {
-        for (i = 0; i < arr1; i++) {
-            for (j = 0; j < arr2; j++) {
-                if (amp == AMP_A) {
-                    r = ybeg + arr1 - i - 1;
-                    c = xbeg + j;
-                } else if (amp == AMP_B) {
-                    r = ybeg + arr1 - i - 1;
-                    c = xbeg + arr2 - j - 1;
-                } else if (amp == AMP_C) {
-                    r = ybeg + i;
-                    c = xbeg + j;
-                } else if (amp == AMP_D) {
-                    r = ybeg + i;
-                    c = xbeg + arr2 - j -1;
-                } else {
-                    trlerror("Amp number not recognized, must be 0-3.");
-                    status = ERROR_RETURN;
-                    return status;
-                }
-
-                Pix(im->sci.data, c, r) = (float) amp_sci_array[i*arr2 + j];
-                Pix(im->err.data, c, r) = (float) amp_err_array[i*arr2 + j];
-            }
+        if ((status = AmpOrientation(amp, &orient)))
+            return status;
+
+        if ((status = putOrientedFloatSect(&im->sci.data, xbeg, ybeg, arr2, arr1, orient, amp_sci_array)) ||
+            (status = putOrientedFloatSect(&im->err.data, xbeg, ybeg, arr2, arr1, orient, amp_err_array))) {
+            trlerror("(pctecorr) Failed to insert amp array");
+            return status;
         }
     } else {
         trlerror("(pctecorr) Detector not supported: %i",acs->detector);
-        status = ERROR_RETURN;
-        return status;
+        return ERROR_RETURN;
     }
 
-    return status;
+    return HSTCAL_OK;
 }
@@ -41,6 +41,7 @@ void ACSInit (ACSInfo *acs) {
     acs->printtime = 0;
     acs->verbose = 0;
     acs->nThreads = 1;
+    acs->parallelAmps = 0;
     acs->cteAlgorithmGen = 0;
     acs->pcteTabNameFromCmd[0] = '\0';
 
@@ -9,8 +9,10 @@
 # include   "acsrej.h"
 # include   "hstcalerr.h"
 # include   "rej.h"
+# include   "hstcal_imagestack.h"
 
-static void closeSciDq (int, IODescPtr [], IODescPtr [], IODescPtr [], clpar *);
+static void closeSciDq (int, IODescPtr [], IODescPtr [], IODescPtr [],
+                        ImageStack *, clpar *);
 
 
 /*  acsrej_do -- Perform the cosmic ray rejection for ACS images
@@ -52,6 +54,7 @@ int acsrej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
     IODescPtr   ipsci[MAX_FILES];   /* science image descriptor */
     IODescPtr   iperr[MAX_FILES];   /* error image descriptor */
     IODescPtr   ipdq[MAX_FILES];    /* data quality image descriptor */
+    ImageStack  stack;              /* inputs, in memory if within budget */
     float       skyval[MAX_FILES];  /* background values */
     float       efac[MAX_FILES];    /* exposure factors */
     multiamp    noise;              /* readout noise */
@@ -104,13 +107,12 @@ int acsrej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
     int     cr_scaling (char *, IRAFPointer, float [], int *, double *,
                         double *);
     int     rejpar_in(clpar *, int [], int, float, int *, float []);
-    void    acsrej_sky (char *, IODescPtr [], IODescPtr [], int, short,
-                        float []);
+    void    acsrej_sky (char *, const ImageStack *, int, short, float []);
     void    cr_history (SingleGroup *, clpar *, int);
-    int     acsrej_init (IODescPtr [], IODescPtr [], clpar *, int, int, int,
+    int     acsrej_init (const ImageStack *, clpar *, int, int, int,
                          float [], float [], SingleGroup *, float *);
     int     acsrej_loop (IODescPtr [], IODescPtr [], IODescPtr [],
-                         char [][CHAR_FNAME_LENGTH], int [], int, clpar *, int, int,
+                         const ImageStack *, char [][CHAR_FNAME_LENGTH], int [], int, clpar *, int, int,
                          int, float [], multiamp, multiamp, float [], float [],
                          FloatTwoDArray *, FloatTwoDArray *, float *,
                          ShortTwoDArray *, int *, char *, char *);
@@ -262,14 +264,34 @@ int acsrej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 		if ( rejpar_in (par, newpar, nimgs, exptot, &niter, sigma) )
 			return(status);
 
+		/* Read all inputs into memory once if they fit within the memory
+		   budget, otherwise each pass below streams them from disk, in
+		   bands as large as the budget allows. */
+		if ((status = openImageStack (&stack, ipsci, iperr, ipdq, nimgs,
+				dim_x, dim_y, (size_t)(par->membudget * 1024. * 1024.)))) {
+			trlerror ("Couldn't read input images for extension %d", extver);
+			closeSciDq(nimgs, ipsci, iperr, ipdq, &stack, par);
+			return (status);
+		}
+		if (par->verbose) {
+			if (stack.inMemory)
+				trlmessage ("Holding in memory %d input images", nimgs);
+			else if (stack.bandLines > 0)
+				trlmessage ("Streaming from disk %d input images, in bands of %d lines",
+				            nimgs, stack.bandLines);
+			else
+				trlmessage ("Streaming from disk %d input images", nimgs);
+		}
+
 		/* allocate array space */
 		efacsum = calloc (dim_x*dim_y, sizeof(float));
 		work    = calloc (nimgs*dim_x, sizeof(float));
 
 		/* calculate the sky levels */
-		acsrej_sky (par->sky, ipsci, ipdq, nimgs, par->badinpdq, skyval);
+		acsrej_sky (par->sky, &stack, nimgs, par->badinpdq, skyval);
 		if (status != ACS_OK) {
 			WhichError (status);
+			freeImageStack (&stack);
 			return (status);
 		}
 		if (par->verbose) {
@@ -297,6 +319,7 @@ int acsrej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 			n++;
 		} while (found == 0);
 
+		syncImageStack (&stack);
 		getSingleGroup (imgdefault, extver, &sg);
 
 		if (non_zero > 1) {
@@ -305,10 +328,10 @@ int acsrej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 			if (non_zero < nimgs) {
 				trlwarn ("Some input exposures had EXPTIME = 0.");
 			}
-			if (acsrej_init (ipsci, ipdq, par, nimgs, dim_x, dim_y, efac,
+			if (acsrej_init (&stack, par, nimgs, dim_x, dim_y, efac,
 							 skyval, &sg, work)) {
 				WhichError(status);
-				closeSciDq(nimgs, ipsci, iperr, ipdq, par);
+				closeSciDq(nimgs, ipsci, iperr, ipdq, &stack, par);
 				return (status);
 			}
 
@@ -316,12 +339,13 @@ int acsrej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 				TimeStamp ("Calculated initial guess for extension", "");
 
 			/* do the iterative cosmic ray rejection calculations */
-			if (acsrej_loop (ipsci, iperr, ipdq, imgname, ext, nimgs, par,
-							 niter, dim_x, dim_y, sigma, noise, gain, efac,
-							 skyval, &sg.sci.data, &sg.err.data, efacsum,
-							 &sg.dq.data, &nrej, shadref.name, imagetyp)) {
+			if (acsrej_loop (ipsci, iperr, ipdq, &stack, imgname, ext, nimgs,
+							 par, niter, dim_x, dim_y, sigma, noise, gain,
+							 efac, skyval, &sg.sci.data, &sg.err.data,
+							 efacsum, &sg.dq.data, &nrej, shadref.name,
+							 imagetyp)) {
 				WhichError(status);
-				closeSciDq(nimgs, ipsci, iperr, ipdq, par);
+				closeSciDq(nimgs, ipsci, iperr, ipdq, &stack, par);
 				return (status);
 			}
 		} else {
@@ -333,7 +357,7 @@ int acsrej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
         } /* End if(non_zero) block */
 
         /* must close all images, now that we are done reading them */
-        closeSciDq(nimgs, ipsci, iperr, ipdq, par);
+        closeSciDq(nimgs, ipsci, iperr, ipdq, &stack, par);
 
         /* calculate the total sky (electrons)... */
         skysum = 0.;
@@ -460,10 +484,13 @@ int acsrej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 
 /* Helper function to clean up image pointers... */
 static void closeSciDq(int nimgs, IODescPtr ipsci[], IODescPtr iperr[],
-                       IODescPtr ipdq[], clpar *par) {
+                       IODescPtr ipdq[], ImageStack *stack, clpar *par) {
     int n;
 
-    /* must close all images, now that we are done reading them */
+    /* release any in-memory copy of the images, stopping any read ahead... */
+    freeImageStack (stack);
+
+    /* ...and close them all, now that we are done reading them */
     for (n = 0; n < nimgs; ++n) {
         closeImage (ipsci[n]);
         closeImage (iperr[n]);
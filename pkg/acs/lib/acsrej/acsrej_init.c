@@ -8,6 +8,8 @@
 # include   "rej.h"
 # include   "acsrej.h"
 # include   "hstcalerr.h"
+# include   "hstcal_imagestack.h"
+# include   "hstcal_select.h"
 
 # define    OK          (short)0
 
@@ -30,16 +32,14 @@
   01-Dec-2015   P.L. Lim        Calculations now entirely in electrons.
   13-Jan-2016   P.L. Lim        Removed variance init and cleaned up function.
 */
-int acsrej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
+int acsrej_init (const ImageStack *stack, clpar *par, int nimgs,
                  int dim_x, int dim_y, float efac[], float skyval[],
                  SingleGroup *sg, float *work) {
     /*
       Parameters:
 
-      ipsci   i: Array of pointers to SCI extension of the given EXTVER,
-                 each pointer is an input image. Unit now in electrons.
-      ipdq    i: Array of pointers to DQ extension of the given EXTVER,
-                 each pointer is an input image.
+      stack   i: SCI and DQ extensions of the given EXTVER of the input
+                 images. SCI unit now in electrons.
       par     i: User specified parameters.
       nimgs   i: Number of input images.
       dim_x, dim_y  i: Image dimension taken from the first input image.
@@ -58,20 +58,17 @@ int acsrej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
     extern int status;
 
     float     val, raw, dumf;
-    int       i, j, n, p, dum;
+    int       i, j, n, dum;
     float     *buf;
     short     *bufdq;
     int       *npts, *ipts;
     short     dqpat;
-    Hdr       dqhdr;
-
-    void      ipiksrt (float [], int, int[]);
 
     /* -------------------------------- begin ------------------------------- */
 
     dqpat = par->badinpdq;
 
-    ipts = calloc (nimgs, sizeof(int));
+    ipts = calloc ((size_t)nimgs*dim_x, sizeof(int));
     npts = calloc (dim_x, sizeof(int));
     buf = calloc (dim_x, sizeof(float));
     bufdq = calloc (dim_x, sizeof(short));
@@ -82,18 +79,15 @@ int acsrej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
             memset (npts, 0, dim_x*sizeof(int));
 
             for (n = 0; n < nimgs; n++) {
-                initHdr(&dqhdr);
-                getHeader(ipdq[n], &dqhdr);
-                getFloatLine (ipsci[n], j, buf);  /* electrons */
-                getShortLine (ipdq[n], j, bufdq);
-                freeHdr(&dqhdr);
+                getStackSciLine (stack, n, j, buf);  /* electrons */
+                getStackDqLine (stack, n, j, bufdq);
 
                 /* Only use GOOD pixels to build initial image.
                    work array is already initialized to zeroes in acsrej_do.c */
                 if (efac[n] > 0.) {
                     for (i = 0; i < dim_x; i++) {
                         if ((bufdq[i] & dqpat) == OK) {
-                            PIX(work, npts[i], i, nimgs) =
+                            PIX(work, i, npts[i], dim_x) =
                                 (buf[i] - skyval[n]) / efac[n];  /* e/s */
                             npts[i] += 1;
                         }
@@ -101,23 +95,22 @@ int acsrej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
                 }
             }  /* End of nimgs loop */
 
+            /* Sort the pixel stacks of the whole line at once */
+            sortStackFloat (work, ipts, npts, nimgs, dim_x, dim_x);
+
             /* ALL AMPS */
             for (i = 0; i < dim_x; i++) {
                 dum = npts[i];  /* Number of good data points */
                 if (dum == 0)
                     Pix(sg->sci.data, i, j) = 0.0F;
                 else {
-                    /* Setup index array for sorting... */
-                    for (p=0; p < nimgs; p++) ipts[p] = p;
-                    /* Sort pixel stack and corresponding index array. */
-                    ipiksrt (&PIX(work, 0, i, nimgs), dum, ipts);
                      /* Even number of input images for this pixel */
                     if ((dum / 2) * 2 == dum) {
                         Pix(sg->sci.data, i, j) =
-                            (PIX(work, dum / 2 - 1, i, nimgs) +
-                             PIX(work, dum / 2, i, nimgs)) / 2.;
+                            (PIX(work, i, dum / 2 - 1, dim_x) +
+                             PIX(work, i, dum / 2, dim_x)) / 2.;
                     } else {
-                        Pix(sg->sci.data, i, j) = PIX(work, dum / 2, i, nimgs);
+                        Pix(sg->sci.data, i, j) = PIX(work, i, dum / 2, dim_x);
                     }
                 }
             } /* End loop over ALL AMPS used on pixels in the line */
@@ -131,12 +124,9 @@ int acsrej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
         }
 
         for (n = 0; n < nimgs; n++) {
-            initHdr(&dqhdr);
-            getHeader(ipdq[n], &dqhdr);
-
             for (j = 0; j < dim_y; j++) {
-                getFloatLine (ipsci[n], j, buf);  /* electrons */
-                getShortLine (ipdq[n], j, bufdq);
+                getStackSciLine (stack, n, j, buf);  /* electrons */
+                getStackDqLine (stack, n, j, bufdq);
 
                 /* ALL AMPS */
                 for (i = 0; i < dim_x; i++) {
@@ -164,8 +154,6 @@ int acsrej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
                     }
                 } /* End of loop over ALL AMPS for this line in each image */
             } /* End of loop over lines in image (y) */
-
-            freeHdr(&dqhdr);
         } /* End of loop over images in set */
     }
 
@@ -11,44 +11,48 @@
 # include   "rej.h"
 # include   "hstcalerr.h"
 # include   "str_util.h"
-
-/* local mask values */
-# define    OK          (short)0
-# define    HIT         (short)8
-# define    SPILL       (short)2
-# define    EXCLUDE     (short)4
+# include   "hstcal_imagestack.h"
+# include   "hstcal_crrej.h"
+
+# ifdef _OPENMP
+#  include  <omp.h>
+# endif
+
+/* local mask values, see hstcal_crrej.h */
+# define    OK          CRREJ_MASK_OK
+# define    HIT         CRREJ_MASK_HIT
+# define    SPILL       CRREJ_MASK_SPILL
+# define    EXCLUDE     CRREJ_MASK_EXCLUDE
 # define    BAD         (short)~OK
 # define    ABS(x)      ((x>0.) ? x : -x)
 
-/* Local routines for dealing with arrays of pointers to
-**   arrays.  */
+/* The line & bit buffers are in hstcal_crrej.h, shared with WF3REJ */
 static void calc_thresholds(int, int, int, float, float, float, float,
                             FloatTwoDArray *, float *, float *,
                             float **, float **);
-static float **allocFloatBuff (int, int);
-static short **allocShortBuff (int, int);
-static void freeFloatBuff (float **, int);
-static void freeShortBuff (short **, int);
-static void scrollFloatBuff (float *, int, int, int, int, float **, float *);
-static void scrollShortBuff (short *, int, int, int, int, short **, short *);
-static void InitShortSect (short **, short *, IODescPtr *, int, int, int);
-static void InitFloatSect (float **, float *, IODescPtr *, int, int, int);
-
-static Byte ***allocBitBuff (int, int, int);
-static void freeBitBuff (Byte ***, int, int);
-static void readBitLine (Byte ***, int, int, int, short, short, short *);
-static void writeBitLine (short *, int, int, int, short, Byte ***);
-
-/* For debugging purposes:
-static void printBitLine (Byte ***, int, int, int);
-*/
 static int  initShad (Hdr *, int, char *, int, int *, int *, int *, int *,
                       int *);
-static void getShadLine (float **, int, int, int, float *);
 static void getShadBuff (IODescPtr *, int, int, int, int, int, int, int, int,
                          float **);
-static void getShadcorr (float **, int, int, int, float, int, float *);
 
+/* ACS noise model of the band rejection */
+typedef struct {
+    const ImageStack *stack;
+    const float *efac;
+    const float *skyval;
+    const float *exp2;
+    const float *shadcorr;
+    float scale;
+    float exptot;
+} AcsRejNoise;
+
+static void acsrejPixels (const void *, int, int, float *);
+static void acsrejThresholds (const void *, int, int, int, float,
+                              const float *, float *, float *, float *,
+                              float *);
+static void acsrejAddVariance (const void *, int, int, const float *,
+                               const char *, float *);
+static float acsrejVariance (const void *, float, float);
 
 /*  acsrej_loop -- Perform cosmic ray rejection
 
@@ -102,6 +106,12 @@ Code Outline:
 
     - Free memory used by all the buffers
 
+    When the input stack is held in memory and no shading correction is
+    applied, each iteration is instead run by crrejBandIteration in parallel
+    horizontal bands, with the same results. Only the pixels whose average
+    changed are then tested again while sigma stays the same, and only
+    those whose rejections changed are accumulated again.
+
 
   Date          Author      Description
   ----          ------      -----------
@@ -147,7 +157,7 @@ Code Outline:
                             ERR images, using only non-CR pixels (Git Issue#371).
 */
 int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
-                 char imgname[][CHAR_FNAME_LENGTH], int grp [], int nimgs,
+                 const ImageStack *stack, char imgname[][CHAR_FNAME_LENGTH], int grp [], int nimgs,
                  clpar *par, int niter, int dim_x, int dim_y,
                  float sigma[], multiamp noise, multiamp gain,
                  float efac[], float skyval[], FloatTwoDArray *ave,
@@ -162,6 +172,8 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
                  each pointer is an input image. Unit now in electrons.
       ipdq    i: Array of pointers to DQ extension of the given EXTVER,
                  each pointer is an input image.
+      stack   i: The same SCI, ERR and DQ extensions, possibly already
+                 held in memory. All data are read through this.
       imgname i: Array of image names.
       grp     i: Array of EXTVER for each input image.
       nimgs   i: Number of input images.
@@ -199,7 +211,6 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
 
     extern int status;
 
-	Hdr		errhdr;				/* error header structure */
     Hdr     dqhdr;              /* data quality header structure */
     int     width;
     int     i, j, k, n, jndx;   /* loop indices */
@@ -230,7 +241,7 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
     short   *bufdq;
     float   *err2;
 
-    Byte    ***crmask;          /* Compressed CR HIT mask for all images */
+    BitMask crmask;             /* Packed CR HIT mask for all images */
 
     /* local variables for sections */
     int     buffheight, line, bufftop;
@@ -255,6 +266,12 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
     float       *zerofbuf;      /* line buffer of all FLOAT zeroes  */
     short       *zerosbuf;      /* line buffer of all SHORT zeroes */
 
+    /* Row-band parallel mode */
+    Bool            useBands;
+    CRRejBands      bands;
+    AcsRejNoise     model;
+    Bool            retest;
+
     /* Functions for dealing with MULTIAMP values of gain and noise */
     int  LoadHdr (char *, Hdr *);
     void WhichError (int);
@@ -394,7 +411,10 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
     shadcorr = calloc (dim_x, sizeof(float));
 
     /* Allocate space for the CR-hit mask */
-    crmask = allocBitBuff (nimgs, dim_y, dim_x);
+    if (allocBitMask (&crmask, dim_x, nimgs * dim_y) != HSTCAL_OK) {
+        trlerror ("Couldn't allocate memory for CR mask in ACSREJ_LOOP.");
+        return (status = OUT_OF_MEMORY);
+    }
 
     /* readout is in e */
     rej2 = SQ(par->radius);  /* pix^2 */
@@ -436,6 +456,45 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
     /* Set up gain and values used for each image */
     get_nsegn (detector, chip, ampx, ampy, gain.val, rog2, gain2, noise2);
 
+    /* The band mode needs random access to all input lines and no shading
+       reference data, otherwise fall back to the scrolling buffers. */
+    useBands = stack->inMemory && par->shadcorr != PERFORM;
+    initCRRejBands (&bands);
+    if (useBands && allocCRRejBands (&bands, stack, width, rej2))
+        useBands = False;
+    if (useBands) {
+        /* ONEs and ZEROes, exactly as getShadcorr and getShadLine
+           return them without a shading correction */
+        getShadBuff (ipshad, 0, shad_dimy, dim_x, shadf_x, rx, ry, x0, y0,
+                     shadbuff);
+        getShadcorr (shadbuff, 0, shad_dimy, dim_x, 1., shadf_x, shadcorr);
+        getShadLine (shadbuff, 0, shad_dimy, dim_x / rx, shadline);
+
+        model.stack = stack;
+        model.efac = efac;
+        model.skyval = skyval;
+        model.exp2 = exp2;
+        model.shadcorr = shadcorr;
+        model.scale = scale;
+        model.exptot = exptot;
+
+        bands.efac = efac;
+        bands.dqpat = dqpat;
+        bands.maskdq = maskdq;
+        bands.crflag = crflag;
+        bands.psig2 = psig2;
+        bands.fillval = par->fillval;
+        bands.shadline = shadline;
+        bands.instrument.data = &model;
+        bands.instrument.thresholds = acsrejThresholds;
+        bands.instrument.pixels = acsrejPixels;
+        bands.instrument.addVariance = acsrejAddVariance;
+        bands.instrument.variance = acsrejVariance;
+
+        if (par->verbose)
+            trlmessage("Rejecting in parallel row bands");
+    }
+
     /* start the rejection iteration */
     for (iter = 0; iter < niter; iter++) {
         if (par->verbose) {
@@ -445,9 +504,12 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
         sig2 = SQ(sigma[iter]);  /* unitless factor */
 
         if (iter > 0) {
-            /* Re-initialize the arrays... */
-            for (j = 0; j < numpix; j++) {
-                *(efacsum + j) = 0.;
+            /* Re-initialize the arrays (the band mode keeps efacsum
+               where the rejections did not change)... */
+            if (!useBands) {
+                for (j = 0; j < numpix; j++) {
+                    *(efacsum + j) = 0.;
+                }
             }
 
             memcpy (buf, zerofbuf, dim_x * sizeof(float));
@@ -469,6 +531,22 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
             }
         } /* End initialization section */
 
+        if (useBands) {
+            /* The tests of a pixel only depend on its average and sigma,
+               and on the initial guess in the first iteration */
+            retest = (iter == 0 || sigma[iter] != sigma[iter - 1] ||
+                      (iter == 1 &&
+                       strncmp (par->initgues, "minimum", 3) == 0));
+            if (crrejBandIteration (&bands, iter, niter, sig2, retest, ave,
+                                    avevar, efacsum, dq, &dq2, nrej,
+                                    &crmask)) {
+                trlerror ("Couldn't allocate memory for scratch array in ACSREJ_LOOP.");
+                status = OUT_OF_MEMORY;
+                break;
+            }
+            continue;
+        }
+
         /* Start loop over lines in image */
         for (line = 0; line < dim_y; line++) {
 
@@ -501,6 +579,9 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
                If no shading correction is being performed, it
                will return a buffer of all ZEROES. */
             if ( (line % shad_dimy) == 0 || line == 0) {
+                /* HSTIO isn't used while input bands are read ahead */
+                if (par->shadcorr)
+                    syncImageStack (stack);
                 getShadBuff (ipshad, line, shad_dimy, dim_x, shadf_x, rx,
                              ry, x0, y0, shadbuff);
             }
@@ -516,15 +597,9 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
                         continue;
 
                     if (bufftop < dim_y) {
-                        initHdr(&dqhdr);
-                        getHeader(ipdq[k], &dqhdr);
-                        initHdr(&errhdr);
-                        getHeader(iperr[k], &errhdr);
-                        getFloatLine (ipsci[k], bufftop, buf);  /* e */
-                        getFloatLine (iperr[k], bufftop, buferr);  /* e */
-                        getShortLine (ipdq[k], bufftop, bufdq);
-                        freeHdr(&dqhdr);
-                        freeHdr(&errhdr);
+                        getStackSciLine (stack, k, bufftop, buf);  /* e */
+                        getStackErrLine (stack, k, bufftop, buferr);  /* e */
+                        getStackDqLine (stack, k, bufftop, bufdq);
                         /* Scale the input values by the sky and exposure time
                            for comparison to the detection threshhold.
                            Unit is e/s. */
@@ -573,10 +648,12 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
 
                     /* Put initial lines of data into scrolling buffers here.
                        Leave thresholds as zeroes. */
-                    InitFloatSect (pic[k], buf, ipsci[k], line, width, dim_x);
-                    InitShortSect (mask[k], bufdq, ipdq[k], line, width, dim_x);
+                    InitFloatSect (pic[k], buf, stack, getStackSciLine, k,
+                                   line, width, dim_x);
+                    InitShortSect (mask[k], bufdq, stack, k, line, width, dim_x);
 
-                    InitFloatSect (scroll_buferr[k], buferr, iperr[k], line, width, dim_x);
+                    InitFloatSect (scroll_buferr[k], buferr, stack,
+                                   getStackErrLine, k, line, width, dim_x);
 
                     /* No data when (ii < width), just zeroes */
                     for (ii = width; ii < buffheight; ii++) {
@@ -592,15 +669,12 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
                            If no shading correction, shadcorr will be all ONEs,
                            to avoid divide by ZERO errors. */
                         jndx = ii - width;  /* line = 0 */
-                        initHdr(&errhdr);
-                        getHeader(iperr[k], &errhdr);
-                        getFloatLine (iperr[k], jndx, buferr);  /* e */
+                        getStackErrLine (stack, k, jndx, buferr);  /* e */
                         getShadcorr (shadbuff, jndx, shad_dimy, dim_x,
                                      efac[k], shadf_x, shadcorr);
                         calc_thresholds(jndx, dim_x, ii, efac[k], exp2[k],
                                         sig2, scale, ave, buferr, shadcorr,
                                         thresh[k], spthresh[k]);
-                        freeHdr(&errhdr);
                     } /* End of loop over each row in scrolling buffers */
                 } /* End loop over images */
             } /* End if...else line > 0 */
@@ -863,11 +937,12 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
 
                         } /* End loop over x position */
 
-                        /* compress bufdq into byte mask, line-by-line.
+                        /* compress bufdq into bit mask, line-by-line.
                            this will be uncompressed later to be written back
                            into the DQ arrays of the input files.
                         */
-                        writeBitLine (bufdq, n, line, dim_x, crflag, crmask);
+                        packBitRow (bitMaskRow (&crmask, n * dim_y + line), bufdq,
+                                    dim_x, crflag);
 
                     } /* End of last iteration block */
                 } /* End if(efacn > 0.) block */
@@ -926,9 +1001,10 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
     /* Write out CR hit information to input images, if par->mask was set
        ("crmask" option is True).
        "crmask" variable below is compressed "buffdq". */
-    if (par->mask) {
+    if (par->mask && status == ACS_OK) {
         /* Close all references to the images so we can open the
            data quality ones as read/write. */
+        syncImageStack (stack);
         for (n = 0; n < nimgs; n++) {
             closeImage (ipsci[n]);
             closeImage (iperr[n]);
@@ -942,7 +1018,10 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
 
             for (line = 0; line < dim_y; line++) {
                 getShortLine (ipdqn, line, bufdq);
-                readBitLine (crmask, n, line, dim_x, crflag, nocr, bufdq);
+                /* As with the former byte mask, the columns of a last
+                   partial byte keep their input DQ */
+                unpackBitRow (bitMaskRow (&crmask, n * dim_y + line), bufdq,
+                              dim_x - dim_x % SIZE_BYTE, crflag);
                 putShortLine (ipdqn, line, bufdq);
             } /* End loop over lines in each image */
 
@@ -991,11 +1070,12 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
     free (buferr);
     free (bufdq);
     free (exp2);
-    freeBitBuff (crmask, nimgs, dim_y);
+    freeBitMask (&crmask);
     free (shadline);
     free (shadcorr);
     freeFloatBuff(shadbuff, shad_dimy);
     freeShortData (&dq2);
+    freeCRRejBands (&bands);
 
     if (par->shadcorr == PERFORM) {
         freeHdr (&scihdr);
@@ -1006,6 +1086,84 @@ int acsrej_loop (IODescPtr ipsci[], IODescPtr iperr[], IODescPtr ipdq[],
 }
 
 
+/* ------------------------------------------------------------------*/
+/*                          band rejection                           */
+/* ------------------------------------------------------------------*/
+
+/* The ACS noise model for crrejBandIteration, as computed for the
+   scrolling buffers by calc_thresholds: the variance of a pixel comes
+   from its ERR, the output ERR from the input ERR only. */
+
+static void acsrejPixels (const void *data, int img, int line, float *pic) {
+
+    const AcsRejNoise *model = data;
+    const ImageStack *stack = model->stack;
+    const float *sci = stack->sci + ((size_t)img*stack->ny + line) * stack->nx;
+    float efacn = model->efac[img];
+    float skyvaln = model->skyval[img];
+    int i;
+
+# ifdef _OPENMP
+    #pragma omp simd
+# endif
+    for (i = 0; i < stack->nx; i++)
+        pic[i] = (sci[i] - skyvaln) / efacn;  /* e/s */
+}
+
+static void acsrejThresholds (const void *data, int img, int line, int iter,
+                              float sig2, const float *ave, float *pic,
+                              float *th, float *spth, float *fwd) {
+
+    const AcsRejNoise *model = data;
+    const ImageStack *stack = model->stack;
+    const float *err = stack->err + ((size_t)img*stack->ny + line) * stack->nx;
+    float efacn = model->efac[img];
+    float exp2n = model->exp2[img];
+    float scale = model->scale;
+    int i;
+
+    (void) iter;
+    acsrejPixels (data, img, line, pic);
+
+# ifdef _OPENMP
+    #pragma omp simd
+# endif
+    for (i = 0; i < stack->nx; i++) {
+        float dum = SQ(err[i]);  /* e^2 */
+        float dum_nosky = ave[i] * efacn / model->shadcorr[i];  /* e */
+        float pixsky = (dum_nosky > 0.) ? dum_nosky : 0.;  /* e */
+        th[i] = sig2 * (dum + SQ(scale * pixsky)) / exp2n;
+        spth[i] = sig2 * dum / exp2n;
+    }
+
+    /* spills from previous lines compare against the same threshold */
+    memcpy (fwd, spth, stack->nx * sizeof(float));
+}
+
+static void acsrejAddVariance (const void *data, int img, int line,
+                               const float *pic, const char *use,
+                               float *sumvar) {
+
+    const AcsRejNoise *model = data;
+    const ImageStack *stack = model->stack;
+    const float *err = stack->err + ((size_t)img*stack->ny + line) * stack->nx;
+    int i;
+
+    (void) pic;
+    for (i = 0; i < stack->nx; i++) {
+        if (use[i])
+            sumvar[i] += SQ(err[i]);  /* e^2 */
+    }
+}
+
+static float acsrejVariance (const void *data, float sumvar, float pixexp) {
+
+    const AcsRejNoise *model = data;
+
+    return ((model->exptot / pixexp) * sqrt(sumvar));
+}
+
+
 /* Calculate thresholds that are scrolling buffers.
 
    Parameters:
@@ -1068,304 +1226,6 @@ static void calc_thresholds(int line, int dim_x, int width,
 }
 
 
-/*------------------------------------------------------------------*/
-/*                         allocFloatBuff                           */
-/*------------------------------------------------------------------*/
-static float **allocFloatBuff (int lines, int numpix) {
-    float **sect;
-    int i;
-
-    sect = (float **) calloc (lines, sizeof(float *));
-
-    for (i=0; i<lines; i++) {
-        sect[i] = (float *) calloc (numpix, sizeof(float));
-    }
-
-    return (sect);
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          allocShortBuff                           */
-/* ------------------------------------------------------------------*/
-static short **allocShortBuff (int lines, int numpix) {
-    short **sect;
-    int i;
-
-    sect = (short **) calloc (lines, sizeof(short *));
-
-    for (i=0; i<lines; i++) {
-        sect[i] = (short *) calloc (numpix, sizeof(short));
-    }
-
-    return (sect);
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          freeFloatBuff                            */
-/* ------------------------------------------------------------------*/
-static void freeFloatBuff (float **sect, int lines) {
-    int i;
-
-    for (i=0; i<lines; i++) free(sect[i]) ;
-    free (sect);
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          freeShortBuff                            */
-/* ------------------------------------------------------------------*/
-static void freeShortBuff (short **sect, int lines) {
-    int i;
-
-    for (i=0; i<lines; i++) free(sect[i]) ;
-    free (sect);
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          allocBitBuff                             */
-/* ------------------------------------------------------------------*/
-static Byte ***allocBitBuff (int nimgs, int lines, int numbits) {
-    Byte ***mask;
-    int y,n;
-    float remainder;
-    int nsize, nrem;
-
-    mask = (Byte ***) calloc (nimgs, sizeof(Byte **));
-    nsize = numbits/SIZE_BYTE;
-
-    /* Compute remainder, if any, for nsize. */
-    remainder = ((float) numbits/SIZE_BYTE) - nsize;
-
-    /* Convert remainder to either 1 or 0 extra bytes that needs to
-       be added to buffer. */
-    nrem = (remainder > 0.) ? 1 : 0;
-
-    for (n=0; n<nimgs; n++) {
-        /* Scale the buffer to 1 BIT per pix */
-        mask[n] = (Byte **) calloc ( lines, sizeof(Byte *));
-        for (y=0; y<lines; y++) {
-            /* Scale the buffer to 1 BIT per pix
-               'numbits/SIZE_BYTE' should always be even, such that
-               there is never any remainder.
-               However, when it is not even, we need to add 1 for the
-               remainder.
-            */
-            mask[n][y] = (Byte *) calloc ( (nsize+1*nrem), sizeof(Byte));
-        }
-    }
-
-    return (mask);
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          freeBitBuff                              */
-/* ------------------------------------------------------------------*/
-static void freeBitBuff (Byte ***crmask, int nimgs, int lines) {
-    int y,n;
-
-    for (n=0; n<nimgs; n++) {
-        for (y=0; y<lines; y++) {
-            free(crmask[n][y]);
-        }
-        free(crmask[n]);
-    }
-    free (crmask);
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          printBitLine                             */
-/* ------------------------------------------------------------------*/
-/* Not used */
-#if false
-static void printBitLine (Byte ***crmask, int img, int line, int nx) {
-    int     x,i;
-    Byte    bit;
-    int     pix;
-
-    /* Print out values in crbuff to STDOUT using 'X' and '.' */
-
-    for (x = 0; x < (nx/SIZE_BYTE); x++) {
-        /* Set each bit in compressed buffer */
-        for (bit = 0x80,i=0; bit > 0; bit=(bit>>1),i++) {
-            if ( (crmask[img][line][x] & bit) > 0) {
-                pix = x * SIZE_BYTE + i;
-                trlmessage("Compressed hit at %d,%d", pix, line);
-                /*printf("X");*/
-            } /*
-            else
-                printf(".");
-            */
-        }
-    }
-    /*printf("\n");*/
-}
-#endif
-
-
-/* ------------------------------------------------------------------*/
-/*                          readBitLine                              */
-/* ------------------------------------------------------------------*/
-static void readBitLine (Byte ***crmask, int img, int line, int numbits,
-                         short crflag, short nocr, short *bufdq) {
-    int     x;
-    Byte    bit;
-    /* int pix, i; */
-    int     buffx=0;
-
-    /* Print out values in mask to line-by-line short int buffer */
-    for (x = 0; x < (numbits/SIZE_BYTE); x++) {
-        /* Decompress buffer here */
-        for (bit = 0x80; bit > 0; bit=(bit>>1)) {
-            /* pix = x * SIZE_BYTE + i; */
-
-            if ( (crmask[img][line][x] & bit) != 0 ) {
-                /*
-                printf("Compressed hit at %d,%d  with bit = %x ",pix,line,bit);
-                printf(" and mask = %x\n",crmask[img][line][x]);
-                */
-                bufdq[buffx] = bufdq[buffx] | crflag;
-            } else
-                bufdq[buffx] = bufdq[buffx] & nocr;
-
-            buffx++;
-        }
-    }
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          writeBitLine                             */
-/* ------------------------------------------------------------------*/
-static void writeBitLine (short *bufdq, int img, int line, int numbits,
-                          short crflag, Byte ***crmask) {
-    int x;  /* Loop counters */
-    int buffx;
-
-    /* Set values in mask based on bufdq.
-       Each CRHIT was set using : bufdq[i] | crflag */
-    for (x = 0; x < numbits; x++) {
-        /* Set each bit in compressed buffer */
-        if ( ( (bufdq[x]) & crflag) == crflag)  {
-            buffx=x/SIZE_BYTE;
-            crmask[img][line][buffx] |=  (0x80 >> ((x)%(SIZE_BYTE)));
-        }
-    }
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          scrollFloatBuff                          */
-/* ------------------------------------------------------------------*/
-static void scrollFloatBuff (float *sect, int line, int nlines, int bufflines,
-                             int numpix, float **subsect, float *zero) {
-/* This function will scroll a subsection up a 2-d array
-
-   Parameters:
-   float *sect         i: line from input image (2-d array)
-   int line            i: line number from image to add to sub-section
-   int nlines          i: number of lines in original image
-   int bufflines       i: number of lines in subsection
-   int numpix          i: number of pixels per line
-   float **subsect     o: scrolled subsection
-   float *zero         i: zeroes
-*/
-    int i;
-    float *begptr; /* Use for first line in buffer */
-
-    /* If there is only one line in the buffer, simply copy it out */
-    if (bufflines == 1) {
-        memcpy (subsect[0], sect, numpix * sizeof(float));
-        return;
-    }
-
-    begptr = *subsect; /* Save first line in buffer */
-
-    /* Shift lines in the buffer up,
-       moving subsect[1] into subssect[0], and so on..
-
-       NOTE: This could probably be optimized to use pointers
-             more directly to get faster code.
-    */
-    for (i=0; i < bufflines-1; i++) {
-        *(subsect+i) = *(subsect+i+1);
-    }
-
-    /* Now, put pointer from first line back as last line
-       This recycles the pointer; the data will be overwritten.
-    */
-    *(subsect + bufflines - 1) = begptr;
-
-    /* Finally, copy in new data into last line of buffer.
-       If the line we want to write to buffer is valid,...
-    */
-    if (line < nlines && bufflines > 1) {
-        /* Copy new line into last line of buffer. */
-        memcpy (subsect[bufflines-1], sect, numpix * sizeof(float));
-    } else {
-        /* Otherwise, set buffer values to default values */
-        memcpy (subsect[bufflines-1], zero, numpix * sizeof(float));
-    }
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          scrollShortBuff                          */
-/* ------------------------------------------------------------------*/
-static void scrollShortBuff (short *ssect, int line, int nlines, int bufflines,
-                             int numpix, short **subssect, short *szero) {
-/* This function will scroll a subsection up a 2-d array
-
-   Parameters:
-   short *ssect        i: line from input DQ image (2-d short array)
-   int line            i: line number from sect to add to sub-section
-   int nlines          i: number of lines in original section
-   int bufflines       i: number of lines in subsection
-   int numpix          i: number of pixels per line
-   short **subssect    o: scrolled subsection
-   short *szero        i: zeroes
-*/
-    int i;
-    short *begsptr; /* Use for first line in buffer */
-
-    /* If there is only one line in the buffer, simply copy it out */
-    if (bufflines == 1) {
-        memcpy (subssect[0], ssect, numpix * sizeof(short));
-        return;
-    }
-
-    begsptr = *subssect; /* Save first line in buffer */
-
-    /* Shift lines in the buffer up,
-       moving subsect[1] into subssect[0], and so on..
-
-       NOTE: This could probably be optimized to use pointers
-             more directly to get faster code.
-    */
-    for (i=0; i < bufflines-1; i++) {
-        subssect[i] = subssect[i+1];
-    }
-
-    /* Now, put pointer from first line back as last line */
-    *(subssect + bufflines - 1) = begsptr;
-
-    /* Finally, copy in new data into last line of buffer.
-       If the line we want to read in is valid,...
-    */
-    if (line < nlines && bufflines > 1) {
-        /* Copy new line into last line of buffer. */
-        memcpy (subssect[bufflines-1], ssect, numpix * sizeof(short));
-    } else {
-        /* Otherwise, set buffer values to default values */
-        memcpy (subssect[bufflines-1], szero, numpix * sizeof(short));
-    }
-}
-
-
 /* ------------------------------------------------------------------*/
 /*                          initShad                                 */
 /* ------------------------------------------------------------------*/
@@ -1400,64 +1260,6 @@ static int initShad (Hdr *scihdr, int dimx, char *shadname, int chipext,
 }
 
 
-/* ------------------------------------------------------------------*/
-/*                          getShadLine                              */
-/* ------------------------------------------------------------------*/
-static void getShadLine (float **shad, int line, int nlines, int dimx,
-                         float *shadline) {
-/* Parameters:
-   shad                i: shadfile buffer
-   line                i: line number from input image we are working with
-   nlines              i: number of lines in shadfile buffer
-   dimx                i: size of shad buffer
-   shadline            o: line of shadfile data to be applied to image
-*/
-    int offset;
-
-    offset = line % nlines;
-
-    /* Copy appropriate line from buffer into shadline */
-    memcpy (shadline, shad[offset], dimx * sizeof(float));
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          getShadcorr                              */
-/* ------------------------------------------------------------------*/
-static void getShadcorr (float **shad, int line, int nlines, int dimx,
-                         float efacn, int shadf_x, float *shadline) {
-/* Parameters:
-   shad                i: shadfile buffer
-   line                i: line number from input image we are working with
-   nlines              i: number of lines in shadfile buffer
-   efacn               i: fraction of exposure time for image
-   dimx                i: size of shad buffer
-   shadf_x             i: number of pixels in input shadfile line
-                        [This will be ZERO if no shading correction is applied]
-   shadline            o: line of shadfile data to be applied to image
-*/
-    int offset;
-
-    int         multkline (float *, float, int);
-    int         addkline (float *, float, int);
-
-    offset = line % nlines;
-
-    /* Copy appropriate line from buffer into shadline */
-    memcpy (shadline, shad[offset], dimx * sizeof(float));
-
-    /* Only when doing shading correction, perform this expensive
-       math operation.
-    */
-    if (shadf_x > 0)  multkline (shadline, 1./efacn, dimx);
-
-    /* Always make sure that shadline is either 1 or 1+1/efacn,
-       to avoid divide by zero errors.
-    */
-    addkline (shadline, 1., dimx);
-}
-
-
 /* ------------------------------------------------------------------*/
 /*                          getShadBuff                              */
 /* ------------------------------------------------------------------*/
@@ -1590,63 +1392,3 @@ void unbinArray (float **a, int inx, int iny, int binx, int biny, float **b) {
 }
 
 
-/* ------------------------------------------------------------------*/
-/*                          InitFloatSect                            */
-/* ------------------------------------------------------------------*/
-static void InitFloatSect (float **sect, float *buf, IODescPtr *ipdat,
-                           int line, int width, int dimx) {
-/* This routine performs all the initial bookkeeping for the scrolling
-   data buffers.
-   - Initializes the scrolling buffer by populating it with the first
-     lines of data from the image.
-
-   Parameters:
-   float     **sect  i/o: scrolling buffer
-   float     *buf    i: single line of scratch space
-   IODescPtr *ipdat  i: file handle for working image (image being processed)
-   int       line    i: number of current line from working image
-   int       width   i: number of lines in buffer on either side of current line
-   int       dimx    i: number of pixels in each line
-*/
-    int     l;
-
-    /* Fill initial buffer with first lines of image */
-    for (l = 0; l <= width; l++) {
-        getFloatLine (ipdat, line+l, buf);
-        /* Copy new line into last line of buffer. */
-        memcpy (sect[width+l], buf, dimx * sizeof(float));
-    }
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          InitShortSect                            */
-/* ------------------------------------------------------------------*/
-static void InitShortSect (short **sect, short *sbuf, IODescPtr *ipdat,
-                           int line, int width, int dimx) {
-/* This routine performs all the initial bookkeeping for the scrolling
-   data buffers.
-   - Initializes the scrolling buffer by populating it with the first
-     lines of data from the image.
-
-   Parameters:
-   short     **sect  i/o: scrolling buffer
-   short     *sbuf   i: single line of scratch space
-   IODescPtr *ipdat  i: file handle for working image (image being processed)
-   int       line    i: number of current line from working image
-   int       width   i: number of lines in buffer on either side of current line
-   int       dimx    i: number of pixels in each line
-*/
-    int     l;
-    Hdr     dqhdr;
-
-    /* Fill initial buffer with first lines of image */
-    initHdr(&dqhdr);
-    getHeader(ipdat,&dqhdr);
-    for (l = 0; l <= width; l++) {
-        getShortLine (ipdat, line+l, sbuf);
-        /* Copy new line into last line of buffer. */
-        memcpy (sect[width+l], sbuf, dimx * sizeof(short));
-    }
-    freeHdr(&dqhdr);
-}
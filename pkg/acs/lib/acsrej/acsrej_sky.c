@@ -1,32 +1,30 @@
 # include   <stdio.h>
 # include   <string.h>
 # include   <stdlib.h>
-# include   <limits.h>
 # include   <math.h>
 
 #include "hstcal.h"
 # include   "hstio.h"
 # include   "acs.h"    /* for message output */
 # include   "hstcalerr.h"
+# include   "hstcal_imagestack.h"
+# include   "hstcal_crsky.h"
 
 # define    MINVAL      -15000
-# define    BIN_WIDTH   1
 # define    MIN_BINS    1000
 # define    MAX_BINS	10000
 
 /* acsrej_sky -- Calculate the sky for an image. */
 
-void acsrej_sky (char *sky, IODescPtr ipsci[], IODescPtr ipdq[], int nimgs,
+void acsrej_sky (char *sky, const ImageStack *stack, int nimgs,
                  short badinpdq, float skyval[]) {
 
     /*
       Parameters:
 
       sky     i: Calculation algorithm ("none" or "mode" only).
-      ipsci   i: Array of pointers to SCI extension of the given EXTVER,
-                 each pointer is an input image. Unit now in electrons.
-      ipdq    i: Array of pointers to DQ extension of the given EXTVER,
-                 each pointer is an input image.
+      stack   i: SCI and DQ extensions of the given EXTVER of the input
+                 images. SCI unit now in electrons.
       nimgs   i: Number of input images.
       badinpdq  i: Data quality pset.
       skyval  o: Array of sky values for each input image.
@@ -42,18 +40,8 @@ void acsrej_sky (char *sky, IODescPtr ipsci[], IODescPtr ipdq[], int nimgs,
     extern int status;
 
     int         *histgrm;   /* pointer to the histogram */
-    int         nbins;      /* number of bins */
-    int         min, max;
-    float       data_min;
-    float       hwidth;     /* histogram resolution */
-    float       hmin;       /* minimum histogram value */
-    int         i, k, h;
-    float       *a;
-    short       *b;
-    int         line, npt;
-    int         dimx, dimy;
-    float       sum, mean;
-    Hdr         dqhdr;
+    CRSkyBinning bin;       /* histogram binning */
+    int         k;
 
     float   cr_mode (int *, int, float, float);
 
@@ -72,113 +60,33 @@ void acsrej_sky (char *sky, IODescPtr ipsci[], IODescPtr ipdq[], int nimgs,
         return;
     }
 
-    dimx = getNaxis1(ipsci[0]);
-    dimy = getNaxis2(ipsci[0]);
-
-    a = (float *) calloc (dimx, sizeof(float));
-    b = (short *) calloc (dimx, sizeof(short));
-    if (a == NULL || b == NULL) {
+    /* use the minimum and twice of the mean of the first image to
+       determine the data range, in bins of 1 (DN) */
+    if (crSkyBinning (stack, 0, 1., badinpdq, MINVAL, MIN_BINS, MAX_BINS,
+                      &bin)) {
         trlerror ("Couldn't allocate memory for sky arrays");
         status = OUT_OF_MEMORY;
         return;
     }
 
-    /* compute MIN and MAX values for data */
-    /* use the minimum and twice of the mean to determine the data range */
-    data_min = INT_MAX;
-    sum = 0.;
-    npt = 0;
-
-    initHdr(&dqhdr);
-    getHeader(ipdq[0], &dqhdr);
-
-    for (line = 0; line < dimy; line++) {
-
-        /* read the data in */
-        getFloatLine (ipsci[0], line, a);
-        getShortLine (ipdq[0], line, b);
-
-        for (i = 0; i < dimx; ++i) {
-            if ( (b[i] & badinpdq) == ACS_OK ) {
-                data_min = (a[i] < data_min) ? a[i] : data_min;
-                sum += a[i];
-                npt++;
-            }
-        }
-    } /* End of loop over lines */
-
-    freeHdr(&dqhdr);
-
-    /* Compute min and max for histogram.
-       MIN is min of good data or MINVAL, which ever is greater
-       DELTA is difference between mean of data and MIN
-       MAX is mean plus DELTA
-       This insures that the mean falls in the center of the range
-       between min and max. */
-    if (npt == 0) npt = 1;
-    min = (data_min < MINVAL) ? MINVAL : data_min;
-    mean = (sum > 0.) ? (int) ( (sum / (float)npt) + 1) : 1;
-    max = 2 * mean - min;
-
-    /* use the mode as sky value, use the bin size of 1 (DN) */
-    nbins = max - min + 1;
-
-
-    /* Insure that there are at least MIN_BINS in the histogram
-       and reset the width accordingly. */
-    if (nbins < MIN_BINS) {
-        nbins = MIN_BINS;
-        hwidth = (float) nbins / (float)MIN_BINS;
-    } else if (nbins > MAX_BINS) {
-        hwidth = (float) nbins / (float)MAX_BINS;
-        nbins = MAX_BINS;
-    } else {
-        hwidth = 1.;
+    /* one histogram, reused for each image */
+    histgrm = calloc (bin.nbins, sizeof(int));
+    if (histgrm == NULL){
+        trlerror ("Couldn't allocate memory for sky histogram array");
+        status = OUT_OF_MEMORY;
+        return;
     }
-    hmin = (float) min;
-
-    /*
-    trlmessage("sky computed using min %d, max %d, mean %g, bins %d, and width %g",
-    min, max, mean, nbins, hwidth);
-    */
 
     /* Now loop over the input images, computing the sky value for each image */
     for (k = 0; k < nimgs; ++k) {
-        /* set up a new histogram array for each image */
-        histgrm = calloc (nbins, sizeof(int));
-        if (histgrm == NULL){
+        if (crSkyHistogram (stack, k, 1., &bin, histgrm)) {
             trlerror ("Couldn't allocate memory for sky histogram array");
             status = OUT_OF_MEMORY;
-            return;
+            break;
         }
 
-        initHdr(&dqhdr);
-        getHeader(ipdq[k], &dqhdr);
-        for (line = 0; line < dimy; line++) {
-
-            /* read the data in */
-            getFloatLine (ipsci[k], line, a);
-            getShortLine (ipdq[k], line, b);
-
-            /* construct the histogram */
-            for (i = 0; i < dimx; ++i) {
-                if (b[i] == ACS_OK) {
-                    /* adjust the bin position by the width of each bin */
-                    if ( fabs((a[i] - min) / hwidth) < INT_MAX ) {
-                        h = (int) ((a[i] - min) / hwidth);
-                        if (h >= 0 && h < nbins)
-                            histgrm[h]++;
-                    }
-                }
-            }
-        } /* End of loop over lines */
-        freeHdr(&dqhdr);
-
         /* calculate the mode from the histogram */
-        skyval[k] = cr_mode (histgrm, nbins, hwidth, hmin);
-
-        free (histgrm);
+        skyval[k] = cr_mode (histgrm, bin.nbins, bin.hwidth, bin.hmin);
     }
-    free(a);
-    free(b);
+    free (histgrm);
 }
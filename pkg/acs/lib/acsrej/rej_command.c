@@ -52,7 +52,7 @@ int newpar[];       o: array of parameters set by the user
         printf("                    [-table <filename>] [-scale #]\n");
         printf("                    [-init (med|min)] [-sky (none|mode)]\n");
         printf("                    [-sigmas #] [-radius #] [-thresh #]\n");
-        printf("                    [-pdq #]\n\n");
+        printf("                    [-pdq #] [--memory-budget #]\n\n");
 		printf("input             comma-delimited string (e.g., filename or filename1,filename2,filename3)\n");
 		printf("output            string\n");
 		printf("-t                print timestamps\n");
@@ -67,7 +67,8 @@ int newpar[];       o: array of parameters set by the user
 		printf("-sigmas #[,#...]  cosmic ray rejection thresholds, no. of thresholds are the no. of iterations\n");
 		printf("-radius #         radius (in pixels) to propagate the cosmic ray\n");
 		printf("-thresh #         cosmic ray rejection propagation threshold\n");
-		printf("-pdq #            data quality flag used for cosmic ray rejection\n\n");
+		printf("-pdq #            data quality flag used for cosmic ray rejection\n");
+		printf("--memory-budget # memory (MB, > 0) for the input images, held in memory if they fit, otherwise read in bands that fit\n\n");
         return(status);
     }
 
@@ -178,6 +179,14 @@ int newpar[];       o: array of parameters set by the user
                 if (getArgS (argv, argc, &ctoken, &par->badinpdq))
                     return (status = INVALID_VALUE);
 
+            } else if (strcmp("-memory-budget", argv[ctoken]+1) == 0) {
+                if (getArgR (argv, argc, &ctoken, &par->membudget))
+                    return (status = INVALID_VALUE);
+                if (par->membudget <= 0.) {
+                    printf ("Invalid memory budget: %g MB\n", par->membudget);
+                    return (status = INVALID_VALUE);
+                }
+
             /* No match. */
             } else
                 return (syntax_error (argv[ctoken]));
@@ -275,6 +284,7 @@ int newpar[];     o: array of parameters set by the user
     par->printtime = 0;
     par->shadcorr = 0;
     par->readnoise_only = 0;
+    par->membudget = MEMBUDGET;
 
     newpar[TOTAL] = 0;
     newpar[SCALENSE] = 0;
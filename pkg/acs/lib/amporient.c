@@ -0,0 +1,33 @@
+# include "hstcal.h"
+# include "hstcalerr.h"
+# include "hstcal_orient.h"
+# include "acs.h"
+# include "trlbuf.h"
+
+/* This function returns the flips that bring the WFC amp 'amp' (AMP_A to
+   AMP_D) to the lower left hand corner of its section, as for amp C. It is
+   shared by BLEVCORR and PCTECORR, which may call it for several amps at
+   once, so the global status is left alone.
+*/
+int AmpOrientation (const int amp, Orientation * orient) {
+
+/* arguments:
+int amp                 i: amp number, AMP_A to AMP_D
+Orientation *orient     o: flips that bring the amp to the lower left
+*/
+
+    if (amp == AMP_A) {
+        *orient = ORIENT_FLIP_Y;
+    } else if (amp == AMP_B) {
+        *orient = ORIENT_ROTATE_180;
+    } else if (amp == AMP_C) {
+        *orient = ORIENT_IDENTITY;
+    } else if (amp == AMP_D) {
+        *orient = ORIENT_FLIP_X;
+    } else {
+        trlerror("Amp number not recognized, must be 0-3.");
+        return (ERROR_RETURN);
+    }
+
+    return (HSTCAL_OK);
+}
@@ -11,7 +11,10 @@
 # include "calacs.h"
 # include "hstcalerr.h"
 #include "hstcal_memory.h"
+#include "hstcal_dqmask.h"
+#include "hstcal_flatfield.h"
 # include "acscorr.h"
+# include "doccd.h"
 # include "acsasn.h"    /* Contains association table structures */
 
 # include "acsrej.h"    /* For ACSRej_0 */
@@ -77,11 +80,12 @@ static int ACSRej_0Wrapper(char * inputList,
         Bool updateASNTableFlag);
 
 static int CopyFFile (char *, char *);
+static void FreeStepCaches (void);
 static void SetACSSw (CalSwitch *, CalSwitch *, CalSwitch *, CalSwitch *);
 static void ResetACSSw (CalSwitch *, CalSwitch *);
 
 
-int CalAcsRun (char *input, int printtime, int save_tmp, int verbose, int debug, const unsigned nThreads, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd) {
+int CalAcsRun (char *input, int printtime, int save_tmp, int verbose, int debug, const unsigned nThreads, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd, const bool parallelAmps) {
 
     /* arguments:
        char *input     i: name of the FITS file/table to be processed
@@ -90,6 +94,7 @@ int CalAcsRun (char *input, int printtime, int save_tmp, int verbose, int debug,
        int verbose     i: true --> print info during processing
        int debug       i: true --> print debugging info during processing
        int onecpu      i: true --> turn off use of OpenMP during processing
+       bool parallelAmps i: true --> run the per-amp CTE corrections concurrently
     */
 
     extern int status;
@@ -108,7 +113,7 @@ int CalAcsRun (char *input, int printtime, int save_tmp, int verbose, int debug,
     void initAsnInfo (AsnInfo *);
     void freeAsnInfo (AsnInfo *);
     int LoadAsn (AsnInfo *);
-    int ProcessACSCCD (AsnInfo *, CALACSInfo *, int *, int, const unsigned nThreads, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd);
+    int ProcessACSCCD (AsnInfo *, CALACSInfo *, int *, int, const unsigned nThreads, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd, const bool parallelAmps);
     int ProcessMAMA (AsnInfo *, CALACSInfo *, int);
     int AcsDth (char *, char *, int, int, int);
     char *BuildDthInput (AsnInfo *, int);
@@ -175,7 +180,8 @@ int CalAcsRun (char *input, int printtime, int save_tmp, int verbose, int debug,
         if (asn.verbose) {
             trlmessage ("CALACS: processing a CCD product");
         }
-        if (ProcessACSCCD(&asn, &acshdr, &save_tmp, printtime, nThreads, cteAlgorithmGen, pcteTabNameFromCmd)) {
+        if (ProcessACSCCD(&asn, &acshdr, &save_tmp, printtime, nThreads, cteAlgorithmGen, pcteTabNameFromCmd, parallelAmps)) {
+            FreeStepCaches ();
             if (status == NOTHING_TO_DO) {
                 trlwarn ("No processing desired for CCD data.");
             } else {
@@ -191,6 +197,7 @@ int CalAcsRun (char *input, int printtime, int save_tmp, int verbose, int debug,
         trlmessage("Starting to process MAMA data now...");
 
         if (ProcessMAMA(&asn, &acshdr, printtime)) {
+            FreeStepCaches ();
             if (status == NOTHING_TO_DO){
                 trlwarn ("No processing desired for MAMA data.");
             } else{
@@ -201,6 +208,7 @@ int CalAcsRun (char *input, int printtime, int save_tmp, int verbose, int debug,
         }
         trlmessage("Finished MAMA processing...");
     }
+    FreeStepCaches ();
 
 
     /* Add DTH processing here... */
@@ -417,7 +425,7 @@ static int ACSRej_0Wrapper(char * inputList,
     return HSTCAL_OK;
 }
 
-int ProcessACSCCD (AsnInfo *asn, CALACSInfo *acshdr, int *save_tmp, int printtime, const unsigned nThreads, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd) {
+int ProcessACSCCD (AsnInfo *asn, CALACSInfo *acshdr, int *save_tmp, int printtime, const unsigned nThreads, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd, const bool parallelAmps) {
 
     extern int status;
 
@@ -445,7 +453,7 @@ int ProcessACSCCD (AsnInfo *asn, CALACSInfo *acshdr, int *save_tmp, int printtim
     void FreeRefFile (RefFileInfo *);
     int ACSRefInit (CALACSInfo *, CalSwitch *, RefFileInfo *);
     int ACSccd (char *, char *, CalSwitch *, RefFileInfo *, int, int);
-    int ACScte (char *, char *, CalSwitch *, RefFileInfo *, int, int, int, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd, const bool forwardModelOnly);
+    int ACScte (char *, char *, CalSwitch *, RefFileInfo *, int, int, int, const unsigned cteAlgorithmGen, const char * pcteTabNameFromCmd, const bool forwardModelOnly, const bool parallelAmps);
     int ACS2d (char *, char *,CalSwitch *, RefFileInfo *, int, int);
     int GetAsnMember (AsnInfo *, int, int, int, CALACSInfo *);
     int GetSingle (AsnInfo *, CALACSInfo *);
@@ -609,7 +617,7 @@ int ProcessACSCCD (AsnInfo *asn, CALACSInfo *acshdr, int *save_tmp, int printtim
                     // ``forwardModelOnly = false`` because it is not part of the pipeline processing.
                     if (ACScte(acshdr->blv_tmp, acshdr->blc_tmp,
                                &acscte_sci_sw, &sciref, printtime,
-                               asn->verbose, nThreads, cteAlgorithmGen, pcteTabNameFromCmd, false)) {
+                               asn->verbose, nThreads, cteAlgorithmGen, pcteTabNameFromCmd, false, parallelAmps)) {
                         return (status);
                     }
                 }
@@ -1168,6 +1176,17 @@ static void ResetACSSw (CalSwitch *acsccd_sci_sw, CalSwitch *acs2d_sci_sw) {
 }
 
 
+/* Free the reference data that the calibration steps keep from one
+   exposure to the next, once the last exposure is done. */
+static void FreeStepCaches (void) {
+
+    clearSinkCatalogs ();
+    clearDQICache ();
+    clearDQMaskCache ();
+    clearFlatFieldCache ();
+}
+
+
 /* This routine copies a FITS file. */
 static int CopyFFile (char *infile, char *outfile) {
 
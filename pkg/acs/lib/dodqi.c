@@ -1,59 +1,37 @@
 /* This file contains:
  doDQI
- OpenBpixTab
- ReadBpixTab
- CloseBpixTab
- DQINormal
+ GetBpixMask
+ SelectBpixRow
+ clearDQICache
  */
 
 # include <stdio.h>
+# include <stdlib.h>
 # include <string.h>
 
 #include "hstcal.h"
-# include "xtables.h"
 # include "hstio.h"
 # include "acs.h"
 # include "acsinfo.h"
 # include "hstcalerr.h"
 # include "acsdq.h"
+# include "hstcal_dqmask.h"
 
-typedef struct {
-    IRAFPointer tp;			/* pointer to table descriptor */
-    IRAFPointer cp_xstart, cp_ystart; /* starting pixel for bad values */
-    IRAFPointer cp_length;		/* this many bad values */
-    IRAFPointer cp_axis;		/* repeat along X or Y axis (1 or 2) */
-    IRAFPointer cp_flag;		/* this is the data quality value */
-    IRAFPointer cp_amp;		/* selection columns */
-    IRAFPointer cp_ccdchip;
-    IRAFPointer cp_ccdgain;
-    int intgain;
-    int nrows;			/* number of rows in table */
-} TblInfo;
-
-typedef struct {
-    /* values read from a table row */
-    int xstart, ystart;
-    int length;
-    int axis;
-    short flag;
-    /* values used for selecting row to be used.*/
-    char ccdamp[ACS_CBUF];
-    /*
-     For tables with int ccdgain, set intgain=1 and populate ccdgaini.
-     For tables with float ccdgain, set intgain=0 and populate ccdgainf.
-     Based on value of intgain, use either ccdgaini or ccdgainf in code.
-     */
-    int ccdgaini;
-    float ccdgainf;
-    int ccdchip;
-} TblRow;
-
+/* The rows of the last BPIXTAB read, so that the table is read once
+ for all chips.
+ */
+static BpixTable bpixtab = {NULL, 0, 0, False, False, False, 0, NULL};
 
-static int OpenBpixTab (char *, TblInfo *);
-static int ReadBpixTab (TblInfo *, int, TblRow *);
-static int CloseBpixTab (TblInfo *);
+static const BpixFormat bpixformat = {
+    "CCDAMP", ACS_CBUF-1, NULL,	/* optional amp column */
+    True,					/* CCDCHIP */
+    True,					/* optional CCDGAIN, int or float */
+    False,					/* no SIZAXIS1, SIZAXIS2 needed */
+    False					/* an empty table has nothing to check */
+};
 
-static void DQINormal (DQHdrData *, double *, TblRow *);
+static int GetBpixMask (ACSInfo *, DQMask **);
+static Bool SelectBpixRow (const BpixTable *, BpixRow *, const void *);
 
 /* This routine ORs the data quality array in the input SingleGroup x
  with the pixels flagged in the data quality initialization table.
@@ -126,8 +104,7 @@ int doDQI (ACSInfo *acs, SingleGroup *x) {
 
     extern int status;
 
-    TblInfo tabinfo;			/* pointer to table descriptor, etc */
-    TblRow tabrow;				/* values read from a table row */
+    DQMask *mask;				/* selected BPIXTAB rows */
 
     /* mappings from one coordinate system to another */
     double ri_m[2], ri_v[2];	/* reference to image */
@@ -137,17 +114,11 @@ int doDQI (ACSInfo *acs, SingleGroup *x) {
     short sum_dq;				/* for binning data quality array */
     int atod_sat;
 
-    int row;					/* loop index for row number */
     int dimx, dimy;
-    int nrows;   				/* number of rows applied to DQ array */
     short dq_fill = 64;         /* default fill value when no rows are applied*/
     int xpos,ypos;
-    int sameamp, samegain, samechip;
 
     int GetLT0 (Hdr *, double *, double *);
-    int SameInt (int, int);
-    int SameFlt (float, float);
-    int SameString (char *, char *);
 
     /* We could still flag saturation even if the bpixtab was dummy. */
     if (acs->dqicorr != PERFORM && acs->dqicorr != DUMMY)
@@ -190,65 +161,15 @@ int doDQI (ACSInfo *acs, SingleGroup *x) {
     if (acs->bpix.exists == EXISTS_NO || acs->dqicorr != PERFORM)
         return (status);
 
-    /* Open the data quality initialization table, find columns, etc. */
-    if (OpenBpixTab (acs->bpix.name, &tabinfo))
+    /* Get the BPIXTAB rows selected for this chip, amp and gain, read
+     and rasterised once per selection. */
+    if (GetBpixMask (acs, &mask))
         return (status);
 
-    nrows = 0;
-    /* Read each row of the table, and fill in data quality values. */
-
-    for (row = 1;  row <= tabinfo.nrows;  row++) {
-
-        if (ReadBpixTab (&tabinfo, row, &tabrow)) {
-            trlerror ("Error reading BPIXTAB.");
-            return (status);
-        }
-
-        /* If CCDAMP column does not exist, always return a match.*/
-        if (tabinfo.cp_amp == 0 || SameString(tabrow.ccdamp,"N/A")) {
-            sameamp = 1;
-        } else {
-            sameamp = SameString (tabrow.ccdamp, acs->ccdamp);
-        }
-
-        /* If CCDGAIN column does not exist, always return a match. */
-        if (tabinfo.cp_ccdgain == 0) {
-            /* No ccdgain column at all, set samegain to 1(yes) */
-            samegain = 1;
-        } else {
-            /* We have a ccdgain column, check the value */
-            if(tabinfo.intgain == 1) {
-                if (tabrow.ccdgaini == -999) {
-                    samegain = 1;
-                } else {
-                    samegain = SameInt (tabrow.ccdgaini, (int)acs->ccdgain);
-                }
-            } else {
-                samegain = SameFlt(tabrow.ccdgainf,-999.0);
-                if (samegain == 0) {
-                    samegain = SameFlt (tabrow.ccdgainf, acs->ccdgain);
-                }
-            }
-        }
-        /* If CCDCHIP column does not exist, always return a match. */
-        if (tabinfo.cp_ccdchip == 0 || tabrow.ccdchip == -999) {
-            samechip = 1;
-        } else {
-            samechip = SameInt (tabrow.ccdchip, acs->chip);
-        }
+    /* Assign the flag values to all relevant pixels. */
+    orDQMask (mask, &x->dq.data, ri_v);
 
-        /* Check whether the row matches the conditions. */
-        if (sameamp && samegain && samechip) {
-            /* Assign the flag value to all relevant pixels. */
-            DQINormal (&x->dq, ri_v, &tabrow);
-            nrows += 1;
-        }
-    }
-
-    if (CloseBpixTab (&tabinfo))		/* done with the table */
-        return (status);
-
-    if (nrows == 0) {
+    if (mask->nruns == 0) {
         trlwarn("No rows from BPIXTAB applied to DQ array.");
         /* This code will mark the first pixel with a value of 64
          to prevent CALACS from crashing when no pixels are marked bad. */
@@ -263,217 +184,97 @@ int doDQI (ACSInfo *acs, SingleGroup *x) {
     return (status);
 }
 
-static int OpenBpixTab (char *tname, TblInfo *tabinfo) {
-
-    extern int status;
-    int colnum, datatype, lendata, lenfmt;
-    char *colname;
-    char *colunits;
-    char *colfmt;
-
-    if ((colname = calloc (SZ_COLNAME+1, sizeof(char))) == NULL) {
-        trlerror ("Out of memory.\n");
-        return (OUT_OF_MEMORY);
-    }
-    if ((colunits = calloc (ACS_CBUF+1, sizeof(char))) == NULL) {
-        trlerror ("Out of memory.\n");
-        return (OUT_OF_MEMORY);
-    }
-    if ((colfmt = calloc (ACS_CBUF+1, sizeof(char))) == NULL) {
-        trlerror ("Out of memory.\n");
-        return (OUT_OF_MEMORY);
-    }
-
-    tabinfo->tp = c_tbtopn (tname, IRAF_READ_ONLY, 0);
-    if (c_iraferr())
-        return (status = OPEN_FAILED);
+/* This routine gets the mask of the BPIXTAB rows that apply to the
+ chip, amp and gain of the image.  Masks are cached by table name and
+ selection, so that the table rows are selected and rasterised once.
+ */
 
-    tabinfo->nrows = c_tbpsta (tabinfo->tp, TBL_NROWS);
-    if (tabinfo->nrows < 1) {
-        return (status);			/* nothing to do */
-    }
+static int GetBpixMask (ACSInfo *acs, DQMask **mask) {
 
-    /* Find the columns. */
-    c_tbcfnd1 (tabinfo->tp, "CCDAMP", &tabinfo->cp_amp);
-    c_tbcfnd1 (tabinfo->tp, "CCDCHIP", &tabinfo->cp_ccdchip);
-    c_tbcfnd1 (tabinfo->tp, "CCDGAIN", &tabinfo->cp_ccdgain);
-    c_tbcfnd1 (tabinfo->tp, "PIX1", &tabinfo->cp_xstart);
-    c_tbcfnd1 (tabinfo->tp, "PIX2", &tabinfo->cp_ystart);
-    c_tbcfnd1 (tabinfo->tp, "LENGTH", &tabinfo->cp_length);
-    c_tbcfnd1 (tabinfo->tp, "AXIS", &tabinfo->cp_axis);
-    c_tbcfnd1 (tabinfo->tp, "VALUE", &tabinfo->cp_flag);
-    if (tabinfo->cp_xstart == 0 ||
-            tabinfo->cp_ystart == 0 ||
-            tabinfo->cp_length == 0 ||
-            tabinfo->cp_axis == 0 ||
-            tabinfo->cp_ccdchip == 0 ||
-            tabinfo->cp_flag == 0) {
-        c_tbtclo (tabinfo->tp);
-        trlerror ("Column not found in BPIXTAB.");
-        return (status = COLUMN_NOT_FOUND);
-    }
-    /* get info on ccdgain column to determine whether we
-     have int or float values to read in.
+    /* arguments:
+     ACSInfo *acs         i: calibration switches, etc
+     DQMask **mask        o: mask of the selected rows
      */
 
-    c_tbcinf(tabinfo->cp_ccdgain, &colnum, colname, colunits, colfmt, &datatype, &lendata, &lenfmt);
-    if (datatype == IRAF_INT) {
-        tabinfo->intgain = 1;
-    } else {
-        tabinfo->intgain = 0;
-    }
-    free(colname);
-    free(colunits);
-    free(colfmt);
-
-    return (status);
-}
-
-
-/* This routine reads the relevant data from one row.  The starting
- pixel location, number of pixels and axis, and the flag value are read.
- The starting pixel (xstart, ystart) will be decremented by one to
- convert to zero-indexing.
- */
-
-static int ReadBpixTab (TblInfo *tabinfo, int row, TblRow *tabrow) {
-
     extern int status;
 
-    /* read in values from selection columns...*/
-    /* If this column exists, read it, otherwise it is not necessary */
-    if (tabinfo->cp_amp != 0) {
-        c_tbegtt (tabinfo->tp, tabinfo->cp_amp, row,
-                  tabrow->ccdamp, ACS_CBUF-1);
-        if (c_iraferr())
-            return (status = TABLE_ERROR);
-    }
-    /* If this column exists, read it, otherwise it is not necessary */
-    if (tabinfo->cp_ccdgain != 0) {
-        if (tabinfo->intgain == 1) {
-            c_tbegti (tabinfo->tp, tabinfo->cp_ccdgain, row, &tabrow->ccdgaini);
-        } else {
-            c_tbegtr (tabinfo->tp, tabinfo->cp_ccdgain, row, &tabrow->ccdgainf);
-        }
-        if (c_iraferr())
-            return (status = TABLE_ERROR);
-    }
-
-    c_tbegti (tabinfo->tp, tabinfo->cp_ccdchip, row, &tabrow->ccdchip);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-
-    /* read in bad pixel value description columns*/
-    c_tbegti (tabinfo->tp, tabinfo->cp_xstart, row, &tabrow->xstart);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    tabrow->xstart--;
-    c_tbegti (tabinfo->tp, tabinfo->cp_ystart, row, &tabrow->ystart);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    tabrow->ystart--;
-    c_tbegti (tabinfo->tp, tabinfo->cp_length, row, &tabrow->length);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    c_tbegti (tabinfo->tp, tabinfo->cp_axis, row, &tabrow->axis);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    c_tbegts (tabinfo->tp, tabinfo->cp_flag, row, &tabrow->flag);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-
-    if (tabrow->axis !=1 && tabrow->axis != 2) {
-        trlerror("Axis = %d in BPIXTAB, but it must be 1 or 2.", tabrow->axis);
-        c_tbtclo (tabinfo->tp);
-        return (status = TABLE_ERROR);
-    }
-    if (tabrow->length <= 0) {
-        trlerror("Length = %d in BPIXTAB, but it must be positive.", tabrow->length);
-        c_tbtclo (tabinfo->tp);
-        return (status = TABLE_ERROR);
-    }
-
-    return (status);
-}
-
-/* This routine closes the bpixtab table. */
+    char key[CHAR_LINE_LENGTH+1];	/* table name and selection */
 
-static int CloseBpixTab (TblInfo *tabinfo) {
+    snprintf (key, sizeof(key), "%s|%d|%s|%.9g", acs->bpix.name, acs->chip,
+              acs->ccdamp, acs->ccdgain);
 
-    extern int status;
+    if ((*mask = findDQMask (key)) != NULL)
+        return (status);
 
-    c_tbtclo (tabinfo->tp);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
+    if ((status = loadBpixTable (&bpixtab, acs->bpix.name, &bpixformat)))
+        return (status);
 
-    return (status);
+    return (status = makeBpixMask (&bpixtab, key, SelectBpixRow, acs, mask));
 }
 
-
-/* This routine assigns data quality values as specified in one row of
- the DQI table.  The current value is ORed with any previous value.
+/* This routine checks one BPIXTAB row against the chip, amp and gain
+ of the image.
  */
 
-static void DQINormal (DQHdrData *ydq, double *ltv, TblRow *tabrow) {
+static Bool SelectBpixRow (const BpixTable *bpix, BpixRow *tabrow,
+                           const void *selection) {
 
     /* arguments:
-     DQHdrData *ydq  	io: data quality array
-     double ltv[2]        i: offset of array within detector
-     TblRow *tabrow       i: data quality info read from one row
+     BpixTable *bpix      i: the table the row is from
+     BpixRow *tabrow      i: a copy of the row
+     void *selection      i: the image, as its ACSInfo
      */
 
-    int xstart, ystart;	/* from tabrow, but scaled and shifted */
-    int xlow, xhigh;	/* limits for loop on i */
-    int ylow, yhigh;	/* limits for loop on j */
-    int i, j;		/* indexes for scratch array ydq */
-    short sum_dq;		/* for binning data quality array */
-
-    /* Take account of possible subarray or overscan.  We use ltv,
-    but we assume ltm = 1.
-    */
-    xstart = tabrow->xstart + ltv[0];
-    ystart = tabrow->ystart + ltv[1];
-
-    if (tabrow->axis == 1) {
-
-        /* The range for x is the repeat count. */
-        xlow = xstart;
-        xhigh = xstart + tabrow->length - 1;
+    const ACSInfo *acs = selection;
+    int sameamp, samegain, samechip;
 
-        /* out of range? */
-        if (xhigh < 0 || xlow >= ydq->data.nx || ystart < 0 || ystart >= ydq->data.ny)
-            return;
+    int SameInt (int, int);
+    int SameFlt (float, float);
+    int SameString (char *, char *);
 
-        if (xlow < 0)
-            xlow = 0;
-        if (xhigh >= ydq->data.nx)
-            xhigh = ydq->data.nx - 1;
+    /* If CCDAMP column does not exist, always return a match.*/
+    if (!bpix->hasText || SameString(tabrow->text,"N/A")) {
+        sameamp = 1;
+    } else {
+        sameamp = SameString (tabrow->text, (char *)acs->ccdamp);
+    }
 
-        j = ystart;
-        for (i = xlow;  i <= xhigh;  i++) {
-            sum_dq = tabrow->flag | PDQPix (&ydq->data, i, j);
-            PDQSetPix (&ydq->data, i, j, sum_dq);
+    /* If CCDGAIN column does not exist, always return a match. */
+    if (!bpix->hasGain) {
+        /* No ccdgain column at all, set samegain to 1(yes) */
+        samegain = 1;
+    } else {
+        /* We have a ccdgain column, check the value */
+        if (bpix->intGain) {
+            if (tabrow->gaini == -999) {
+                samegain = 1;
+            } else {
+                samegain = SameInt (tabrow->gaini, (int)acs->ccdgain);
+            }
+        } else {
+            samegain = SameFlt(tabrow->gain,-999.0);
+            if (samegain == 0) {
+                samegain = SameFlt (tabrow->gain, acs->ccdgain);
+            }
         }
+    }
+    /* If CCDCHIP column has a wildcard value, always return a match. */
+    if (tabrow->chip == -999) {
+        samechip = 1;
+    } else {
+        samechip = SameInt (tabrow->chip, acs->chip);
+    }
 
-    } else if (tabrow->axis == 2) {
-
-        /* The range for y is the repeat count. */
-        ylow = ystart;
-        yhigh = ystart + tabrow->length - 1;
+    /* Check whether the row matches the conditions. */
+    return (sameamp && samegain && samechip);
+}
 
-        /* out of range? */
-        if (xstart < 0 || xstart >= ydq->data.nx || yhigh < 0 || ylow >= ydq->data.ny)
-            return;
+/* This routine frees the rows of the last BPIXTAB read, once the last
+ exposure of a run has been processed.  The masks made from them are
+ freed by clearDQMaskCache.
+ */
 
-        if (ylow < 0)
-            ylow = 0;
-        if (yhigh >= ydq->data.ny)
-            yhigh = ydq->data.ny - 1;
+void clearDQICache (void) {
 
-        i = xstart;
-        for (j = ylow;  j <= yhigh;  j++) {
-            sum_dq = tabrow->flag | PDQPix (&ydq->data, i, j);
-            PDQSetPix (&ydq->data, i, j, sum_dq);
-        }
-    }
+    freeBpixTable (&bpixtab);
 }
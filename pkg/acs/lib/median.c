@@ -7,15 +7,16 @@
 # include <stdlib.h>
 # include <string.h>
 # include "acs.h"	/* for message output */
-
-static int CompareDouble (const void *vp, const void *vq);
-static int CompareFloat (const void *vp, const void *vq);
+# include "hstcal_select.h"
 
 /* These two routines (one for double precision, one for single) return
    the median of a floating-point array.
 
    If inplace = 0, the input array is copied to a scratch array, and the
-   scratch array is sorted; otherwise, the input array is sorted in-place.
+   median is selected from the scratch array; otherwise, the input array
+   is reordered in-place.  The order it is left in is unspecified (the
+   values are not sorted), so callers may only reuse it as a set of
+   values, e.g. for sums or deviations from the median.
 */
 
 double MedianDouble (double *v, int n, int inplace) {
@@ -23,12 +24,11 @@ double MedianDouble (double *v, int n, int inplace) {
 /* arguments:
 double v[n]    i: input array (io if inplace=1)
 int n          i: size of array
-int inplace    i: sort the input array in-place?
+int inplace    i: reorder the input array in-place?
 */
 
 	double *vt;		/* scratch for a copy of v */
 	double median;
-	int i;
 
 	if (n < 1) {
 	    trlwarn ("(MedianDouble) No data.");
@@ -49,13 +49,7 @@ int inplace    i: sort the input array in-place?
 	    memcpy (vt, v, n * sizeof (double));
 	}
 
-	qsort (vt, n, sizeof (double), CompareDouble);
-
-	i = n / 2;
-	if (n == i * 2)
-	    median = (vt[i-1] + vt[i]) / 2.;
-	else
-	    median = vt[i];
+	median = medianDouble (vt, n);
 
 	if (!inplace)
 	    free (vt);
@@ -68,12 +62,11 @@ float MedianFloat (float *v, int n, int inplace) {
 /* arguments:
 double v[n]    i: input array (io if inplace=1)
 int n          i: size of array
-int inplace    i: sort the input array in-place?
+int inplace    i: reorder the input array in-place?
 */
 
 	float *vt;
 	float median;
-	int i;
 
 	if (n < 1) {
 	    trlwarn ("(MedianFloat) No data.");
@@ -94,44 +87,10 @@ int inplace    i: sort the input array in-place?
 	    memcpy (vt, v, n * sizeof (float));
 	}
 
-	qsort (vt, n, sizeof (float), CompareFloat);
-
-	i = n / 2;
-	if (n == i * 2)
-	    median = (vt[i-1] + vt[i]) / 2.F;
-	else
-	    median = vt[i];
+	median = medianFloat (vt, n);
 
 	if (!inplace)
 	    free (vt);
 
 	return (median);
 }
-
-/* These routines are used to sort the array. */
-
-static int CompareDouble (const void *vp, const void *vq) {
-
-	const double *p = vp;
-	const double *q = vq;
-
-	if (*p > *q)
-	    return (1);
-	else if (*p < *q)
-	    return (-1);
-	else
-	    return (0);
-}
-
-static int CompareFloat (const void *vp, const void *vq) {
-
-	const float *p = vp;
-	const float *q = vq;
-
-	if (*p > *q)
-	    return (1);
-	else if (*p < *q)
-	    return (-1);
-	else
-	    return (0);
-}
@@ -4,14 +4,19 @@
 	InterpDQInfo
 */
 
-# include <stdlib.h>		/* calloc */
+# include <stdlib.h>		/* free */
 # include <string.h>		/* strncmp */
-# include <math.h>		/* sqrt */
 # include "hstio.h"  /* for SingleGroupLine definitions */
 
 # include "acs.h"
 # include "acsinfo.h"
 # include "hstcalerr.h"
+# include "hstcal_resample.h"
+
+static int unbinFloatLines (FloatHdrLine *, int, FloatHdrLine *, int, int,
+		UnbinAxis *, UnbinAxis *, ResampleKind);
+static int unbinShortLines (ShortHdrLine *, int, ShortHdrLine *, int, int,
+		UnbinAxis *, UnbinAxis *);
 
 /* This routine takes an input data array and expands it by linear
    interpolation, writing to the output array.  The calling routine
@@ -45,23 +50,13 @@ ACSsect *b        o: output expanded data
 
 	double block[2];	/* number of input pixels for one output */
 	double offset[2] = {0., 0.};	/* offset of binned image */
-	float p, q, r, s;	/* for interpolating */
-	float xoffset, yoffset;	/* for getting location of output in input */
-	float ai, aj;		/* location in input corresponding to m,n */
-	float value;		/* interpolated value */
-	float e1, e2, e3, e4;	/* errors at four corners */
 	int inx, iny;		/* size of input array */
 	int onx, ony;		/* size of output array */
 	int binx, biny;		/* number of output pixels per input pixel */
-	int m, n;		/* pixel index in output array */
-	int i, j;		/* pixel index in input array */
-	int i1, i2, num_i;	/* for ORing data quality */
-	int j1, j2, num_j;	/* for ORing data quality */
-	short dq;		/* OR of the data quality arrays */
+	UnbinAxis xaxis, yaxis;	/* interpolation weights along x and y */
+	UnbinAxis *x, *y;	/* NULL for an axis that is not expanded */
 
 	int BinCoords (Hdr *, double *, double *, Hdr *, Hdr *, Hdr *);
-	void InterpInfo (float, int, int *, float *, float *);
-	void InterpDQInfo (float, int, int *, int *, int *);
 
 	inx = a->npix;
 	iny = a->nlines;
@@ -75,126 +70,31 @@ ACSsect *b        o: output expanded data
 	    return (status = INVALID_VALUE);
 	}
 
-	xoffset = (float)(binx - 1) / 2.0F;
-	yoffset = (float)(biny - 1) / 2.0F;
-
-	if (binx == 1 && biny == 1) {
-
-	    /* Same size, so just copy. */
-
-	    /* Copy the science data. */
-	    /* Copy the error array. */
-	    /* Copy the data quality array. */
-	    for (n = 0;  n < ony;  n++) {
-		    for (m = 0;  m < onx;  m++) {
-		        b->sci[n].line[m] = a->sci[n].line[m];
-		        b->err[n].line[m] = a->err[n].line[m];
-		        b->dq[n].line[m] = a->dq[n].line[m];
-            }
-        }
-
-	} else if (binx == 1) {
-
-	    /* Interpolate in Y. */
-	    for (n = 0;  n < ony;  n++) {
-			aj = ((float)n - yoffset) / (float)biny;
-			InterpInfo (aj, iny, &j, &r, &s);
-			InterpDQInfo (aj, iny, &j1, &j2, &num_j);
-
-			for (m = 0;  m < onx;  m++) {
-        	    /* Science data array. */
-		    	value = r * a->sci[j].line[m] + s * a->sci[j+1].line[m];
-		    	b->sci[n].line[m] = value;
-
-        	    /* Error array. */
-		    	e1 = a->err[j].line[m];
-		    	e2 = a->err[j+1].line[m];
-		    	value = r * e1*e1 + s * e2*e2;
-		    	b->err[n].line[m] = sqrt (value);                
-
-        	    /* Data quality array. */
-		    	if (num_j == 1)
-					dq = a->dq[j1].line[m];
-		    	else
-	    			dq = a->dq[j1].line[m] | a->dq[j2].line[m];
-		    	b->dq[n].line[m] = dq;
-			}
-	    }
-
-	} else if (biny == 1) {
-
-	    /* Interpolate in X. */
-
-
-	    for (n = 0;  n < ony;  n++) {
-			for (m = 0;  m < onx;  m++) {
-		    	ai = ((float)m - xoffset) / (float)binx;
-		    	InterpInfo (ai, inx, &i, &p, &q);
-
-        	    /* Science data array. */
-		    	value = p * a->sci[n].line[i] + q * a->sci[n].line[i+1];
-		    	b->sci[n].line[m] = value;
-
-        	    /* Error array. */
-		    	e1 = a->err[n].line[i];
-		    	e2 = a->err[n].line[i+1];
-		    	value = p * e1*e1 + q * e2*e2;
-		    	b->err[n].line[m] = sqrt (value);
-
-        	    /* Data quality array. */
-		    	InterpDQInfo (ai, inx, &i1, &i2, &num_i);
-		    	if (num_i == 1)
-					dq = a->dq[n].line[i1];
-		    	else
-					dq = a->dq[n].line[i1] | a->dq[n].line[i2];
-		    	b->dq[n].line[m] = dq;
-			}
-	    }
-
-	} else {
-
-	    for (n = 0;  n < ony;  n++) {
-			aj = ((float)n - yoffset) / (float)biny;
-			InterpInfo (aj, iny, &j, &r, &s);
-			InterpDQInfo (aj, iny, &j1, &j2, &num_j);
-			for (m = 0;  m < onx;  m++) {
-		    	ai = ((float)m - xoffset) / (float)binx;
-		    	InterpInfo (ai, inx, &i, &p, &q);
-                
-        	    /* Science data array. */
-		    	value = p * r * a->sci[j].line[i] +
-			    	q * r * a->sci[j].line[i+1] +
-			    	p * s * a->sci[j+1].line[i] +
-			    	q * s * a->sci[j+1].line[i+1];
-		    	b->sci[n].line[m] = value;
-
-        	    /* Error array. */
-		    	e1 = a->err[j].line[i];
-		    	e2 = a->err[j].line[i+1];
-		    	e3 = a->err[j+1].line[i];
-		    	e4 = a->err[j+1].line[i+1];
-		    	value = p * r * e1*e1 + q * r * e2*e2 + p * s * e3*e3 + q * s * e4*e4;
-		    	b->err[n].line[m] = sqrt (value);
-
-        	    /* Data quality array. */
-		    	InterpDQInfo (ai, inx, &i1, &i2, &num_i);
-		    	if (num_i == 1 && num_j == 1)
-					dq = a->dq[j1].line[i1];
-		    	else if (num_i == 1)
-					dq = a->dq[j1].line[i1] |
-			    	 	 a->dq[j2].line[i1];
-		    	else if (num_j == 1)
-					dq = a->dq[j1].line[i1] |
-			    	 	 a->dq[j1].line[i2];
-		    	else
-					dq = a->dq[j1].line[i1] |
-			    	 	 a->dq[j1].line[i2] |
-			    	 	 a->dq[j2].line[i1] |
-			    	 	 a->dq[j2].line[i2];
-		    	b->dq[n].line[m] = dq;
-			}
-	    }
+	initUnbinAxis (&xaxis);
+	initUnbinAxis (&yaxis);
+	if ((binx > 1 && makeUnbinAxis (&xaxis, inx, binx, NO)) ||
+	    (biny > 1 && makeUnbinAxis (&yaxis, iny, biny, NO))) {
+	    freeUnbinAxis (&xaxis);
+	    freeUnbinAxis (&yaxis);
+	    trlerror("(unbinsect) Out of memory.");
+	    return (status = OUT_OF_MEMORY);
+	}
+	x = (binx > 1) ? &xaxis : NULL;
+	y = (biny > 1) ? &yaxis : NULL;
+
+	/* Science data, error and data quality arrays. */
+	if (unbinFloatLines (a->sci, iny, b->sci, onx, ony, x, y,
+			RESAMPLE_VALUE) ||
+	    unbinFloatLines (a->err, iny, b->err, onx, ony, x, y,
+			RESAMPLE_ERROR) ||
+	    unbinShortLines (a->dq, iny, b->dq, onx, ony, x, y)) {
+	    freeUnbinAxis (&xaxis);
+	    freeUnbinAxis (&yaxis);
+	    trlerror("(unbinsect) Out of memory.");
+	    return (status = OUT_OF_MEMORY);
 	}
+	freeUnbinAxis (&xaxis);
+	freeUnbinAxis (&yaxis);
 
 	if (update == YES) {
 		/* Copy the headers. */
@@ -220,3 +120,39 @@ ACSsect *b        o: output expanded data
 	}
 	return (status);
 }
+
+/* These routines expand the iny lines of one array of a section into
+   the ony lines of onx pixels of another.
+*/
+
+static int unbinFloatLines (FloatHdrLine *a, int iny, FloatHdrLine *b,
+		int onx, int ony, UnbinAxis *x, UnbinAxis *y, ResampleKind kind) {
+
+	float **in, **out;	/* lines of a and b */
+	int ok;
+
+	in = floatLineRows (a, iny);
+	out = floatLineRows (b, ony);
+	ok = (in != NULL && out != NULL);
+	if (ok)
+	    unbinFloat (in, out, onx, ony, x, y, kind);
+	free (in);
+	free (out);
+	return (ok ? 0 : OUT_OF_MEMORY);
+}
+
+static int unbinShortLines (ShortHdrLine *a, int iny, ShortHdrLine *b,
+		int onx, int ony, UnbinAxis *x, UnbinAxis *y) {
+
+	short **in, **out;	/* lines of a and b */
+	int ok;
+
+	in = shortLineRows (a, iny);
+	out = shortLineRows (b, ony);
+	ok = (in != NULL && out != NULL);
+	if (ok)
+	    unbinShort (in, out, onx, ony, x, y);
+	free (in);
+	free (out);
+	return (ok ? 0 : OUT_OF_MEMORY);
+}
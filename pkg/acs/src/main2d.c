@@ -9,6 +9,8 @@ extern int status;			/* zero is OK */
 
 # include <c_iraf.h>		/* for c_irafinit */
 #include "hstcal_memory.h"
+#include "hstcal_dqmask.h"
+#include "hstcal_flatfield.h"
 #include "hstcal.h"
 # include "ximio.h"
 # include "hstio.h"
@@ -18,6 +20,7 @@ extern int status;			/* zero is OK */
 # include "acsversion.h"
 # include "hstcalerr.h"
 # include "acscorr.h"		/* calibration switch names for cs1 */
+# include "doccd.h"
 # include "hstcalversion.h"
 #include "trlbuf.h"
 
@@ -290,7 +293,9 @@ int main (int argc, char **argv) {
         }
     }
 
-
+    clearDQICache ();
+    clearDQMaskCache ();
+    clearFlatFieldCache ();
     freeOnExit(&ptrReg);
 
     if (status)
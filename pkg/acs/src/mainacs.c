@@ -1,6 +1,7 @@
 # include <stdio.h>
 # include <stdlib.h>
 # include <string.h>
+# include <stdbool.h>
 
 #include "hstcal_memory.h"
 #include "hstcal.h"
@@ -20,7 +21,7 @@ struct TrlBuf trlbuf = { 0 };
 
 static void printSyntax(void)
 {
-    printf("syntax:  calacs.e [--help] [-t] [-s] [-v] [-q] [-r] [--version] [--gitinfo] [-1|--nthreads <N>] [--ctegen <1|2>] [--pctetab <path>] input \n");
+    printf("syntax:  calacs.e [--help] [-t] [-s] [-v] [-q] [-r] [--version] [--gitinfo] [-1|--nthreads <N>] [--ctegen <1|2>] [--pctetab <path>] [--parallelAmps] input \n");
 }
 static void printHelp(void)
 {
@@ -40,13 +41,14 @@ int main(int argc, char **argv) {
     unsigned cteAlgorithmGen = 0; //Use gen1cte algorithm rather than gen2 (default)
     char pcteTabNameFromCmd[CHAR_LINE_LENGTH];
     *pcteTabNameFromCmd = '\0';
+    bool parallelAmps = false; /* run the per-amp CTE corrections as concurrent tasks? */
 	int too_many = NO;	/* too many command-line arguments? */
 	int i, j;		/* loop indexes */
     unsigned nThreads = 0;
 
 	/* Function definitions */
 	void c_irafinit (int, char **);
-	int CalAcsRun (char *, int, int, int, int, const unsigned nThreads, const int gen1cte, const char * pcteTabNameFromCmd);
+	int CalAcsRun (char *, int, int, int, int, const unsigned nThreads, const int gen1cte, const char * pcteTabNameFromCmd, const bool parallelAmps);
     void WhichError (int);
 
 	/* Initialize status to OK and MsgText to null */
@@ -111,6 +113,14 @@ int main(int argc, char **argv) {
             ++i;
             continue;
         }
+        else if (strncmp(argv[i], "--parallelAmps", 14) == 0)
+        {
+#ifndef _OPENMP
+            printf("WARNING: '--parallelAmps' used but OPENMP not found!\n");
+#endif
+            parallelAmps = true;
+            continue;
+        }
         else if (strncmp(argv[i], "--nthreads", 10) == 0)
         {
             if (i + 1 > argc - 1)
@@ -224,7 +234,7 @@ int main(int argc, char **argv) {
 #endif
 
 	/* Call the CALACS main program */
-	if (CalAcsRun (input, printtime, save_tmp, verbose, debug, nThreads, cteAlgorithmGen, pcteTabNameFromCmd)) {
+	if (CalAcsRun (input, printtime, save_tmp, verbose, debug, nThreads, cteAlgorithmGen, pcteTabNameFromCmd, parallelAmps)) {
 
         if (status == NOTHING_TO_DO){
             /* If there is just nothing to do,
@@ -9,6 +9,7 @@ extern int status;			/* zero is OK */
 
 # include <c_iraf.h>		/* for c_irafinit */
 #include "hstcal_memory.h"
+#include "hstcal_dqmask.h"
 #include "hstcal.h"
 # include "ximio.h"
 # include "hstio.h"
@@ -17,6 +18,7 @@ extern int status;			/* zero is OK */
 # include "acsinfo.h"
 # include "hstcalerr.h"
 # include "acscorr.h"		/* calibration switch names for acsccd */
+# include "doccd.h"
 # include "hstcalversion.h"
 # include "acsversion.h"
 #include "trlbuf.h"
@@ -268,6 +270,9 @@ int main (int argc, char **argv) {
         }
     }
 
+    clearSinkCatalogs ();
+    clearDQICache ();
+    clearDQMaskCache ();
     freeOnExit(&ptrReg);
 
     if (status)
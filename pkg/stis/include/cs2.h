@@ -13,4 +13,7 @@
 # define	CRMASK		8
 # define	MAX_PAR		8
 
+/* default memory budget (MB) */
+# define	MEMBUDGET	1024.
+
 #endif /* INCL_CS2_H */
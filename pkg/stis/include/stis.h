@@ -166,6 +166,7 @@ typedef struct {
 	short	badbits;
 	int	printtime;
 	int	verbose;
+	float	membudget;	/* memory (MB) for the working arrays */
 } clpar;
 
 /* Prototypes for calstisN functions. */
@@ -176,6 +177,7 @@ int CalStis0 (char *rawfile, char *wavfile, char *outroot,
 int CalStis1 (char *input, char *output, char *outblev,
 	cs1_switch *cs1_sw, RefFileInfo *refnames,
 	int printtime, int verbose);
+void clearDQICache (void);
 
 int CalStis2 (char *input, char *fout, clpar *par, int newpar[]);
 
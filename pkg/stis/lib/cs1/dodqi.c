@@ -1,52 +1,45 @@
 /* This file contains:
 	doDQI
-	OpenBpixTab
-	ReadBpixTab
-	CloseBpixTab
-	DQINormal
+	GetBpixMask
+	SelectBpixRow
+	clearDQICache
+	InBpixTab
 	DQIHigh
 	FirstLast
 */
 
 # include <stdio.h>
+# include <stdlib.h>
 # include <string.h>
 
 # include "c_iraf.h"
 # include "hstio.h"
-# include "xtables.h"
 # include "stis.h"
 # include "calstis1.h"
 # include "hstcalerr.h"
 # include "stisdq.h"
 # include "stisdef.h"
+# include "hstcal_dqmask.h"
 
-typedef struct {
-	IRAFPointer tp;			/* pointer to table descriptor */
-	IRAFPointer cp_opt_elem;	/* grating name */
-	IRAFPointer cp_xstart, cp_ystart; /* starting pixel for bad values */
-	IRAFPointer cp_length;		/* this many bad values */
-	IRAFPointer cp_axis;		/* repeat along X or Y axis (1 or 2) */
-	IRAFPointer cp_flag;		/* this is the data quality value */
-	int axlen1, axlen2;		/* DQ array size specified in header */
-	int nrows;			/* number of rows in table */
-} TblInfo;
-
-typedef struct {
-	/* values read from a table row */
-	char opt_elem[STIS_CBUF+1];
-	int xstart, ystart;
-	int length;
-	int axis;
-	short flag;
-} TblRow;
-
-static int OpenBpixTab (char *, TblInfo *);
-static int ReadBpixTab (TblInfo *, int, TblRow *);
-static int CloseBpixTab (TblInfo *);
+/* The rows of the last BPIXTAB read, so that the table is read once
+   for all imsets.
+*/
+static BpixTable bpixtab = {NULL, 0, 0, False, False, False, 0, NULL};
+
+static const BpixFormat bpixformat = {
+	"OPT_ELEM", STIS_CBUF, "ANY",	/* optional, for backward compatibility */
+	False,				/* no CCDCHIP */
+	False,				/* no CCDGAIN */
+	True,				/* SIZAXIS1, SIZAXIS2 */
+	True				/* check an empty table too */
+};
+
+static int GetBpixMask (StisInfo1 *, DQMask **);
+static Bool SelectBpixRow (const BpixTable *, BpixRow *, const void *);
+static int InBpixTab (const BpixTable *, BpixRow *);
 static void FirstLast (double *, double *, int *, int *,
 		int *, int *, int *, int *);
-static void DQINormal (ShortTwoDArray *, double *, TblRow *);
-static void DQIHigh (ShortTwoDArray *, double *, TblRow *, int, int);
+static void DQIHigh (ShortTwoDArray *, double *, BpixRow *, int, int);
 
 /* This routine ORs the data quality array in the input SingleGroup x
    with the pixels flagged in the data quality initialization table.
@@ -162,8 +155,8 @@ SingleGroup *x    io: image to be calibrated; DQ array written to in-place
 
 	int status;
 
-	TblInfo tabinfo;	/* pointer to table descriptor, etc */
-	TblRow tabrow;		/* values read from a table row */
+	DQMask *mask;		/* selected BPIXTAB rows */
+	BpixRow *tabrow;	/* a cached table row */
 
 	ShortTwoDArray ydq;		/* scratch space */
 
@@ -328,17 +321,28 @@ SingleGroup *x    io: image to be calibrated; DQ array written to in-place
 	    doppmax = 0;
 	}
 
-	/* Open the data quality initialization table, find columns, etc. */
-	if ((status = OpenBpixTab (sts->bpix.name, &tabinfo)))
+	/* Read the data quality initialization table, unless that was
+	   done already for another imset.
+	*/
+	if ((status = loadBpixTable (&bpixtab, sts->bpix.name, &bpixformat)))
 	    return (status);
 
+	/* Without Doppler convolution, the rows selected for this
+	   grating are rasterised once, then ORed in a single pass.
+	*/
+	mask = NULL;
+	if (!high_res) {
+	    if ((status = GetBpixMask (sts, &mask)))
+		return (status);
+	}
+
 	/* Size of scratch image */
 	if (high_res) {
-	    snpix[0] = 2 * tabinfo.axlen1;
-	    snpix[1] = 2 * tabinfo.axlen2;
+	    snpix[0] = 2 * bpixtab.axlen1;
+	    snpix[1] = 2 * bpixtab.axlen2;
 	} else {
-	    snpix[0] = tabinfo.axlen1;
-	    snpix[1] = tabinfo.axlen2;
+	    snpix[0] = bpixtab.axlen1;
+	    snpix[1] = bpixtab.axlen2;
 	}
 
 	/* size of current image */
@@ -357,41 +361,39 @@ SingleGroup *x    io: image to be calibrated; DQ array written to in-place
 		    DQSetPix (ydq, i, j, 0);		/* initially OK */
 	}
 
-	/* Read each row of the table, and fill in data quality values. */
-
-	for (row = 1;  row <= tabinfo.nrows;  row++) {
+	/* Go through the rows selected for this grating, warn about
+	   those out of range, and fill in data quality values for
+	   high-res pixels.
+	*/
+	for (row = 0;  row < bpixtab.nrows;  row++) {
 
-	    if ((status = ReadBpixTab (&tabinfo, row, &tabrow))) {
-		trlerror("Error reading BPIXTAB.");
-		return (status);
-	    }
+	    tabrow = &bpixtab.rows[row];
 
-	    if (!SameString (tabrow.opt_elem, sts->opt_elem))
+	    if (!SameString (tabrow->text, sts->opt_elem))
 		continue;
 
-	    if (tabrow.xstart < 0 || tabrow.xstart >= tabinfo.axlen1 ||
-		tabrow.ystart < 0 || tabrow.ystart >= tabinfo.axlen2) {
+	    if (!InBpixTab (&bpixtab, tabrow)) {
 		trlwarn("Starting pixel (%d,%d) in BPIXTAB is out of range.",
-			tabrow.xstart+1, tabrow.ystart+1);
+			tabrow->run.x+1, tabrow->run.y+1);
 		continue;			/* ignore this row */
 	    }
 
 	    /* Assign the flag value to all relevant pixels. */
-	    if (in_place) {
-		if (high_res)
-		    DQIHigh (&x->dq.data, ri_v, &tabrow, doppmin, doppmax);
-		else
-		    DQINormal (&x->dq.data, ri_v, &tabrow);
-	    } else {				/* use scratch array */
-		if (high_res)
-		    DQIHigh (&ydq, rs_v, &tabrow, doppmin, doppmax);
-		else
-		    DQINormal (&ydq, rs_v, &tabrow);
+	    if (high_res) {
+		if (in_place)
+		    DQIHigh (&x->dq.data, ri_v, tabrow, doppmin, doppmax);
+		else				/* use scratch array */
+		    DQIHigh (&ydq, rs_v, tabrow, doppmin, doppmax);
 	    }
 	}
 
-	if ((status = CloseBpixTab (&tabinfo)))	/* done with the table */
-	    return (status);
+	/* OR the rasterised rows for low-res pixels. */
+	if (!high_res) {
+	    if (in_place)
+		orDQMask (mask, &x->dq.data, ri_v);
+	    else				/* use scratch array */
+		orDQMask (mask, &ydq, rs_v);
+	}
 
 	if (!in_place) {
 
@@ -423,185 +425,69 @@ SingleGroup *x    io: image to be calibrated; DQ array written to in-place
 	return (0);
 }
 
-static int OpenBpixTab (char *tname, TblInfo *tabinfo) {
-
-	tabinfo->tp = c_tbtopn (tname, IRAF_READ_ONLY, 0);
-	if (c_iraferr())
-	    return (OPEN_FAILED);
-
-	tabinfo->nrows = c_tbpsta (tabinfo->tp, TBL_NROWS);
-
-	/* Find the columns. */
-	c_tbcfnd1 (tabinfo->tp, "PIX1", &tabinfo->cp_xstart);
-	c_tbcfnd1 (tabinfo->tp, "PIX2", &tabinfo->cp_ystart);
-	c_tbcfnd1 (tabinfo->tp, "LENGTH", &tabinfo->cp_length);
-	c_tbcfnd1 (tabinfo->tp, "AXIS", &tabinfo->cp_axis);
-	c_tbcfnd1 (tabinfo->tp, "VALUE", &tabinfo->cp_flag);
-	if (tabinfo->cp_xstart == 0 ||
-	    tabinfo->cp_ystart == 0 ||
-	    tabinfo->cp_length == 0 ||
-	    tabinfo->cp_axis == 0 ||
-	    tabinfo->cp_flag == 0) {
-	    c_tbtclo (tabinfo->tp);
-	    trlerror("Column not found in BPIXTAB.");
-	    return (COLUMN_NOT_FOUND);
-	}
-
-	/* This column is optional, for backward compatibility. */
-	c_tbcfnd1 (tabinfo->tp, "OPT_ELEM", &tabinfo->cp_opt_elem);
-
-	/* Find out how large a full-size data quality array should be. */
-	tabinfo->axlen1 = c_tbhgti (tabinfo->tp, "SIZAXIS1");
-	if (c_iraferr()) {
-	    c_tbtclo (tabinfo->tp);
-	    trlerror("Couldn't get SIZAXIS1 from BPIXTAB header.");
-	    return (TABLE_ERROR);
-	}
-	tabinfo->axlen2 = c_tbhgti (tabinfo->tp, "SIZAXIS2");
-	if (c_iraferr()) {
-	    c_tbtclo (tabinfo->tp);
-	    trlerror("Couldn't get SIZAXIS2 from BPIXTAB header.");
-	    return (TABLE_ERROR);
-	}
-
-	return (0);
-}
-
-
-/* This routine reads the relevant data from one row.  The starting
-   pixel location, number of pixels and axis, and the flag value are read.
-   The starting pixel (xstart, ystart) will be decremented by one to
-   convert to zero-indexing.
+/* This routine gets the mask of the BPIXTAB rows that apply to the
+   grating of the image.  Masks are cached by table name and grating,
+   so that the table rows are selected and rasterised once.  The rows
+   must have been loaded already.
 */
 
-static int ReadBpixTab (TblInfo *tabinfo, int row, TblRow *tabrow) {
-
-	/* OPT_ELEM is an optional column. */
-	if (tabinfo->cp_opt_elem == 0) {
-	    strcpy (tabrow->opt_elem, "ANY");
-	} else {
-	    c_tbegtt (tabinfo->tp, tabinfo->cp_opt_elem, row,
-			tabrow->opt_elem, STIS_CBUF);
-	    if (c_iraferr())
-		return (TABLE_ERROR);
-	}
-
-	c_tbegti (tabinfo->tp, tabinfo->cp_xstart, row, &tabrow->xstart);
-	if (c_iraferr())
-	    return (TABLE_ERROR);
-	tabrow->xstart--;
-	c_tbegti (tabinfo->tp, tabinfo->cp_ystart, row, &tabrow->ystart);
-	if (c_iraferr())
-	    return (TABLE_ERROR);
-	tabrow->ystart--;
-	c_tbegti (tabinfo->tp, tabinfo->cp_length, row, &tabrow->length);
-	if (c_iraferr())
-	    return (TABLE_ERROR);
-	c_tbegti (tabinfo->tp, tabinfo->cp_axis, row, &tabrow->axis);
-	if (c_iraferr())
-	    return (TABLE_ERROR);
-	c_tbegts (tabinfo->tp, tabinfo->cp_flag, row, &tabrow->flag);
-	if (c_iraferr())
-	    return (TABLE_ERROR);
-
-	if (tabrow->axis !=1 && tabrow->axis != 2) {
-	    trlerror("Axis = %d in BPIXTAB, but it must be 1 or 2.",
-			tabrow->axis);
-	    c_tbtclo (tabinfo->tp);
-	    return (TABLE_ERROR);
-	}
-	if (tabrow->length <= 0) {
-	    trlerror("Length = %d in BPIXTAB, but it must be positive.",
-		    tabrow->length);
-	    c_tbtclo (tabinfo->tp);
-	    return (TABLE_ERROR);
-	}
+static int GetBpixMask (StisInfo1 *sts, DQMask **mask) {
 
-	return (0);
-}
+/* arguments:
+StisInfo1 *sts    i: calibration switches, etc
+DQMask **mask     o: mask of the selected rows
+*/
 
-/* This routine closes the bpixtab table. */
+	char key[STIS_LINE+STIS_CBUF+2];	/* table name and grating */
 
-static int CloseBpixTab (TblInfo *tabinfo) {
+	sprintf (key, "%s|%s", sts->bpix.name, sts->opt_elem);
 
-	c_tbtclo (tabinfo->tp);
-	if (c_iraferr())
-	    return (TABLE_ERROR);
+	if ((*mask = findDQMask (key)) != NULL)
+	    return (0);
 
-	return (0);
+	return (makeBpixMask (&bpixtab, key, SelectBpixRow, sts, mask));
 }
 
-
-/* This routine assigns data quality values as specified in one row of
-   the DQI table.  The current value is ORed with any previous value.
+/* This routine checks one BPIXTAB row against the grating of the image,
+   and that it is within the full-size data quality array.
 */
 
-static void DQINormal (ShortTwoDArray *ydq, double *ltv, TblRow *tabrow) {
+static Bool SelectBpixRow (const BpixTable *bpix, BpixRow *tabrow,
+		const void *selection) {
 
 /* arguments:
-ShortTwoDArray *ydq  io: data quality array
-double ltv[2]        i: offset of array within detector
-TblRow *tabrow       i: data quality info read from one row
+BpixTable *bpix    i: the table the row is from
+BpixRow *tabrow    i: a copy of the row
+void *selection    i: the image, as its StisInfo1
 */
 
-	int xstart, ystart;	/* from tabrow, but scaled and shifted */
-	int xlow, xhigh;	/* limits for loop on i */
-	int ylow, yhigh;	/* limits for loop on j */
-	int i, j;		/* indexes for scratch array ydq */
-	short sum_dq;		/* for binning data quality array */
-
-	/* Take account of possible subarray or overscan.  We use ltv,
-	   but we assume ltm = 1.
-	*/
-	xstart = tabrow->xstart + ltv[0];
-	ystart = tabrow->ystart + ltv[1];
-
-	if (tabrow->axis == 1) {
-
-	    /* The range for x is the repeat count. */
-	    xlow = xstart;
-	    xhigh = xstart + tabrow->length - 1;
-
-	    /* out of range? */
-	    if (xhigh < 0 || xlow >= ydq->nx ||
-		ystart < 0 || ystart >= ydq->ny)
-		return;
+	const StisInfo1 *sts = selection;
 
-	    if (xlow < 0)
-		xlow = 0;
-	    if (xhigh >= ydq->nx)
-		xhigh = ydq->nx - 1;
+	return (SameString (tabrow->text, (char *)sts->opt_elem) &&
+		InBpixTab (bpix, tabrow));
+}
 
-	    j = ystart;
-	    for (i = xlow;  i <= xhigh;  i++) {
-		sum_dq = tabrow->flag | PDQPix (ydq, i, j);
-		PDQSetPix (ydq, i, j, sum_dq);
-	    }
+/* This routine frees the BPIXTAB rows and the masks made from them,
+   which are kept between calls of CalStis1.
+*/
 
-	} else if (tabrow->axis == 2) {
+void clearDQICache (void) {
 
-	    /* The range for y is the repeat count. */
-	    ylow = ystart;
-	    yhigh = ystart + tabrow->length - 1;
+	freeBpixTable (&bpixtab);
+	clearDQMaskCache();
+}
 
-	    /* out of range? */
-	    if (xstart < 0 || xstart >= ydq->nx ||
-		yhigh < 0 || ylow >= ydq->ny)
-		return;
+/* This routine checks that the starting pixel of a row is within the
+   full-size data quality array.
+*/
 
-	    if (ylow < 0)
-		ylow = 0;
-	    if (yhigh >= ydq->ny)
-		yhigh = ydq->ny - 1;
+static int InBpixTab (const BpixTable *bpix, BpixRow *tabrow) {
 
-	    i = xstart;
-	    for (j = ylow;  j <= yhigh;  j++) {
-		sum_dq = tabrow->flag | PDQPix (ydq, i, j);
-		PDQSetPix (ydq, i, j, sum_dq);
-	    }
-	}
+	return (tabrow->run.x >= 0 && tabrow->run.x < bpix->axlen1 &&
+		tabrow->run.y >= 0 && tabrow->run.y < bpix->axlen2);
 }
 
+
 /* This routine assigns data quality values as specified in one row of
    the DQI table, for the case where the data quality array is binned
    in MAMA high-res pixels while the tabular values are low-res pixels.
@@ -610,12 +496,12 @@ TblRow *tabrow       i: data quality info read from one row
 */
 
 static void DQIHigh (ShortTwoDArray *ydq, double *ltv,
-		TblRow *tabrow, int doppmin, int doppmax) {
+		BpixRow *tabrow, int doppmin, int doppmax) {
 
 /* arguments:
 ShortTwoDArray *ydq   io: data quality array
 double ltv[2]         i: vector part of mapping from reference coords
-TblRow *tabrow        i: data quality info read from one row
+BpixRow *tabrow       i: data quality info read from one row
 int doppmin, doppmax  i: offsets for Doppler shift
 */
 
@@ -633,20 +519,20 @@ int doppmin, doppmax  i: offsets for Doppler shift
 	   i.e. (Xs - 0.5) = (Xr - 0.5) * 2 + ltv
 	    -->  Xs = Xr * 2 + ltv - 0.5
 	*/
-	temp = (double)tabrow->xstart * 2. + ltv[0] - 0.5;
+	temp = (double)tabrow->run.x * 2. + ltv[0] - 0.5;
 	xstart = NINT (temp);
-	temp = (double)tabrow->ystart * 2. + ltv[1] - 0.5;
+	temp = (double)tabrow->run.y * 2. + ltv[1] - 0.5;
 	ystart = NINT (temp);
 
 	/* The repeat count is either two (one low-res pixel) or
 	   twice the number read from the dqi table.
 	*/
-	if (tabrow->axis == 1) {
-	    xlength = tabrow->length * 2;
+	if (tabrow->run.axis == 1) {
+	    xlength = tabrow->run.length * 2;
 	    ylength = 2;
-	} else if (tabrow->axis == 2) {
+	} else if (tabrow->run.axis == 2) {
 	    xlength = 2;
-	    ylength = tabrow->length * 2;
+	    ylength = tabrow->run.length * 2;
 	}
 
 	nx = ydq->nx;
@@ -657,7 +543,7 @@ int doppmin, doppmax  i: offsets for Doppler shift
 	xhigh = xstart + xlength - 1;
 
 	/* Now include Doppler convolution. */
-	if (tabrow->flag & DETECTORPROB) {
+	if (tabrow->run.flag & DETECTORPROB) {
 	    /* We're flagging the edge of the detector, so don't shift
 		the flagged region away from the edge.
 	    */
@@ -690,7 +576,7 @@ int doppmin, doppmax  i: offsets for Doppler shift
 
 	for (j = ylow;  j <= yhigh;  j++) {
 	    for (i = xlow;  i <= xhigh;  i++) {
-		sum_dq = tabrow->flag | PDQPix (ydq, i, j);
+		sum_dq = tabrow->run.flag | PDQPix (ydq, i, j);
 		PDQSetPix (ydq, i, j, sum_dq);
 	    }
 	}
@@ -10,6 +10,7 @@
 # include	"stisdef.h"
 
 static int countImsets (IRAFPointer);
+static double workingBytes (int, int, int);
 
 /*  crrej_do -- Perform the cosmic ray rejection for STIS images
 
@@ -120,6 +121,16 @@ trlmessage("Total number of input image sets = %d", max_files);
 	if (crrej_check (tpin, par, newpar, imgname, grp, ipsci, ipdq,
 			  noise, gain, &dim_x, &dim_y, &nimgs))
 	    return (2);
+
+	/* The input images are read a line at a time, the memory used scales
+	   with the image size: check it against the budget before starting. */
+	if (workingBytes (dim_x, dim_y, nimgs) > par->membudget * 1024. * 1024.) {
+	    trlerror("CR rejection of %d images of %d x %d needs %.1f MB, more than the memory budget of %g MB",
+		nimgs, dim_x, dim_y,
+		workingBytes (dim_x, dim_y, nimgs) / (1024. * 1024.),
+		par->membudget);
+	    return (2);
+	}
 	
 	/* calculate the scaling factors due to different exposure time */
 	strcpy (par->expname, "EXPTIME");
@@ -268,6 +279,25 @@ trlmessage("Total number of input image sets = %d", max_files);
 	return (0);
 }
 
+/* This function returns the number of bytes allocated for the rejection:
+   the output image set, efacsum, and the per-pixel arrays of crrej_loop
+   (pic, thresh, spthresh, sum, sumvar, mask and flags), plus the line
+   buffers of all input images.
+*/
+
+static double workingBytes (int dim_x, int dim_y, int nimgs) {
+
+	double npix = (double) dim_x * dim_y;
+	double perpix, perline;
+
+	perpix = 2 * sizeof(float) + sizeof(short) +		/* output */
+		 sizeof(float) +				/* efacsum */
+		 5 * sizeof(float) + sizeof(short) + sizeof(unsigned short);
+	perline = sizeof(float) + sizeof(int);			/* work, ipts */
+
+	return (npix * perpix + (double) nimgs * dim_x * perline);
+}
+
 /* This function returns a count of the total number of image sets in the
    set of input files.  The function value will be -1 if any of the input
    images can't be opened.
@@ -6,6 +6,7 @@
 # include	"stis.h"
 # include	"calstis2.h"
 # include	"cs2.h"
+# include	"hstcal_select.h"
 
 /*  crrej_init -- get the initial average pixel values
 
@@ -32,9 +33,7 @@ int crrej_init (IODescPtr ipsci[], clpar *par, int nimgs, int dim_x, int dim_y,
 	float		*buf;
 	int		i, j, n;
 	int		dum;
-	int		*npts;
-
-	void		piksrt (float [], int);
+	int		*npts, *ipts;
 
 /* -------------------------------- begin ---------------------------------- */
 
@@ -42,7 +41,8 @@ int crrej_init (IODescPtr ipsci[], clpar *par, int nimgs, int dim_x, int dim_y,
 
 	npts = calloc (dim_x, sizeof(int));
 	buf = calloc (dim_x, sizeof(float));
-	if (npts == NULL || buf == NULL) {
+	ipts = calloc ((size_t)nimgs*dim_x, sizeof(int));
+	if (npts == NULL || buf == NULL || ipts == NULL) {
 	    trlerror("out of memory in crrej_init");
 	    return (2);
 	}
@@ -56,22 +56,23 @@ int crrej_init (IODescPtr ipsci[], clpar *par, int nimgs, int dim_x, int dim_y,
 		for (n = 0; n < nimgs; n++) {
 		    getFloatLine (ipsci[n], j, buf);
 		    for (i = 0; i < dim_x; i++) {
-			PIX(work,npts[i],i,nimgs) = (buf[i] - skyval[n]) / 
+			PIX(work,i,npts[i],dim_x) = (buf[i] - skyval[n]) / 
 							efac[n];
 			npts[i] += 1;
 		    }
 		}
+		/* sort the pixel stacks of the whole line at once */
+		sortStackFloat (work, ipts, npts, nimgs, dim_x, dim_x);
 		for (i = 0; i < dim_x; i++) {
 		    dum = npts[i];
 		    if (dum == 0)
 			PPix(ave,i,j) = 0.0F;
 		    else {
-			piksrt (&PIX(work,0,i,nimgs), dum);
 			if ((dum/2)*2 == dum) 
-			    PPix(ave,i,j) = (PIX(work,dum/2-1,i,nimgs) + 
-						  PIX(work,dum/2,i,nimgs))/2.;
+			    PPix(ave,i,j) = (PIX(work,i,dum/2-1,dim_x) + 
+						  PIX(work,i,dum/2,dim_x))/2.;
 			else
-			    PPix(ave,i,j) = PIX(work,dum/2,i,nimgs);
+			    PPix(ave,i,j) = PIX(work,i,dum/2,dim_x);
 		    }
 		}
 	    }
@@ -111,6 +112,7 @@ int crrej_init (IODescPtr ipsci[], clpar *par, int nimgs, int dim_x, int dim_y,
 	/* free the memory */
 	free (npts);
 	free (buf);
+	free (ipts);
 
 	return (0);
 }
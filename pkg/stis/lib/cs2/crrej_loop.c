@@ -7,6 +7,7 @@
 # include	"stis.h"
 # include	"cs2.h"
 # include	"calstis2.h"
+# include	"hstcal_crrej.h"
 
 /*  crrej_loop -- Perform cosmic ray rejection
 
@@ -25,6 +26,11 @@ next to the cosmic ray hit.
 				to this file, to handle scalense correctly;
 				i.e. subtract the sky before applying scalense.
   22-May-2012  Phil Hodge	Change the declaration of imgname.
+
+  Hits are found in parallel, see hstcal_crrej.h: the detection and spill
+  tests of all pixels are computed first, independently, then the hits
+  are resolved and the pixels near them marked. The result is the same as
+  that of scanning the image for hits one pixel at a time.
 */
 
 int crrej_loop (IODescPtr ipsci[], IODescPtr ipdq[], 
@@ -38,9 +44,8 @@ int crrej_loop (IODescPtr ipsci[], IODescPtr ipdq[],
 	Hdr	dqhdr;			/* data quality header structure */
 	int	width;
 	int	npts;
-	int	i, j, k, n, indx, jndx;		/* loop indices */
+	int	i, j, k, n, indx;		/* loop indices */
 	int	iter;
-	int	ii, jj, j2;
 	float	rog2, sig2, psig2, rej2, exp2;	/* square of something */
 	float	scale, val, dum, pixsky;
 	short	sval, crflag, nocr, dqpat;
@@ -59,6 +64,8 @@ int crrej_loop (IODescPtr ipsci[], IODescPtr ipdq[],
 	short	*mask;
 	float	*buf;
 	short	*bufdq;
+	unsigned short	*flags;		/* hit & spill flags */
+	CRNeighbourhood	nb;
 
 /* -------------------------------- begin ---------------------------------- */
 
@@ -80,9 +87,10 @@ int crrej_loop (IODescPtr ipsci[], IODescPtr ipdq[],
 	mask = calloc (npts, sizeof(short));
 	buf = calloc (dim_x, sizeof(float));
 	bufdq = calloc (dim_x, sizeof(short));
+	flags = calloc (npts, sizeof(unsigned short));
 	if (pic == NULL || thresh == NULL || spthresh == NULL ||
 	    sum == NULL || sumvar == NULL ||
-	    mask == NULL || buf == NULL || bufdq == NULL) {
+	    mask == NULL || buf == NULL || bufdq == NULL || flags == NULL) {
 	    trlerror("out of memory in crrej_loop");
 	    return (2);
 	}
@@ -94,6 +102,10 @@ int crrej_loop (IODescPtr ipsci[], IODescPtr ipdq[],
 	    psig2 = -1.;
 
 	width = (int) (par->rej+1.e-5);
+	if (allocCRNeighbourhood (&nb, width, rej2)) {
+	    trlerror("out of memory in crrej_loop");
+	    return (2);
+	}
 
 	/* reset the (ouput) DQF */
 	/* set to crflag so it is easier to do the logical AND and OR later */
@@ -145,6 +157,9 @@ int crrej_loop (IODescPtr ipsci[], IODescPtr ipdq[],
 
                 /* calculate the threshold for each pixel */
 	        if (strncmp(par->initial, "minimum", 3) == 0 && iter == 0) {
+# ifdef _OPENMP
+		    #pragma omp parallel for private(i, indx)
+# endif
 		    for (j = 0; j < dim_y; ++j) {
                         indx = j*dim_x;
 			for (i = 0; i < dim_x; ++i) {
@@ -153,6 +168,9 @@ int crrej_loop (IODescPtr ipsci[], IODescPtr ipdq[],
 			}
                     }
 	        } else {
+# ifdef _OPENMP
+		    #pragma omp parallel for private(i, indx, dum, val, pixsky)
+# endif
 		    for (j = 0; j < dim_y; ++j) {
                         indx = j*dim_x;
 			for (i = 0; i < dim_x; ++i) {
@@ -193,43 +211,59 @@ int crrej_loop (IODescPtr ipsci[], IODescPtr ipdq[],
 
 		freeHdr (&dqhdr);
 
+		/* find the CR by using statistical rejection: a pixel above
+		   threshold is a HIT unless EXCLUDEd, pixels above the spill
+		   threshold become SPILL when within rej of a HIT, and an
+		   EXCLUDEd pixel above threshold becomes a HIT if spilled onto
+		   by a HIT before it in the image */
+# ifdef _OPENMP
+		#pragma omp parallel for private(i, indx, dum)
+# endif
 		for (j = 0; j < dim_y; ++j) {
 		    indx = j*dim_x;
 		    for (i = 0; i < dim_x; ++i) {
-
-			/* find the CR by using statistical rejection */
-			if (SQ(pic[indx+i]-PPix(ave,i,j)) > 
-				thresh[indx+i] && mask[indx+i] != EXCLUDE) {
-			    mask[indx+i] = HIT;
-
-			    /* mark the surrounding pixels also as CR */
-			    for (jj = j-width; jj <= j+width; ++jj) {
-				if (jj >= dim_y || jj < 0) continue;
-				j2 = (jj-j) * (jj-j);
-				jndx = jj*dim_x;
-				for (ii = i-width; ii <= i+width; ++ii) {
-				    if ((float)((ii-i)*(ii-i)+j2) > rej2) 
-					continue;
-				    if (ii >= dim_x || ii < 0) continue;
-
-				    if (SQ(pic[jndx+ii]-PPix(ave,ii,jj)) <=
-					    psig2*spthresh[jndx+ii]) continue;
-				    if (mask[jndx+ii] != HIT)
-					mask[jndx+ii] = SPILL;
-				}
-			    }
+			dum = SQ(pic[indx+i]-PPix(ave,i,j));
+			flags[indx+i] = 0;
+			if (dum <= psig2*spthresh[indx+i]) {
+			    if (dum > thresh[indx+i] &&
+				mask[indx+i] != EXCLUDE)
+				flags[indx+i] = CRREJ_HIT;
+			} else {
+			    if (dum > thresh[indx+i])
+				flags[indx+i] = (mask[indx+i] != EXCLUDE) ?
+				    CRREJ_HIT : (CRREJ_PENDING |
+				    CRREJ_UNLOCK_PRIOR | CRREJ_UNLOCK_LEFT);
+			    /* above the spill threshold */
+			    flags[indx+i] |= CRREJ_USER;
 			}
+		    }
+		}
 
-/* for debugging */
-/*
-if (i==676 && j==642) {
-if (n==0)trlerror("At pixel (%d,%d) ave=%0.3g sigma=%0.3g", i+1, j+1, PPix(ave,i,j), sqrt(thresh[indx+i]/sig2));trlmessage("file=%d scaled DN/sec=%0.3g mask = %d", n, pic[indx+i], mask[indx+i]);
-}
-*/
+		if (resolveCRHits (flags, dim_x, dim_y, &nb) ||
+		    markCRNeighbours (flags, dim_x, dim_y, &nb)) {
+		    trlerror("out of memory in crrej_loop");
+		    return (2);
+		}
+
+		/* mark the surrounding pixels also as CR */
+# ifdef _OPENMP
+		#pragma omp parallel for private(i, indx)
+# endif
+		for (j = 0; j < dim_y; ++j) {
+		    indx = j*dim_x;
+		    for (i = 0; i < dim_x; ++i) {
+			if (flags[indx+i] & CRREJ_HIT)
+			    mask[indx+i] = HIT;
+			else if ((flags[indx+i] & CRREJ_USER) &&
+				 (flags[indx+i] & CRREJ_NEAR_ANY))
+			    mask[indx+i] = SPILL;
 		    }
 		}
 
 		/* accumulate the total counts in each pixel */
+# ifdef _OPENMP
+		#pragma omp parallel for private(i, indx, dum, val)
+# endif
 		for (j = 0; j < dim_y; ++j) {
 		    indx = j*dim_x;
 		    for (i = 0; i < dim_x; ++i) {
@@ -301,6 +335,9 @@ if (n==0)trlerror("At pixel (%d,%d) ave=%0.3g sigma=%0.3g", i+1, j+1, PPix(ave,i
 	    }
 
 	    /* calculate the new average after the rejection */
+# ifdef _OPENMP
+	    #pragma omp parallel for private(i, indx)
+# endif
 	    for (j = 0; j < dim_y; ++j) {
 		indx = j*dim_x;
 		for (i = 0; i < dim_x; ++i) {
@@ -337,6 +374,8 @@ if (n==0)trlerror("At pixel (%d,%d) ave=%0.3g sigma=%0.3g", i+1, j+1, PPix(ave,i
 	free (mask);
 	free (buf);
 	free (bufdq);
+	free (flags);
+	freeCRNeighbourhood (&nb);
 
 	return (0);
 }
@@ -16,6 +16,7 @@ int newpar;		o: parameter been set by the user?
 	par->tbname[0] = '\0';
 	par->verbose = 0;
 	par->printtime = 0;
+	par->membudget = MEMBUDGET;
 
 	newpar[TOTAL] = 0;
 	newpar[SCALENSE] = 0;
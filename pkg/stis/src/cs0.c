@@ -268,6 +268,7 @@ int main (int argc, char **argv) {
 	    }
 	}
 
+	clearDQICache ();
     freeOnExit(&ptrReg);
 
 	if (status)
@@ -331,6 +331,7 @@ int main (int argc, char **argv) {
 	    }
 	}
 
+	clearDQICache ();
     freeOnExit(&ptrReg);
 
 	if (status)
@@ -22,6 +22,10 @@ static int getArgT (char **, int, int *, char *);
    20 Oct 97  -  Adapted from cs6 commline.c (JC Hsu)
    06 Jul 11  -  Add command-line option --version (Phil Hodge)
    10 Feb 12  -  Add command-line option -r (Phil Hodge)
+
+   --memory-budget MB limits the memory of the working arrays, which are
+   of the size of the output image. As for acsrej and wf3rej the budget
+   must be greater than 0.
 */
 
 int cs2_command (int argc, char **argv, char *input, char *output,
@@ -60,7 +64,7 @@ int newpar;		o: parameter been set by the user?
 
 	/* not enough arguments */
 	if (argc < 3)
-	    return (syntax_error ("cs2 input output"));
+	    return (syntax_error ("cs2 input output [-t] [-v] [-crmask yes|no] [-table name] [-scale #] [-init name] [-sky name] [-sigmas list] [-radius #] [-thresh #] [-pdq #] [--memory-budget MB]"));
 
 	/* Get names of input and output files. These are mandatory. */
 	strcpy (input,  argv[1]);
@@ -148,6 +152,15 @@ int newpar;		o: parameter been set by the user?
 	                if (getArgS (argv, argc, &ctoken, &par->badbits))
 	                    return (1);
 
+	            } else if (strcmp("-memory-budget", argv[ctoken]+1) == 0) {
+	                if (getArgR (argv, argc, &ctoken, &par->membudget))
+	                    return (1);
+			if (par->membudget <= 0.) {
+			    printf("ERROR  Invalid memory budget: %g MB\n",
+				par->membudget);
+			    return (1);
+			}
+
 	            /* No match. */
 	            } else
 	                return (syntax_error (argv[ctoken]));
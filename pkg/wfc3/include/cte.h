@@ -8,6 +8,7 @@
 #include "hstio.h"
 #include "wf3.h"
 #include "wf3info.h"
+#include "hstcal_robuststats.h"
 /* structure to hold CTE parameters from the reference files */
 typedef struct {
     double scale512[RAZ_COLS]; /*scaling appropriate at row 512 */
@@ -49,7 +50,6 @@ void WF3Init (WF3Info *);
 int MkName (char *, char *, char *, char *, char *, int);
 int GetKeys (WF3Info *, Hdr *);
 int GetSwitch (Hdr *, char *, int *);
-int resistmean(float *, int, float, float *,float *,float *,float *);
 int  FileExists (char *);
 void PrRefInfo (char *, char *,char *, char *, char *);
 void PrSwitch (char *, int );
@@ -5,13 +5,6 @@
 #include "wf3info.h"
 
 /*USEFUL LIB FUNCTIONS*/
-static void AtoDMsg (WF3Info *, int);
-static void BiasMsg (WF3Info *, int);
-static void SatMsg (WF3Info *, int);
-static void FlashMsg (WF3Info *, int);
-static void BlevMsg (WF3Info *, int);
-static void dqiMsg  (WF3Info *, int);
-
 int checkBinned (SingleGroup *);
 int GetCorner (Hdr *, int , int *, int *);
 int doAtoD (WF3Info *, SingleGroup *);
@@ -26,6 +19,7 @@ int blevHistory (WF3Info *, Hdr *, int, int);
 int CCDHistory (WF3Info *, Hdr *);
 int doDQI (WF3Info *, SingleGroup *, int overscan);
 int dqiHistory (WF3Info *, Hdr *);
+void clearDQICache (void);
 int doNoise (WF3Info *, SingleGroup *, int *);
 int noiseHistory (Hdr *);
 int GetGrp (WF3Info *, Hdr *);
@@ -40,6 +34,8 @@ int FindOverscan (WF3Info *, int, int, int *);
 int GetCCDTab (WF3Info *, int, int);
 int GetKeyBool (Hdr *, char *, int, Bool, Bool *);
 int SinkDetect (WF3Info *, SingleGroup *);
+int makeSinkCatalog (char *, int, FloatTwoDArray *);
+void clearSinkCatalogs (void);
 int FindLine (SingleGroup *, SingleGroupLine *, int *, int *,int *,int *, int *);
 
 int Full2Sub(WF3Info *, SingleGroup *, SingleGroup *, int, int, int);
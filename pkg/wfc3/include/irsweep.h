@@ -0,0 +1,53 @@
+#ifndef INCL_IRSWEEP_H
+#define INCL_IRSWEEP_H
+
+# include "hstio.h"
+# include "wf3info.h"
+
+/* The per-pixel work of ZOFFCORR, NOISCORR, NLINCORR, DARKCORR and
+** UNITCORR is done in a single sweep through each MULTIACCUM read, one
+** image row at a time, so that the SCI, ERR, DQ and TIME arrays of a read
+** are brought through the cache once instead of once per step. Each pixel
+** still goes through the steps in pipeline order.
+**
+** What the steps report to the trailer is saved in an IRSweep, group by
+** group, and printed afterwards by doZoffIR, doNoisIR, doNlinIR, doDarkIR
+** and doUnitIR, which also update the step switches, so that the trailer
+** reads as when the steps were run one after the other.
+*/
+
+typedef struct {
+    int zoffcorr;               /* steps done by the sweep */
+    int noiscorr;
+    int nlincorr;
+    int darkcorr;
+    int unitcorr;
+    int noisskip;               /* ERR already populated in this group */
+    int nsatpix[MAX_MAREADS];   /* NLINCORR saturated pixels, per group */
+    DarkTypes darktype[MAX_MAREADS];  /* DARKCORR ref frames, per group */
+    int darkframe1[MAX_MAREADS];
+    int darkframe2[MAX_MAREADS];
+    int unitskip[MAX_MAREADS];  /* group already in countrates */
+} IRSweep;
+
+int doSweepIR (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *zoff,
+               SingleNicmosGroup *zsig, IRSweep *);
+
+/* Per-group set up and row kernels of the steps; the kernels work on row j
+** of a group and leave the reference pixels alone, except for zoffRow and
+** satcheckRow, which do the whole row. */
+int  zoffTime (WF3Info *, SingleNicmosGroup *zoff, double *ztime);
+void zoffRow (SingleNicmosGroup *, SingleNicmosGroup *zoff, int j);
+int  errPopulated (WF3Info *, SingleNicmosGroup *);
+void noisRow (WF3Info *, SingleNicmosGroup *, int j);
+int  nlinCorner (WF3Info *, SingleNicmosGroup *, NlinData *,
+                 int *li_beg, int *lj_beg);
+int  nlinRow (WF3Info *, SingleNicmosGroup *, NlinData *,
+              SingleNicmosGroup *zsig, int j, int li_beg, int lj_beg);
+void satcheckRow (SingleNicmosGroup *, SingleNicmosGroup *, int j);
+void darkRow (WF3Info *, SingleNicmosGroup *, DarkData *, int j);
+int  darkMean (WF3Info *, SingleNicmosGroup *, DarkData *);
+void unitRow (WF3Info *, SingleNicmosGroup *, int j);
+int  unitKeys (WF3Info *, SingleNicmosGroup *);
+
+#endif /* INCL_IRSWEEP_H */
@@ -0,0 +1,33 @@
+#ifndef INCL_RAMPCUBE_H
+#define INCL_RAMPCUBE_H
+
+# include "hstio.h"
+
+/* A ramp cube holds the MULTIACCUM samples of a run of pixels of one
+** image row in pixel-major order: the nsamp samples of a pixel are
+** consecutive, starting with the zeroth read (the last group of the
+** stack), so that fitting up the ramp walks memory sequentially instead
+** of visiting one page of every group per sample.
+**
+** Sample s of pixel p of the run is at index p*nsamp + s of each array.
+*/
+
+typedef struct {
+    int nsamp;          /* samples per pixel */
+    int npix;           /* pixels in the run */
+    float *sci;         /* counts */
+    float *err;
+    short *dq;          /* DQ, with ZEROSIG removed */
+    float *time;        /* integration time of the sample */
+} RampCube;
+
+void initRampCube (RampCube *);
+int allocRampCube (RampCube *, int nsamp, int npix);
+void freeRampCube (RampCube *);
+
+/* Load pixels x0 to x0+npix-1 of row j of the stack. Countrates are
+** converted to counts when countrate is set. */
+void loadRampCube (RampCube *, const MultiNicmosGroup *, int x0, int j,
+                   int countrate);
+
+#endif /* INCL_RAMPCUBE_H */
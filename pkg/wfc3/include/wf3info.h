@@ -105,6 +105,7 @@
 
 # define NAMPS  4    /* Maximum number of amps for a single readout */
 # define MAX_MAREADS	26	/* Max number of MultiAccum reads */
+# define NLIN_MAXCOEFF	10	/* Max number of nonlinearity coefficients */
 
 /* Dark image interpolation type */
 enum DarkTypes_ {MATCH, INTERP, EXTRAP};
@@ -283,5 +284,19 @@ typedef struct {
 	FloatHdrData *zerr;
 } NlinData;
 
+/* IR dark reference data: the dark of a read is made pixel by pixel from
+** one or two reference groups as it is needed, instead of being stored as
+** a whole image. The reference groups are held between reads, so that
+** neighbouring reads of a MultiAccum that use the same groups load them
+** only once. */
+typedef struct {
+	DarkTypes     type;	/* how the dark of the read is made */
+	float	      frac;	/* interpolation or extrapolation factor */
+	SingleNicmosGroup *d1;	/* reference groups used for the read */
+	SingleNicmosGroup *d2;
+	int	      extver[2];	/* reference groups held, 0 if none */
+	SingleNicmosGroup group[2];
+} DarkData;
+
 
 #endif /* INCL_WF3INFO_H */
@@ -17,6 +17,9 @@
 # define    CRMASK      8
 # define    MAX_PAR     8
 
+/* default memory budget (MB) for holding all inputs in memory */
+# define    MEMBUDGET   1024.
+
 /*  define the parameter structure */
 typedef struct {
     char    tbname[CHAR_FNAME_LENGTH+1];      /* Name of CCDTAB to be read */
@@ -37,6 +40,7 @@ typedef struct {
     int     shadcorr;
     int     printtime;
     int     verbose;
+    float   membudget;  /* in-core budget (MB) for the input stack, > 0 */
 } clpar;
 
 #endif /* INCL_WF3REJ_H */
@@ -5,6 +5,12 @@
 # include "hstio.h"
 # include "wf3.h"		/* for message output */
 # include "hstcalerr.h"		/* SIZE_MISMATCH */
+# include "hstcal_resample.h"
+
+static int binFloatData (FloatTwoDArray *, int, int, int, int, int,
+		ResampleKind, FloatTwoDArray *);
+static int binShortData (ShortTwoDArray *, int, int, int, int,
+		ShortTwoDArray *);
 
 /* This routine takes an input data array, extracts a subset, bins it
    by averaging within rectangular bins, and assigns the values to an
@@ -12,6 +18,9 @@
    SingleGroup (setting its size) and free it when done.
    The coordinate keywords in the output extension headers will be updated.
 
+   The lines of each output array are binned in parallel (see
+   hstcal_resample.h).
+
    Revision history:
 
    Howard Bushouse, 19 Mar 2002: Added the bin2d_ir routine (copy of bin2d)
@@ -35,22 +44,13 @@ SingleGroup *b        o: output data
 
 	double block[2];	/* number of input pixels for one output */
 	double offset[2];	/* offset of binned image */
-	float weight;		/* binx * biny (or sqrt for errors) */
-	float sum;		/* for summing data values */
-	float sum_err;		/* for summing error array */
-	short sum_dq;		/* for ORing data quality array */
 	int nx, ny;		/* size of output array */
-	int m, n;		/* pixel index in output array */
-	int i, j;		/* pixel index in input array */
-	int i0, j0;		/* starting location of (m,n) in input */
 
 	int BinCoords (Hdr *, double *, double *, Hdr *, Hdr *, Hdr *);
 
 	nx = b->sci.data.nx;
 	ny = b->sci.data.ny;
 
-	weight = binx * biny;
-
 	block[0] = binx;
 	block[1] = biny;
 	offset[0] = xcorner;
@@ -73,81 +73,15 @@ SingleGroup *b        o: output data
 	    return (status = SIZE_MISMATCH);
 	}
 
-	if (binx == 1 && biny == 1) {
-
-	    for (n = 0, j = ycorner;  n < ny;  n++, j++)
-		for (m = 0, i = xcorner;  m < nx;  m++, i++)
-		    Pix (b->sci.data, m, n) = Pix (a->sci.data, i, j);
-
-	    /* Extract the error array. */
-	    for (n = 0, j = ycorner;  n < ny;  n++, j++)
-		for (m = 0, i = xcorner;  m < nx;  m++, i++)
-		    Pix (b->err.data, m, n) = Pix (a->err.data, i, j);
-
-	    /* Extract the data quality array. */
-	    for (n = 0, j = ycorner;  n < ny;  n++, j++)
-		for (m = 0, i = xcorner;  m < nx;  m++, i++)
-		    DQSetPix (b->dq.data, m, n, DQPix(a->dq.data,i,j));
-
-	} else {
-
-	    /* Average the science data array. */
-
-	    j0 = ycorner;				/* zero indexed */
-	    /* for each line of output ... */
-	    for (n = 0;  n < ny;  n++) {
-		i0 = xcorner;				/* zero indexed */
-		/* for each sample in current output line ... */
-		for (m = 0;  m < nx;  m++) {
-		    /* loop over each pixel in input for current output pixel */
-		    sum = 0.;
-		    for (j = j0;  j < j0+biny;  j++)
-			for (i = i0;  i < i0+binx;  i++)
-			    sum += Pix (a->sci.data, i, j);
-		    if (avg)
-			Pix (b->sci.data, m, n) = sum / weight;
-		    else
-			Pix (b->sci.data, m, n) = sum;
-		    i0 += binx;
-		}
-		j0 += biny;
-	    }
-
-	    /* Average the error array (square root of sum of squares). */
-
-	    j0 = ycorner;
-	    for (n = 0;  n < ny;  n++) {
-		i0 = xcorner;
-		for (m = 0;  m < nx;  m++) {
-		    sum_err = 0.;
-		    for (j = j0;  j < j0+biny;  j++)
-			for (i = i0;  i < i0+binx;  i++)
-			    sum_err += Pix (a->err.data, i, j) * 
-				       Pix (a->err.data, i, j);
-		    if (avg)
-			Pix (b->err.data, m, n) = sqrt (sum_err) / weight;
-		    else
-			Pix (b->err.data, m, n) = sqrt (sum_err);
-		    i0 += binx;
-		}
-		j0 += biny;
-	    }
-
-	    /* Bitwise OR the data quality array. */
-	    j0 = ycorner;
-	    for (n = 0;  n < ny;  n++) {
-		i0 = xcorner;
-		for (m = 0;  m < nx;  m++) {
-		    sum_dq = 0;				/* zero is OK */
-		    for (j = j0;  j < j0+biny;  j++)
-			for (i = i0;  i < i0+binx;  i++)
-			    sum_dq |= DQPix (a->dq.data, i, j);
-		    DQSetPix (b->dq.data, m, n, sum_dq);
-		    i0 += binx;
-		}
-		j0 += biny;
-	    }
-	}
+	/* Extract (and bin) the science data, error and data quality
+	** arrays. */
+	if (binFloatData (&a->sci.data, xcorner, ycorner, binx, biny, avg,
+			  RESAMPLE_VALUE, &b->sci.data) ||
+	    binFloatData (&a->err.data, xcorner, ycorner, binx, biny, avg,
+			  RESAMPLE_ERROR, &b->err.data) ||
+	    binShortData (&a->dq.data, xcorner, ycorner, binx, biny,
+			  &b->dq.data))
+	    return (status = OUT_OF_MEMORY);
 
 	/* Copy the headers. */
 	copyHdr (b->globalhdr, a->globalhdr);
@@ -188,12 +122,8 @@ SingleGroup *b        o: output data
 
 	double block[2];	/* number of input pixels for one output */
 	double offset[2];	/* offset of binned image */
-	float weight;		/* binx * biny (or sqrt for errors) */
-	float sum;		/* for summing data values */
-	float sum_err;		/* for summing error array */
-	short sum_dq;		/* for ORing data quality array */
+	float weight;		/* binx * biny */
 	short sum_smpl;		/* for summing samples array */
-	float sum_intg;		/* for summing time array */
 	int nx, ny;		/* size of output array */
 	int m, n;		/* pixel index in output array */
 	int i, j;		/* pixel index in input array */
@@ -229,91 +159,27 @@ SingleGroup *b        o: output data
 	    return (status = SIZE_MISMATCH);
 	}
 
-	if (binx == 1 && biny == 1) {
+	/* Extract (and bin) the science data, error, data quality and time
+	** arrays. */
+	if (binFloatData (&a->sci.data, xcorner, ycorner, binx, biny, avg,
+			  RESAMPLE_VALUE, &b->sci.data) ||
+	    binFloatData (&a->err.data, xcorner, ycorner, binx, biny, avg,
+			  RESAMPLE_ERROR, &b->err.data) ||
+	    binShortData (&a->dq.data, xcorner, ycorner, binx, biny,
+			  &b->dq.data) ||
+	    binFloatData (&a->intg.data, xcorner, ycorner, binx, biny, avg,
+			  RESAMPLE_VALUE, &b->intg.data))
+	    return (status = OUT_OF_MEMORY);
 
-	    for (n = 0, j = ycorner;  n < ny;  n++, j++)
-		for (m = 0, i = xcorner;  m < nx;  m++, i++)
-		    Pix (b->sci.data, m, n) = Pix (a->sci.data, i, j);
-
-	    /* Extract the error array. */
-	    for (n = 0, j = ycorner;  n < ny;  n++, j++)
-		for (m = 0, i = xcorner;  m < nx;  m++, i++)
-		    Pix (b->err.data, m, n) = Pix (a->err.data, i, j);
-
-	    /* Extract the data quality array. */
-	    for (n = 0, j = ycorner;  n < ny;  n++, j++)
-		for (m = 0, i = xcorner;  m < nx;  m++, i++)
-		    DQSetPix (b->dq.data, m, n, DQPix(a->dq.data,i,j));
+	if (binx == 1 && biny == 1) {
 
 	    /* Extract the samples array. */
 	    for (n = 0, j = ycorner;  n < ny;  n++, j++)
 		for (m = 0, i = xcorner;  m < nx;  m++, i++)
 		    Pix (b->smpl.data, m, n) = Pix (a->smpl.data, i, j);
 
-	    /* Extract the time array. */
-	    for (n = 0, j = ycorner;  n < ny;  n++, j++)
-		for (m = 0, i = xcorner;  m < nx;  m++, i++)
-		    Pix (b->intg.data, m, n) = Pix (a->intg.data, i, j);
-
 	} else {
 
-	    /* Average the science data array. */
-
-	    j0 = ycorner;				/* zero indexed */
-	    /* for each line of output ... */
-	    for (n = 0;  n < ny;  n++) {
-		i0 = xcorner;				/* zero indexed */
-		/* for each sample in current output line ... */
-		for (m = 0;  m < nx;  m++) {
-		    /* loop over each pixel in input for current output pixel */
-		    sum = 0.;
-		    for (j = j0;  j < j0+biny;  j++)
-			for (i = i0;  i < i0+binx;  i++)
-			    sum += Pix (a->sci.data, i, j);
-		    if (avg)
-			Pix (b->sci.data, m, n) = sum / weight;
-		    else
-			Pix (b->sci.data, m, n) = sum;
-		    i0 += binx;
-		}
-		j0 += biny;
-	    }
-
-	    /* Average the error array (square root of sum of squares). */
-
-	    j0 = ycorner;
-	    for (n = 0;  n < ny;  n++) {
-		i0 = xcorner;
-		for (m = 0;  m < nx;  m++) {
-		    sum_err = 0.;
-		    for (j = j0;  j < j0+biny;  j++)
-			for (i = i0;  i < i0+binx;  i++)
-			    sum_err += Pix (a->err.data, i, j) * 
-				       Pix (a->err.data, i, j);
-		    if (avg)
-			Pix (b->err.data, m, n) = sqrt (sum_err) / weight;
-		    else
-			Pix (b->err.data, m, n) = sqrt (sum_err);
-		    i0 += binx;
-		}
-		j0 += biny;
-	    }
-
-	    /* Bitwise OR the data quality array. */
-	    j0 = ycorner;
-	    for (n = 0;  n < ny;  n++) {
-		i0 = xcorner;
-		for (m = 0;  m < nx;  m++) {
-		    sum_dq = 0;				/* zero is OK */
-		    for (j = j0;  j < j0+biny;  j++)
-			for (i = i0;  i < i0+binx;  i++)
-			    sum_dq |= DQPix (a->dq.data, i, j);
-		    DQSetPix (b->dq.data, m, n, sum_dq);
-		    i0 += binx;
-		}
-		j0 += biny;
-	    }
-
 	    /* Average the samples data array. */
 
 	    j0 = ycorner;				/* zero indexed */
@@ -332,26 +198,6 @@ SingleGroup *b        o: output data
 		}
 		j0 += biny;
 	    }
-
-	    /* Average the time data array. */
-
-	    j0 = ycorner;				/* zero indexed */
-	    for (n = 0;  n < ny;  n++) {
-		i0 = xcorner;				/* zero indexed */
-		for (m = 0;  m < nx;  m++) {
-		    sum_intg = 0.;
-		    for (j = j0;  j < j0+biny;  j++)
-			for (i = i0;  i < i0+binx;  i++)
-			    sum_intg += Pix (a->intg.data, i, j);
-		    if (avg)
-			Pix (b->intg.data, m, n) = sum_intg / weight;
-		    else
-			Pix (b->intg.data, m, n) = sum_intg;
-		    i0 += binx;
-		}
-		j0 += biny;
-	    }
-
 	}
 
 	/* Copy the headers. */
@@ -382,3 +228,47 @@ SingleGroup *b        o: output data
 	return (status);
 }
 
+/* These routines extract the subset of one array of an imset starting at
+   (xcorner,ycorner), binned by binx and biny, into another.
+*/
+
+static int binFloatData (FloatTwoDArray *a, int xcorner, int ycorner,
+		int binx, int biny, int avg, ResampleKind kind,
+		FloatTwoDArray *b) {
+
+	float **in, **out;	/* lines of a, from ycorner, and of b */
+	int ok;
+
+	in = floatRows (&PPix (a, xcorner, ycorner), a->tot_nx, b->ny * biny);
+	out = floatRows (b->data, b->tot_nx, b->ny);
+	ok = (in != NULL && out != NULL);
+	if (ok)
+	    binFloat (in, out, b->nx, b->ny, binx, biny, avg, kind);
+	free (in);
+	free (out);
+	if (!ok) {
+	    trlerror("(bin2d) Out of memory.");
+	    return (OUT_OF_MEMORY);
+	}
+	return (0);
+}
+
+static int binShortData (ShortTwoDArray *a, int xcorner, int ycorner,
+		int binx, int biny, ShortTwoDArray *b) {
+
+	short **in, **out;	/* lines of a, from ycorner, and of b */
+	int ok;
+
+	in = shortRows (&PDQPix (a, xcorner, ycorner), a->tot_nx, b->ny * biny);
+	out = shortRows (b->data, b->tot_nx, b->ny);
+	ok = (in != NULL && out != NULL);
+	if (ok)
+	    binShort (in, out, b->nx, b->ny, binx, biny);
+	free (in);
+	free (out);
+	if (!ok) {
+	    trlerror("(bin2d) Out of memory.");
+	    return (OUT_OF_MEMORY);
+	}
+	return (0);
+}
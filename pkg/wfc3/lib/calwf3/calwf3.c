@@ -11,9 +11,14 @@
 # include "wf3corr.h"
 # include "wf3asn.h"	/* Contains association table structures */
 #include "wf3info.h"
+#include "hstcal_dqmask.h"
+#include "hstcal_flatfield.h"
+#include "doccd.h"
 
 # define NOPOSID 0
 
+static void FreeStepCaches (void);
+
 
 /* calwf3 -- integrated calwf3 processing
 
@@ -209,6 +214,7 @@ int CalWf3Run (char *input, int printtime, int save_tmp, int verbose, int debug,
 			trlmessage("CALWF3: processing a UVIS product");
 		}
 		if (ProcessCCD (&asn, &wf3hdr, &save_tmp, printtime, onecpu)) {
+			FreeStepCaches ();
 			if (status == NOTHING_TO_DO) {
 				trlwarn("No processing desired for CCD data.");
 			} else {
@@ -216,6 +222,7 @@ int CalWf3Run (char *input, int printtime, int save_tmp, int verbose, int debug,
 			}
 			return (status);
 		}
+		FreeStepCaches ();
 
 	} else { /* Process IR observations here */
 		if (asn.verbose) {
@@ -353,6 +360,17 @@ int CalWf3Run (char *input, int printtime, int save_tmp, int verbose, int debug,
 
 }
 
+/* FREESTEPCACHES: Free the reference data that the calibration steps
+** keep from one exposure to the next, once the last exposure is done. */
+
+static void FreeStepCaches (void) {
+
+	clearSinkCatalogs ();
+	clearDQICache ();
+	clearDQMaskCache ();
+	clearFlatFieldCache ();
+}
+
 char* BuildDthInput (AsnInfo *asn, int prod, char *suffix_name) {
 
 	int i, j;
@@ -1,50 +1,46 @@
 /* This file contains:
 	doDQI
-	OpenBpixTab
-	ReadBpixTab
-	CloseBpixTab
-	DQINormal
+	GetBpixMask
+	SelectBpixRow
+	clearDQICache
+	ToWF3RawCoords
 	FirstLast
 */
 
 # include <stdio.h>
+# include <stdlib.h>
 # include <string.h>
 
 #include "hstcal.h"
-# include "xtables.h"
 # include "hstio.h"
 # include "wf3.h"
 # include "wf3info.h"
 # include "hstcalerr.h"
 # include "wf3dq.h"
+# include "hstcal_dqmask.h"
 
 # define MIN(a,b) (a < b ? a : b)
 
-typedef struct {
-    IRAFPointer tp;			/* pointer to table descriptor */
-    IRAFPointer cp_xstart, cp_ystart; /* starting pixel for bad values */
-    IRAFPointer cp_length;		/* this many bad values */
-    IRAFPointer cp_axis;		/* repeat along X or Y axis (1 or 2) */
-    IRAFPointer cp_flag;		/* this is the data quality value */
-    IRAFPointer cp_amp;		/* selection columns */
-    IRAFPointer cp_ccdchip;
-    IRAFPointer cp_ccdgain;
-    int axlen1, axlen2;		/* DQ array size specified in header */
-    int nrows;			/* number of rows in table */
-} TblInfo;
+/* The rows of the last BPIXTAB read, so that the table is read once
+   for both chips and for every readout of an IR exposure.
+*/
+static BpixTable bpixtab = {NULL, 0, 0, False, False, False, 0, NULL};
+
+static const BpixFormat bpixformat = {
+    "CCDAMP", SZ_CBUF, NULL,	/* optional amp column */
+    True,			/* CCDCHIP */
+    True,			/* optional CCDGAIN */
+    True,			/* SIZAXIS1, SIZAXIS2 */
+    False			/* an empty table has nothing to check */
+};
 
+/* What the rows of a mask are selected and adjusted for. */
 typedef struct {
-    /* values read from a table row */
-    int xstart, ystart;
-    int length;
-    int axis;
-    short flag;
-    /* values used for selecting row to be used */
-    char ccdamp[SZ_CBUF+1];
-    float ccdgain;
-    int ccdchip;
-} TblRow;
+    WF3Info *wf3;
+    double *ltm;
+} BpixSelection;
 
+static Bool SelectBpixRow (const BpixTable *, BpixRow *, const void *);
 static void FirstLast (double *, double *, int *, int *, int *, int *,
                        int *, int *);
 
@@ -153,8 +149,7 @@ int doDQI (WF3Info *wf3, SingleGroup *x, int overscan) {
 
     extern int status;
 
-    TblInfo tabinfo;	/* pointer to table descriptor, etc */
-    TblRow tabrow;		/* values read from a table row */
+    DQMask *mask;		/* selected BPIXTAB rows */
 
     DQHdrData ydq;		/* scratch space */
 
@@ -193,23 +188,11 @@ int doDQI (WF3Info *wf3, SingleGroup *x, int overscan) {
     short sum_dq;		/* for binning data quality array */
     float sat;			/* saturation threshold */
 
-    int row;		/* loop index for row number */
     int dimx, dimy;
-    int nrows;		/* number of rows applied to DQ array */
-    int sameamp, samegain, samechip;
 
     int GetLT0 (Hdr *, double *, double *);
-    int SameInt (int, int);
-    int SameFlt (float, float);
-    int SameString (char *, char *);
-
-    int OpenBpixTab (char *, TblInfo *);
-    int ReadBpixTab (TblInfo *, int, TblRow *);
-    int CloseBpixTab (TblInfo *);
-
-    void DQINormal (DQHdrData *, double *, TblRow *);
-    void ToWF3RawCoords (WF3Info *, double *, TblRow *);
     void ComputeLimits(WF3Info *, int, int, int *, int *, int *, int *);
+    int GetBpixMask (WF3Info *, double *, DQMask **);
 
     /* Get the dimensions of the data image */
     dimx = x->sci.data.nx;
@@ -394,21 +377,36 @@ int doDQI (WF3Info *wf3, SingleGroup *x, int overscan) {
         si_v[1] = ri_v[1];
     }
 
-    /* Open the data quality initialization table, find columns, etc. */
-    if (OpenBpixTab (wf3->bpix.name, &tabinfo))
+    /* Get the BPIXTAB rows selected for this chip, amp, gain and
+    ** binning, read and rasterised once per selection. */
+    if (GetBpixMask (wf3, ri_m, &mask))
         return (status);
 
-    /* Size of scratch image */
-    snpix[0] = tabinfo.axlen1;
-    snpix[1] = tabinfo.axlen2;
+    /* Assign the flag values to all relevant pixels. */
+    if (in_place)
+        orDQMask (mask, &x->dq.data, ri_v);
 
-    /* Size of current image */
-    npix[0] = x->dq.data.nx;
-    npix[1] = x->dq.data.ny;
+    if (mask->nruns == 0) {
+        trlwarn("No rows from BPIXTAB applied to DQ array.");
+    }
 
-    /* Allocate space for scratch array */
-    initShortHdrData (&ydq);
-    if (!in_place) {
+    /* Set the flags in a scratch array, then copy them into the
+    ** binned DQ array */
+    if (!in_place && mask->nruns > 0) {
+
+        /* Size of scratch image, from the table the mask was made
+        ** from; a cached mask may outlive the rows of its table. */
+        if ((status = loadBpixTable (&bpixtab, wf3->bpix.name, &bpixformat)))
+            return (status);
+        snpix[0] = bpixtab.axlen1;
+        snpix[1] = bpixtab.axlen2;
+
+        /* Size of current image */
+        npix[0] = x->dq.data.nx;
+        npix[1] = x->dq.data.ny;
+
+        /* Allocate space for scratch array */
+        initShortHdrData (&ydq);
         allocShortHdrData (&ydq, snpix[0], snpix[1], True);
         if (hstio_err()) {
             trlerror("doDQI couldn't allocate data quality array.");
@@ -417,66 +415,8 @@ int doDQI (WF3Info *wf3, SingleGroup *x, int overscan) {
         for (j=0; j < snpix[1]; j++)
             for (i=0; i < snpix[0]; i++)
                 DQSetPix (ydq.data, i, j, 0);	/* initially OK */
-    }
-
-    /* Read each row of the table, and fill in data quality values. */
-    nrows = 0;
-    for (row = 1;  row <= tabinfo.nrows;  row++) {
-
-        if (ReadBpixTab (&tabinfo, row, &tabrow)) {
-            trlerror("Error reading BPIXTAB.");
-            return (status);
-        }
-
-        /* If CCDAMP column does not exist or it has a wildcard value,
-        ** always return a match. */
-        if (tabinfo.cp_amp == 0 || SameString(tabrow.ccdamp, "N/A")) {
-            sameamp = 1;
-        } else {
-            sameamp = SameString (tabrow.ccdamp, wf3->ccdamp);
-        }
 
-        /* If CCDGAIN column does not exist or it has a wildcard value,
-        ** always return a match. */
-        if (tabinfo.cp_ccdgain == 0 || tabrow.ccdgain == -999) {
-            samegain = 1;
-        } else {
-            samegain = SameFlt (tabrow.ccdgain, wf3->ccdgain);
-        }
-
-        /* If CCDCHIP column does not exist or it has a wildcard value,
-        ** always return a match. */
-        if (tabinfo.cp_ccdchip == 0 || tabrow.ccdchip == -999) {
-            samechip = 1;
-        } else {
-            samechip = SameInt (tabrow.ccdchip, wf3->chip);
-        }
-
-        /* Check for a match with selection criteria */
-        if (sameamp && samegain && samechip) {
-
-            /* Adjust BPIXTAB pixel coords for presence of serial
-               virtual overscan pixels in WFC3 raw images */
-            ToWF3RawCoords (wf3, ri_m, &tabrow);
-
-            /* Assign the flag value to all relevant pixels. */
-            if (in_place)
-                DQINormal (&x->dq, ri_v, &tabrow);
-            else
-                DQINormal (&ydq, rs_v, &tabrow);
-            nrows += 1;
-        }
-    }
-
-    if (CloseBpixTab (&tabinfo))		/* done with the table */
-        return (status);
-
-    if (nrows == 0) {
-        trlwarn("No rows from BPIXTAB applied to DQ array.");
-    }
-
-    /* Copy scratch contents into input DQ array */
-    if (!in_place) {
+        orDQMask (mask, &ydq.data, rs_v);
 
         /* Get corners of region of overlap between image
            and scratch array */
@@ -508,129 +448,109 @@ int doDQI (WF3Info *wf3, SingleGroup *x, int overscan) {
     return (status);
 }
 
-int OpenBpixTab (char *tname, TblInfo *tabinfo) {
+/* This routine gets the mask of the BPIXTAB rows that apply to the
+   chip, amp, gain and binning of the image, with the pixel coordinates
+   of UVIS images adjusted by ToWF3RawCoords.  Masks are cached by table
+   name and selection, so that the table rows are selected and rasterised
+   once.
+*/
+
+int GetBpixMask (WF3Info *wf3, double *ltm, DQMask **mask) {
+
+    /* arguments:
+    WF3Info *wf3         i: calibration switches, etc
+    double ltm[2]        i: scale factor of science data
+    DQMask **mask        o: mask of the selected rows
+    */
 
     extern int status;
 
-    tabinfo->tp = c_tbtopn (tname, IRAF_READ_ONLY, 0);
-    if (c_iraferr())
-        return (status = OPEN_FAILED);
+    char key[CHAR_LINE_LENGTH+1];	/* table name and selection */
+    BpixSelection selection;
 
-    tabinfo->nrows = c_tbpsta (tabinfo->tp, TBL_NROWS);
-    if (tabinfo->nrows < 1) {
-        return (status);			/* nothing to do */
-    }
+    /* The pixel coords depend on the amps, binning and trim through
+    ** ToWF3RawCoords. */
+    snprintf (key, sizeof(key), "%s|%d|%d|%s|%.9g|%d|%d|%d", wf3->bpix.name,
+              wf3->detector, wf3->chip, wf3->ccdamp, wf3->ccdgain,
+              NINT (1. / ltm[0]), wf3->ampx, wf3->trimx[2] + wf3->trimx[3]);
 
-    /* Find the columns. */
-    c_tbcfnd1 (tabinfo->tp, "CCDAMP", &tabinfo->cp_amp);
-    c_tbcfnd1 (tabinfo->tp, "CCDCHIP", &tabinfo->cp_ccdchip);
-    c_tbcfnd1 (tabinfo->tp, "CCDGAIN", &tabinfo->cp_ccdgain);
-    c_tbcfnd1 (tabinfo->tp, "PIX1", &tabinfo->cp_xstart);
-    c_tbcfnd1 (tabinfo->tp, "PIX2", &tabinfo->cp_ystart);
-    c_tbcfnd1 (tabinfo->tp, "LENGTH", &tabinfo->cp_length);
-    c_tbcfnd1 (tabinfo->tp, "AXIS", &tabinfo->cp_axis);
-    c_tbcfnd1 (tabinfo->tp, "VALUE", &tabinfo->cp_flag);
-    if (tabinfo->cp_xstart == 0 ||
-            tabinfo->cp_ystart == 0 ||
-            tabinfo->cp_length == 0 ||
-            tabinfo->cp_axis == 0 ||
-            tabinfo->cp_ccdchip == 0 ||
-            tabinfo->cp_flag == 0) {
-        c_tbtclo (tabinfo->tp);
-        trlerror("Column not found in BPIXTAB.");
-        return (status = COLUMN_NOT_FOUND);
-    }
+    if ((*mask = findDQMask (key)) != NULL)
+        return (status);
 
-    /* Find out how large a full-size data quality array should be. */
-    tabinfo->axlen1 = c_tbhgti (tabinfo->tp, "SIZAXIS1");
-    if (c_iraferr ()) {
-        c_tbtclo (tabinfo->tp);
-        trlerror("Couldn't get SIZAXIS1 from BPIXTAB header.");
-        return (status = TABLE_ERROR);
-    }
-    tabinfo->axlen2 = c_tbhgti (tabinfo->tp, "SIZAXIS2");
-    if (c_iraferr ()) {
-        c_tbtclo (tabinfo->tp);
-        trlerror("Couldn't get SIZAXIS2 from BPIXTAB header.");
-        return (status = TABLE_ERROR);
-    }
+    if ((status = loadBpixTable (&bpixtab, wf3->bpix.name, &bpixformat)))
+        return (status);
 
-    return (status);
+    selection.wf3 = wf3;
+    selection.ltm = ltm;
+    return (status = makeBpixMask (&bpixtab, key, SelectBpixRow, &selection,
+                                   mask));
 }
 
-
-/* This routine reads the relevant data from one row.  The starting
-   pixel location, number of pixels and axis, and the flag value are read.
-   The starting pixel (xstart, ystart) will be decremented by one to
-   convert to zero-indexing.
+/* This routine checks one BPIXTAB row against the chip, amp and gain
+   of the image, and adjusts its pixel coords for UVIS images.
 */
 
-int ReadBpixTab (TblInfo *tabinfo, int row, TblRow *tabrow) {
+static Bool SelectBpixRow (const BpixTable *bpix, BpixRow *tabrow,
+                           const void *selection) {
 
-    extern int status;
+    /* arguments:
+    BpixTable *bpix      i: the table the row is from
+    BpixRow *tabrow      io: a copy of the row
+    void *selection      i: the image, as a BpixSelection
+    */
 
-    /* read in values from selection columns */
-    /* If AMP column exists, read it, otherwise it is not necessary */
-    if (tabinfo->cp_amp != 0) {
-        c_tbegtt (tabinfo->tp, tabinfo->cp_amp, row, tabrow->ccdamp,
-                  SZ_CBUF);
-        if (c_iraferr())
-            return (status = TABLE_ERROR);
-    }
-    c_tbegti (tabinfo->tp, tabinfo->cp_ccdchip, row, &tabrow->ccdchip);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    /* If GAIN column exists, read it, otherwise it is not necessary */
-    if (tabinfo->cp_ccdgain != 0) {
-        c_tbegtr (tabinfo->tp, tabinfo->cp_ccdgain, row, &tabrow->ccdgain);
-        if (c_iraferr())
-            return (status = TABLE_ERROR);
+    const BpixSelection *sel = selection;
+    WF3Info *wf3 = sel->wf3;
+    int sameamp, samegain, samechip;
+
+    int SameInt (int, int);
+    int SameFlt (float, float);
+    int SameString (char *, char *);
+    void ToWF3RawCoords (WF3Info *, double *, BpixRow *);
+
+    /* If CCDAMP column does not exist or it has a wildcard value,
+    ** always return a match. */
+    if (!bpix->hasText || SameString(tabrow->text, "N/A")) {
+        sameamp = 1;
+    } else {
+        sameamp = SameString (tabrow->text, wf3->ccdamp);
     }
 
-    /* read in bad pixel value description columns */
-    c_tbegti (tabinfo->tp, tabinfo->cp_xstart, row, &tabrow->xstart);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    tabrow->xstart--;
-    c_tbegti (tabinfo->tp, tabinfo->cp_ystart, row, &tabrow->ystart);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    tabrow->ystart--;
-    c_tbegti (tabinfo->tp, tabinfo->cp_length, row, &tabrow->length);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    c_tbegti (tabinfo->tp, tabinfo->cp_axis, row, &tabrow->axis);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-    c_tbegts (tabinfo->tp, tabinfo->cp_flag, row, &tabrow->flag);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
-
-    if (tabrow->axis !=1 && tabrow->axis != 2) {
-        trlerror("Axis = %d in BPIXTAB, but it must be 1 or 2.", tabrow->axis);
-        c_tbtclo (tabinfo->tp);
-        return (status = TABLE_ERROR);
+    /* If CCDGAIN column does not exist or it has a wildcard value,
+    ** always return a match. */
+    if (!bpix->hasGain || tabrow->gain == -999) {
+        samegain = 1;
+    } else {
+        samegain = SameFlt (tabrow->gain, wf3->ccdgain);
     }
-    if (tabrow->length <= 0) {
-        trlerror("Length = %d in BPIXTAB, but it must be positive.", tabrow->length);
-        c_tbtclo (tabinfo->tp);
-        return (status = TABLE_ERROR);
+
+    /* If CCDCHIP column has a wildcard value, always return a match. */
+    if (tabrow->chip == -999) {
+        samechip = 1;
+    } else {
+        samechip = SameInt (tabrow->chip, wf3->chip);
     }
 
-    return (status);
-}
+    /* Check for a match with selection criteria */
+    if (!(sameamp && samegain && samechip))
+        return (False);
 
-/* This routine closes the bpixtab table. */
+    /* Adjust BPIXTAB pixel coords for presence of serial virtual
+       overscan pixels in WFC3 UVIS raw images */
+    if (wf3->detector != IR_DETECTOR)
+        ToWF3RawCoords (wf3, sel->ltm, tabrow);
 
-int CloseBpixTab (TblInfo *tabinfo) {
+    return (True);
+}
 
-    extern int status;
+/* This routine frees the rows of the last BPIXTAB read, once the last
+   exposure of a run has been processed.  The masks made from them are
+   freed by clearDQMaskCache.
+*/
 
-    c_tbtclo (tabinfo->tp);
-    if (c_iraferr())
-        return (status = TABLE_ERROR);
+void clearDQICache (void) {
 
-    return (status);
+    freeBpixTable (&bpixtab);
 }
 
 /* This routine adds an offset to the DQ pixel coords read from the
@@ -638,12 +558,12 @@ int CloseBpixTab (TblInfo *tabinfo) {
 ** in some modes of WFC3 raw images.
 */
 
-void ToWF3RawCoords (WF3Info *wf3, double *ltm, TblRow *tabrow) {
+void ToWF3RawCoords (WF3Info *wf3, double *ltm, BpixRow *tabrow) {
 
     /* arguments:
     WF3Info *wf3	     i: WFC3 calibration info
     double ltm[2]        i: scale factor of science data
-    TblRow *tabrow       io: data quality info read from one row of BPIXTAB
+    BpixRow *tabrow      io: data quality info read from one row of BPIXTAB
     */
 
     int rbin; 	/* binning factor */
@@ -664,89 +584,19 @@ void ToWF3RawCoords (WF3Info *wf3, double *ltm, TblRow *tabrow) {
         ** overscan columns. This applies to all pixels in the domain
         ** of the second readout amp for the chip (i.e. amp B for AB,
         ** and amp D for CD. */
-        if (tabrow->xstart >= wf3->ampx * rbin) {
+        if (tabrow->run.x >= wf3->ampx * rbin) {
 
             /* Add an offset equal to the number of virtual overscan
             ** columns that occur in the middle of an unbinned raw image.
             ** We get the number of colums from the trim information in
             ** the OSCNTAB reference table, multiplied back up to
             ** unbinned space. */
-            tabrow->xstart += (wf3->trimx[2] + wf3->trimx[3]) * rbin;
+            tabrow->run.x += (wf3->trimx[2] + wf3->trimx[3]) * rbin;
 
             /* Raw images with a binning factor of 2 use a smaller
             ** trim value, therefore we need to add an extra offset. */
             if (rbin == 2)
-                tabrow->xstart += 2;
-        }
-    }
-}
-
-/* This routine assigns data quality values as specified in one row of
-   the DQI table.  The current value is ORed with any previous value.
-*/
-
-void DQINormal (DQHdrData *ydq, double *ltv, TblRow *tabrow) {
-
-    /* arguments:
-    DQHdrData *ydq	    io: data quality array
-    double ltv[2]        i: offset of array within detector
-    TblRow *tabrow       i: data quality info read from one row
-    */
-
-    int xstart, ystart;	/* from tabrow, but scaled and shifted */
-    int xlow, xhigh;	/* limits for loop on i */
-    int ylow, yhigh;	/* limits for loop on j */
-    int i, j;		/* indexes for scratch array ydq */
-    short sum_dq;		/* for binning data quality array */
-
-    /* Take account of possible subarray or overscan.  We use ltv,
-       but we assume ltm = 1.
-    */
-    xstart = tabrow->xstart + ltv[0];
-    ystart = tabrow->ystart + ltv[1];
-
-    if (tabrow->axis == 1) {
-
-        /* The range for x is the repeat count. */
-        xlow = xstart;
-        xhigh = xstart + tabrow->length - 1;
-
-        /* out of range? */
-        if (xhigh < 0 || xlow >= ydq->data.nx ||
-                ystart < 0 || ystart >= ydq->data.ny)
-            return;
-
-        if (xlow < 0)
-            xlow = 0;
-        if (xhigh >= ydq->data.nx)
-            xhigh = ydq->data.nx - 1;
-
-        j = ystart;
-        for (i = xlow;  i <= xhigh;  i++) {
-            sum_dq = tabrow->flag | PDQPix (&ydq->data, i, j);
-            PDQSetPix (&ydq->data, i, j, sum_dq);
-        }
-
-    } else if (tabrow->axis == 2) {
-
-        /* The range for y is the repeat count. */
-        ylow = ystart;
-        yhigh = ystart + tabrow->length - 1;
-
-        /* out of range? */
-        if (xstart < 0 || xstart >= ydq->data.nx ||
-                yhigh < 0 || ylow >= ydq->data.ny)
-            return;
-
-        if (ylow < 0)
-            ylow = 0;
-        if (yhigh >= ydq->data.ny)
-            yhigh = ydq->data.ny - 1;
-
-        i = xstart;
-        for (j = ylow;  j <= yhigh;  j++) {
-            sum_dq = tabrow->flag | PDQPix (&ydq->data, i, j);
-            PDQSetPix (&ydq->data, i, j, sum_dq);
+                tabrow->run.x += 2;
         }
     }
 }
@@ -8,17 +8,20 @@
 # include "wf3.h"
 # include "wf3info.h"
 # include "hstcalerr.h"
+# include "wf3dq.h"
+# include "hstcal_flatfield.h"
 
-static int divFlat (SingleGroup *, char *, WF3Info *, int);
+static int getFlat (SingleGroup *, char *, WF3Info *, int, FlatField **);
 
 /* This routine divides x in-place by the flat fields.
-   There are up to three flat fields.  Each flat field is loaded
-   and divided into the science image line-by-line, one flat at
-   a time.
+   There are up to three flat fields.  Each flat field is read for
+   the chip and subarray of the science image, and kept in memory for
+   the following images; the flats are then divided into the science
+   image together, in one pass.
 
-   The low-order flat, which is usually stored at a lower resolution
-   than the other flats, is rebinned to match the science image before
-   being applied.
+   The low-order flat must be the size of the science image; one
+   stored at a lower resolution is rejected until there is a good
+   enough interpolation to expand it.
 
    Warren Hack, 1998 June 12:
    	Initial ACS version.
@@ -62,32 +65,20 @@ SingleGroup *x    io: image to be calibrated; written to in-place
 
 	extern int status;
 
-	SingleGroupLine w, zl, ztrim;	/* scratch space */
-	WF3sect lfsect, elfsect;
+	SingleGroupLine w;	/* scratch space */
 	int rx, ry;		/* for binning dark down to size of x */
 	int x0, y0;		/* offsets of sci image */
 	int same_size;		/* true if no binning of ref image required */
-	int xline;		/* counter for science image lines */
 	int chipext;		/* Reference file IMSET corresponding to
 				** CCD chip id for science image */
-	int lf, zline;
 	Hdr phdr;
-	int update = NO;	/* Flag to determine whether hdr info needs
-				** to be updated*/
-	int scilines;
 	int applygain;		/* Flag to determine whether to apply the gain
 				** to ref file */
+	FlatField *flats[3];	/* flats to divide into x */
+	int nflats = 0;
 
 	int FindLine (SingleGroup *, SingleGroupLine *, int *, int *, int *,
 		      int *, int *);
-	int div1d (SingleGroup *, int, SingleGroupLine *);
-	int allocWF3sect (WF3sect *, int, int);
-	void initWF3sect (WF3sect *);
-	void freeWF3sect (WF3sect *);
-	void closeWF3sect (WF3sect *);
-	void copySectLine (WF3sect *, int, SingleGroupLine *);
-	void getWF3sect (char *, SingleGroupLine *, int, int, WF3sect *);
-	int unbinsect (WF3sect *, int, WF3sect *);
 	int DetCCDChip (char *, int, int, int *);
 
 	/* Initialize applygain so that correction gets applied */
@@ -95,20 +86,24 @@ SingleGroup *x    io: image to be calibrated; written to in-place
 
 	/* Apply pixel-to-pixel flat, if set to PERFORM */
 	if (wf32d->pfltcorr == PERFORM) {
-	    if (divFlat (x, wf32d->pflt.name, wf32d, applygain)) {
+	    if (getFlat (x, wf32d->pflt.name, wf32d, applygain,
+			 &flats[nflats])) {
 		trlerror("Problem applying PFLTFILE %s... ", wf32d->pflt.name);
 		return(status);
 	    }
+	    nflats++;
 	    /* Turn off applygain so that it doesn't get applied again */
 	    applygain = 0;
 	}
 
 	/* Apply delta flat, if set to PERFORM */
 	if (wf32d->dfltcorr == PERFORM) {
-	    if (divFlat (x, wf32d->dflt.name, wf32d, applygain)) {
+	    if (getFlat (x, wf32d->dflt.name, wf32d, applygain,
+			 &flats[nflats])) {
 		trlerror("Problem applying DFLTFILE %s... ", wf32d->dflt.name);
 		return (status);
 	    }
+	    nflats++;
 	    /* Turn off applygain so that it doesn't get applied again */
 	    applygain = 0;
 	}
@@ -143,110 +138,47 @@ SingleGroup *x    io: image to be calibrated; written to in-place
 	    /* If the L-flat is the same size as the science data, then just do
 	    ** a straight division of the two images. */
 	    if (same_size) {
-		if (divFlat (x, wf32d->lflt.name, wf32d, applygain)) {
+		if (getFlat (x, wf32d->lflt.name, wf32d, applygain,
+			     &flats[nflats])) {
 		    trlerror("Problem applying LFLTFILE %s... ", wf32d->lflt.name);
 		    return (status);
 		}
+		nflats++;
 
 	    /* If the L-flat is binned, then we have to interpolate it to
 	    ** match the science image before doing the division. */
 	    } else {
 
-	    /* Now we know what IMSET corresponds to the appropriate chip,
-	    ** we can read in the flat-field file, expand it, combine it
-	    ** with the other flats, then apply it to the science data... */
-
 	    /* The current L-flat interpolation methods are known to be
 	    ** non-optimal and we're not going to allow them to be used until
-	    ** they're improved. So put in a temporary stub here that forces
-	    ** a return with a warning if the L-flat is binned. */
+	    ** they're improved, so a binned L-flat is an error. */
 	    trlerror("LFLTFILE %s size does not match science data.", wf32d->lflt.name);
 	    trlerror("LFLTFILE interpolation methods are not available at this time.");
 	    trlerror("Please use an LFLTFILE that matches size of science image.");
 	    closeSingleGroupLine (&w);
 	    freeSingleGroupLine (&w);
 	    return (status = SIZE_MISMATCH);
-
-	    /* Low-order flat is binned down more than science image, and
-	    ** needs to be expanded to match the image size */
-	    /* Set up scratch spaces to expand low-order flat */
-	    /* Input file section */
-	    initWF3sect (&lfsect);
-	    if (allocWF3sect (&lfsect, w.sci.tot_nx, SECTLINES) ) {
-		trlerror("(doFlat) Out of memory. ");
-		return (status = OUT_OF_MEMORY);
-	    }
-	    /* Output (expanded) file section.  */
-	    initWF3sect (&elfsect);
-	    if (allocWF3sect (&elfsect, w.sci.tot_nx * rx, SECTLINES * ry) ){
-		trlerror("(doFlat) Out of memory. ");
-		return (status = OUT_OF_MEMORY);
-	    }
-
-	    /* Set up individual lfltfile line to be applied to image */
-	    initSingleGroupLine (&zl);
-	    allocSingleGroupLine (&zl, w.sci.tot_nx * rx);
-
-	    initSingleGroupLine (&ztrim);
-	    allocSingleGroupLine (&ztrim, x->sci.data.nx);
-
-	    xline = 0;	lf = 0;
-	    scilines = x->sci.data.ny;
-
-	    /* Loop over the science image lines, reading in and expanding the
-	    ** appropriate L-flat image lines to apply to it. */
-	    while (xline < scilines) {
-
-		   /* Read in lfltfile and apply to input image here */
-                   if (scilines-xline <= ry) lf=lf-1;
-		   getWF3sect (wf32d->lflt.name, &w, lf, SECTLINES, &lfsect);
-
-		   /* Increment row counter for reference image */
-		   lf += 1;
-
-		   /* Expand binned reference data accounting for
-		   ** offsets of subarrays */
-		   unbinsect (&lfsect, update, &elfsect);
-
-		   /* For each line in expanded section, copy out a
-		   SingleGroupLine and apply it to the science image. */
-		   for (zline=0; (zline < ry) && (xline<scilines); zline++) {
-
-			/* Copy out individual averaged, expanded lines from
-        		** reference data. */
-			if (scilines-xline <= ry) {
-			    copySectLine (&elfsect, zline+ry, &zl);
-			} else {
-			    copySectLine (&elfsect, zline, &zl);
-			}
-
-			/* We now have 1 expanded low-order flat line to apply
-			** Let's check to see if we have any other
-			** flat-fields to apply...  */
-
-			/* Now, apply flat-field */
-			div1d (x, xline, &zl);
-			xline++;
-
-		   } /* End loop over expanded lflt lines, zline loop */
-	    } /* End loop over input image lines, xline loop */
-
-	    /* Clean up scratch areas that were used... */
-	    freeWF3sect (&lfsect);
-	    freeWF3sect (&elfsect);
-	    freeSingleGroupLine (&zl);
-	    freeSingleGroupLine (&ztrim);
 	    }
 	    closeSingleGroupLine (&w);
 	    freeSingleGroupLine (&w);
 
 	} /* End if (lfltcorr) */
 
+	/* Divide all the flats into the science data at once. */
+	if (divFlatFields (x, flats, nflats, BADFLAT))
+	    return (status = SIZE_MISMATCH);
+
 	return (status);
 }
 
-static int divFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
-		    int applygain) {
+/* This routine gets a flat field as it is to be divided into x: the
+   IMSET for the chip of x, trimmed to the subarray of x and, if
+   applygain is set, divided by the gain.  The flat is read only if it
+   is not in the cache already.
+*/
+
+static int getFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
+		    int applygain, FlatField **flat) {
 
 	extern int status;
 
@@ -264,13 +196,13 @@ static int divFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
 	float gain[NAMPS];
 	float rn2[NAMPS];	/* only need this to call get_nsegn */
 	float gnscale;
+	char key[CHAR_LINE_LENGTH+1];	/* flat name, chip, window and gain */
 
 	int FindLine (SingleGroup *, SingleGroupLine *, int *, int *, int *,
 		      int *, int *);
 	int DetCCDChip (char *, int, int, int *);
 	int trim1d (SingleGroupLine *, int, int, int, int, int,
 		    SingleGroupLine *);
-	int div1d (SingleGroup *, int, SingleGroupLine *);
 	void get_nsegn (int, int, int, int, float *, float *, float *, float *);
 	void multgn1d (SingleGroupLine *, int, int, int, float *, float);
 
@@ -303,8 +235,7 @@ static int divFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
 	** in the image...  */
 	scilines = x->sci.data.ny;
 
-	/* Divide the reference image by the calibrated gain value atodgain,
-	** and divide the flat into x. */
+	/* Divide the reference image by the calibrated gain value atodgain. */
 
 	for (i = 0; i < NAMPS; i++) {
 	     gain[i] = 0.;
@@ -318,6 +249,23 @@ static int divFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
 	for (i=0; i<NAMPS; i++)
 	     gain[i] = wf32d->mean_gain;
 
+	/* Use the flat read for an earlier image if there is one. */
+	snprintf (key, sizeof(key), "%s|%d|%d|%d|%d|%d|%d|%d|%.9g|%d|%d",
+		  flatname, pchipext, ysame_size, y_x0, y_y0, x->sci.data.nx,
+		  scilines, applygain, wf32d->mean_gain, wf32d->ampx,
+		  wf32d->ampy);
+	if ((*flat = findFlatField (key)) != NULL) {
+	    closeSingleGroupLine (&y);
+	    freeSingleGroupLine (&y);
+	    return (status);
+	}
+	if ((*flat = newFlatField (key, x->sci.data.nx, scilines)) == NULL) {
+	    closeSingleGroupLine (&y);
+	    freeSingleGroupLine (&y);
+	    trlerror("(doFlat) Out of memory. ");
+	    return (status = OUT_OF_MEMORY);
+	}
+
 	/* For the sake of run-time speed, the loop over lines
 	** is performed differently and separately depending on
 	** whether it is the same size or not...  */
@@ -330,8 +278,7 @@ static int divFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
 		 if (applygain)
 		   multgn1d (&y, line, wf32d->ampx, wf32d->ampy, gain, gnscale);
 
-		 /* Now, apply flat-field */
-		 div1d (x, line, &y);
+		 putFlatFieldLine (*flat, line, &y);
 
 	    } /* End loop over input image lines, xline loop */
 
@@ -348,7 +295,8 @@ static int divFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
 		   getSingleGroupLine (flatname, line, &y);
 
 		   /* Make sure it is the same length as science image */
-		   trim1d (&y, y_x0, y_y0, y_rx, avg, update, &ytrim);
+		   if (trim1d (&y, y_x0, y_y0, y_rx, avg, update, &ytrim))
+		       break;
 
 		   /* Divide flat by gain, if requested */
 		   if (applygain) {
@@ -356,8 +304,7 @@ static int divFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
 				 gnscale);
 		   }
 
-		   /* Now, apply flat-field */
-		   div1d (x, i, &ytrim);
+		   putFlatFieldLine (*flat, i, &ytrim);
 
 	    } /* End loop over input image lines, xline loop */
 
@@ -368,7 +315,12 @@ static int divFlat (SingleGroup *x, char *flatname, WF3Info *wf32d,
 	closeSingleGroupLine (&y);
 	freeSingleGroupLine (&y);
 
+	/* Don't keep a flat that could not be read completely. */
+	if (status) {
+	    freeFlatField (*flat);
+	    *flat = NULL;
+	}
+
 	return (status);
 
 }
-
@@ -79,6 +79,13 @@
 # include "hstcalerr.h"
 # include "doccd.h"
 
+static void AtoDMsg (WF3Info *, int);
+static void BiasMsg (WF3Info *, int);
+static void SatMsg (WF3Info *, int);
+static void FlashMsg (WF3Info *, int);
+static void BlevMsg (WF3Info *, int);
+static void dqiMsg  (WF3Info *, int);
+
 int PutKeyDbl(Hdr *, char *, double , char *);
 int PutKeyStr(Hdr *, char *, char *, char *);
 
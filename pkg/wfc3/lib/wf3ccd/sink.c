@@ -27,7 +27,14 @@
     value of the pixel in the reference image is zero), or until the value of the sink pixel in the exposure
     is greater than the value of the upstream pixel in the reference image
 
-    The pixel mask is saved to the group DQ image in the raz which is passed
+    The sink pixels are few, so the reference image is reduced to a catalogue of
+    them, each with its turn-on date, whether its downstream pixel is flagged and
+    the values of its upstream trail. The catalogue is found in the native orientation
+    of the chip: a raz column is a chip column, with the rows running up for imset 1 and
+    down for imset 2, so the raz rows are never built. It is kept between calls, for
+    each imset of the last SINKFILE read, and flagging an exposure only visits the sinks.
+
+    The pixel mask is saved to the group DQ image which is passed
 
     As long as the un-raz'ed DQ information makes it to the BLC_TMP file that wf3cte saves
     we should be good since the rest of the code uses a logical OR for all the DQ
@@ -44,105 +51,216 @@
 
 */
 
-# include <time.h>
+# include <stdlib.h>
 # include <string.h>
 #include "hstcal.h"
 # include "wf3dq.h"
 # include "hstio.h"
 # include "wf3.h"
 # include "wf3info.h"
+# include "hstcalerr.h"
 # include "wf3corr.h"		/* calibration switch names */
+# include "doccd.h"
 
-int makedqRAZ(SingleGroup *, SingleGroup *);
-int makeSciSingleRAZ(SingleGroup *, SingleGroup *);
-int undodqRAZ(SingleGroup *, SingleGroup *);
-int makeFloatRaz(FloatTwoDArray *, FloatTwoDArray  *, int);
 int getFloatHD(char *, char *, int , FloatHdrData *);
 
-int SinkDetect(WF3Info *wf3, SingleGroup *x){
+# define SINK_REFDATE 50000.   /* reference values above this are sink turn-on dates */
+
+/* A sink pixel of the reference image */
+typedef struct {
+    int x, y;        /* position in the chip */
+    float date;      /* turn-on date (MJD) */
+    int down;        /* flag the downstream pixel as well */
+    int trail;       /* index of its first upstream value in the catalogue */
+    int ntrail;      /* number of upstream values */
+} SinkPixel;
+
+/* The sink pixels of one chip of a SINKFILE */
+typedef struct {
+    char name[CHAR_FNAME_LENGTH+1];  /* SINKFILE, empty if not loaded */
+    int dir;         /* row step from a sink to its upstream pixels */
+    int nsink;
+    SinkPixel *sink;
+    float *trail;    /* upstream values of all sinks */
+} SinkCatalog;
+
+static SinkCatalog sinkcat[2];  /* one for each imset, by group_num */
+
+/* Number of upstream values of the sink at (x,y), which are copied to trail
+   unless it is NULL. The trail continues as long as the reference values are
+   between 1 and 1000; a zero, a date or a negative value ends it. */
+static int sinkTrail (FloatTwoDArray *ref, int x, int y, int dir, float *trail) {
+
+    int n = 0;
+    float val;
+
+    for (y += dir; y >= 0 && y < RAZ_ROWS; y += dir) {
+        val = PPix(ref,x,y);
+        if (!(val >= 1. && val < 1000.))
+            break;
+        if (trail != NULL)
+            trail[n] = val;
+        n++;
+    }
+    return (n);
+}
 
-    extern int status;
-    int i,j, jj;
-    short dqval=0;
-    float scipix; /*to save the value of the science pixel*/
-    float refdate=50000.;
-    int keep_going=1;
+static void freeSinkCatalog (SinkCatalog *cat) {
 
-    trlmessage("\nPerforming SINK pixel detection for imset %i",x->group_num);
+    free (cat->sink);
+    free (cat->trail);
+    cat->name[0] = '\0';
+    cat->nsink = 0;
+    cat->sink = NULL;
+    cat->trail = NULL;
+}
 
-    /*THE SCIENCE IMAGE*/
-    SingleGroup raz; /*quad rotated image to work with*/
+/* Free the catalogues kept between calls, once the last exposure of a run
+   has been processed. */
+void clearSinkCatalogs (void) {
 
-    /* INIT THE SCIENCE INPUT  */
-    initSingleGroup (&raz);
-    allocSingleGroup (&raz,RAZ_COLS/2, RAZ_ROWS, True);
+    freeSinkCatalog (&sinkcat[0]);
+    freeSinkCatalog (&sinkcat[1]);
+}
+
+/* Make the catalogue of the sink pixels of imset extver of the SINKFILE name
+   from its reference image ref, and keep it in place of the catalogue of the
+   imset read before. */
+int makeSinkCatalog (char *name, int extver, FloatTwoDArray *ref) {
+
+    extern int status;
+    int x, y, n, ntrail;
+    float val;
+    SinkCatalog *cat = &sinkcat[extver-1];
+
+    freeSinkCatalog (cat);
+
+    /* The upstream pixels of imset 1 are above the sink, those of imset 2,
+       which is upside down in the raw image, below it */
+    cat->dir = (extver == 1) ? 1 : -1;
+
+    /* Count the sinks and their trails, then fill in the catalogue */
+    n = 0;
+    ntrail = 0;
+    for (y = 0; y < RAZ_ROWS; y++) {
+        for (x = 0; x < RAZ_COLS/2; x++) {
+            if (PPix(ref,x,y) > SINK_REFDATE) {
+                ntrail += sinkTrail (ref, x, y, cat->dir, NULL);
+                n++;
+            }
+        }
+    }
+
+    cat->sink  = malloc ((n > 0 ? n : 1) * sizeof(SinkPixel));
+    cat->trail = malloc ((ntrail > 0 ? ntrail : 1) * sizeof(float));
+    if (cat->sink == NULL || cat->trail == NULL) {
+        trlerror("Out of memory for the sink pixel catalogue");
+        freeSinkCatalog (cat);
+        return (status = OUT_OF_MEMORY);
+    }
+
+    n = 0;
+    ntrail = 0;
+    for (y = 0; y < RAZ_ROWS; y++) {
+        for (x = 0; x < RAZ_COLS/2; x++) {
+            val = PPix(ref,x,y);
+            if (val > SINK_REFDATE) {
+                cat->sink[n].x = x;
+                cat->sink[n].y = y;
+                cat->sink[n].date = val;
+                cat->sink[n].down = (y - cat->dir >= 0 &&
+                                     y - cat->dir < RAZ_ROWS &&
+                                     PPix(ref,x,y - cat->dir) < 0);
+                cat->sink[n].trail = ntrail;
+                cat->sink[n].ntrail = sinkTrail (ref, x, y, cat->dir,
+                                                 cat->trail + ntrail);
+                ntrail += cat->sink[n].ntrail;
+                n++;
+            }
+        }
+    }
+    cat->nsink = n;
+    strcpy (cat->name, name);
+
+    return (status);
+}
 
-    /*CONVERT DQ DATA TO RAZ FORMAT FOR SCIENCE FILE*/
-    makedqRAZ(x, &raz);
-    makeSciSingleRAZ(x, &raz);
+/* Load the catalogue of the sink pixels of imset extver from the SINKFILE,
+   unless it is already loaded. */
+static int getSinkCatalog (char *name, int extver) {
 
-	/* GET THE SINK FILE REFERENCE IMAGE FROM SINKFILE AND INITIALIZE */
+    extern int status;
     FloatHdrData sinkref;
+    SinkCatalog *cat = &sinkcat[extver-1];
+
+    if (cat->name[0] != '\0' && strcmp (cat->name, name) == 0)
+        return (status);
+    freeSinkCatalog (cat);
+
     initFloatHdrData(&sinkref);
-    getFloatHD(wf3->sink.name,"SCI",x->group_num,&sinkref);
+    if (getFloatHD(name, "SCI", extver, &sinkref)) {
+        trlopenerr (name);
+        freeFloatHdrData(&sinkref);
+        return (status = OPEN_FAILED);
+    }
 
-    /*NOW TURN THE SINK REFERENCE IMAGES INTO RAZ FORMAT*/
-    FloatTwoDArray sinkraz;
-    initFloatData(&sinkraz); /*float 2d arrays*/
-    allocFloatData(&sinkraz,RAZ_COLS/2, RAZ_ROWS, True);
+    makeSinkCatalog (name, extver, &sinkref.data);
 
-    makeFloatRaz(&sinkref.data,&sinkraz,x->group_num);
+    freeFloatHdrData(&sinkref);
+    return (status);
+}
+
+int SinkDetect(WF3Info *wf3, SingleGroup *x){
+
+    extern int status;
+    int n, k, y;
+    short dqval=0;
+    float scipix; /*to save the value of the science pixel*/
+    SinkCatalog *cat;
+    SinkPixel *sink;
 
+    trlmessage("\nPerforming SINK pixel detection for imset %i",x->group_num);
+
+    if (x->group_num != 1 && x->group_num != 2){
+        trlerror("Invalid group number passed to SinkDetect");
+        return(status=INVALID_VALUE);
+    }
+
+	/* GET THE SINK PIXELS OF THIS IMSET FROM THE SINKFILE */
+    if (getSinkCatalog (wf3->sink.name, x->group_num))
+        return (status);
+    cat = &sinkcat[x->group_num-1];
 
     /*THE MJD OF THE SCIENCE EXPOSURE IS THE COMPARISON DATE
      THE FOLLOWING TRANSLATION TAKEN FROM ISR WFC3-2014-22.PDF */
 
-    scipix=0.;
-    for (i=0;i<(RAZ_COLS/2);i++){
-        for (j=0; j<RAZ_ROWS; j++){
-
-            if (  (PPix(&sinkraz,i,j) > refdate)  &&  ( wf3->expstart > PPix(&sinkraz,i,j))  ){
-                keep_going=1;
-
-                /*FLAG THE PRIMARY SINK PIXEL*/
-                dqval = TRAP | DQPix (raz.dq.data, i, j);
-                DQSetPix (raz.dq.data, i, j, dqval);
-                scipix = Pix(raz.sci.data,i,j);
-
-                /*FLAG THE DOWNSTREAM PIXEL*/
-                if (j>0 && PPix(&sinkraz,i,j-1) < 0 ){
-                    dqval = TRAP | DQPix (raz.dq.data, i, j-1);
-                    DQSetPix (raz.dq.data, i, j-1, dqval);
-                }
-
-                /*FLAG THE UPSTREAM PIXELS*/
-                for (jj=j+1; jj<RAZ_ROWS; jj++){
-                    if ((int) PPix(&sinkraz,i,jj) == 0)
-                        keep_going=0;
-                    if ( PPix(&sinkraz,i,jj) > refdate)
-                        keep_going=0;
-                    if ( 0. < PPix(&sinkraz,i,jj) &&  PPix(&sinkraz,i,jj) < 1000. && keep_going){
-                        if (scipix <= PPix(&sinkraz,i,jj) ){
-                           dqval = TRAP | DQPix (raz.dq.data, i, jj);
-                           DQSetPix (raz.dq.data, i, jj, dqval);
-                        }
-                    } else {
-                        keep_going=0;
-                    }
-                }
-            } /*end if*/
-        } /*end j*/
-    }/*end i*/
-
-    /*format the dq data back to expected orientation*/
-    undodqRAZ(x,&raz);
-
-    freeSingleGroup(&raz);
-    freeFloatData(&sinkraz);
-    freeFloatHdrData(&sinkref);
+    for (n = 0; n < cat->nsink; n++){
+        sink = &cat->sink[n];
+        if (!(wf3->expstart > sink->date))
+            continue;
+
+        /*FLAG THE PRIMARY SINK PIXEL*/
+        dqval = TRAP | DQPix (x->dq.data, sink->x, sink->y);
+        DQSetPix (x->dq.data, sink->x, sink->y, dqval);
+        scipix = Pix(x->sci.data, sink->x, sink->y);
+
+        /*FLAG THE DOWNSTREAM PIXEL*/
+        if (sink->down){
+            y = sink->y - cat->dir;
+            dqval = TRAP | DQPix (x->dq.data, sink->x, y);
+            DQSetPix (x->dq.data, sink->x, y, dqval);
+        }
+
+        /*FLAG THE UPSTREAM PIXELS*/
+        for (k = 0; k < sink->ntrail; k++){
+            if (scipix <= cat->trail[sink->trail + k]){
+                y = sink->y + (k+1) * cat->dir;
+                dqval = TRAP | DQPix (x->dq.data, sink->x, y);
+                DQSetPix (x->dq.data, sink->x, y, dqval);
+            }
+        }
+    }
+
     trlmessage("Sink pixel flagging complete");
     return(status);
 }
-
-
-
@@ -11,11 +11,14 @@
 # include "trlbuf.h"
 # include "wf3rej.h"
 # include "rej.h"
+# include "rampcube.h"
 
 # define max_CRs         4
 # define equal_weight    0
 # define optimum_weight  1
 
+# define SPIKE_THRESH 6.0   /* sigma threshold for spike rejection */
+
 # define DEBUG 0
 # define DEBUG2 0
 # define X1     605-1
@@ -25,6 +28,28 @@
 
 static short DQIGNORE = SATPIXEL;
 
+/* Per-thread scratch of crrejRow, sized for a row of npix pixels */
+
+typedef struct {
+    RampCube cube;      /* samples of the pixels of a row */
+    float *tot_ADUs;    /* total ADUs from dark current and amp glow for
+                           the samples of a pixel */
+    short *out_dq;      /* output dq   values of the row */
+    float *out_sci;     /* output values of the ramps fitted in batches */
+    float *out_err;
+    float *out_time;
+    short *out_samp;
+    char  *state;       /* how each pixel is fitted, see RAMP_ below */
+    int   *clean;       /* pixels with clean ramps */
+} RowScratch;
+
+# define RAMP_DONE      0   /* output already set */
+# define RAMP_SCALAR    1   /* fitted by fitsamps */
+# define RAMP_FITTED    2   /* fitted in a batch */
+
+/* Pixels fitted together in the SIMD lanes of fitCleanRamps */
+# define RAMP_LANES     32
+
 /** Function Instantiation **/
 
 static int RejSpikes (float *, float *, short *, float *, short, float, int *);
@@ -35,6 +60,14 @@ static void EstimateDarkandGlow(const short nsamp,float *time,float,float *tot_A
 extern int status;
 
 static int  crrej (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *);
+static void initRowScratch (RowScratch *);
+static void freeRowScratch (RowScratch *);
+static int  allocRowScratch (RowScratch *, int, int);
+static void fitCleanRamps (const RampCube *, int, const int *, int, float,
+        float, RowScratch *);
+static int  crrejRow (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *,
+        short, short, short, int, RowScratch *);
+int fitRamps (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *, int);
 static void fitsamps (const short, float *, float *, short *,float *, float *, float,
         float *, float *, short *, float *, short, short, float, float);
 static void linfit (short, float *, float *, float *, float *, short, float,
@@ -202,26 +235,6 @@ int cridcalc (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *crimage)
          */
 
         /* Local variables */
-        short i, j, k, l;       /* pixel and loop indexes */
-        short ibeg, iend, jbeg, jend;   /* loop limits */
-        short nsamp;            /* number of samples for pixel */
-        float current_sci;      /* current sci value */
-        float current_err;      /* current err value */
-        short current_dq;       /* current dq  value */
-        float *sci;         /* list of sci  values for pixel */
-        float *err;         /* list of err  values for pixel */
-        short *dq;          /* list of dq   values for pixel */
-        float *time;            /* list of time values for pixel */
-        float *tot_ADUs;        /* list of total ADUs from dark current and
-                           amp glow for pixel */
-        float out_sci;      /* output sci  value */
-        float out_err;      /* output err  value */
-        short out_dq;           /* output dq   value */
-        short out_samp;     /* output samp value */
-        float out_time;     /* output time value */
-        float flat_value;             /* value to convert from flat fielded ADUs to
-                         electrons */
-        float flat_uncertainty;       /* unitless rms flat field uncertainty */
         int ncurved;            /* Number of pixels with high curvature */
         int   niter = 0;        /* number of rejection iterations */
         float sigma[MAX_ITER];  /* list of sigma values for rejection */
@@ -233,17 +246,6 @@ int cridcalc (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *crimage)
         int crrpar_in (clpar *, int [], int, float, int *, float []);
         void rej_reset (clpar *, int []);
 
-        /* Allocate memory for local arrays */
-        sci    = NULL;
-        err    = NULL;
-        dq     = NULL;
-        time   = NULL;
-        sci    = (float *) calloc(wf3->ngroups, sizeof(float));
-        err    = (float *) calloc(wf3->ngroups, sizeof(float));
-        dq     = (short *) calloc(wf3->ngroups, sizeof(short));
-        time   = (float *) calloc(wf3->ngroups, sizeof(float));
-        tot_ADUs   = (float *) calloc(wf3->ngroups, sizeof(float));
-
         /* Read in the parameters from the crrejtab */
         rej_reset (&par, newpar);
         strcpy (par.tbname, wf3->crrej.name);
@@ -274,7 +276,34 @@ int cridcalc (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *crimage)
             trlmessage("               %d bad DQ mask", DQIGNORE);
             trlmessage("               %d max CRs for UNSTABLE",max_CRs);
         }
-        ncurved = 0;
+
+        ncurved = fitRamps (wf3, input, crimage, 1);
+        if (ncurved < 0)
+            return (status = OUT_OF_MEMORY);
+
+        if (ncurved > 0) {
+            trlmessage("%d pixels detected as unstable", ncurved);
+        }
+
+        /* Successful return */
+        return (status = 0);
+    }
+
+
+/* FITRAMPS: Compute the mean countrate of every pixel of the stack into
+ ** crimage and flag the outliers found in the input DQ arrays. Clean ramps
+ ** are fitted in batches when batch is set, otherwise every ramp is fitted
+ ** by fitsamps, with the same results. Returns the number of pixels found
+ ** to be unstable, or -1 when out of memory.
+ */
+
+int fitRamps (WF3Info *wf3, MultiNicmosGroup *input,
+        SingleNicmosGroup *crimage, int batch) {
+
+        short ibeg, iend, jbeg, jend;   /* loop limits */
+        short nsamp;            /* number of samples for pixel */
+        int nomem;              /* a thread failed to allocate its arrays */
+        int ncurved = 0;        /* Number of pixels with high curvature */
 
         /* Loop over image array, computing mean countrate at each pixel;
          ** the loop limits are set so that reference pixels are skipped;
@@ -285,174 +314,498 @@ int cridcalc (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *crimage)
         jbeg = wf3->trimy[0];
         jend = input->group[0].sci.data.ny - wf3->trimy[1];
 
-        for (j=jbeg; j<jend; j++) {
-            for (i=ibeg; i<iend; i++) {
-
-                /* Get the DQ value in the zeroth-read */
-                k = wf3->ngroups-1;
-                current_dq = DQPix(input->group[k].dq.data,i,j);
-
-                /* Back out the ZEROSIG  dq flags */
-                if (current_dq & ZEROSIG)
-                    current_dq -= ZEROSIG;
-
-                /* Check for pixels that are saturated already in first read */
-                if ((wf3->zsigcorr == PERFORM || wf3->zsigcorr == COMPLETE) &&
-                    (DQPix(input->group[k-1].dq.data,i,j) & SATPIXEL)) {
-
-                    /* For these pixels, just set the output values equal
-                     ** to what's in the input zeroth-read image, regardless
-                     ** of whether the zeroth-read is saturated or not. If it
-                     ** is saturated in the zeroth-read, the DQ flag will get
-                     ** carried over to the output to indicate it's bad. */
-                    Pix(crimage->sci.data,i,j) = Pix(input->group[k].sci.data,i,j);
-                    Pix(crimage->err.data,i,j) = Pix(input->group[k].err.data,i,j);
-                    DQSetPix(crimage->dq.data,i,j,current_dq);
-                    Pix(crimage->smpl.data,i,j) = 1;
-                    Pix(crimage->intg.data,i,j) = wf3->sampzero;
-
-                    continue;
-                }
+        /* Rows are fitted in parallel, each thread with its own scratch
+         ** arrays; the samples of each row are gathered pixel by pixel.
+         ** The results do not depend on the number of threads. */
+        nsamp = wf3->ngroups;
+        nomem = 0;
+# ifdef _OPENMP
+        #pragma omp parallel reduction(+:ncurved)
+# endif
+        {
+            RowScratch scr;     /* scratch arrays of the thread */
+            int row;
+
+            if (allocRowScratch (&scr, nsamp, iend > ibeg ? iend-ibeg : 1)) {
+# ifdef _OPENMP
+                #pragma omp atomic write
+# endif
+                nomem = 1;
+            }
 
-                /* Initialize the output image DQ value */
-                out_dq = 0;
+# ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
+# endif
+            for (row = jbeg; row < jend; row++) {
+                if (scr.state != NULL)
+                    ncurved += crrejRow (wf3, input, crimage, row, ibeg, iend,
+                                         batch, &scr);
+            }
 
-                /* Create list of samples for this pixel */
-                nsamp = 0;
-                for (k = wf3->ngroups-1; k >= 0; k--) {
+            freeRowScratch (&scr);
+        }
 
-                    /* Retrieve SCI, ERR, and DQ values for this sample */
-                    current_sci = Pix(input->group[k].sci.data,i,j);
-                    current_err = Pix(input->group[k].err.data,i,j);
-                    current_dq  = DQPix(input->group[k].dq.data,i,j);
+        return (nomem ? -1 : ncurved);
+    }
 
-                    /* Temporarily convert countrates back to counts */
-                    if (wf3->bunit[0] == COUNTRATE) {
-                        current_sci *= Pix(input->group[k].intg.data,i,j);
-                        current_err *= Pix(input->group[k].intg.data,i,j);
-                    }
 
-                    /* Remove ZEROSIG bits from DQ, if present,
-                     ** because those samples are OK to use here (Vsn 3.2) */
-                    if (current_dq & ZEROSIG)
-                        current_dq -= ZEROSIG;
-
-                    /* Propagate DQ values to output DQ */
-                    out_dq = out_dq | current_dq;
-
-                    /* Temporarily flag first samp_rej samples to exclude
-                     ** them from the fit (Version 3.3) */
-                    if (wf3->samp_rej > 0 && nsamp > 0 && nsamp <= wf3->samp_rej)
-                        current_dq = current_dq | RESERVED2;
-
-                    /* Copy all values to the fitting arrays */
-                    sci[nsamp]  = current_sci;
-                    err[nsamp]  = current_err;
-                    dq[nsamp]   = current_dq;
-                    time[nsamp] = Pix(input->group[k].intg.data,i,j);
-                    nsamp++;
-                }
+static void initRowScratch (RowScratch *scr) {
 
-                /* Get dark and amp glow values for each sample of this pixel */
-                /*if (wf3->darkcorr == PERFORM)*/
-                EstimateDarkandGlow (nsamp, time, wf3->mean_gain, tot_ADUs);
+    initRampCube (&scr->cube);
+    scr->tot_ADUs = NULL;
+    scr->out_dq   = NULL;
+    scr->out_sci  = NULL;
+    scr->out_err  = NULL;
+    scr->out_time = NULL;
+    scr->out_samp = NULL;
+    scr->state    = NULL;
+    scr->clean    = NULL;
+}
 
-                if (wf3->flatcorr == PERFORM) {
-                    flat_value = wf3->mean_gain;
-                    flat_uncertainty = 0.0;
-                } else {
-                    flat_value = wf3->mean_gain;
-                    flat_uncertainty = 0.0;
-                }
+static void freeRowScratch (RowScratch *scr) {
+
+    freeRampCube (&scr->cube);
+    free (scr->tot_ADUs);
+    free (scr->out_dq);
+    free (scr->out_sci);
+    free (scr->out_err);
+    free (scr->out_time);
+    free (scr->out_samp);
+    free (scr->state);
+    free (scr->clean);
+    initRowScratch (scr);
+}
 
-                /* Do iterative rejection and computation of slope */
-                fitsamps (nsamp, sci, err, dq, time, tot_ADUs, wf3->crthresh,
-                        &out_sci, &out_err, &out_samp, &out_time, i, j, flat_value,
-                        flat_uncertainty);
+static int allocRowScratch (RowScratch *scr, int nsamp, int npix) {
+
+    initRowScratch (scr);
+    scr->tot_ADUs = calloc (nsamp, sizeof(float));
+    scr->out_dq   = malloc (npix * sizeof(short));
+    scr->out_sci  = malloc (npix * sizeof(float));
+    scr->out_err  = malloc (npix * sizeof(float));
+    scr->out_time = malloc (npix * sizeof(float));
+    scr->out_samp = malloc (npix * sizeof(short));
+    scr->state    = malloc (npix * sizeof(char));
+    scr->clean    = malloc (npix * sizeof(int));
+    if (scr->tot_ADUs == NULL || scr->out_dq == NULL ||
+        scr->out_sci == NULL || scr->out_err == NULL ||
+        scr->out_time == NULL || scr->out_samp == NULL ||
+        scr->state == NULL || scr->clean == NULL ||
+        allocRampCube (&scr->cube, nsamp, npix)) {
+        freeRowScratch (scr);
+        return (OUT_OF_MEMORY);
+    }
+    return (0);
+}
 
-                /* Propagate all DQ flags to output EXCEPT for SATPIXEL
-                 ** and DATAREJECT  (Version 4.2) */
-                out_dq = out_dq - (out_dq & SATPIXEL);
+/* FITCLEANRAMPS: Fit the clean ramps of the pixels listed in clean, in
+ ** batches of RAMP_LANES pixels. A clean ramp has good samples (DQ 0 and
+ ** non-zero error) from sample first to the last one, so that fitsamps
+ ** would fit one interval of them.
+ **
+ ** The equal-weight fit is computed for all lanes at once, and the lanes
+ ** where RejSpikes, RejCRs or RejFirstRead could find an outlier are left
+ ** to fitsamps (state RAMP_SCALAR). The others get the optimum-weight fit
+ ** and their outputs (state RAMP_FITTED). The arithmetic is that of linfit
+ ** and fitsamps, operation for operation, so the results are the same; the
+ ** optimum weights only depend on the number of samples and the SNR range,
+ ** and are computed once per batch instead of once per sample.
+ */
 
-                /* Convert results back to counts if necessary */
-                if (wf3->bunit[0] == COUNTS) {
-                    out_sci *= out_time;
-                    out_err *= out_time;
-                }
+static void fitCleanRamps (const RampCube *cube, int first, const int *clean,
+        int nclean, float gain, float thresh, RowScratch *scr) {
+
+    /* The optimum weighting powers of linfit, by decreasing SNR */
+    static const float powers[6] = {10.0, 6.0, 3.0, 1.0, 0.4, 0};
+
+    const int nsamp = cube->nsamp;
+    const int ndata = nsamp - first;
+    float y[MAX_MAREADS][RAMP_LANES];
+    float x[MAX_MAREADS][RAMP_LANES];
+    float sig[MAX_MAREADS][RAMP_LANES];
+    float diff[MAX_MAREADS][RAMP_LANES];
+    float weights[6][MAX_MAREADS];
+    float S[RAMP_LANES], Sx[RAMP_LANES], Sy[RAMP_LANES];
+    float Sxx[RAMP_LANES], Sxy[RAMP_LANES];
+    float a[RAMP_LANES], b[RAMP_LANES];
+    float dg0[RAMP_LANES], dg1[RAMP_LANES];
+    int   ipow[RAMP_LANES];
+    char  suspect[RAMP_LANES];
+    float rdns, invrdns2, lineardark, ampglow;
+    int   lane0, l, k, p;
+
+    /* As in linfit and EstimateDarkandGlow */
+    rdns = 21.0 / gain;
+    invrdns2 = 1. / (rdns*rdns);
+    lineardark = 0.036 / gain;
+    ampglow = 0.0;
 
-                /* Set DATAREJECT DQ for all samples following a hit
-                   This is done so that people looking at the imas in the
-                   future know that the absolute value of the pixel is wrong
-                   after the first hit, but it smears the location of any hits
-                   which occurred in addition to the first one. */
-                for (k = 0; k < wf3->ngroups-1; k++) {
-                    if (dq[k] & DATAREJECT) {
-                        dq[k+1] = dq[k+1] | DATAREJECT;
-                    }
-                }
+    for (p = 0; p < 6; p++) {
+        for (k = 0; k < ndata; k++) {
+            float wt;
+            wt=fabs(pow(fabs(k-((ndata-1)/2.))/((ndata-1)/2.),powers[p]));
+            wt*=invrdns2;
+            weights[p][k] = wt;
+        }
+    }
 
-                /* If the HIGH-CURVATURE bit is set anywhere, set it for all
-                   groups and unset the DATAREJECT bit */
-                for (k = 0; k < wf3->ngroups-1; k++) {
-                    if (dq[k] & HIGH_CURVATURE) {
-                        for (l=0; l < wf3->ngroups; l++) {
-                            dq[l] = dq[l] | HIGH_CURVATURE;
-                            dq[l] = dq[l] - (dq[l] & DATAREJECT);
-                        }
-                        break;
-                    }
-                }
+    for (lane0 = 0; lane0 < nclean; lane0 += RAMP_LANES) {
+        const int nl = (nclean - lane0 < RAMP_LANES) ? nclean - lane0 : RAMP_LANES;
 
-                /* Add UNSTABLE bit to output crimage if the pixel is marked as
-                 ** HIGH_CURVATURE and unset the DATAREJECT bit. */
-                if (dq[nsamp-1] & HIGH_CURVATURE) {
-                    out_dq = out_dq | UNSTABLE;
-                    out_dq = out_dq - (out_dq & DATAREJECT);
-                    /* And increment the ncurved counter */
-                    ncurved++;
-                }
+        /* Gather the samples of the interval, sample-major */
+        for (l = 0; l < nl; l++) {
+            const size_t base = (size_t)clean[lane0+l] * nsamp + first;
+            for (k = 0; k < ndata; k++) {
+                y[k][l]   = cube->sci[base+k];
+                x[k][l]   = cube->time[base+k];
+                sig[k][l] = cube->err[base+k];
+            }
+            dg0[l] = x[0][l]*lineardark + first*ampglow;
+            dg1[l] = x[ndata-1][l]*lineardark + (nsamp-1)*ampglow;
+        }
+
+        /* Equal-weight fit: every weight is invrdns2 */
+        for (l = 0; l < nl; l++) {
+            S[l] = 0; Sx[l] = 0; Sy[l] = 0; Sxx[l] = 0; Sxy[l] = 0;
+        }
+        for (k = 0; k < ndata; k++) {
+            for (l = 0; l < nl; l++) {
+                S[l] += invrdns2;
+                Sy[l] += y[k][l] * invrdns2;
+                Sx[l] += x[k][l] * invrdns2;
+                Sxx[l] += x[k][l] * x[k][l] * invrdns2;
+                Sxy[l] += x[k][l] * y[k][l] * invrdns2;
+            }
+        }
+        for (l = 0; l < nl; l++) {
+            float denom = (S[l]*Sxx[l] - (Sx[l]*Sx[l]));
+            if (denom < 1e-6)
+                denom = 1e-6;
+            b[l] = (S[l]*Sxy[l] - Sx[l]*Sy[l])/denom;
+            a[l] = (Sxx[l]*Sy[l] - Sx[l]*Sxy[l])/denom;
+        }
+
+        for (k = 0; k < ndata; k++) {
+            for (l = 0; l < nl; l++)
+                diff[k][l] = (y[k][l]-(a[l]+b[l]*x[k][l])) / sig[k][l];
+        }
 
-                /* Store final values in output crimage */
-                Pix(crimage->sci.data,i,j)  = out_sci;
-                Pix(crimage->err.data,i,j)  = out_err;
-                DQSetPix(crimage->dq.data,i,j,out_dq);
-                Pix(crimage->smpl.data,i,j) = out_samp;
-                Pix(crimage->intg.data,i,j) = out_time;
+        /* Any spike, CR or first read jump sends the pixel to fitsamps */
+        for (l = 0; l < nl; l++) {
+            suspect[l] = 0;
+            for (k = 2; k < ndata; k++) {
+                if (diff[k-1][l] - diff[k-2][l] > SPIKE_THRESH &&
+                        diff[k-1][l] - diff[k][l] > SPIKE_THRESH &&
+                        diff[k-2][l] < 0 && diff[k][l] < 0)
+                    suspect[l] = 1;
+            }
+            for (k = 1; k < ndata; k++) {
+                if (fabs(diff[k][l] - diff[k-1][l]) > thresh)
+                    suspect[l] = 1;
+            }
+        }
 
-                /* Update input DQ values for detected outliers */
-                for (k = wf3->ngroups-1; k >= 0; k--) {
+        /* Optimum weighting by the SNR over the interval */
+        for (l = 0; l < nl; l++) {
+            float snr;
+            if (sig[ndata-1][l] > 0.0)
+                snr = (y[ndata-1][l]-y[0][l])/sig[ndata-1][l];
+            else
+                snr = 0.0;
+            ipow[l] = (snr > 100) ? 0 : (snr > 50) ? 1 : (snr > 20) ? 2 :
+                      (snr > 10) ? 3 : (snr > 5) ? 4 : 5;
+        }
 
-                    if (dq[wf3->ngroups-1-k] & DATAREJECT)
-                        DQSetPix (input->group[k].dq.data,i,j,
-                                DQPix (input->group[k].dq.data,i,j) | DATAREJECT);
+        for (l = 0; l < nl; l++) {
+            S[l] = 0; Sx[l] = 0; Sy[l] = 0; Sxx[l] = 0; Sxy[l] = 0;
+        }
+        for (k = 0; k < ndata; k++) {
+            for (l = 0; l < nl; l++) {
+                const float wt = weights[ipow[l]][k];
+                S[l] += wt;
+                Sy[l] += y[k][l] * wt;
+                Sx[l] += x[k][l] * wt;
+                Sxx[l] += x[k][l] * x[k][l] * wt;
+                Sxy[l] += x[k][l] * y[k][l] * wt;
+            }
+        }
 
-                    if (dq[wf3->ngroups-1-k] & SPIKE)
-                        DQSetPix (input->group[k].dq.data,i,j,
-                                DQPix (input->group[k].dq.data,i,j) | DETECTORPROB);
+        for (l = 0; l < nl; l++) {
+            const int   pix = clean[lane0+l];
+            float dx, dy, ddg, denom, slope, sigb, fit_uncert;
+            float terma, termb, termc, errterms;
+            float sigsquared, sumwts, sum, int_time;
+
+            if (suspect[l] || !(S[l] > 0))
+                continue;
+
+            dx = x[ndata-1][l]-x[0][l];
+            dy = y[ndata-1][l]-y[0][l];
+            ddg = dg1[l]-dg0[l];
+            denom = (S[l]*Sxx[l] - (Sx[l]*Sx[l]));
+            if (denom < 1e-6)
+                denom = 1e-6;
+
+            slope = (S[l]*Sxy[l] - Sx[l]*Sy[l])/denom;
+            fit_uncert = sqrt(S[l]/denom);
+            sigb = fit_uncert;
+
+            terma = (gain*fit_uncert*dx)*(gain*fit_uncert*dx);
+            termb =  gain*ddg;
+            termc =  gain*dy;
+            errterms = terma + termb + termc;
+            if (errterms > 0)
+                sigb = (sqrt(errterms)/dx)/gain;
+
+            sigsquared = sigb*sigb;
+            if (sigsquared == 0.0)
+                continue;
+
+            /* The sums of fitsamps over a single interval */
+            int_time = 0;
+            int_time += cube->time[(size_t)pix*nsamp + first] -
+                        cube->time[(size_t)pix*nsamp + first-1];
+            int_time += x[ndata-1][l] - x[0][l];
+            sumwts = 0;
+            sum = 0;
+            sumwts += 1.0/sigsquared;
+            sum    += slope/sigsquared;
+
+            /* e.g. an infinite sigb, fitsamps then uses the last good read */
+            if (!(sumwts > 0))
+                continue;
+
+            scr->out_sci[pix]  = sum/sumwts;
+            scr->out_err[pix]  = sqrt(1/sumwts);
+            scr->out_time[pix] = int_time;
+            scr->out_samp[pix] = ndata + 1;
+            scr->state[pix]    = RAMP_FITTED;
+        }
+    }
+}
 
-                    if (dq[wf3->ngroups-1-k] & HIGH_CURVATURE)
-                        DQSetPix (input->group[k].dq.data,i,j,
-                                DQPix (input->group[k].dq.data,i,j) | UNSTABLE);
-                }
+/* CRREJROW: Fit the samples of pixels ibeg to iend-1 of row j, loaded
+ ** into the cube of scr, store the results in crimage and flag the
+ ** outliers found in the input DQ arrays. Rows are independent of each
+ ** other. Returns the number of pixels found to be unstable.
+ **
+ ** Clean ramps are fitted in batches by fitCleanRamps when batch is set,
+ ** the others (and those where it finds a possible outlier) one by one by
+ ** fitsamps.
+ */
 
-            } /* end of loop over nx */
-        } /* end of loop over ny */
+static int crrejRow (WF3Info *wf3, MultiNicmosGroup *input,
+        SingleNicmosGroup *crimage, short j, short ibeg, short iend,
+        int batch, RowScratch *scr) {
 
-        if (ncurved > 0) {
-            trlmessage("%d pixels detected as unstable", ncurved);
+    /* Local variables */
+    short i, k, l;          /* pixel and loop indexes */
+    short nsamp;            /* number of samples for pixel */
+    short current_dq;       /* current dq  value */
+    RampCube *cube;         /* samples of the pixels of the row */
+    float *sci;         /* list of sci  values for pixel */
+    float *err;         /* list of err  values for pixel */
+    short *dq;          /* list of dq   values for pixel */
+    float *time;            /* list of time values for pixel */
+    float out_sci;      /* output sci  value */
+    float out_err;      /* output err  value */
+    short out_dq;           /* output dq   value */
+    short out_samp;     /* output samp value */
+    float out_time;     /* output time value */
+    float flat_value;             /* value to convert from flat fielded ADUs to
+                                     electrons */
+    float flat_uncertainty;       /* unitless rms flat field uncertainty */
+    int first;              /* first sample fitted in a clean ramp */
+    int nclean;             /* number of clean ramps */
+    int ncurved = 0;        /* Number of pixels with high curvature */
+
+    cube = &scr->cube;
+    nsamp = cube->nsamp;
+    first = 1 + (wf3->samp_rej > 0 ? wf3->samp_rej : 0);
+    nclean = 0;
+
+    if (iend > ibeg)
+        loadRampCube (cube, input, ibeg, j, wf3->bunit[0] == COUNTRATE);
+
+    for (i=ibeg; i<iend; i++) {
+
+        /* Get the DQ value in the zeroth-read */
+        k = wf3->ngroups-1;
+        current_dq = DQPix(input->group[k].dq.data,i,j);
+
+        /* Back out the ZEROSIG  dq flags */
+        if (current_dq & ZEROSIG)
+            current_dq -= ZEROSIG;
+
+        /* Check for pixels that are saturated already in first read */
+        if ((wf3->zsigcorr == PERFORM || wf3->zsigcorr == COMPLETE) &&
+            (DQPix(input->group[k-1].dq.data,i,j) & SATPIXEL)) {
+
+            /* For these pixels, just set the output values equal
+             ** to what's in the input zeroth-read image, regardless
+             ** of whether the zeroth-read is saturated or not. If it
+             ** is saturated in the zeroth-read, the DQ flag will get
+             ** carried over to the output to indicate it's bad. */
+            Pix(crimage->sci.data,i,j) = Pix(input->group[k].sci.data,i,j);
+            Pix(crimage->err.data,i,j) = Pix(input->group[k].err.data,i,j);
+            DQSetPix(crimage->dq.data,i,j,current_dq);
+            Pix(crimage->smpl.data,i,j) = 1;
+            Pix(crimage->intg.data,i,j) = wf3->sampzero;
+
+            /* Leave its input DQ values as they are */
+            for (k = 0; k < nsamp; k++)
+                cube->dq[(size_t)(i-ibeg)*nsamp + k] = 0;
+
+            scr->state[i-ibeg] = RAMP_DONE;
+            continue;
         }
 
-        /* Free memory allocated locally */
-        free(sci);
-        free(err);
-        free(dq);
-        free(time);
-        free(tot_ADUs);
+        /* Initialize the output image DQ value */
+        out_dq = 0;
 
-        /* Successful return */
-        return (status = 0);
+        /* The list of samples for this pixel, in counts and
+         ** without ZEROSIG bits, which are OK to use here (Vsn 3.2) */
+        err  = cube->err  + (size_t)(i-ibeg) * nsamp;
+        dq   = cube->dq   + (size_t)(i-ibeg) * nsamp;
+
+        for (k = 0; k < nsamp; k++) {
+
+            /* Propagate DQ values to output DQ */
+            out_dq = out_dq | dq[k];
+
+            /* Temporarily flag first samp_rej samples to exclude
+             ** them from the fit (Version 3.3) */
+            if (wf3->samp_rej > 0 && k > 0 && k <= wf3->samp_rej)
+                dq[k] = dq[k] | RESERVED2;
+        }
+        scr->out_dq[i-ibeg] = out_dq;
+        scr->state[i-ibeg] = RAMP_SCALAR;
+
+        /* Is the ramp clean, with at least 3 samples to fit? The
+         ** samp_rej samples before first carry RESERVED2, so fitsamps
+         ** skips them whatever else they are flagged with. */
+        if (batch && nsamp - first >= 3) {
+            for (k = first; k < nsamp; k++) {
+                if (dq[k] != 0 || err[k] == 0)
+                    break;
+            }
+            if (k == nsamp)
+                scr->clean[nclean++] = i-ibeg;
+        }
+    }
+
+    if (wf3->flatcorr == PERFORM) {
+        flat_value = wf3->mean_gain;
+        flat_uncertainty = 0.0;
+    } else {
+        flat_value = wf3->mean_gain;
+        flat_uncertainty = 0.0;
     }
 
+    fitCleanRamps (cube, first, scr->clean, nclean, flat_value,
+                   wf3->crthresh, scr);
+
+    for (i=ibeg; i<iend; i++) {
+
+        if (scr->state[i-ibeg] == RAMP_DONE)
+            continue;
+
+        out_dq = scr->out_dq[i-ibeg];
+        sci  = cube->sci  + (size_t)(i-ibeg) * nsamp;
+        err  = cube->err  + (size_t)(i-ibeg) * nsamp;
+        dq   = cube->dq   + (size_t)(i-ibeg) * nsamp;
+        time = cube->time + (size_t)(i-ibeg) * nsamp;
+
+        if (scr->state[i-ibeg] == RAMP_FITTED) {
+            out_sci  = scr->out_sci[i-ibeg];
+            out_err  = scr->out_err[i-ibeg];
+            out_samp = scr->out_samp[i-ibeg];
+            out_time = scr->out_time[i-ibeg];
+        } else {
+
+            /* Get dark and amp glow values for each sample of this pixel */
+            /*if (wf3->darkcorr == PERFORM)*/
+            EstimateDarkandGlow (nsamp, time, wf3->mean_gain, scr->tot_ADUs);
+
+            /* Do iterative rejection and computation of slope */
+            fitsamps (nsamp, sci, err, dq, time, scr->tot_ADUs, wf3->crthresh,
+                    &out_sci, &out_err, &out_samp, &out_time, i, j, flat_value,
+                    flat_uncertainty);
+        }
+
+        /* Propagate all DQ flags to output EXCEPT for SATPIXEL
+         ** and DATAREJECT  (Version 4.2) */
+        out_dq = out_dq - (out_dq & SATPIXEL);
+
+        /* Convert results back to counts if necessary */
+        if (wf3->bunit[0] == COUNTS) {
+            out_sci *= out_time;
+            out_err *= out_time;
+        }
+
+        /* Set DATAREJECT DQ for all samples following a hit
+           This is done so that people looking at the imas in the
+           future know that the absolute value of the pixel is wrong
+           after the first hit, but it smears the location of any hits
+           which occurred in addition to the first one. */
+        for (k = 0; k < wf3->ngroups-1; k++) {
+            if (dq[k] & DATAREJECT) {
+                dq[k+1] = dq[k+1] | DATAREJECT;
+            }
+        }
+
+        /* If the HIGH-CURVATURE bit is set anywhere, set it for all
+           groups and unset the DATAREJECT bit */
+        for (k = 0; k < wf3->ngroups-1; k++) {
+            if (dq[k] & HIGH_CURVATURE) {
+                for (l=0; l < wf3->ngroups; l++) {
+                    dq[l] = dq[l] | HIGH_CURVATURE;
+                    dq[l] = dq[l] - (dq[l] & DATAREJECT);
+                }
+                break;
+            }
+        }
+
+        /* Add UNSTABLE bit to output crimage if the pixel is marked as
+         ** HIGH_CURVATURE and unset the DATAREJECT bit. */
+        if (dq[nsamp-1] & HIGH_CURVATURE) {
+            out_dq = out_dq | UNSTABLE;
+            out_dq = out_dq - (out_dq & DATAREJECT);
+            /* And increment the ncurved counter */
+            ncurved++;
+        }
+
+        /* Store final values in output crimage */
+        Pix(crimage->sci.data,i,j)  = out_sci;
+        Pix(crimage->err.data,i,j)  = out_err;
+        DQSetPix(crimage->dq.data,i,j,out_dq);
+        Pix(crimage->smpl.data,i,j) = out_samp;
+        Pix(crimage->intg.data,i,j) = out_time;
+
+    } /* end of loop over nx */
+
+    /* Update input DQ values for detected outliers, a row of
+     ** each group at a time */
+    for (k = wf3->ngroups-1; k >= 0; k--) {
+        short *indq = &DQPix(input->group[k].dq.data,0,j);
+        const short *samp = cube->dq + (wf3->ngroups-1-k);
+
+        for (i=ibeg; i<iend; i++) {
+            short flags = samp[(size_t)(i-ibeg)*nsamp];
+
+            if (flags & DATAREJECT)
+                indq[i] = indq[i] | DATAREJECT;
+
+            if (flags & SPIKE)
+                indq[i] = indq[i] | DETECTORPROB;
+
+            if (flags & HIGH_CURVATURE)
+                indq[i] = indq[i] | UNSTABLE;
+        }
+    }
+
+    return (ncurved);
+}
 
 /* FITSAMPS: Fit accumulating counts vs. time to compute mean countrate,
  ** iteratively rejecting CR hits and refitting until no new samples are
@@ -1235,7 +1588,6 @@ static void linfit (short weight_type, float *x, float *y, float *sig,
  ** Mar 2010: Modified to use SPIKE_THRESH, separate from CR_THRESH. HAB
  */
 
-# define SPIKE_THRESH 6.0   /* sigma threshold for spike rejection */
 
 static int RejSpikes (float *tsci, float*terr, short *dq, float *diff,
         short nsamp, float thresh, int *max_samp) {
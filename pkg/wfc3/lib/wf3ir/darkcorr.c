@@ -1,54 +1,58 @@
 # include <stdio.h>
 # include <float.h>
+# include <math.h>
 
 #include "hstcal.h"
 # include "hstio.h"	/* defines HST I/O functions */
 # include "wf3.h"
 # include "wf3info.h"
+# include "irsweep.h"
 # include "trlbuf.h"
 
 extern int status;
 
-static int darkcorr (WF3Info *, SingleNicmosGroup *, SingleNicmosGroup *);
-
-/* DoDarkIR: Call DARKCORR routine for each readout of a MultiAccum.
-**	     The appropriate dark image is loaded for each readout
-**	     from the DARKFILE reference file.
+/* DoDarkIR: Report the DARKCORR step, which is done for each readout of
+**	     a MultiAccum by doSweepIR. The appropriate dark image is
+**	     loaded for each readout from the DARKFILE reference file.
 **
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
 */
 
-int doDarkIR (WF3Info *wf3, MultiNicmosGroup *input) {
+int doDarkIR (WF3Info *wf3, IRSweep *sweep) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
-**	input	io: image to be dark subtracted
+**	sweep	 i: results of the sweep through the groups
 */
 
 	/* Local variables */
-	SingleNicmosGroup dark;
+	int group;		/* group number */
+	int frame1, frame2;	/* dark ref frames used */
 
 	/* Function definitions */
-	int getDarkImage (WF3Info *, SingleNicmosGroup *, int);
 	void PrSwitch (char *, int);
 
-	/* Do the dark current subtraction for each group */
-	if (wf3->darkcorr == PERFORM) {
-
-	    for (wf3->group=wf3->ngroups; wf3->group >= 1; wf3->group--) {
-
-		 /* Load the appropriate dark image for this group */
-	    	 initSingleNicmosGroup (&dark);
-		 if (getDarkImage (wf3, &dark, wf3->group))
-		     return (status);
-
-		 /* Do dark subtraction for this group */
-		 if (darkcorr (wf3, &(input->group[wf3->group-1]), &dark))
-		     return (status);
-
-		 /* Free the dark image */
-	    	 freeSingleNicmosGroup (&dark);
+	if (sweep->darkcorr) {
+
+	    /* Report which ref file frames were used */
+	    for (group=wf3->ngroups; group >= 1; group--) {
+		 frame1 = sweep->darkframe1[group-1];
+		 frame2 = sweep->darkframe2[group-1];
+
+		 if (sweep->darktype[group-1] == MATCH) {
+		     trlmessage("DARKCORR using dark imset %2d for imset %2d with exptime=%8.6g",
+			      frame1, group, wf3->exptime[group-1]);
+		 } else if (sweep->darktype[group-1] == INTERP) {
+		     trlwarn("DARKCORR using dark imsets %d and %d for imset %d", frame1, frame2, group);
+		     trlwarn("         interpolated to exptime=%g", wf3->exptime[group-1]);
+		 } else if (sweep->darktype[group-1] == EXTRAP && frame1 != 0) {
+		     trlwarn("DARKCORR using dark imset %d for imset %d", frame1, group);
+		     trlwarn("         extrapolated to exptime=%g", wf3->exptime[group-1]);
+		 } else if (sweep->darktype[group-1] == EXTRAP && frame2 != 0) {
+		     trlwarn("DARKCORR using dark imset %d for imset %d", frame2, group);
+		     trlwarn("         extrapolated to exptime=%g", wf3->exptime[group-1]);
+		 }
 	    }
 
 	    /* Print status to trailer */
@@ -65,6 +69,10 @@ int doDarkIR (WF3Info *wf3, MultiNicmosGroup *input) {
 ** with the science data errors and DQ flags. The input SAMP and TIME
 ** arrays are unchanged.
 **
+** darkRow subtracts one row of the dark image; darkMean populates
+** MEANDARK once the image has been subtracted. Both make the dark image
+** pixel by pixel from the reference groups in the dark data.
+**
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
 ** H.Bushouse	20-Mar-2002	Added use of RebinRef to extract subarray
@@ -78,55 +86,122 @@ int doDarkIR (WF3Info *wf3, MultiNicmosGroup *input) {
 ** H.Bushouse	14-May-2010	Added computation of MEANDARK.
 */
 
-static int darkcorr (WF3Info *wf3, SingleNicmosGroup *input,
-		     SingleNicmosGroup *dark) {
+/* DARKPIX: Dark image pixel (i,j). An interpolated pixel is computed
+** with the same steps as asub, amulk and aadd would take on the whole
+** images, and an extrapolated one as amulk, so that the values don't
+** depend on how the dark is made.
+*/
+
+static inline void darkPix (const DarkData *dark, int i, int j,
+			    float *sci, float *err, short *dq) {
+
+	float s1, e1, s2, e2;
+
+	s1 = Pix(dark->d1->sci.data,i,j);
+	e1 = Pix(dark->d1->err.data,i,j);
+	*dq = DQPix(dark->d1->dq.data,i,j);
+
+	switch (dark->type) {
+	case INTERP:
+	    s2 = Pix(dark->d2->sci.data,i,j);
+	    e2 = Pix(dark->d2->err.data,i,j);
+	    *dq |= DQPix(dark->d2->dq.data,i,j);
+
+	    e2  = sqrt(e2*e2 + e1*e1);
+	    s2 -= s1;
+	    s2 *= dark->frac;
+	    e2 *= dark->frac;
+	    *err = sqrt(e1*e1 + e2*e2);
+	    *sci = s1 + s2;
+	    break;
+	case EXTRAP:
+	    *sci = s1 * dark->frac;
+	    *err = e1 * dark->frac;
+	    break;
+	default:
+	    *sci = s1;
+	    *err = e1;
+	}
+}
+
+void darkRow (WF3Info *wf3, SingleNicmosGroup *input, DarkData *dark, int j) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
-**	dark	 i: dark current image
 **	input	io: image to be dark subtracted
+**	dark	 i: dark reference data
+**	j	 i: image row
+*/
+
+	/* Local variables */
+	int i;			/* array index */
+	int ibeg, iend;		/* loop limits */
+	int jbeg, jend;		/* loop limits */
+	float aerr;		/* input error */
+	float dsci, derr;	/* dark value and error */
+	short ddq;		/* dark DQ */
+
+	/* Do the dark subtraction in-place in input, as in asub_noref;
+	** this subtraction does NOT include the reference pixels. */
+	ibeg = wf3->trimx[0]; iend = input->sci.data.nx - wf3->trimx[1];
+	jbeg = wf3->trimy[0]; jend = input->sci.data.ny - wf3->trimy[1];
+	if (j < jbeg || j >= jend)
+	    return;
+
+	for (i = ibeg; i < iend; i++) {
+
+	     darkPix (dark, i, j, &dsci, &derr, &ddq);
+
+	     /* error data */
+	     aerr = Pix(input->err.data,i,j);
+	     Pix(input->err.data,i,j) = sqrt(aerr*aerr + derr*derr);
+
+	     /* science data */
+	     Pix(input->sci.data,i,j) -= dsci;
+
+	     /* data quality */
+	     DQSetPix(input->dq.data,i,j, DQPix(input->dq.data,i,j) | ddq);
+	}
+}
+
+int darkMean (WF3Info *wf3, SingleNicmosGroup *input, DarkData *dark) {
+
+/* Arguments:
+**	wf3	 i: WFC3 info structure
+**	input	io: dark subtracted image
+**	dark	 i: dark reference data
 */
 
         /* Local variables */
+        int i, j;                       /* pixel indexes */
         int i1, i2, j1, j2;             /* stats pixel limits */
+        int npix;                       /* unrejected pixels */
         short dqmask;                   /* mask for stat rejs */
-        float low, high;                /* stat rej limits */
-        float mean, median, mode;       /* stats */
-        float stdv, min, max;           /* more stats */
+        float mean;                     /* mean dark value */
+        float dsci, derr;               /* dark pixel */
+        short ddq;
+        double sumx;                    /* sum of unrejected values */
 
 	/* Function definitions */
-	void asub_noref (WF3Info *, SingleNicmosGroup *, SingleNicmosGroup *);
-        int stats (SingleNicmosGroup *, int, int, int, int, float, float, short,
-                   float *, float *, float *, float *, float *, float *);
 	int PutKeyFlt (Hdr *, char *, float, char *);
 
-	/* Report which ref file frames are being used */
-	if (wf3->DarkType == MATCH) {
-	    trlmessage("DARKCORR using dark imset %2d for imset %2d with exptime=%8.6g",
-		     wf3->darkframe1, wf3->group, wf3->exptime[wf3->group-1]);
-	} else if (wf3->DarkType == INTERP) {
-	    trlwarn("DARKCORR using dark imsets %d and %d for imset %d", wf3->darkframe1, wf3->darkframe2, wf3->group);
-	    trlwarn("         interpolated to exptime=%g", wf3->exptime[wf3->group-1]);
-	} else if (wf3->DarkType == EXTRAP && wf3->darkframe1 != 0) {
-	    trlwarn("DARKCORR using dark imset %d for imset %d", wf3->darkframe1, wf3->group);
-	    trlwarn("         extrapolated to exptime=%g", wf3->exptime[wf3->group-1]);
-	} else if (wf3->DarkType == EXTRAP && wf3->darkframe2 != 0) {
-	    trlwarn("DARKCORR using dark imset %d for imset %d", wf3->darkframe2, wf3->group);
-	    trlwarn("         extrapolated to exptime=%g", wf3->exptime[wf3->group-1]);
-	}
-
-	/* Do the dark subtraction in-place in input;
-	** this subtraction does NOT include the reference pixels. */
-	asub_noref (wf3, input, dark);
-
-	/* Compute the mean of the dark image and populate MEANDARK */
+	/* Compute the mean of the dark image and populate MEANDARK; only
+	** the mean of the statistics that stats would give is needed */
 	dqmask = 4+8+16+32+128+256+512;
-	low = -FLT_MAX; high = FLT_MAX;
 	i1 = wf3->trimx[0]; i2 = input->sci.data.nx - wf3->trimx[1] - 1;
 	j1 = wf3->trimy[0]; j2 = input->sci.data.ny - wf3->trimy[1] - 1;
-	if (stats (dark,i1,i2,j1,j2,low,high,dqmask,&mean,&median,&mode,
-		   &stdv,&min,&max))
-	    return (status = -1);
+	npix = 0;
+	sumx = 0;
+	for (j = j1; j <= j2; j++) {
+	     for (i = i1; i <= i2; i++) {
+		  darkPix (dark, i, j, &dsci, &derr, &ddq);
+		  if (!(dqmask & ddq) && dsci > -FLT_MAX && dsci < FLT_MAX) {
+		      sumx += dsci;
+		      npix++;
+		  }
+	     }
+	}
+	mean = (npix > 0) ? sumx / npix : 0;
 
 	if (PutKeyFlt (&input->sci.hdr, "MEANDARK", mean, ""))
 	    return (status);
@@ -134,4 +209,3 @@ static int darkcorr (WF3Info *wf3, SingleNicmosGroup *input,
 	/* Successful return */
 	return (status = 0);
 }
-
@@ -5,6 +5,7 @@
 # include "hstio.h"	/* defines HST I/O functions */
 # include "wf3.h"
 # include "wf3info.h"
+# include "irsweep.h"
 # include "hstcalerr.h"
 # include "trlbuf.h"
 
@@ -71,6 +72,7 @@ int DoIR (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *crimage) {
 	Bool subarray;
 	SingleNicmosGroup zoff;		/* original zero-read image */
 	static SingleNicmosGroup zsig;	/* zero-read signal image */
+	IRSweep sweep;			/* outcome of the per-read steps */
 
 	/* Function definitions */
 	int getDarkInfo (WF3Info *);
@@ -86,12 +88,12 @@ int DoIR (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *crimage) {
 	int doDQIIR  (WF3Info *, MultiNicmosGroup *);
 	int doBlevIR (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *);
 	int doZsigIR (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *);
-	int doZoffIR (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *);
-	int doNoisIR (WF3Info *, MultiNicmosGroup *);
-	int doDarkIR (WF3Info *, MultiNicmosGroup *);
-	int doNlinIR (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *);
+	int doZoffIR (WF3Info *);
+	int doNoisIR (WF3Info *, IRSweep *);
+	int doDarkIR (WF3Info *, IRSweep *);
+	int doNlinIR (WF3Info *, IRSweep *);
 	int doFlatIR (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *);
-	int doUnitIR (WF3Info *, MultiNicmosGroup *);
+	int doUnitIR (WF3Info *, IRSweep *);
         int photcalc (WF3Info *, MultiNicmosGroup *);
 	int cridcalc (WF3Info *, MultiNicmosGroup *, SingleNicmosGroup *);
 	int statcalc (WF3Info *, SingleNicmosGroup *, short);
@@ -228,31 +230,38 @@ int DoIR (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *crimage) {
 	if (blevIRHistory (wf3, input->group[0].globalhdr))
 	    return (status);
 
+	/* Do the per-pixel work of the zero-read subtraction, noise
+	** calculation, linearity correction, dark subtraction and units
+	** conversion in one sweep through each group. The steps are
+	** reported below in turn. */
+	if (doSweepIR (wf3, input, &zoff, &zsig, &sweep))
+	    return (status);
+	freeSingleNicmosGroup (&zoff);
+
 	/* Do MultiAccum zero-read subtraction */
 	zoffMsg (wf3);
-	if (doZoffIR (wf3, input, &zoff))
+	if (doZoffIR (wf3))
 	    return (status);
 	if (zoffIRHistory (wf3, input->group[0].globalhdr))
 	    return (status);
-	freeSingleNicmosGroup (&zoff);
 
 	/* Do noise (error) calculation */
 	noisMsg (wf3);
-	if (doNoisIR (wf3, input))
+	if (doNoisIR (wf3, &sweep))
 	    return (status);
 	if (noisIRHistory (wf3, input->group[0].globalhdr))
 	    return (status);
 
 	/* Do linearity correction */
 	nlinMsg (wf3);
-	if (doNlinIR (wf3, input, &zsig))
+	if (doNlinIR (wf3, &sweep))
 	    return (status);
 	if (nlinIRHistory (wf3, input->group[0].globalhdr))
 	    return (status);
 
 	/* Do dark subtraction */
 	darkMsg (wf3);
-	if (doDarkIR (wf3, input))
+	if (doDarkIR (wf3, &sweep))
 	    return (status);
 	if (darkIRHistory (wf3, input->group[0].globalhdr))
 	    return (status);
@@ -276,7 +285,7 @@ int DoIR (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *crimage) {
 
 	/* Do units conversion */
 	unitMsg (wf3);
-	if (doUnitIR (wf3, input))
+	if (doUnitIR (wf3, &sweep))
 	    return (status);
 	if (unitIRHistory (wf3, input->group[0].globalhdr))
 	    return (status);
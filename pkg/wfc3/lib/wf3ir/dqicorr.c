@@ -1,4 +1,3 @@
-# include <xtables.h>
 #include "hstcal.h"
 # include "hstio.h"	/* defines HST I/O functions */
 
@@ -6,31 +5,7 @@
 # include "wf3info.h"
 # include "hstcalerr.h"
 # include "wf3dq.h"
-
-typedef struct {
-        IRAFPointer tp;                 /* pointer to table descriptor */
-        IRAFPointer cp_xstart, cp_ystart; /* starting pixel for bad values */
-        IRAFPointer cp_length;          /* this many bad values */
-        IRAFPointer cp_axis;            /* repeat along X or Y axis (1 or 2) */
-        IRAFPointer cp_flag;            /* this is the data quality value */
-	IRAFPointer cp_amp;		/* selection columns */
-	IRAFPointer cp_ccdchip;
-	IRAFPointer cp_ccdgain;
-	int axlen1, axlen2;		/* DQ array size specified in header */
-        int nrows;                      /* number of rows in table */
-} TblInfo;
-
-typedef struct {
-        /* values read from a table row */
-        int xstart, ystart;
-        int length;
-        int axis;
-        short flag;
-	/* values used for selecting row to be used */
-	char ccdamp[SZ_CBUF+1];
-	float ccdgain;
-	int ccdchip;
-} TblRow;
+# include "hstcal_dqmask.h"
 
 extern int status;
 
@@ -75,29 +50,17 @@ int doDQIIR (WF3Info *wf3, MultiNicmosGroup *input) {
 */
 
 	/* Local variables */
-	TblInfo tabinfo;	/* pointer to table descriptor, etc */
-	TblRow  tabrow;		/* values read from a table row */
+	DQMask *bpixmask;		/* selected BPIXTAB rows */
 
 	/* mappings from one coordinate system to another */
 	double ri_m[2], ri_v[2];	/* reference to image */
-	int row;			/* loop index for row number */
-	int nrows;			/* number of rows applied */
 	int npix[2];			/* size of current image */
-	int sameamp, samegain, samechip;
 
 	SingleNicmosGroup mask;		/* temporary DQ mask image */
 
 	/* Function definitions */
 	int  GetLT0 (Hdr *, double *, double *);
-	int  SameInt (int, int);
-	int  SameFlt (float, float);
-	int  SameString (char *, char *);
-
-	int  OpenBpixTab (char *, TblInfo *);
-	int  ReadBpixTab (TblInfo *, int, TblRow *);
-	int  CloseBpixTab (TblInfo *);
-
-	void DQINormal (DQHdrData *, double *, TblRow *);
+	int  GetBpixMask (WF3Info *, double *, DQMask **);
 	void PrSwitch (char *, int);
 
 	/* Do the DQ initialization */
@@ -107,8 +70,9 @@ int doDQIIR (WF3Info *wf3, MultiNicmosGroup *input) {
 	    if (GetLT0 (&(input->group[0].sci.hdr), ri_m, ri_v))
 		return (status);
 
-	    /* Open the DQ ref table, find columns, etc. */
-	    if (OpenBpixTab (wf3->bpix.name, &tabinfo))
+	    /* Get the BPIXTAB rows selected for this chip, amp and gain,
+	    ** read and rasterised once per selection (lib/dodqi.c) */
+	    if (GetBpixMask (wf3, ri_m, &bpixmask))
 		return (status);
 
 	    /* Size of current (science) image */
@@ -122,51 +86,10 @@ int doDQIIR (WF3Info *wf3, MultiNicmosGroup *input) {
 		return (status = OUT_OF_MEMORY);
 	    }
 
-	    /* Read each row of the table and load DQ values into mask image */
-	    nrows = 0;
-	    for (row = 1; row <= tabinfo.nrows; row++) {
-		 if (ReadBpixTab (&tabinfo, row, &tabrow)) {
-		     trlerror("Error reading BPIXTAB.");
-		     return (status);
-		 }
-
-		 /* If CCDAMP column does not exist or it has a wildcard value,
-		 ** always return a match. */
-		 if (tabinfo.cp_amp == 0 || SameString(tabrow.ccdamp, "N/A")) {
-		     sameamp = 1;
-		 } else {
-		     sameamp = SameString (tabrow.ccdamp, wf3->ccdamp);
-		 }
-
-		 /* If CCDGAIN column does not exist or it has a wildcard value,
-		 ** always return a match. */
-		 if (tabinfo.cp_ccdgain == 0 || tabrow.ccdgain == -999) {
-		     samegain = 1;
-		 } else {
-		     samegain = SameFlt (tabrow.ccdgain, wf3->ccdgain);
-		 }
-
-		 /* If CCDCHIP column does not exist or it has a wildcard value,
-		 ** always return a match. */
-		 if (tabinfo.cp_ccdchip == 0 || tabrow.ccdchip == -999) {
-		     samechip = 1;
-		 } else {
-		     samechip = SameInt (tabrow.ccdchip, wf3->chip);
-		 }
-
-		 /* Check for a match with selection criteria */
-		 if (sameamp && samegain && samechip) {
-
-		     /* Assign the flag values to all relevant pixels */
-		     DQINormal (&(mask.dq), ri_v, &tabrow);
-		     nrows += 1;
-		 }
-	    }
-
-	    if (CloseBpixTab (&tabinfo))	/* done with the table */
-		return (status);
+	    /* Load the DQ values of the selected rows into the mask image */
+	    orDQMask (bpixmask, &(mask.dq.data), ri_v);
 
-	    if (nrows == 0) {
+	    if (bpixmask->nruns == 0) {
 	        trlwarn("No rows from BPIXTAB applied to DQ array.");
 	    }
 
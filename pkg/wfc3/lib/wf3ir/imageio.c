@@ -17,6 +17,9 @@ extern int status;
 **
 ** getRawData: Reads one group of raw data from input file.
 **
+** shareSmpl: Shares identical SAMP arrays between the groups of a
+**	      MultiAccum.
+**
 ** putCalData: Writes one group of calibrated data to output file.
 **
 ** putCalDataSect: Writes a section of one group of calibrated data to an
@@ -74,6 +77,8 @@ int getPriHdr (WF3Info *wf3, Hdr *PriHdr) {
 	return (status = 0);
 }
 
+static void shareSmpl (MultiNicmosGroup *);
+
 /* GETRAWDATA: Read raw data from input file. One group is read. */
 
 int getRawData (WF3Info *wf3, MultiNicmosGroup *in) {
@@ -120,10 +125,75 @@ int getRawData (WF3Info *wf3, MultiNicmosGroup *in) {
 	     }
 	}
 
+	/* Keep one copy of SAMP arrays that are the same in several groups */
+	shareSmpl (in);
+
 	/* Successful return */
 	return (status = 0);
 }
 
+/* SHARESMPL: The SAMP arrays of a MultiAccum are usually the same
+** constant in all groups, and the IR steps only ever read them. A group
+** whose SAMP array equals that of an earlier group is made to refer to
+** the earlier array and its own is freed. The referring array is left
+** without a buffer of its own, so that freeing its group does not free
+** the shared data, which goes with the owning group. The SAMP arrays
+** must not be written to once they are shared.
+**
+** This is the first part of a compact MultiAccum representation; only
+** SAMP is shared so far. TODO: the rest of it, tracked as a request of
+** its own, since each part changes how every IR step and the hstio
+** writers address a group:
+**  - TIME stored once per read where it is constant (the arrays differ
+**    between reads, and ZOFFCORR rewrites them in place);
+**  - ERR kept as a variance or computed on demand;
+**  - DQ bit-packed;
+**  - reads streamed through the steps that do not need the whole stack
+**    (CRCORR and the IMA output still do).
+*/
+
+static void shareSmpl (MultiNicmosGroup *in) {
+
+/* Arguments:
+**	in	io: input image data
+*/
+
+	/* Local variables */
+	int k, m;		/* group indexes */
+	size_t npix;		/* pixels in the array */
+	ShortTwoDArray *smpl;	/* SAMP array of group k */
+	ShortTwoDArray *owner;	/* SAMP array of earlier group m */
+
+	for (k = 1; k < in->ngroups; k++) {
+	     smpl = &(in->group[k].smpl.data);
+	     if (smpl->buffer == NULL || smpl->data != smpl->buffer)
+		 continue;
+	     npix = (size_t)smpl->tot_nx * smpl->tot_ny;
+
+	     for (m = 0; m < k; m++) {
+		  owner = &(in->group[m].smpl.data);
+
+		  /* Compare only with arrays that have their own data */
+		  if (owner->buffer == NULL || owner->data != owner->buffer ||
+		      owner->tot_nx != smpl->tot_nx ||
+		      owner->tot_ny != smpl->tot_ny)
+		      continue;
+
+		  if (memcmp (owner->data, smpl->data,
+			      npix * sizeof(short)) == 0) {
+		      freeShortData (smpl);
+		      smpl->tot_nx = owner->tot_nx;
+		      smpl->tot_ny = owner->tot_ny;
+		      smpl->nx = owner->nx;
+		      smpl->ny = owner->ny;
+		      smpl->storageOrder = owner->storageOrder;
+		      smpl->data = owner->data;
+		      break;
+		  }
+	     }
+	}
+}
+
 /* PUTCALDATA: Write calibrated data to a single-group ouput file. */
 
 int putCalData (SingleNicmosGroup *out, char *fname) {
@@ -0,0 +1,180 @@
+# include <string.h>
+
+#include "hstcal.h"
+# include "hstio.h"	/* defines HST I/O functions */
+# include "wf3.h"
+# include "wf3info.h"
+# include "irsweep.h"
+# include "trlbuf.h"
+
+extern int status;
+
+/* DOSWEEPIR: Apply the ZOFFCORR, NOISCORR, NLINCORR, DARKCORR and UNITCORR
+** steps to all readouts of a MultiAccum in a single sweep, see irsweep.h.
+**
+** Each group is visited once, from the zeroth read up, and the enabled
+** steps are applied to it row by row in pipeline order. The parts of the
+** steps that need the whole group come before its rows are swept (the
+** zero-read exposure time, the check for an already populated ERR array,
+** selecting the dark reference groups) or after (MEANDARK, the BUNIT keywords).
+** Saturation flags are carried into the next group row by row, which is
+** still ahead of that group's linearity correction. The rows of a group
+** are independent, and are swept in parallel when built with OpenMP.
+**
+** The outcome of each step is saved in sweep for doZoffIR, doNoisIR,
+** doNlinIR, doDarkIR and doUnitIR to report.
+*/
+
+int doSweepIR (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *zoff,
+	       SingleNicmosGroup *zsig, IRSweep *sweep) {
+
+/* Arguments:
+**	wf3	 i: WFC3 info structure
+**	input	io: input image
+**	zoff	 i: zeroth read image
+**	zsig	 i: MULTIACCUM zero-read signal image
+**	sweep	 o: results of the sweep through the groups
+*/
+
+	/* Local variables */
+	int j;			/* row index */
+	int nsatpix;		/* saturated pixels in the group */
+	int nois;		/* noise calculation still being done */
+	int unit;		/* group to be converted to countrates */
+	int li_beg, lj_beg;	/* nlin ref data offsets */
+	double ztime;		/* zero-read exposure time */
+	NlinData nlin;		/* nonlinearity reference data */
+	DarkData dark;		/* dark reference data */
+	SingleNicmosGroup *group;
+
+	/* Function definitions */
+	int getNlinData (WF3Info *, NlinData *);
+	void freeNlinData (NlinData *);
+	int getDarkData (WF3Info *, DarkData *, int);
+	void initDarkData (DarkData *);
+	void freeDarkData (DarkData *);
+
+	memset (sweep, 0, sizeof(IRSweep));
+	sweep->zoffcorr = (wf3->zoffcorr == PERFORM);
+	sweep->noiscorr = (wf3->noiscorr == PERFORM);
+	sweep->nlincorr = (wf3->nlincorr == PERFORM);
+	sweep->darkcorr = (wf3->darkcorr == PERFORM);
+	sweep->unitcorr = (wf3->unitcorr == PERFORM);
+
+	if (!sweep->zoffcorr && !sweep->noiscorr && !sweep->nlincorr &&
+	    !sweep->darkcorr && !sweep->unitcorr)
+	    return (status = 0);
+
+	/* Get the zero-read exposure time */
+	ztime = 0;
+	if (sweep->zoffcorr) {
+	    if (zoffTime (wf3, zoff, &ztime))
+		return (status);
+	}
+
+	/* Load the nlin reference file data */
+	if (sweep->nlincorr) {
+	    if (getNlinData (wf3, &nlin))
+		return (status);
+	}
+
+	initDarkData (&dark);
+	nois = sweep->noiscorr;
+	for (wf3->group=wf3->ngroups; wf3->group >= 1; wf3->group--) {
+	     group = &(input->group[wf3->group-1]);
+
+	     /* Subtract the exposure time of the zero-read image
+	     ** from the exposure time of the group */
+	     if (sweep->zoffcorr)
+		 wf3->exptime[wf3->group-1] -= ztime;
+
+	     /* Stop the noise calculation at the first group
+	     ** whose ERR array has been populated before */
+	     if (nois && errPopulated (wf3, group)) {
+		 sweep->noisskip = wf3->group;
+		 nois = 0;
+	     }
+
+	     if (sweep->nlincorr) {
+		 if (nlinCorner (wf3, group, &nlin, &li_beg, &lj_beg)) {
+		     freeDarkData (&dark);
+		     freeNlinData (&nlin);
+		     return (status);
+		 }
+	     }
+
+	     /* Get the dark reference groups for this group; the
+	     ** ones the previous group used are kept if still needed */
+	     if (sweep->darkcorr) {
+		 if (getDarkData (wf3, &dark, wf3->group)) {
+		     freeDarkData (&dark);
+		     if (sweep->nlincorr)
+			 freeNlinData (&nlin);
+		     return (status);
+		 }
+		 sweep->darktype[wf3->group-1]   = wf3->DarkType;
+		 sweep->darkframe1[wf3->group-1] = wf3->darkframe1;
+		 sweep->darkframe2[wf3->group-1] = wf3->darkframe2;
+	     }
+
+	     /* Skip conversion if units are already countrate */
+	     unit = sweep->unitcorr && wf3->bunit[wf3->group-1] != COUNTRATE;
+	     sweep->unitskip[wf3->group-1] = sweep->unitcorr && !unit;
+
+	     /* The rows are independent of one another */
+	     nsatpix = 0;
+# ifdef _OPENMP
+	     #pragma omp parallel for reduction(+:nsatpix) schedule(static)
+# endif
+	     for (j = 0; j < group->sci.data.ny; j++) {
+
+		  if (sweep->zoffcorr)
+		      zoffRow (group, zoff, j);
+
+		  if (nois)
+		      noisRow (wf3, group, j);
+
+		  if (sweep->nlincorr) {
+		      nsatpix += nlinRow (wf3, group, &nlin, zsig, j,
+					  li_beg, lj_beg);
+
+		      /* Flag pixels in the next group as saturated if
+		      ** they're flagged as saturated in this group */
+		      if (wf3->group-1 > 0)
+			  satcheckRow (group, &(input->group[wf3->group-2]), j);
+		  }
+
+		  if (sweep->darkcorr)
+		      darkRow (wf3, group, &dark, j);
+
+		  if (unit)
+		      unitRow (wf3, group, j);
+	     }
+	     sweep->nsatpix[wf3->group-1] = nsatpix;
+
+	     if (sweep->darkcorr) {
+		 if (darkMean (wf3, group, &dark)) {
+		     freeDarkData (&dark);
+		     if (sweep->nlincorr)
+			 freeNlinData (&nlin);
+		     return (status);
+		 }
+	     }
+
+	     if (unit) {
+		 if (unitKeys (wf3, group)) {
+		     freeDarkData (&dark);
+		     if (sweep->nlincorr)
+			 freeNlinData (&nlin);
+		     return (status);
+		 }
+	     }
+	}
+
+	freeDarkData (&dark);
+	if (sweep->nlincorr)
+	    freeNlinData (&nlin);
+
+	/* Successful return */
+	return (status = 0);
+}
@@ -6,16 +6,15 @@
 # include "wf3.h"
 # include "wf3info.h"
 # include "wf3dq.h"
+# include "irsweep.h"
 # include "trlbuf.h"
 
 extern int status;
 
-static int nlincorr (WF3Info *, SingleNicmosGroup *, NlinData *,
-		     SingleNicmosGroup *);
-
-/* DONLIN: Call NLINCORR for all readouts of a MultiAccum.
+/* DONLIN: Report the NLINCORR step, which is done for all readouts of a
+**	   MultiAccum by doSweepIR.
 **
-**	   After each MultiAccum group is corrected the routine also
+**	   After each MultiAccum group is corrected the sweep also
 **	   sets saturation flags in the next group for those pixels
 **	   that are flagged as saturated in the current group. This
 **	   is necessary because the SCI image value of a saturated
@@ -28,46 +27,24 @@ static int nlincorr (WF3Info *, SingleNicmosGroup *, NlinData *,
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
 */
 
-int doNlinIR (WF3Info *wf3, MultiNicmosGroup *input,
-	      SingleNicmosGroup *zsig) {
+int doNlinIR (WF3Info *wf3, IRSweep *sweep) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
-**	input	io: input image to be corrected
-**	zsig	 i: MULTIACCUM zero-read signal image
+**	sweep	 i: results of the sweep through the groups
 */
 
 	/* Local variables */
-	NlinData nlin;
+	int group;		/* group number */
 
 	/* Function definitions */
-	int getNlinData (WF3Info *, NlinData *);
-	void freeNlinData (NlinData *);
-	void satcheck (SingleNicmosGroup *, SingleNicmosGroup *);
 	void PrSwitch (char *, int);
 
-	/* Do the non-linearity correction for each group */
-	if (wf3->nlincorr == PERFORM) {
-
-	    /* Load the nlin reference file data */
-	    if (getNlinData (wf3, &nlin))
-		return (status);
-
-	    /* Loop over MultiAccum groups */
-	    for (wf3->group=wf3->ngroups; wf3->group >= 1; wf3->group--) {
-
-		 if (nlincorr (wf3, &(input->group[wf3->group-1]), &nlin,
-			       zsig))
-		     return (status);
+	if (sweep->nlincorr) {
 
-		 /* Flag pixels in the next group as saturated if they're
-		 ** flagged as saturated in the current group */
-		 if (wf3->group-1 > 0)
-		     satcheck (&(input->group[wf3->group-1]),
-			       &(input->group[wf3->group-2]));
-	    }
-
-	    freeNlinData (&nlin);
+	    /* Report the number of saturated pixels */
+	    for (group=wf3->ngroups; group >= 1; group--)
+		 trlmessage("NLINCORR detected %d saturated pixels in imset %d", sweep->nsatpix[group-1], group);
 
 	    PrSwitch ("nlincorr", COMPLETE);
 	}
@@ -102,6 +79,9 @@ int doNlinIR (WF3Info *wf3, MultiNicmosGroup *input,
 ** The SCI and ERR arrays are updated, and the DQ values are propagated.
 ** The SAMP and TIME arrays are not modified.
 **
+** nlinCorner locates the group within the ref data; nlinRow corrects one
+** row of the group.
+**
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
 ** H.Bushouse	21-Mar-2002	Modified to support WFC3 IR subarrays.
@@ -122,30 +102,23 @@ int doNlinIR (WF3Info *wf3, MultiNicmosGroup *input,
 **				this time. This will be added in the future.
 */
 
-static int nlincorr (WF3Info *wf3, SingleNicmosGroup *input, NlinData *nlin,
-		     SingleNicmosGroup *zsig) {
+int nlinCorner (WF3Info *wf3, SingleNicmosGroup *input, NlinData *nlin,
+		int *li_beg, int *lj_beg) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
-**	input	io: input image to be corrected
+**	input	 i: input image to be corrected
 **	nlin	 i: nonlinearity reference data
-**	zsig	 i: MULTIACCUM zero-read signal image
+**	li_beg	 o: ref data column of the first corrected column
+**	lj_beg	 o: ref data row of the first corrected row
 */
 
 	/* Local variables */
-	int i, j, li, lj, k;	/* pixel indexes */
-	int ibeg, iend;		/* loop limits */
-	int jbeg, jend;		/* loop limits */
-	int li_beg, lj_beg;	/* loop limits */
 	int rsize = 1;		/* for use by GetCorner */
 	int sci_bin[2];		/* bin size of science image */
 	int sci_corner[2];	/* science image corner location */
 	int ref_bin[2];		/* bin size of reference image */
 	int ref_corner[2];	/* ref image corner location */
-	int nsatpix;		/* number of saturated pixels */
-	float sval, eval;	/* science and err image values */
-	float corr;		/* correction value */
-	float n1;		/* node value */
 
 	/* Function definitions */
 	int GetCorner (Hdr *, int, int *, int*);
@@ -157,73 +130,120 @@ static int nlincorr (WF3Info *wf3, SingleNicmosGroup *input, NlinData *nlin,
 	if ( (status = GetCorner(&nlin->coeff[0].hdr, rsize, ref_bin, ref_corner)))
 	    return (status);
 
+	*li_beg = (sci_corner[0] - ref_corner[0]) + wf3->trimx[0];
+	*lj_beg = (sci_corner[1] - ref_corner[1]) + wf3->trimy[0];
+
+	/* Successful return */
+	return (status = 0);
+}
+
+int nlinRow (WF3Info *wf3, SingleNicmosGroup *input, NlinData *nlin,
+	     SingleNicmosGroup *zsig, int j, int li_beg, int lj_beg) {
+
+/* Arguments:
+**	wf3	 i: WFC3 info structure
+**	input	io: input image to be corrected
+**	nlin	 i: nonlinearity reference data
+**	zsig	 i: MULTIACCUM zero-read signal image
+**	j	 i: image row
+**	li_beg	 i: ref data column of the first corrected column
+**	lj_beg	 i: ref data row of the first corrected row
+**
+** Returns the number of saturated pixels in the row.
+*/
+
+	/* Local variables */
+	int i, lj, k;		/* pixel indexes */
+	int ibeg, iend;		/* loop limits */
+	int jbeg, jend;		/* loop limits */
+	int npix;		/* pixels in the row */
+	int nsatpix;		/* number of saturated pixels */
+	int addzsig;		/* add the zero-read signal back in */
+	float *sci;		/* science image row */
+	short *dq;		/* DQ image row */
+	const float *zsci;	/* zero-read signal row */
+	const short *zdq;
+	const float *node;	/* saturation node row */
+	const short *ndq;	/* nlin ref DQ row */
+	float *coeff[NLIN_MAXCOEFF];	/* coefficient rows */
+
 	/* Initialize saturated pixel counter */
 	nsatpix = 0;
 
-	/* Loop through science image */
+	/* Loop through science image row */
 	ibeg = wf3->trimx[0]; iend = input->sci.data.nx - wf3->trimx[1];
 	jbeg = wf3->trimy[0]; jend = input->sci.data.ny - wf3->trimy[1];
-	li_beg = (sci_corner[0] - ref_corner[0]) + ibeg;
-	lj_beg = (sci_corner[1] - ref_corner[1]) + jbeg;
-
-	for (j = jbeg, lj = lj_beg; j < jend; j++, lj++) {
-	for (i = ibeg, li = li_beg; i < iend; i++, li++) {
-
-	     /* Get the science and error image values */
-	     sval = Pix(input->sci.data,i,j);
-	     eval = Pix(input->err.data,i,j);
-
-	     /* Temporarily add the MULTIACCUM zero-read signal back into the
-	     ** the pixel value, but only if ZSIG step is turned on and only
-	     ** for groups other than the zeroth-read itself */
-	     if (wf3->zsigcorr == PERFORM && wf3->group != wf3->ngroups) {
-		 sval += Pix(zsig->sci.data,i,j);
-		 if (DQPix(zsig->dq.data,i,j) & ZEROSIG) {
-		     DQSetPix(input->dq.data,i,j,
-			DQPix(input->dq.data,i,j) | ZEROSIG);
-		 }
+	if (j < jbeg || j >= jend || iend <= ibeg)
+	    return (nsatpix);
+	lj = lj_beg + (j - jbeg);
+	npix = iend - ibeg;
+
+	/* Temporarily add the MULTIACCUM zero-read signal back into the
+	** the pixel values, but only if ZSIG step is turned on and only
+	** for groups other than the zeroth-read itself */
+	addzsig = (wf3->zsigcorr == PERFORM && wf3->group != wf3->ngroups);
+
+	sci  = &Pix(input->sci.data,ibeg,j);
+	dq   = &DQPix(input->dq.data,ibeg,j);
+	zsci = addzsig ? &Pix(zsig->sci.data,ibeg,j) : NULL;
+	zdq  = addzsig ? &DQPix(zsig->dq.data,ibeg,j) : NULL;
+	node = &Pix(nlin->nodes[0].data,li_beg,lj);
+	ndq  = &DQPix(nlin->dqual[0].data,li_beg,lj);
+	for (k=0; k < nlin->ncoeff; k++)
+	     coeff[k] = &Pix(nlin->coeff[k].data,li_beg,lj);
+
+	/* The pixels are independent, and the polynomial is evaluated
+	** without calls to pow: the powers of the pixel value are built
+	** up by multiplication in double precision. Up to the cube each
+	** takes a single rounding, agreeing with pow to the last bit of a
+	** double, well below the precision of the float result. */
+# ifdef _OPENMP
+	#pragma omp simd reduction(+:nsatpix)
+# endif
+	for (i = 0; i < npix; i++) {
+	     float sval = sci[i];
+	     short flags = dq[i];
+	     float corr;		/* correction value */
+	     double power;		/* sval to the k */
+
+	     if (addzsig) {
+		 sval += zsci[i];
+		 flags |= zdq[i] & ZEROSIG;
 	     }
 
-	     /* Get the node values for this pixel */
-	     n1 = Pix(nlin->nodes[0].data,li,lj);
-
 	     /* Propagate the DQ value from the NLIN ref data */
-	     DQSetPix(input->dq.data,i,j,
-		DQPix(input->dq.data,i,j) | DQPix(nlin->dqual[0].data,li,lj));
+	     flags |= ndq[i];
 
 	     /* If it's already flagged as saturated,
 	     ** skip the correction */
-	     if (DQPix(input->dq.data,i,j) & SATPIXEL) {
+	     if (flags & SATPIXEL) {
 		 nsatpix++;
 
 	     /* Apply the correction for the non-linear region */
-	     /*} else if (sval >= n1 && sval <= n2) {*/
-	     } else if (sval <= n1) {
-
-	       /* Compute the new science image pixel value */
-	       corr = 1.0;
-	       for (k=0; k < nlin->ncoeff; k++)
-		    corr += Pix(nlin->coeff[k].data,li,lj) * (pow(sval,k));
-	       Pix(input->sci.data,i,j) = sval * corr;
+	     } else if (sval <= node[i]) {
+
+		 /* Compute the new science image pixel value */
+		 corr = 1.0;
+		 power = 1.0;
+		 for (k=0; k < nlin->ncoeff; k++) {
+		      corr += coeff[k][i] * power;
+		      power *= sval;
+		 }
+		 sci[i] = sval * corr;
 
-	       /* Remove the MULTIACCUM zero-read signal that was added in
-	       ** above, but only if ZSIG step is turned on and only for
-	       ** groups other than the zeroth-read itself */
-	       if (wf3->zsigcorr == PERFORM && wf3->group != wf3->ngroups)
-		   Pix(input->sci.data,i,j) -= Pix(zsig->sci.data,i,j);
+		 /* Remove the MULTIACCUM zero-read signal that was
+		 ** added in above */
+		 if (addzsig)
+		     sci[i] -= zsci[i];
 
 	     /* Above the saturation node, just mark the pixel as saturated */
-	     } else if (sval > n1) {
-	       nsatpix++;
-	       DQSetPix(input->dq.data,i,j,
-		  DQPix(input->dq.data,i,j) | SATPIXEL);
+	     } else if (sval > node[i]) {
+		 nsatpix++;
+		 flags |= SATPIXEL;
 	     }
-	}}
 
-	/* Report the number of saturated pixels */
-	trlmessage("NLINCORR detected %d saturated pixels in imset %d", nsatpix, wf3->group);
+	     dq[i] = flags;
+	}
 
-	/* Successful return */
-	return (status = 0);
+	return (nsatpix);
 }
-
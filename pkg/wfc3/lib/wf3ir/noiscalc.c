@@ -5,11 +5,13 @@
 # include "hstio.h"	/* defines HST I/O functions */
 # include "wf3.h"
 # include "wf3info.h"
+# include "irsweep.h"
 # include "trlbuf.h"
 
 extern int status;
 
-/* DoNoisIR: Call NOISCALC for each readout of a MultiAccum.
+/* DoNoisIR: Report the NOISCALC step, which is done for each readout of
+** a MultiAccum by doSweepIR.
 **
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
@@ -21,27 +23,23 @@ extern int status;
 **				processing. (PR 66081)
 */
 
-int doNoisIR (WF3Info *wf3, MultiNicmosGroup *input) {
+int doNoisIR (WF3Info *wf3, IRSweep *sweep) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
-**	input	io: input image
+**	sweep	 i: results of the sweep through the groups
 */
 
 	/* Function definitions */
-	int noiscalc (WF3Info *, SingleNicmosGroup *);
 	int OmitStep (int);
 	void PrSwitch (char *, int);
 
-	/* Do the noise calculation for each group */
-	if (wf3->noiscorr == PERFORM) {
-
-	    for (wf3->group=wf3->ngroups; wf3->group >= 1; wf3->group--) {
-		 if (noiscalc (wf3, &(input->group[wf3->group-1]))) {
-		     PrSwitch ("noiscorr", SKIPPED);
-		     return (status=0);
-		 }
-	    }
+	/* The noise calculation stopped at a group whose ERR array
+	** had already been populated */
+	if (sweep->noiscorr && sweep->noisskip) {
+	    wf3->noiscorr = SKIPPED;
+	    PrSwitch ("noiscorr", SKIPPED);
+	    return (status=0);
 	}
 
 	/* Print status to trailer */
@@ -64,6 +62,11 @@ int doNoisIR (WF3Info *wf3, MultiNicmosGroup *input) {
 ** ELECTRONS (not DNs). The noise calculation is performed in units of
 ** electrons and then converted back to DNs.
 **
+** errPopulated checks whether any ERR value outside the reference
+** pixels is non-zero, i.e. the ERR array has been populated before, in
+** which case doSweepIR stops the calculation; noisRow computes the ERR
+** values of one row.
+**
 ** Revision history:
 ** H.Bushouse	10-Apr-2002	Modified to skip WFC3 reference pixels by
 **				setting	loop limits based on OSCNTAB trim
@@ -82,102 +85,87 @@ int doNoisIR (WF3Info *wf3, MultiNicmosGroup *input) {
 **				re-entrant processing. (PR 66081)
 */
 
-int noiscalc (WF3Info *wf3, SingleNicmosGroup *input) {
+int errPopulated (WF3Info *wf3, SingleNicmosGroup *input) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
-**	input	io: input image
+**	input	 i: input image
 */
 
 	/* Local variables */
 	int i, j;		/* loop indexes */
 	int ibeg, iend;		/* loop limits */
 	int jbeg, jend;		/* loop limits */
-	int ampx, ampy;		/* AMP readout boundaries */
-	float gain;		/* gain value */
-	float rn2;		/* read noise squared */
-	float noise;		/* noise value */
-	float signal;		/* science image value */
-
-	/* Loop over all pixels in science image, computing err
-	** estimate pixel-by-pixel. Note that loop limits exclude
-	** the IR detector reference pixels. */
 
 	ibeg = wf3->trimx[0]; iend = input->err.data.nx - wf3->trimx[1];
 	jbeg = wf3->trimy[0]; jend = input->err.data.ny - wf3->trimy[1];
 
-	/* First check to see if the ERR array has been populated before.
-	** If it has, then just return without doing anything. */
 	for (j = jbeg; j < jend; j++) {
 	     for (i = ibeg; i < iend; i++) {
-		  if (Pix (input->err.data,i,j) != 0.) {
-		      wf3->noiscorr = SKIPPED;
-		      return (status=1);  /* not an empty array */
-		  }
+		  if (Pix (input->err.data,i,j) != 0.)
+		      return (1);
 	     }
 	}
 
+	return (0);
+}
+
+/* NOISROW: Noise calculation for row j of the image. Rows and columns
+** of IR detector reference pixels are left alone.
+*/
+
+void noisRow (WF3Info *wf3, SingleNicmosGroup *input, int j) {
+
+/* Arguments:
+**	wf3	 i: WFC3 info structure
+**	input	io: input image
+**	j	 i: image row
+*/
+
+	/* Local variables */
+	int i;			/* loop index */
+	int ibeg, iend;		/* loop limits */
+	int jbeg, jend;		/* loop limits */
+	int ampx, ampy;		/* AMP readout boundaries */
+	int amp1, amp2;		/* amps left and right of ampx */
+	float gain;		/* gain value */
+	float rn2;		/* read noise squared */
+	float noise;		/* noise value */
+	float signal;		/* science image value */
+
+	ibeg = wf3->trimx[0]; iend = input->err.data.nx - wf3->trimx[1];
+	jbeg = wf3->trimy[0]; jend = input->err.data.ny - wf3->trimy[1];
+
 	/* Correct AMP readout boundaries for subarray offsets */
 	ampx = wf3->ampx + wf3->offsetx - wf3->trimx[0];
 	ampy = wf3->ampy + wf3->offsety - wf3->trimy[0];
 
-	/* Quad 2 = Amp B */
-	gain = wf3->atodgain[1];
-	rn2  = wf3->readnoise[1] * wf3->readnoise[1];
-	for (j = jbeg; j < ampy; j++) {
-	     for (i = ibeg; i < ampx; i++) {
-
-		  /* Combine (in quadrature) the detector readnoise and the
-		  ** photon noise for each pixel. */
-		  signal = Pix(input->sci.data,i,j);  /* photon noise (in DN) */
-		  noise = sqrt (rn2 + fabs(signal*gain));
-		  Pix(input->err.data,i,j) = noise / gain;
-	     }
+	/* Quad 2 = Amp B and Quad 3 = Amp C from jbeg up to ampy,
+	** Quad 1 = Amp A and Quad 4 = Amp D from ampy up to jend */
+	if (j >= jbeg && j < ampy) {
+	    amp1 = 1; amp2 = 2;
+	} else if (j >= ampy && j < jend) {
+	    amp1 = 0; amp2 = 3;
+	} else
+	    return;
+
+	gain = wf3->atodgain[amp1];
+	rn2  = wf3->readnoise[amp1] * wf3->readnoise[amp1];
+	for (i = ibeg; i < ampx; i++) {
+
+	     /* Combine (in quadrature) the detector readnoise and the
+	     ** photon noise for each pixel. */
+	     signal = Pix(input->sci.data,i,j);  /* photon noise (in DN) */
+	     noise = sqrt (rn2 + fabs(signal*gain));
+	     Pix(input->err.data,i,j) = noise / gain;
 	}
 
-	/* Quad 3 = Amp C */
-	gain = wf3->atodgain[2];
-	rn2  = wf3->readnoise[2] * wf3->readnoise[2];
-	for (j = jbeg; j < ampy; j++) {
-	     for (i = ampx; i < iend; i++) {
-
-		  /* Combine (in quadrature) the detector readnoise and the
-		  ** photon noise for each pixel. */
-		  signal = Pix(input->sci.data,i,j);  /* photon noise (in DN) */
-		  noise = sqrt (rn2 + fabs(signal*gain));
-		  Pix(input->err.data,i,j) = noise / gain;
-	     }
-	}
-
-	/* Quad 1 = Amp A */
-	gain = wf3->atodgain[0];
-	rn2  = wf3->readnoise[0] * wf3->readnoise[0];
-	for (j = ampy; j < jend; j++) {
-	     for (i = ibeg; i < ampx; i++) {
-
-		  /* Combine (in quadrature) the detector readnoise and the
-		  ** photon noise for each pixel. */
-		  signal = Pix(input->sci.data,i,j);  /* photon noise (in DN) */
-		  noise = sqrt (rn2 + fabs(signal*gain));
-		  Pix(input->err.data,i,j) = noise / gain;
-	     }
-	}
+	gain = wf3->atodgain[amp2];
+	rn2  = wf3->readnoise[amp2] * wf3->readnoise[amp2];
+	for (i = ampx; i < iend; i++) {
 
-	/* Quad 4 = Amp D */
-	gain = wf3->atodgain[3];
-	rn2  = wf3->readnoise[3] * wf3->readnoise[3];
-	for (j = ampy; j < jend; j++) {
-	     for (i = ampx; i < iend; i++) {
-
-		  /* Combine (in quadrature) the detector readnoise and the
-		  ** photon noise for each pixel. */
-		  signal = Pix(input->sci.data,i,j);  /* photon noise (in DN) */
-		  noise = sqrt (rn2 + fabs(signal*gain));
-		  Pix(input->err.data,i,j) = noise / gain;
-	     }
+	     signal = Pix(input->sci.data,i,j);  /* photon noise (in DN) */
+	     noise = sqrt (rn2 + fabs(signal*gain));
+	     Pix(input->err.data,i,j) = noise / gain;
 	}
-
-	/* Successful return */
-	return (status = 0);
 }
-
@@ -0,0 +1,84 @@
+# include <stdlib.h>
+
+#include "hstcal.h"
+# include "hstio.h"
+# include "wf3.h"
+# include "wf3dq.h"
+# include "rampcube.h"
+
+/* RAMPCUBE: Pixel-major buffers of MULTIACCUM samples, see rampcube.h.
+*/
+
+void initRampCube (RampCube *cube) {
+
+	cube->nsamp = 0;
+	cube->npix  = 0;
+	cube->sci   = NULL;
+	cube->err   = NULL;
+	cube->dq    = NULL;
+	cube->time  = NULL;
+}
+
+int allocRampCube (RampCube *cube, int nsamp, int npix) {
+
+	size_t n = (size_t)nsamp * npix;
+
+	initRampCube (cube);
+
+	cube->sci  = malloc (n * sizeof(float));
+	cube->err  = malloc (n * sizeof(float));
+	cube->dq   = malloc (n * sizeof(short));
+	cube->time = malloc (n * sizeof(float));
+	if (cube->sci == NULL || cube->err == NULL || cube->dq == NULL ||
+	    cube->time == NULL) {
+	    freeRampCube (cube);
+	    return (OUT_OF_MEMORY);
+	}
+	cube->nsamp = nsamp;
+	cube->npix  = npix;
+
+	return (0);
+}
+
+void freeRampCube (RampCube *cube) {
+
+	free (cube->sci);
+	free (cube->err);
+	free (cube->dq);
+	free (cube->time);
+	initRampCube (cube);
+}
+
+void loadRampCube (RampCube *cube, const MultiNicmosGroup *input, int x0,
+		   int j, int countrate) {
+
+	int nsamp = cube->nsamp;
+	int s, p;
+
+	/* Each group row is read sequentially and scattered to the
+	** sample of every pixel; the zeroth read (last group) is sample 0. */
+	for (s = 0; s < nsamp; s++) {
+	    const SingleNicmosGroup *group = &input->group[input->ngroups-1-s];
+	    const float *sci  = &Pix(group->sci.data,x0,j);
+	    const float *err  = &Pix(group->err.data,x0,j);
+	    const short *dq   = &DQPix(group->dq.data,x0,j);
+	    const float *intg = &Pix(group->intg.data,x0,j);
+
+	    for (p = 0; p < cube->npix; p++) {
+		size_t k = (size_t)p * nsamp + s;
+
+		/* Temporarily convert countrates back to counts */
+		if (countrate) {
+		    cube->sci[k] = sci[p] * intg[p];
+		    cube->err[k] = err[p] * intg[p];
+		} else {
+		    cube->sci[k] = sci[p];
+		    cube->err[k] = err[p];
+		}
+
+		/* ZEROSIG samples are OK to use for fitting */
+		cube->dq[k]   = dq[p] & ~ZEROSIG;
+		cube->time[k] = intg[p];
+	    }
+	}
+}
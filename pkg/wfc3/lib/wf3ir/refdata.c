@@ -101,6 +101,11 @@ int getNlinData (WF3Info *wf3, NlinData *nlin) {
             trlkwerr ("NCOEF", wf3->nlin.name);
             return (status = 1);
         }
+	if (nlin->ncoeff < 0 || nlin->ncoeff > NLIN_MAXCOEFF) {
+	    trlerror("NCOEF=%d in %s is out of range; at most %d coefficients are supported",
+		     nlin->ncoeff, wf3->nlin.name, NLIN_MAXCOEFF);
+	    return (status = 1);
+	}
 
 	/* Read the NERR keyword from the NLINFILE */
         if (getKeyI (nlin->globalhdr, "NERR", &nlin->nerr)) {
@@ -376,27 +381,37 @@ int getDarkInfo (WF3Info *wf3) {
 
 # define ALLOWDIFF 0.01	/* Max allowed exptime difference */
 
-int getDarkImage (WF3Info *wf3, SingleNicmosGroup *dark1, int ngroup) {
+/* GETDARKDATA: Select the dark reference groups for a science group and
+** set up the dark data to make its dark image from them, as darkPix does
+** in darkcorr.c. Groups that are already held from the previous read are
+** reused; groups that are no longer needed are freed.
+**
+** TODO: the groups are freed with the exposure. Keeping them for the next
+** exposures with the same SAMP_SEQ and DARKFILE, within a memory budget
+** (a full-frame group takes some 16 MB), is tracked as a request of its
+** own.
+*/
+
+int getDarkData (WF3Info *wf3, DarkData *dark, int ngroup) {
 
 /* Arguments:
-**	nic	 i: NICMOS info structure
-**	dark1	 o: dark current image
+**	wf3	 i: WFC3 info structure
+**	dark	io: dark reference data
 **	ngroup	 i: group number
 */
 
 	/* Local variables */
-	int i;					/* loop index */
+	int i, k;				/* loop indexes */
+	int extver[2];				/* groups needed for the read */
 	double etime_lower, etime_upper;	/* dark exposure times */
-	SingleNicmosGroup dark2;		/* temporary dark image */
+	double exptime;				/* science exposure time */
 
 	/* Function definitions */
 	int  getRefImage (RefImage *, int, SingleNicmosGroup *);
-	void dark_interp (SingleNicmosGroup *, SingleNicmosGroup *,
-			  double, double, double);
-	void dark_extrap (SingleNicmosGroup *, double, double);
 
-    etime_lower=0.0f;
-    etime_upper=0.0f;
+	etime_lower = 0.0;
+	etime_upper = 0.0;
+	exptime = wf3->exptime[ngroup-1];
 
 	/* Initialize frame interpolation information */
 	wf3->DarkType   = 0;
@@ -410,7 +425,7 @@ int getDarkImage (WF3Info *wf3, SingleNicmosGroup *dark1, int ngroup) {
 	    ** time sequence, then find the ref file group that matches the
 	    ** exposure time of the science group. */
 	    for (i = 0; i < wf3->ndarks; i++) {
-		 if (fabs(wf3->dtimes[i]-wf3->exptime[ngroup-1]) <= ALLOWDIFF){
+		 if (fabs(wf3->dtimes[i]-exptime) <= ALLOWDIFF){
 		     wf3->DarkType = MATCH;
 		     wf3->darkframe1 = i+1;
 		     break;
@@ -430,15 +445,15 @@ int getDarkImage (WF3Info *wf3, SingleNicmosGroup *dark1, int ngroup) {
 	    ** science data, or two times that bracket it */
 
 	    for (i = 0; i < wf3->ndarks; i++) {
-		 if (fabs(wf3->dtimes[i]-wf3->exptime[ngroup-1]) <= ALLOWDIFF){
+		 if (fabs(wf3->dtimes[i]-exptime) <= ALLOWDIFF){
 		     wf3->DarkType = MATCH;
 		     wf3->darkframe1 = i+1;
 		     break;
-		 } else if (wf3->dtimes[i] < wf3->exptime[ngroup-1]) {
+		 } else if (wf3->dtimes[i] < exptime) {
 		     wf3->DarkType = INTERP;
 		     wf3->darkframe1 = i+1;
 		     etime_lower = wf3->dtimes[i];
-		 } else if (wf3->dtimes[i] > wf3->exptime[ngroup-1] &&
+		 } else if (wf3->dtimes[i] > exptime &&
 		     wf3->darkframe2 == 0) {
 		     wf3->DarkType = INTERP;
 		     wf3->darkframe2 = i+1;
@@ -447,38 +462,68 @@ int getDarkImage (WF3Info *wf3, SingleNicmosGroup *dark1, int ngroup) {
 	    }
 	}
 
-	/* If there's a dark image with a matching exposure time, load it. */
-	if (wf3->DarkType == MATCH) {
-	    if (getRefImage (&wf3->dark, wf3->darkframe1, dark1))
-		return (status);
+	/* A matching dark image is used as it is; otherwise two images
+	** are interpolated, or one is extrapolated outside the available
+	** range. */
+	extver[0] = 0;
+	extver[1] = 0;
+	if (wf3->DarkType == MATCH && wf3->darkframe1 != 0) {
+	    dark->type = MATCH;
+	    dark->frac = 1;
+	    extver[0]  = wf3->darkframe1;
 
-	/* Otherwise, load two images and interpolate between them */
 	} else if (wf3->darkframe1 != 0  &&  wf3->darkframe2 != 0) {
-	    if (getRefImage (&wf3->dark, wf3->darkframe1, dark1))
-		return (status);
-
-	    if (getRefImage (&wf3->dark, wf3->darkframe2, &dark2))
-		return (status);
-
-	    dark_interp (dark1, &dark2, etime_lower, etime_upper,
-			 wf3->exptime[ngroup-1]);
+	    dark->type = INTERP;
+	    dark->frac = (exptime - etime_lower) / (etime_upper - etime_lower);
+	    extver[0]  = wf3->darkframe1;
+	    extver[1]  = wf3->darkframe2;
 
-	    freeSingleNicmosGroup (&dark2);
+	} else if (wf3->darkframe1 != 0) {
+	    wf3->DarkType = EXTRAP;
+	    dark->type = EXTRAP;
+	    dark->frac = exptime / etime_lower;
+	    extver[0]  = wf3->darkframe1;
 
-	/* Otherwise, extrapolate outside the available range */
-	} else if (wf3->darkframe1 !=0) {
+	} else if (wf3->darkframe2 != 0) {
 	    wf3->DarkType = EXTRAP;
-	    if (getRefImage (&wf3->dark, wf3->darkframe1, dark1))
-		return (status);
+	    dark->type = EXTRAP;
+	    dark->frac = exptime / etime_upper;
+	    extver[0]  = wf3->darkframe2;
 
-	    dark_extrap (dark1, etime_lower, wf3->exptime[ngroup-1]);
+	/* Only possible for a DARKFILE with no images (NUMEXPOS = 0) or a
+	** NaN exposure time. This used to go on with an empty dark image,
+	** which darkcorr then read through a NULL data array. */
+	} else {
+	    trlerror("Can't find a dark image in %s for group %d", wf3->dark.name, ngroup);
+	    return (status = 1);
+	}
 
-	} else if (wf3->darkframe2 !=0) {
-	    wf3->DarkType = EXTRAP;
-	    if (getRefImage (&wf3->dark, wf3->darkframe2, dark1))
-		return (status);
+	/* Free the reference groups this read doesn't use */
+	for (k = 0; k < 2; k++) {
+	     if (dark->extver[k] != 0 && dark->extver[k] != extver[0] &&
+		 dark->extver[k] != extver[1]) {
+		 freeSingleNicmosGroup (&dark->group[k]);
+		 dark->extver[k] = 0;
+	     }
+	}
 
-	    dark_extrap (dark1, etime_upper, wf3->exptime[ngroup-1]);
+	/* Load the ones that aren't held yet */
+	dark->d1 = NULL;
+	dark->d2 = NULL;
+	for (i = 0; i < 2 && extver[i] != 0; i++) {
+	     for (k = 0; k < 2 && dark->extver[k] != extver[i]; k++)
+		  ;
+	     if (k == 2) {
+		 for (k = 0; dark->extver[k] != 0; k++)
+		      ;
+		 if (getRefImage (&wf3->dark, extver[i], &dark->group[k]))
+		     return (status);
+		 dark->extver[k] = extver[i];
+	     }
+	     if (i == 0)
+		 dark->d1 = &dark->group[k];
+	     else
+		 dark->d2 = &dark->group[k];
 	}
 
 	/* Successful return */
@@ -486,55 +531,28 @@ int getDarkImage (WF3Info *wf3, SingleNicmosGroup *dark1, int ngroup) {
 
 }
 
-/* DARK_INTERP: Do a linear interpolation of two dark images */
-
-void dark_interp (SingleNicmosGroup *d1, SingleNicmosGroup *d2,
-	     double etime_d1, double etime_d2, double exptime) {
-
-/* Arguments:
-**	d1		io: dark image #1; overwritten by interpolated image
-**	d2	 	 i: dark image #2
-**	etime_d1   	 i: exposure time of dark image #1
-**	etime_d2   	 i: exposure time of dark image #2
-**	exptime		 i: desired exposure time of interpolated image
-*/
-	/* Local variables */
-	float frac;
-
-	/* Function definitions */
-	void aadd  (SingleNicmosGroup *, SingleNicmosGroup *);
-	void asub  (SingleNicmosGroup *, SingleNicmosGroup *);
-	void amulk (SingleNicmosGroup *, float);
-
-	/* Compute the fractional exposure time */
-	frac = (exptime - etime_d1) / (etime_d2 - etime_d1);
+void initDarkData (DarkData *dark) {
 
-	/* Interpolate the images */
-	asub  (d2, d1);
-	amulk (d2, frac);
-	aadd  (d1, d2);
+	dark->type = MATCH;
+	dark->frac = 1;
+	dark->d1 = NULL;
+	dark->d2 = NULL;
+	dark->extver[0] = 0;
+	dark->extver[1] = 0;
+	initSingleNicmosGroup (&dark->group[0]);
+	initSingleNicmosGroup (&dark->group[1]);
 }
 
-/* DARK_EXTRAP: Do a linear extrapolation of a dark image */
-
-void dark_extrap (SingleNicmosGroup *d1, double etime, double exptime) {
+void freeDarkData (DarkData *dark) {
 
-/* Arguments:
-**	d1		io: dark image; overwritten by extrapolated image
-**	etime		 i: exposure time of dark image
-**	exptime		 i: desired exposure time of extrapolated image
-*/
 	/* Local variables */
-	float frac;
+	int k;				/* loop index */
 
-	/* Function definitions */
-	void amulk (SingleNicmosGroup *, float);
-
-	/* Compute the fractional exposure time */
-	frac = exptime / etime;
-
-	/* Extrapolate the image */
-	amulk (d1, frac);
+	for (k = 0; k < 2; k++) {
+	     if (dark->extver[k] != 0)
+		 freeSingleNicmosGroup (&dark->group[k]);
+	}
+	initDarkData (dark);
 }
 
 /* GETREFIMAGE: Load the data from a reference image. */
@@ -1,9 +1,11 @@
 # include "hstio.h"     /* defines HST I/O functions */
 # include "wf3.h"
 # include "wf3dq.h"
+# include "irsweep.h"
 
 /* SATCHECK: Flag pixels as saturated in a MultiAccum group if they're
-** flagged as such in the preceding group.
+** flagged as such in the preceding group. The check is done one row at a
+** time, following the sweep of doSweepIR through the group.
 **
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
@@ -11,27 +13,27 @@
 **				"SATURATED" to "SATPIXEL".
 */
 
-void satcheck (SingleNicmosGroup *group1, SingleNicmosGroup *group2) {
+void satcheckRow (SingleNicmosGroup *group1, SingleNicmosGroup *group2,
+		  int j) {
 
 /* Arguments:
 **	group1	 i: first image group
 **	group2	io: second image group
+**	j	 i: image row
 */
 
 	/* Local variables */
-	int i, j;		/* loop indexes */
+	int i;			/* loop index */
 
-	/* Loop through the DQ image of group 1 */
-	for (j=0; j<group1->dq.data.ny; j++) {
-	     for (i=0; i<group1->dq.data.nx; i++) {
+	/* Loop through row j of the DQ image of group 1 */
+	for (i=0; i<group1->dq.data.nx; i++) {
 
-		  /* If a pixel has a saturation flag, make sure the
-		  ** flag is also set in the next group */
+	     /* If a pixel has a saturation flag, make sure the
+	     ** flag is also set in the next group */
 
-		  if (DQPix(group1->dq.data,i,j) & SATPIXEL)
-		      DQSetPix(group2->dq.data,i,j,
-			 DQPix(group2->dq.data,i,j) | SATPIXEL);
-	     }
+	     if (DQPix(group1->dq.data,i,j) & SATPIXEL)
+		 DQSetPix(group2->dq.data,i,j,
+		    DQPix(group2->dq.data,i,j) | SATPIXEL);
 	}
 
 }
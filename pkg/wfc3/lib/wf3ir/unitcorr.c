@@ -4,35 +4,39 @@
 # include "hstio.h"	/* defines HST I/O functions */
 # include "wf3.h"
 # include "wf3info.h"
+# include "irsweep.h"
 # include "trlbuf.h"
 
 extern int status;
 
-/* DOUNIT: Call UNITCORR for all readouts of a MultiAccum.
+/* DOUNIT: Report the UNITCORR step, which is done for all readouts of a
+** MultiAccum by doSweepIR.
 **
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
 */
 
-int doUnitIR (WF3Info *wf3, MultiNicmosGroup *input) {
+int doUnitIR (WF3Info *wf3, IRSweep *sweep) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
-**	input	io: input image
+**	sweep	 i: results of the sweep through the groups
 */
 
 	/* Local variables */
+	int group;		/* group number */
 
 	/* Function definitions */
-	int unitcorr (WF3Info *, SingleNicmosGroup *);
 	void PrSwitch (char *, int);
 
-	/* Do the units correction for each group */
-	if (wf3->unitcorr == PERFORM) {
+	if (sweep->unitcorr) {
 
-	    for (wf3->group=wf3->ngroups; wf3->group >= 1; wf3->group--) {
-		 if (unitcorr (wf3, &(input->group[wf3->group-1])))
-		     return (status);
+	    /* Groups that were already in countrates were skipped */
+	    for (group=wf3->ngroups; group >= 1; group--) {
+		 if (sweep->unitskip[group-1]) {
+		     trlwarn("Data already in units of countrates; UNITCORR will be skipped");
+		     wf3->unitcorr = SKIP;
+		 }
 	    }
 
 	    PrSwitch ("unitcorr", COMPLETE);
@@ -47,6 +51,10 @@ int doUnitIR (WF3Info *wf3, MultiNicmosGroup *input) {
 ** The DQ, SAMP, and TIME arrays are unchanged.
 ** The BUNIT keyword in the SCI and ERR image headers are updated.
 **
+** unitRow converts one row of the group; unitKeys updates the headers
+** once the group has been converted. Groups that are already in units
+** of countrates are skipped by doSweepIR.
+**
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
 ** H.Bushouse	10-Apr-2002	Modified to skip IR reference pixels by using
@@ -60,55 +68,59 @@ int doUnitIR (WF3Info *wf3, MultiNicmosGroup *input) {
 **				support re-entrant processing. (PR 66081)
 */
 
-int unitcorr (WF3Info *wf3, SingleNicmosGroup *input) {
+void unitRow (WF3Info *wf3, SingleNicmosGroup *input, int j) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
 **	input	io: input image
+**	j	 i: image row
 */
 
 	/* Local variables */
-	int i, j;		/* pixel indexes */
+	int i;			/* pixel index */
 	int ibeg, iend;		/* loop limits */
 	int jbeg, jend;		/* loop limits */
 	float time;		/* exposure time */
 
-	/* Function definitions */
-	void amulk_noref (WF3Info *, SingleNicmosGroup *, float);
-	int  PutKeyStr (Hdr *, char *, char *, char *);
-
-	/* Skip conversion if units are already countrate */
-	if (wf3->bunit[wf3->group-1] == COUNTRATE) {
-	    trlwarn("Data already in units of countrates; UNITCORR will be skipped");
-	    wf3->unitcorr = SKIP;
-	    return (status = 0);
-	}
+	ibeg = wf3->trimx[0]; iend = input->sci.data.nx - wf3->trimx[1];
+	jbeg = wf3->trimy[0]; jend = input->sci.data.ny - wf3->trimy[1];
+	if (j < jbeg || j >= jend)
+	    return;
 
 	/* If we're processing a MultiAccum zeroth read, use the value of
-	** wf3->sampzero for the exposure time */
+	** wf3->sampzero for the exposure time, as in amulk_noref */
 	if (wf3->group == wf3->ngroups) {
 	    time = 1.0 / wf3->sampzero;
-	    amulk_noref (wf3, input, time);
+	    for (i = ibeg; i < iend; i++) {
+		 Pix(input->sci.data,i,j) *= time;
+		 Pix(input->err.data,i,j) *= time;
+	    }
 
 	/* Otherwise, divide the input SCI and ERR arrays by the TIME array */
 	} else {
 
-	    ibeg = wf3->trimx[0]; iend = input->sci.data.nx - wf3->trimx[1];
-	    jbeg = wf3->trimy[0]; jend = input->sci.data.ny - wf3->trimy[1];
-
-	    for (j = jbeg; j < jend; j++) {
-		 for (i = ibeg; i < iend; i++) {
-		      time = Pix(input->intg.data,i,j);
-		      if (time != 0) {
-			  Pix(input->sci.data,i,j) /= time;
-			  Pix(input->err.data,i,j) /= time;
-		      } else {
-			  Pix(input->sci.data,i,j) = 0.0;
-			  Pix(input->err.data,i,j) = 0.0;
-		      }
+	    for (i = ibeg; i < iend; i++) {
+		 time = Pix(input->intg.data,i,j);
+		 if (time != 0) {
+		     Pix(input->sci.data,i,j) /= time;
+		     Pix(input->err.data,i,j) /= time;
+		 } else {
+		     Pix(input->sci.data,i,j) = 0.0;
+		     Pix(input->err.data,i,j) = 0.0;
 		 }
 	    }
 	}
+}
+
+int unitKeys (WF3Info *wf3, SingleNicmosGroup *input) {
+
+/* Arguments:
+**	wf3	 i: WFC3 info structure
+**	input	io: input image
+*/
+
+	/* Function definitions */
+	int  PutKeyStr (Hdr *, char *, char *, char *);
 
 	/* Update the units keyword in the SCI and ERR headers */
 	if (wf3->flatcorr == COMPLETE) {
@@ -127,4 +139,3 @@ int unitcorr (WF3Info *wf3, SingleNicmosGroup *input) {
 	/* Successful return */
 	return (status = 0);
 }
-
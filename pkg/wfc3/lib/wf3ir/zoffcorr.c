@@ -1,42 +1,30 @@
 # include "hstio.h"    /* defines HST I/O functions */
 # include "wf3.h"
 # include "wf3info.h"
+# include "irsweep.h"
 # include "trlbuf.h"
 
 extern int status;
 
-static int zoffcorr (WF3Info *, SingleNicmosGroup *, SingleNicmosGroup *);
-
-/* DOZOFF: Call the ZOFFCORR step for all MULTIACCUM groups.
+/* DOZOFF: Report the ZOFFCORR step, which is done for all MULTIACCUM
+** groups by doSweepIR.
 **
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
 ** H.Bushouse	08-May-2002	Modified to use trlkwerr.
 */
 
-int doZoffIR (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *zoff) {
+int doZoffIR (WF3Info *wf3) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
-**	input	io: MULTIACCUM science image
-**	zoff	 i: zeroth read image
 */
 
-	/* Local variables */
-
 	/* Function definitions */
 	void PrSwitch (char *, int);
 
-	/* Do the MultiAccum zero-read subtraction for each group */
-	if (wf3->zoffcorr == PERFORM) {
-
-	    for (wf3->group=wf3->ngroups; wf3->group >= 1; wf3->group--) {
-		 if (zoffcorr (wf3, &(input->group[wf3->group-1]), zoff))
-		     return (status);
-	    }
-
+	if (wf3->zoffcorr == PERFORM)
 	    PrSwitch ("zoffcorr", COMPLETE);
-	}
 
 	/* Successful return */
 	return (status = 0);
@@ -48,53 +36,52 @@ int doZoffIR (WF3Info *wf3, MultiNicmosGroup *input, SingleNicmosGroup *zoff) {
 ** The exposure time for the group being corrected is reduced
 ** by an amount equal to the exposure time of the zero-read.
 **
+** zoffTime returns the exposure time of the zero-read; zoffRow does
+** the subtraction for one row of a group.
+**
 ** Revision history:
 ** H.Bushouse	Oct. 2000	Initial CALNICA to CALWF3 port.
 */
 
-static int zoffcorr (WF3Info *wf3, SingleNicmosGroup *input,
-		     SingleNicmosGroup *zoff) {
+int zoffTime (WF3Info *wf3, SingleNicmosGroup *zoff, double *ztime) {
 
 /* Arguments:
 **	wf3	 i: WFC3 info structure
+**	zoff	 i: zero-read image
+**	ztime	 o: zero-read exposure time
+*/
+
+	*ztime = 0;
+	if (getKeyD (&(zoff->sci.hdr), "SAMPTIME", ztime)) {
+	    trlkwerr ("SAMPTIME", wf3->zoff.name);
+	    return (status = 1);
+	}
+
+	/* Successful return */
+	return (status = 0);
+}
+
+void zoffRow (SingleNicmosGroup *input, SingleNicmosGroup *zoff, int j) {
+
+/* Arguments:
 **	input	io: image to be zero-subtracted
 **	zoff	 i: zero-read image
+**	j	 i: image row
 */
 
 	/* Local variables */
-	int i, j;		/* loop indexes */
-	double ztime;		/* zero-read exposure time */
-
-	/* Function definitions */
-	void aor (SingleNicmosGroup *, SingleNicmosGroup *);
+	int i;			/* loop index */
 
 	/* Subtract the science arrays from one another */
-	for (j=0; j < input->sci.data.ny; j++) {
-	     for (i=0; i < input->sci.data.nx; i++) {
-		  Pix(input->sci.data,i,j) -= Pix(zoff->sci.data,i,j);
-	     }
-	}
+	for (i=0; i < input->sci.data.nx; i++)
+	     Pix(input->sci.data,i,j) -= Pix(zoff->sci.data,i,j);
 
 	/* Combine (i.e. logical "OR") the data quality arrays */
-	aor (input, zoff);
-
-	/* Subtract the exposure time of the zero-read image
-	** from the exposure time of the science image being processed */
-	ztime = 0;
-	if (getKeyD (&(zoff->sci.hdr), "SAMPTIME", &ztime)) {
-	    trlkwerr ("SAMPTIME", wf3->zoff.name);
-	    return (status = 1);
-	}
-	wf3->exptime[wf3->group-1] -= ztime;
+	for (i=0; i < input->dq.data.nx; i++)
+	     DQSetPix (input->dq.data,i,j,
+		DQPix (input->dq.data,i,j) | DQPix (zoff->dq.data,i,j) );
 
 	/* Subtract the time arrays from one another */
-	for (j=0; j < input->intg.data.ny; j++) {
-	     for (i=0; i < input->intg.data.nx; i++) {
-		  Pix(input->intg.data,i,j) -= Pix(zoff->intg.data,i,j);
-	     }
-	}
-
-	/* Successful return */
-	return (status = 0);
+	for (i=0; i < input->intg.data.nx; i++)
+	     Pix(input->intg.data,i,j) -= Pix(zoff->intg.data,i,j);
 }
-
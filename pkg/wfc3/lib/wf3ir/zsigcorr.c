@@ -6,6 +6,7 @@
 # include "wf3.h"
 # include "wf3info.h"
 # include "wf3dq.h"
+# include "irsweep.h"
 # include "trlbuf.h"
 
 extern int status;
@@ -132,7 +133,6 @@ static int zsigcorr (WF3Info *wf3, MultiNicmosGroup *input, NlinData *nlin,
 	int  copyGroup (SingleNicmosGroup *, SingleNicmosGroup *);
 	void asub (SingleNicmosGroup *, SingleNicmosGroup *);
 	void asub_noref (WF3Info *, SingleNicmosGroup *, SingleNicmosGroup *);
-	int  noiscalc (WF3Info *, SingleNicmosGroup *);
 	int  GetCorner (Hdr *, int, int *, int *);
 
 	/* Initialize counters */
@@ -167,9 +167,14 @@ static int zsigcorr (WF3Info *wf3, MultiNicmosGroup *input, NlinData *nlin,
 	     Pix(zsig->sci.data,i,j) -= Pix(nlin->zsci[0].data,li,lj);
 	}}
 
-	/* Compute noise in the zsig image */
-	if (noiscalc (wf3, zsig))
-	    return (status);
+	/* Compute noise in the zsig image, unless its ERR array
+	** has been populated before */
+	if (errPopulated (wf3, zsig)) {
+	    wf3->noiscorr = SKIPPED;
+	    return (status = 1);
+	}
+	for (j = 0; j < zsig->err.data.ny; j++)
+	     noisRow (wf3, zsig, j);
 
 	/* Loop over the zsig image, skipping reference pixels */
 	for (j = jbeg, lj = lj_beg; j < jend; j++, lj++) {
@@ -21,7 +21,7 @@ static void printSyntax(void) {
     printf("                      [-table <filename>] [-scale #]\n");
     printf("                      [-init (med|min)] [-sky (none|mode)]\n");
     printf("                      [-sigmas #] [-radius #] [-thresh #]\n");
-    printf("                      [-pdq #]\n");
+    printf("                      [-pdq #] [--memory-budget #]\n");
     printf("                      [-r]\n");
 
     printf("    -r: report version of code and exit\n");
@@ -36,7 +36,9 @@ static void printSyntax(void) {
     printf("    -sigmas <sigma_values>: rejection levels for each iteration\n");
     printf("    -radius <number>: CR expansion radius\n");
     printf("    -thresh <number> : rejection propagation threshold\n");
-    printf("    -pdq <number>: data quality flag bits to reject\n\n");
+    printf("    -pdq <number>: data quality flag bits to reject\n");
+    printf("    --memory-budget <number>: memory (MB, > 0) for the input images, held\n");
+    printf("          in memory if they fit, otherwise read in bands that fit\n\n");
 
     printf("    Usage\n");
     printf("    Process data with timestamps and a custom cosmic ray rejection table:\n");
@@ -190,6 +192,14 @@ int newpar[];       o: array of parameters set by the user
                     if (getArgS (argv, argc, &ctoken, &par->badinpdq))
                         return (status = INVALID_VALUE);
 
+                } else if (strcmp("-memory-budget", argv[ctoken]+1) == 0) {
+                    if (getArgR (argv, argc, &ctoken, &par->membudget))
+                        return (status = INVALID_VALUE);
+                    if (par->membudget <= 0.) {
+                        printf("\nInvalid memory budget: %g MB\n\n", par->membudget);
+                        return (status = INVALID_VALUE);
+                    }
+
                 /* No match. */
                 } else {
                     printf("\nUnrecognized option: %s\n\n", argv[ctoken]);
@@ -292,6 +302,7 @@ int newpar[];     o: array of parameters set by the user
     par->verbose = 0;
     par->printtime = 0;
     par->shadcorr = 0;
+    par->membudget = MEMBUDGET;
 
     newpar[TOTAL] = 0;
     newpar[SCALENSE] = 0;
@@ -10,8 +10,10 @@
 # include   "hstcalerr.h"
 # include   "wf3info.h"
 # include   "rej.h"
+# include   "hstcal_imagestack.h"
 
-static void closeSciDq (int, IODescPtr [], IODescPtr [], clpar *);
+static void closeSciDq (int, IODescPtr [], IODescPtr [], ImageStack *,
+			clpar *);
 
 /*  rej_do -- Perform the cosmic ray rejection for WFC3 images
 
@@ -64,6 +66,7 @@ int rej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 
     IODescPtr   ipsci[MAX_FILES];   /* science image descriptor */
     IODescPtr   ipdq[MAX_FILES];    /* data quality image descriptor */
+    ImageStack  stack;              /* inputs, in memory if within budget */
     float       skyval[MAX_FILES];  /* background DN values */
     float       efac[MAX_FILES];    /* exposure factors */
     DataUnits	bunit[MAX_FILES];   /* image data units */
@@ -114,13 +117,14 @@ int rej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
     int     cr_scaling (char *, IRAFPointer, float [], int *, double *,
 			double *, DataUnits []);
     int     rejpar_in (clpar *, int [], int, float,   int *, float []);
-    void    rej_sky (char *, IODescPtr [], IODescPtr [], int, short, float [],
+    void    rej_sky (char *, const ImageStack *, int, short, float [],
 		     DataUnits [], float []);
     void    cr_history (SingleGroup *, clpar *, int, int);
-    int     rej_init (IODescPtr [], IODescPtr [], clpar *, int, int, int,
+    int     rej_init (const ImageStack *, clpar *, int, int, int,
                 multiamp, multiamp, float [], float [], DataUnits [],
 		SingleGroup *, float *);
-    int     rej_loop (IODescPtr [], IODescPtr [], char [][CHAR_FNAME_LENGTH+1],
+    int     rej_loop (IODescPtr [], IODescPtr [], const ImageStack *,
+		char [][CHAR_FNAME_LENGTH+1],
                 int [], int, clpar *, int, int, int, float [], multiamp,
 		multiamp, float [], float [], DataUnits [], FloatTwoDArray *,
 		FloatTwoDArray *, float *, ShortTwoDArray *, int *, char *);
@@ -263,15 +267,35 @@ int rej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
         if (rejpar_in (par, newpar, nimgs, exptot, &niter, sigma) )
             return(status);
 
+        /* Read all inputs into memory once if they fit within the memory
+           budget, otherwise each pass below streams them from disk, in
+           bands as large as the budget allows. */
+        if ((status = openImageStack (&stack, ipsci, NULL, ipdq, nimgs,
+			dim_x, dim_y, (size_t)(par->membudget * 1024. * 1024.)))) {
+            trlerror("Couldn't read input images for extension %d", extver);
+            closeSciDq (nimgs, ipsci, ipdq, &stack, par);
+            return (status);
+        }
+        if (par->verbose) {
+            if (stack.inMemory)
+                trlmessage("Holding in memory %d input images", nimgs);
+            else if (stack.bandLines > 0)
+                trlmessage("Streaming from disk %d input images, in bands of %d lines",
+                           nimgs, stack.bandLines);
+            else
+                trlmessage("Streaming from disk %d input images", nimgs);
+        }
+
         /* Allocate array space */
         efacsum = calloc (dim_x*dim_y, sizeof(float));
         work    = calloc (nimgs*dim_x, sizeof(float));
 
         /* Calculate the sky levels */
-        rej_sky (par->sky, ipsci, ipdq, nimgs, par->badinpdq, efac,
+        rej_sky (par->sky, &stack, nimgs, par->badinpdq, efac,
 		 bunit, skyval);
         if (status != WF3_OK) {
             WhichError (status);
+            freeImageStack (&stack);
             return (status);
         }
         if (par->verbose) {
@@ -297,6 +321,7 @@ int rej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 	   n++;
 	} while (found == 0);
 
+        syncImageStack (&stack);
         getSingleGroup (imgdefault, extver, &sg);
 
 	if (non_zero > 1) {
@@ -306,10 +331,10 @@ int rej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 
             /* Compute the initial pixel values to be used to compare against
 	    ** all images. */
-            if (rej_init (ipsci, ipdq, par, nimgs, dim_x, dim_y,
+            if (rej_init (&stack, par, nimgs, dim_x, dim_y,
 			  noise, gain, efac, skyval, bunit, &sg, work)) {
                 WhichError(status);
-                closeSciDq(nimgs, ipsci, ipdq, par);
+                closeSciDq(nimgs, ipsci, ipdq, &stack, par);
                 return (status);
             }
 
@@ -317,12 +342,12 @@ int rej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
                 TimeStamp ("Calculated initial guess for extension", "");
 
             /* Do the iterative cosmic ray rejection calculations */
-            if (rej_loop (ipsci, ipdq, imgname, ext, nimgs, par, niter, dim_x,
-		      dim_y, sigma, noise, gain, efac, skyval, bunit,
+            if (rej_loop (ipsci, ipdq, &stack, imgname, ext, nimgs, par, niter,
+		      dim_x, dim_y, sigma, noise, gain, efac, skyval, bunit,
 		      &sg.sci.data, &sg.err.data, efacsum, &sg.dq.data, &nrej,
 		      shadref.name)){
                 WhichError(status);
-                closeSciDq(nimgs, ipsci, ipdq, par);
+                closeSciDq(nimgs, ipsci, ipdq, &stack, par);
                 return (status);
             }
 
@@ -339,7 +364,7 @@ int rej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 	} /* End if(non_zero) block */
 
         /* Must close all images, now that we are done reading them */
-        closeSciDq (nimgs, ipsci, ipdq, par);
+        closeSciDq (nimgs, ipsci, ipdq, &stack, par);
 
         /* Calculate the total sky ... */
         skysum = 0.;
@@ -458,11 +483,14 @@ int rej_do (IRAFPointer tpin, char *outfile, char *mtype, clpar *par,
 /* Helper function to clean up image pointers... */
 
 static void closeSciDq (int nimgs, IODescPtr ipsci[], IODescPtr ipdq[],
-			clpar *par) {
+			ImageStack *stack, clpar *par) {
 
     int n;
 
-    /* Must close all images, now that we are done reading them */
+    /* Release any in-memory copy of the images, stopping any read ahead... */
+    freeImageStack (stack);
+
+    /* ...and close them all, now that we are done reading them */
     for (n = 0; n < nimgs; ++n) {
         closeImage (ipsci[n]);
         closeImage (ipdq[n]);
@@ -9,6 +9,8 @@
 # include   "wf3rej.h"
 # include   "hstcalerr.h"
 # include   "wf3info.h"
+# include   "hstcal_imagestack.h"
+# include   "hstcal_select.h"
 
 # define    OK          (short)0
 
@@ -41,7 +43,7 @@
 				units of count rates. (PR 69969; Trac #814)
 */
 
-int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
+int rej_init (const ImageStack *stack, clpar *par, int nimgs,
 	      int dim_x, int dim_y, multiamp noise, multiamp gain, float efac[],
 	      float skyval[], DataUnits bunit[], SingleGroup *sg, float *work) {
 
@@ -58,13 +60,11 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
     float  gain2[NAMPS];
     float  nse[2], gn[2];
     int    ampx, ampy, detector, chip;
-    int    k, p;
+    int    k;
     short  dqpat;
     float  exp2n, expn;
     int    non_zero;
-    Hdr    dqhdr;
 
-    void ipiksrt (float [], int, int[]);
     void get_nsegn (int, int, int, int, float *, float*, float *, float *);
 
     /* -------------------------------- begin ------------------------------ */
@@ -76,7 +76,7 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
     chip = gain.chip;
     dqpat = par->badinpdq;
 
-    ipts = calloc (nimgs, sizeof(int));
+    ipts = calloc ((size_t)nimgs*dim_x, sizeof(int));
     npts = calloc (dim_x, sizeof(int));
     buf = calloc (dim_x, sizeof(float));
     exp2 = (float *) calloc (nimgs, sizeof(float));
@@ -116,11 +116,8 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
             }
 
             for (n = 0; n < nimgs; n++) {
-                initHdr(&dqhdr);
-                getHeader(ipdq[n],&dqhdr);
-                getFloatLine (ipsci[n], j, buf);
-                getShortLine (ipdq[n], j, bufdq);
-                freeHdr(&dqhdr);
+                getStackSciLine (stack, n, j, buf);
+                getStackDqLine (stack, n, j, bufdq);
 
 		/* Rescale SCI data, if necessary */
 		if (bunit[n] == COUNTRATE) {
@@ -133,15 +130,17 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
 		     if (efac[n] > 0.) {
                          /* Only use GOOD pixels to build initial image */
                          if ((bufdq[i] & dqpat) == OK) {
-                             PIX(work,npts[i],i,nimgs) =
+                             PIX(work,i,npts[i],dim_x) =
 						(buf[i] - skyval[n]) / efac[n];
                              npts[i] += 1;
                          }
-		     } else {
-			 PIX(work,npts[i],i,nimgs) = 0.;
 		     }
                 }
             }
+
+	    /* Sort the pixel stacks of the whole line at once, with the
+	    ** index of each sorted value, as a stable sort */
+	    sortStackFloat (work, ipts, npts, nimgs, dim_x, dim_x);
  
             for (i = 0; i < ampx; i++) {
                 dum = npts[i];
@@ -151,22 +150,18 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
 
                 else {
 
-		    /* Setup index array for sorting... */
-		    for (p=0; p < nimgs; p++) ipts[p] = p;
-		    /* Sort pixel stack and corresponding index array. */
-                    ipiksrt (&PIX(work,0,i,nimgs), dum, ipts);
-
 		    /* Use sorted index array to match proper exptimes to
 		       selected pixels for use in ERR array calculation. */
                     if ((dum/2)*2 == dum) {
                         /* Even number of input images for this pixel */
-                        Pix(sg->sci.data,i,j) = (PIX(work,dum/2-1,i,nimgs) +
-						 PIX(work,dum/2,i,nimgs)) / 2.;
-			expn = (exp2[ipts[dum/2-1]] + exp2[ipts[dum/2]]) / 2.;
+                        Pix(sg->sci.data,i,j) = (PIX(work,i,dum/2-1,dim_x) +
+						 PIX(work,i,dum/2,dim_x)) / 2.;
+			expn = (exp2[PIX(ipts,i,dum/2-1,dim_x)] +
+				exp2[PIX(ipts,i,dum/2,dim_x)]) / 2.;
                     } else {
 			/* Odd number of input images for this pixel */
-                        Pix(sg->sci.data,i,j) = PIX(work,dum/2,i,nimgs);
-			expn = exp2[ipts[dum/2]];
+                        Pix(sg->sci.data,i,j) = PIX(work,i,dum/2,dim_x);
+			expn = exp2[PIX(ipts,i,dum/2,dim_x)];
 		    }
                 }
                 
@@ -181,16 +176,15 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
                 if (dum == 0)
                     Pix(sg->sci.data,i,j) = 0.0F;
                 else {
-		    for (p=0; p < nimgs; p++) ipts[p] = p;
-                    ipiksrt (&PIX(work,0,i,nimgs), dum, ipts);
                     if ((dum/2)*2 == dum) {
                         /* Even number of input images for this pixel */
-                        Pix(sg->sci.data,i,j) = (PIX(work,dum/2-1,i,nimgs) +
-						 PIX(work,dum/2,i,nimgs)) / 2.;
-			expn = (exp2[ipts[dum/2-1]] + exp2[ipts[dum/2]]) / 2.;
+                        Pix(sg->sci.data,i,j) = (PIX(work,i,dum/2-1,dim_x) +
+						 PIX(work,i,dum/2,dim_x)) / 2.;
+			expn = (exp2[PIX(ipts,i,dum/2-1,dim_x)] +
+				exp2[PIX(ipts,i,dum/2,dim_x)]) / 2.;
                     } else {
-                        Pix(sg->sci.data,i,j) = PIX(work,dum/2,i,nimgs);
-			expn = exp2[ipts[dum/2]];
+                        Pix(sg->sci.data,i,j) = PIX(work,i,dum/2,dim_x);
+			expn = exp2[PIX(ipts,i,dum/2,dim_x)];
 		    }
                 }
                 
@@ -210,8 +204,6 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
         }
 
         for (n = 0; n < nimgs; n++) {
-            initHdr(&dqhdr);
-            getHeader(ipdq[n],&dqhdr);
             for (j = 0; j < dim_y; j++) { 
                 /* Set up the gain and noise values used for this line
 		** in ALL images */
@@ -227,8 +219,8 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
                     nse[1] = noise2[AMP_B];            
                 }
 
-                getFloatLine (ipsci[n], j, buf);
-		getShortLine (ipdq[n],  j, bufdq);
+                getStackSciLine (stack, n, j, buf);
+		getStackDqLine (stack, n, j, bufdq);
 
 		/* Rescale SCI data, if necessary */
 		if (bunit[n] == COUNTRATE) {
@@ -285,7 +277,6 @@ int rej_init (IODescPtr ipsci[], IODescPtr ipdq[], clpar *par, int nimgs,
                 } /* End of loop over SECOND AMP for this line in each image */
 
             } /* End of loop over lines in image (y) */
-            freeHdr(&dqhdr);
         } /* End of loop over images in set */
     }
 
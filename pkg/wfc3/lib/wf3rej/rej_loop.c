@@ -11,41 +11,50 @@
 # include   "rej.h"
 # include   "hstcalerr.h"
 # include   "wf3info.h"
-
-/* local mask values */
-# define    OK          (short)0
-# define    HIT         (short)8
-# define    SPILL       (short)2
-# define    EXCLUDE     (short)4
+# include   "hstcal_imagestack.h"
+# include   "hstcal_crrej.h"
+
+# ifdef _OPENMP
+#  include  <omp.h>
+# endif
+
+/* local mask values, see hstcal_crrej.h */
+# define    OK          CRREJ_MASK_OK
+# define    HIT         CRREJ_MASK_HIT
+# define    SPILL       CRREJ_MASK_SPILL
+# define    EXCLUDE     CRREJ_MASK_EXCLUDE
 # define    BAD         (short)~OK
 # define    ABS(x)      ((x>0.) ? x : -x)
 
-/* Local routines for dealing with arrays of pointers to
-**  arrays.  */
-
-static float **allocFloatBuff (int, int);
-static short **allocShortBuff (int, int);
-static void freeFloatBuff (float **, int);
-static void freeShortBuff (short **, int);
-static void scrollFloatBuff (float *, int, int, int, int, float **, float *);
-static void scrollShortBuff (short *, int, int, int, int, short **, short *);
-static void InitShortSect (short **, short *, IODescPtr *, int, int, int);
-static void InitFloatSect (float **, float *, IODescPtr *, int, int, int);
-
-static Byte ***allocBitBuff (int, int, int);
-static void freeBitBuff (Byte ***, int, int);
-static void readBitLine (Byte ***, int, int, int, short, short, short *);
-static void writeBitLine (short *, int, int, int, short, Byte ***); 
-
-/* For debugging purposes:
-static void printBitLine (Byte ***, int, int, int);
-*/
+/* The line & bit buffers are in hstcal_crrej.h, shared with ACSREJ */
 static int  initShad (Hdr *, int, char *, int, int *, int *, int *, int *,
 		      int *);
-static void getShadLine (float **, int, int, int, float *);
 static void getShadBuff (IODescPtr *, int, int, int, int, int , int , int ,
 			 int , float **);
-static void getShadcorr (float **, int, int, int, float, int, float *);
+
+/* WFC3 noise model of the band rejection */
+typedef struct {
+    const ImageStack *stack;
+    const float *efac;
+    const float *skyval;
+    const float *exp2;
+    const DataUnits *bunit;
+    const float *gain2;
+    const float *noise2;
+    const float *shadcorr;
+    const FloatTwoDArray *avevar;
+    int ampx, ampy;
+    int width;
+    float scale;
+    Bool minimum;       /* initial guess is the minimum */
+} RejNoise;
+
+static void rejPixels (const void *, int, int, float *);
+static void rejThresholds (const void *, int, int, int, float, const float *,
+			   float *, float *, float *, float *);
+static void rejAddVariance (const void *, int, int, const float *,
+			    const char *, float *);
+static float rejVariance (const void *, float, float);
 
 /*  crrej_loop -- Perform cosmic ray rejection
 
@@ -95,6 +104,12 @@ Code Outline:
                     how many images contributed to the output value.
      
     - Write out CR-hit information to all the input images if par->mask was set
+
+    When the input stack is held in memory and no shading correction is
+    applied, each iteration is instead run by rejBandIteration in parallel
+    horizontal bands, with the same results. Only the pixels whose average
+    changed are then tested again while sigma stays the same, and only
+    those whose rejections changed are accumulated again.
     
     - Free memory used by all the buffers                    
             
@@ -148,7 +163,8 @@ Code Outline:
 				units of count rates. (PR 69969; Trac #814)
 */
 
-int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LENGTH+1],
+int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], const ImageStack *stack,
+	      char imgname[][CHAR_FNAME_LENGTH+1],
 	      int grp [], int nimgs, clpar *par, int niter, int dim_x,
 	      int dim_y, float sigma[], multiamp noise, multiamp gain, 
 	      float efac[], float skyval[], DataUnits bunit[],
@@ -182,7 +198,7 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
     float   *buf;
     short   *bufdq;
     
-    Byte    ***crmask;          /* Compressed CR HIT mask for all images */
+    BitMask crmask;             /* Packed CR HIT mask for all images */
 
     /* local variables for sections */
     int     buffheight, line, bufftop;
@@ -207,6 +223,12 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
     float       *zerofbuf;       /* line buffer of all FLOAT zeroes  */
     short       *zerosbuf;      /* line buffer of all SHORT zeroes */
 
+    /* Row-band parallel mode */
+    Bool            useBands;
+    CRRejBands      bands;
+    RejNoise        model;
+    Bool            retest;
+
     /* Functions for dealing with MULTIAMP values of gain and noise */
 /*  int       LoadHdr (char *, Hdr *);*/
     void      WhichError (int);
@@ -331,7 +353,10 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
     shadcorr = calloc (dim_x, sizeof(float));
 
     /* Allocate space for the CR-hit mask */	
-    crmask = allocBitBuff (nimgs, dim_y, dim_x);
+    if (allocBitMask (&crmask, dim_x, nimgs * dim_y) != HSTCAL_OK) {
+        trlerror("Couldn't allocate memory for CR mask in REJ_LOOP.");
+        return (status = OUT_OF_MEMORY);
+    }
 
     /* readout is in DN */
     rej2 = SQ(par->radius);
@@ -371,6 +396,52 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
     /* Set up gain and values used for each image */
     get_nsegn (detector, chip, ampx, ampy, gain.val, rog2, gain2, noise2); 
 
+    /* The band mode needs random access to all input lines and no shading
+       reference data, otherwise fall back to the scrolling buffers. */
+    useBands = stack->inMemory && par->shadcorr != PERFORM;
+    initCRRejBands (&bands);
+    if (useBands && allocCRRejBands (&bands, stack, width, rej2))
+        useBands = False;
+    if (useBands) {
+        /* ONEs and ZEROes, exactly as getShadcorr and getShadLine
+           return them without a shading correction */
+        getShadBuff (ipshad, 0, shad_dimy, dim_x, shadf_x, rx, ry, x0, y0,
+                     shadbuff);
+        getShadcorr (shadbuff, 0, shad_dimy, dim_x, 1., shadf_x, shadcorr);
+        getShadLine (shadbuff, 0, shad_dimy, dim_x/rx, shadline);
+
+        model.stack = stack;
+        model.efac = efac;
+        model.skyval = skyval;
+        model.exp2 = exp2;
+        model.bunit = bunit;
+        model.gain2 = gain2;
+        model.noise2 = noise2;
+        model.shadcorr = shadcorr;
+        model.avevar = avevar;
+        model.ampx = ampx;
+        model.ampy = ampy;
+        model.width = width;
+        model.scale = scale;
+        model.minimum = (strncmp(par->initgues,"minimum",3) == 0);
+
+        bands.efac = efac;
+        bands.dqpat = dqpat;
+        bands.maskdq = maskdq;
+        bands.crflag = crflag;
+        bands.psig2 = psig2;
+        bands.fillval = par->fillval;
+        bands.shadline = shadline;
+        bands.instrument.data = &model;
+        bands.instrument.thresholds = rejThresholds;
+        bands.instrument.pixels = rejPixels;
+        bands.instrument.addVariance = rejAddVariance;
+        bands.instrument.variance = rejVariance;
+
+        if (par->verbose)
+            trlmessage("Rejecting in parallel row bands");
+    }
+
     /* start the rejection iteration */
     for (iter = 0; iter < niter; iter++) {
         if (par->verbose) { 
@@ -380,9 +451,12 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
         sig2 = SQ(sigma[iter]);
 
 	if (iter > 0) {
-            /* Re-initialize the arrays... */
-            for (j = 0; j < numpix; j++) {
-                *(efacsum+j) = 0.;
+            /* Re-initialize the arrays (the band mode keeps efacsum
+               where the rejections did not change)... */
+            if (!useBands) {
+                for (j = 0; j < numpix; j++) {
+                    *(efacsum+j) = 0.;
+                }
             }
              
             memcpy (sum, zerofbuf, dim_x * sizeof(float));
@@ -399,6 +473,20 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
                 }
             }
         } /* End initialization section */
+
+        if (useBands) {
+            /* The tests of a pixel only depend on its average and sigma,
+               and on the initial guess in the first iteration */
+            retest = (iter == 0 || sigma[iter] != sigma[iter-1] ||
+                      (iter == 1 && model.minimum));
+            if (crrejBandIteration (&bands, iter, niter, sig2, retest, ave,
+                                    avevar, efacsum, dq, &dq2, nrej, &crmask)) {
+                trlerror("Couldn't allocate memory for scratch array in REJ_LOOP.");
+                status = OUT_OF_MEMORY;
+                break;
+            }
+            continue;
+        }
         
         /* Start loop over lines in image */
         for (line =0; line < dim_y; line++) { 
@@ -432,6 +520,9 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
                 will return a buffer of all ZEROES.
             */
             if ((line % shad_dimy) == 0 || line == 0) {
+                /* HSTIO isn't used while input bands are read ahead */
+                if (par->shadcorr)
+                    syncImageStack (stack);
                 getShadBuff (ipshad, line, shad_dimy, dim_x, shadf_x, rx,
                 ry, x0, y0, shadbuff);
             }
@@ -445,11 +536,8 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
                 for (k = 0; k < nimgs; k++) {
                     
                     if (bufftop < dim_y) {
-                        initHdr(&dqhdr);
-                        getHeader(ipdq[k],&dqhdr);
-                        getFloatLine (ipsci[k], bufftop, buf);
-                        getShortLine (ipdq[k], bufftop, bufdq);
-                        freeHdr(&dqhdr);
+                        getStackSciLine (stack, k, bufftop, buf);
+                        getStackDqLine (stack, k, bufftop, bufdq);
 
 			/* Rescale the inputs by exposure time, if needed */
 			if (bunit[k] == COUNTRATE) {
@@ -488,10 +576,13 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
                 */
                 for (k = 0; k < nimgs; k++) {
                     /* Put initial lines of data into scrolling buffers here. */
-                    InitFloatSect (pic[k], buf, ipsci[k], line, width, dim_x);
-                    InitFloatSect (thresh[k], buf, ipsci[k], line, width,dim_x);
-                    InitFloatSect (spthresh[k], buf, ipsci[k],line,width,dim_x);
-                    InitShortSect (mask[k], bufdq, ipdq[k], line, width, dim_x);
+                    InitFloatSect (pic[k], buf, stack, getStackSciLine, k,
+                                   line, width, dim_x);
+                    InitFloatSect (thresh[k], buf, stack, getStackSciLine, k,
+                                   line, width, dim_x);
+                    InitFloatSect (spthresh[k], buf, stack, getStackSciLine,
+                                   k, line, width, dim_x);
+                    InitShortSect (mask[k], bufdq, stack, k, line, width, dim_x);
 
 		    /* Rescale input data by exposure time, if necessary */
 		    if (bunit[k] == COUNTRATE) {
@@ -718,10 +809,11 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
 
                         } /* End loop over x position */
                     
-                        /* compress bufdq into byte mask, line-by-line */
+                        /* compress bufdq into bit mask, line-by-line */
 			/* this will be uncompressed later to be written back
 			   into the DQ arrays of the input files */
-                        writeBitLine (bufdq, n, line, dim_x, crflag, crmask);
+                        packBitRow (bitMaskRow (&crmask, n * dim_y + line), bufdq,
+                                    dim_x, crflag);
 
                     } /* End of last iteration block */
 		} /* End if(efacn > 0.) block */
@@ -762,9 +854,10 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
     /* Write out CR hit information to input images,
        if par->mask was set...
     */
-    if (par->mask) {
+    if (par->mask && status == WF3_OK) {
         /* Close all references to the images so we can open the
            data quality ones as read/write. */
+        syncImageStack (stack);
         for (n=0; n<nimgs; n++) {
             closeImage (ipsci[n]);
             closeImage (ipdq[n]);
@@ -778,7 +871,10 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
 
             for (line = 0; line < dim_y; line++) {
                 getShortLine (ipdqn, line, bufdq);
-                readBitLine (crmask, n, line, dim_x, crflag, nocr, bufdq);
+                /* As with the former byte mask, the columns of a last
+                   partial byte keep their input DQ */
+                unpackBitRow (bitMaskRow (&crmask, n * dim_y + line), bufdq,
+                              dim_x - dim_x % SIZE_BYTE, crflag);
                 putShortLine (ipdqn, line, bufdq);
             } /* End loop over lines in each image */
 
@@ -820,11 +916,12 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
     free (buf);
     free (bufdq);
     free (exp2);
-    freeBitBuff (crmask, nimgs, dim_y);	
+    freeBitMask (&crmask);	
     free (shadline);
     free (shadcorr);
     freeFloatBuff(shadbuff, shad_dimy);
     freeShortData (&dq2);
+    freeCRRejBands (&bands);
 
     if (par->shadcorr == PERFORM) {
         freeHdr (&scihdr);
@@ -835,312 +932,138 @@ int rej_loop (IODescPtr ipsci[], IODescPtr ipdq[], char imgname[][CHAR_FNAME_LEN
 }
 
 /* ------------------------------------------------------------------*/
-/*                          allocFloatBuff                           */
+/*                          band rejection                           */
 /* ------------------------------------------------------------------*/
 
+/* The WFC3 noise model for crrejBandIteration, as computed for the
+   scrolling buffers of rej_loop. Each amp is processed by a loop of its
+   own so that the arithmetic vectorizes. */
 
-static float **allocFloatBuff (int lines, int numpix) {
-    float **sect;
-    int i;
-
-    sect = (float **) calloc (lines, sizeof(float *));
-
-    for (i=0; i<lines; i++){
-        sect[i] = (float *) calloc (numpix, sizeof(float));
-    }
-
-    return (sect);
-}
+static void rejAmpNoise (const RejNoise *model, int line, float gn[2],
+                         float nse[2]) {
 
-/* ------------------------------------------------------------------*/
-/*                          allocShortBuff                           */
-/* ------------------------------------------------------------------*/
-
-
-static short **allocShortBuff (int lines, int numpix){
-    short **sect;
-    int i;
-
-    sect = (short **) calloc (lines, sizeof(short *));
-
-    for (i=0; i<lines; i++){
-        sect[i] = (short *) calloc (numpix, sizeof(short));
+    if (line < model->ampy) {
+        gn[0] = model->gain2[AMP_C];
+        gn[1] = model->gain2[AMP_D];
+        nse[0] = model->noise2[AMP_C];
+        nse[1] = model->noise2[AMP_D];
+    } else {
+        gn[0] = model->gain2[AMP_A];
+        gn[1] = model->gain2[AMP_B];
+        nse[0] = model->noise2[AMP_A];
+        nse[1] = model->noise2[AMP_B];
     }
-
-    return (sect);
 }
 
+/* first pixel of the second amp of a line */
+static int rejAmpSplit (const RejNoise *model) {
 
-/* ------------------------------------------------------------------*/
-/*                          freeFloatBuff                            */
-/* ------------------------------------------------------------------*/
-
-
-static void freeFloatBuff (float **sect, int lines){
-    int i;
-
-    for (i=0; i<lines; i++) free(sect[i]) ;
-    free (sect);
+    if (model->ampx < 0)
+        return (0);
+    return ((model->ampx < model->stack->nx) ? model->ampx :
+            model->stack->nx);
 }
 
-/* ------------------------------------------------------------------*/
-/*                          freeShortBuff                            */
-/* ------------------------------------------------------------------*/
-
+static void rejPixels (const void *data, int img, int line, float *pic) {
 
-static void freeShortBuff (short **sect, int lines){
+    const RejNoise *model = data;
+    const ImageStack *stack = model->stack;
+    const float *sci = stack->sci + ((size_t)img*stack->ny + line) * stack->nx;
+    float efacn = model->efac[img];
+    float skyvaln = model->skyval[img];
     int i;
 
-    for (i=0; i<lines; i++) free(sect[i]) ;
-    free (sect);
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          allocBitBuff                             */
-/* ------------------------------------------------------------------*/
-
-
-static Byte ***allocBitBuff (int nimgs, int lines, int numbits){
-    Byte ***mask;
-    int y,n;
-    float remainder;
-    int nsize, nrem;
-
-    mask = (Byte ***) calloc (nimgs, sizeof(Byte **));
-    nsize = numbits/SIZE_BYTE;
-    /* Compute remainder, if any, for nsize. */
-    remainder = ((float) numbits/SIZE_BYTE) - nsize;
-    /* Convert remainder to either 1 or 0 extra bytes that needs to
-    ** be added to buffer. */
-    nrem = (remainder > 0.) ? 1 : 0;
-
-    for (n=0; n<nimgs; n++){
-        /* Scale the buffer to 1 BIT per pix */
-        mask[n] = (Byte **) calloc ( lines, sizeof(Byte *));
-        for (y=0; y<lines; y++){
-            /* Scale the buffer to 1 BIT per pix
-                'numbits/SIZE_BYTE' should always be even, such that
-                there is never any remainder...
-		However, when it is not even, we need to add 1 for the
-		remainder.
-            */
-            mask[n][y] = (Byte *) calloc ( (nsize+1*nrem), sizeof(Byte));
-        }
+    if (model->bunit[img] == COUNTRATE) {
+# ifdef _OPENMP
+        #pragma omp simd
+# endif
+        for (i = 0; i < stack->nx; i++)
+            pic[i] = (sci[i] * efacn - skyvaln) / efacn;
+    } else {
+# ifdef _OPENMP
+        #pragma omp simd
+# endif
+        for (i = 0; i < stack->nx; i++)
+            pic[i] = (sci[i] - skyvaln) / efacn;
     }
-
-    return (mask);
 }
 
-/* ------------------------------------------------------------------*/
-/*                          freeBitBuff                              */
-/* ------------------------------------------------------------------*/
-
-
-static void freeBitBuff (Byte ***crmask, int nimgs, int lines){
-    int y,n;
-
-    for (n=0; n<nimgs; n++) {
-        for (y=0; y<lines; y++) {
-            free(crmask[n][y]) ;
+static void rejThresholds (const void *data, int img, int line, int iter,
+                           float sig2, const float *ave, float *pic,
+                           float *th, float *spth, float *fwd) {
+
+    const RejNoise *model = data;
+    const ImageStack *stack = model->stack;
+    const float *sci = stack->sci + ((size_t)img*stack->ny + line) * stack->nx;
+    float efacn = model->efac[img];
+    float skyvaln = model->skyval[img];
+    float exp2n = model->exp2[img];
+    float scale = model->scale;
+    float gn[2], nse[2];
+    int a, i, first, last;
+
+    rejPixels (data, img, line, pic);
+
+    if (model->minimum && iter == 0) {
+        for (i = 0; i < stack->nx; i++) {
+            th[i] = sig2 * PPix(model->avevar,i,line);
+            spth[i] = sig2 * PPix(model->avevar,i,line);
         }
-        free(crmask[n]) ;
-    }
-    free (crmask);
-}
-
-/* ------------------------------------------------------------------*/
-/*                          printBitLine                             */
-/* ------------------------------------------------------------------*/
-
-
-static void printBitLine (Byte ***crmask, int img, int line, int nx){
-
-    int     x,i;
-    Byte    bit;
-    int     pix;
-
-    /* Print out values in crbuff to STDOUT using 'X' and '.' */
-
-    for (x = 0; x < (nx/SIZE_BYTE); x++) {
-        /* Set each bit in compressed buffer */
-        for (bit = 0x80,i=0; bit > 0; bit=(bit>>1),i++) {
-            if ( (crmask[img][line][x] & bit) > 0) { 
-                pix = x * SIZE_BYTE + i;
-                trlmessage("Compressed hit at %d,%d", pix, line);
-            } /*	printf("X");
-            else
-                printf("."); 
-            */
-        }		
-    }
-    /*printf("\n"); */
-
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          readBitLine                              */
-/* ------------------------------------------------------------------*/
-
-
-static void readBitLine (Byte ***crmask, int img, int line, int numbits, short
-crflag, short nocr, short *bufdq) {
-
-    int     x;
-    Byte    bit;
-    /* int pix, i; */
-    int     buffx=0;
-
-    /* Print out values in mask to line-by-line short int buffer */
-    for (x = 0; x < (numbits/SIZE_BYTE); x++) {
-        /* Decompress buffer here */
-        for (bit = 0x80; bit > 0; bit=(bit>>1)) {
-            /* pix = x * SIZE_BYTE + i; */
-
-            if ( (crmask[img][line][x] & bit) != 0 ) {
-                /*
-                ** printf("Compressed hit at %d,%d  with bit = %x ",pix,line,bit);
-                ** printf(" and mask = %x\n",crmask[img][line][x]);
-                */
-                bufdq[buffx] = bufdq[buffx] | crflag;					
-            } else
-                bufdq[buffx] = bufdq[buffx] & nocr;
-
-            buffx++;
-        }		
-    }
-
-}
-
-/* ------------------------------------------------------------------*/
-/*                          writeBitLine                             */
-/* ------------------------------------------------------------------*/
-
-
-static void writeBitLine (short *bufdq, int img, int line, int numbits, short
-crflag, Byte ***crmask) 
-{
-    int x;					/* Loop counters */
-    int buffx;
-
-    /* Set values in mask based on bufdq  */
-    /* Each CRHIT was set using : bufdq[i] | crflag */
-    for (x = 0; x < numbits; x++) {
-        /* Set each bit in compressed buffer */
-        if ( ( (bufdq[x]) & crflag) == crflag)  {
-            buffx=x/SIZE_BYTE;				
-            crmask[img][line][buffx] |=  (0x80 >> ((x)%(SIZE_BYTE)));
-        } 
-    }
-}
-
-/* ------------------------------------------------------------------*/
-/*                          scrollFloatBuff                          */
-/* ------------------------------------------------------------------*/
-
-
-/* This function will scroll a subsection up a 2-d array */
-static void scrollFloatBuff (float *sect, int line, int nlines, int bufflines, int numpix, float **subsect, float *zero) {
-/* Parameters:
-**	float *sect         i: line from input image (2-d array)
-**	int line            i: line number from image to add to sub-section
-**	int nlines          i: number of lines in original image
-**	int bufflines       i: number of lines in subsection
-**	int numpix          i: number of pixels per line
-**	float **subsect     o: scrolled subsection
-*/
-
-    int i;	
-    float *begptr; /* Use for first line in buffer */
-
-    /* If there is only one line in the buffer, simply copy it out */
-    if (bufflines == 1) {
-        memcpy (subsect[0], sect, numpix * sizeof(float));
-        return;
-    }
-    
-    begptr = *subsect; /* Save first line in buffer */
-        
-    /* Shift lines in the buffer up, 
-    **	moving subsect[1] into subssect[0], and so on..
-    **
-    ** NOTE: This could probably be optimized to use pointers
-    **		more directly to get faster code.
-    */ 
-    for (i=0; i < bufflines-1; i++){
-        *(subsect+i) = *(subsect+i+1); 
-    }
-    
-    /* Now, put pointer from first line back as last line
-    **  This recycles the pointer; the data will be overwritten.
-    */
-    *(subsect + bufflines -1) = begptr;
-
-    /* Finally, copy in new data into last line of buffer.
-    **	If the line we want to write to buffer is valid,...
-    */
-    if (line < nlines && bufflines > 1) { 
-        /* Copy new line into last line of buffer. */
-        memcpy (subsect[bufflines-1], sect, numpix * sizeof(float));	 
     } else {
-        /* Otherwise, set buffer values to default values */
-        memcpy (subsect[bufflines-1], zero, numpix * sizeof(float));
+        rejAmpNoise (model, line, gn, nse);
+        for (a = 0; a < 2; a++) {
+            first = (a == 0) ? 0 : rejAmpSplit (model);
+            last = (a == 0) ? rejAmpSplit (model) : stack->nx;
+# ifdef _OPENMP
+            #pragma omp simd
+# endif
+            for (i = first; i < last; i++) {
+                float dum = ave[i]*efacn/model->shadcorr[i] + skyvaln;
+                float val = (dum > 0.) ? dum : 0.;
+                float pixsky = (dum-skyvaln > 0.) ? dum-skyvaln : 0.;
+                th[i] = sig2 * ((nse[a] + val/gn[a] + SQ(scale * pixsky))) /
+                        exp2n;
+                spth[i] = sig2 * ((nse[a] + val/gn[a])) / exp2n;
+            }
+        }
     }
 
+    /* A spill from a previous line compares against spthresh as it was
+       in the scrolling buffer, i.e. the normalized pixel value, or the
+       raw one for the lines loaded by InitFloatSect. */
+    memcpy (fwd, (line <= model->width) ? sci : pic,
+            stack->nx * sizeof(float));
 }
 
-/* ------------------------------------------------------------------*/
-/*                          scrollShortBuff                          */
-/* ------------------------------------------------------------------*/
-
-
-/* This function will scroll a subsection up a 2-d array */
-static void scrollShortBuff (short *ssect, int line, int nlines, int bufflines, int numpix, short **subssect, short *szero) {
-/* Parameters:
-**	short *ssect         i: line from input DQ image (2-d short array)
-**	int line            i: line number from sect to add to sub-section
-**	int nlines          i: number of lines in original section
-**	int bufflines       i: number of lines in subsection
-**	int numpix          i: number of pixels per line
-**	short **ssubsect     o: scrolled subsection
-*/
-
-    int i;	
-    short *begsptr; /* Use for first line in buffer */
-
-    /* If there is only one line in the buffer, simply copy it out */
-    if (bufflines == 1) {
-        memcpy (subssect[0], ssect, numpix * sizeof(short));
-        return;
-    }
-    
-    begsptr = *subssect; /* Save first line in buffer */
-    
-    /* Shift lines in the buffer up, 
-    **	moving subsect[1] into subssect[0], and so on..
-    **
-    ** NOTE: This could probably be optimized to use pointers
-    **		more directly to get faster code.
-    */ 
-    for (i=0; i < bufflines-1; i++){
-        subssect[i] = subssect[i+1]; 
+static void rejAddVariance (const void *data, int img, int line,
+                            const float *pic, const char *use,
+                            float *sumvar) {
+
+    const RejNoise *model = data;
+    float efacn = model->efac[img];
+    float skyvaln = model->skyval[img];
+    float gn[2], nse[2];
+    float dum, val;
+    int a, i, first, last;
+
+    rejAmpNoise (model, line, gn, nse);
+    for (a = 0; a < 2; a++) {
+        first = (a == 0) ? 0 : rejAmpSplit (model);
+        last = (a == 0) ? rejAmpSplit (model) : model->stack->nx;
+        for (i = first; i < last; i++) {
+            if (use[i]) {
+                dum = pic[i]*efacn + skyvaln;
+                val = (dum > 0.) ? dum : 0.;
+                sumvar[i] += nse[a] + val/gn[a];
+            }
+        }
     }
+}
 
-    /* Now, put pointer from first line back as last line */
-    *(subssect + bufflines - 1) = begsptr;
-
-    /* Finally, copy in new data into last line of buffer.
-    **	If the line we want to read in is valid,...
-    */
-    if (line < nlines && bufflines > 1) {
-        /* Copy new line into last line of buffer. */
-        memcpy (subssect[bufflines-1], ssect, numpix * sizeof(short));
-    } else {
-        /* Otherwise, set buffer values to default values */
-        memcpy (subssect[bufflines-1], szero, numpix * sizeof(short));
-    }
+static float rejVariance (const void *data, float sumvar, float pixexp) {
 
+    (void) data;
+    return (sqrt(sumvar)/pixexp);
 }
 
 /* ------------------------------------------------------------------*/
@@ -1178,70 +1101,6 @@ static int initShad (Hdr *scihdr, int dimx, char *shadname, int chipext,
     return (status);
 }
 
-/* ------------------------------------------------------------------*/
-/*                          getShadLine                              */
-/* ------------------------------------------------------------------*/
-
-
-static void getShadLine (float **shad, int line, int nlines, int dimx,
-			 float *shadline) {
-
-/* Parameters:
-	shad                i: shadfile buffer
-	line                i: line number from input image we are working with
-	nlines              i: number of lines in shadfile buffer
-	dimx                i: size of shad buffer
-	shadline            o: line of shadfile data to be applied to image
-*/	
-    int offset;
-
-    offset = line % nlines;
-
-    /* Copy appropriate line from buffer into shadline */
-    memcpy (shadline, shad[offset], dimx * sizeof(float));
-	
-}
-
-/* ------------------------------------------------------------------*/
-/*                          getShadcorr                              */
-/* ------------------------------------------------------------------*/
-
-
-static void getShadcorr (float **shad, int line, int nlines, int dimx,
-			 float efacn, int shadf_x, float *shadline) {
-
-/* Parameters:
-    shad                i: shadfile buffer
-    line                i: line number from input image we are working with
-    nlines              i: number of lines in shadfile buffer
-    efacn               i: fraction of exposure time for image
-    dimx                i: size of shad buffer
-    shadf_x             i: number of pixels in input shadfile line
-                         [This will be ZERO if no shading correction is applied]
-    shadline            o: line of shadfile data to be applied to image
-*/	
-    int offset;
-
-    int         multkline (float *, float, int);
-    int         addkline (float *, float, int);
-
-    offset = line % nlines;
-
-    /* Copy appropriate line from buffer into shadline */
-    memcpy (shadline, shad[offset], dimx * sizeof(float));
-    
-    /* Only when doing shading correction, perform this expensive
-        math operation. 
-    */
-    if (shadf_x > 0)  multkline (shadline, 1./efacn, dimx);
-    
-    /* Always make sure that shadline is either 1 or 1+1/efacn,
-        to avoid divide by zero errors.
-    */
-    addkline (shadline, 1., dimx);
-	
-}
-
 /* ------------------------------------------------------------------*/
 /*                          getShadBuff                              */
 /* ------------------------------------------------------------------*/
@@ -1379,67 +1238,3 @@ void unbinArray (float **a, int inx, int iny, int binx, int biny, float **b){
 }
 
 
-/* ------------------------------------------------------------------*/
-/*                          InitFloatSect                            */
-/* ------------------------------------------------------------------*/
-
-/* 
-    This routine performs all the initial bookkeeping for the scrolling
-    data buffers. 
-        - Initializes the scrolling buffer by populating it with the first
-            lines of data from the image.
-*/
-static void InitFloatSect (float **sect, float *buf, IODescPtr *ipdat, int line, int width, int dimx){
-/* Parameters:
-float     **sect  i/o: scrolling buffer
-float     *buf    i: single line of scratch space
-IODescPtr *ipdat  i: file handle for working image (image being processed)
-int       line    i: number of current line from working image
-int       width   i: number of lines in buffer on either side of current line
-int       dimx    i: number of pixels in each line
-*/	
-    int     l;
-        
-    /* Fill initial buffer with first lines of image */
-    for (l = 0; l <= width; l++){
-        getFloatLine (ipdat, line+l, buf);
-        /* Copy new line into last line of buffer. */
-        memcpy (sect[width+l], buf, dimx * sizeof(float));	 
-    }
-}
-
-
-/* ------------------------------------------------------------------*/
-/*                          InitShortSect                            */
-/* ------------------------------------------------------------------*/
-
-/* 
-    This routine performs all the initial bookkeeping for the scrolling
-    data buffers. 
-        - Initializes the scrolling buffer by populating it with the first
-            lines of data from the image.
-*/
-static void InitShortSect (short **sect, short *sbuf, IODescPtr *ipdat,
-			   int line, int width, int dimx) {
-/* Parameters:
-short       **sect   i/o: scrolling buffer
-short       *sbuf    i: single line of scratch space
-IODescPtr   *ipdat   i: file handle for working image (image being processed)
-int         line     i: number of current line from working image
-int         width    i: number of lines in buffer on either side of current line
-int         dimx     i: number of pixels in each line
-*/	
-    int     l;
-    Hdr     dqhdr;
-
-    /* Fill initial buffer with first lines of image */
-    initHdr(&dqhdr);
-    getHeader(ipdat,&dqhdr);
-    for (l = 0; l <= width; l++){
-        getShortLine (ipdat, line+l, sbuf);
-        /* Copy new line into last line of buffer. */
-        memcpy (sect[width+l], sbuf, dimx * sizeof(short));	 
-    }
-    freeHdr(&dqhdr);
-
-}
@@ -8,6 +8,8 @@
 extern int status;
 
 #include "hstcal_memory.h"
+#include "hstcal_dqmask.h"
+#include "hstcal_flatfield.h"
 #include "hstcal.h"
 # include "c_iraf.h"		/* for c_irafinit */
 # include "ximio.h"
@@ -17,6 +19,7 @@ extern int status;
 # include "wf3info.h"
 # include "hstcalerr.h"
 # include "wf3corr.h"		/* calibration switch names for cs1 */
+# include "doccd.h"
 # include "wf3version.h"
 # include "hstcalversion.h"
 # include "trlbuf.h"
@@ -245,7 +248,9 @@ int main (int argc, char **argv) {
 	    }
 	}
 
-
+	clearDQICache ();
+	clearDQMaskCache ();
+	clearFlatFieldCache ();
 	freeOnExit(&ptrReg);
 
 	if (status)
@@ -8,6 +8,7 @@
 extern int status;
 
 #include "hstcal_memory.h"
+#include "hstcal_dqmask.h"
 #include "hstcal.h"
 # include "c_iraf.h"		/* for c_irafinit */
 # include "ximio.h"
@@ -17,6 +18,7 @@ extern int status;
 # include "wf3info.h"
 # include "hstcalerr.h"
 # include "wf3corr.h"		/* calibration switch names for wf3ccd */
+# include "doccd.h"
 # include "wf3version.h"
 # include "hstcalversion.h"
 # include "trlbuf.h"
@@ -250,6 +252,9 @@ int main (int argc, char **argv) {
 	    }
 	}
 
+    clearSinkCatalogs ();
+    clearDQICache ();
+    clearDQMaskCache ();
     freeOnExit(&ptrReg);
 
 	if (status)
@@ -8,6 +8,7 @@
 extern int status;
 
 #include "hstcal_memory.h"
+#include "hstcal_dqmask.h"
 #include "hstcal.h"
 # include "c_iraf.h"		/* for c_irafinit */
 # include "ximio.h"
@@ -17,6 +18,7 @@ extern int status;
 # include "wf3info.h"
 # include "hstcalerr.h"
 # include "wf3corr.h"        /* calibration switch names for wf3ir */
+# include "doccd.h"
 # include "wf3version.h"
 # include "hstcalversion.h"
 # include "trlbuf.h"
@@ -240,6 +242,8 @@ int main (int argc, char **argv) {
 	    }
 	}
 
+	clearDQICache ();
+	clearDQMaskCache ();
     freeOnExit(&ptrReg);
 
 	if (status)